@@ -178,6 +178,9 @@ StringMap<Graphics::StatType, Graphics::STAT_MAX_ENUM>::Entry Graphics::statType
 {
 	{ "drawcalls", STAT_DRAW_CALLS },
 	{ "canvasswitches", STAT_CANVAS_SWITCHES },
+	{ "shaderswitches", STAT_SHADER_SWITCHES },
+	{ "textureswitches", STAT_TEXTURE_SWITCHES },
+	{ "blendmodeswitches", STAT_BLEND_MODE_SWITCHES },
 	{ "canvases", STAT_CANVASES },
 	{ "images", STAT_IMAGES },
 	{ "fonts", STAT_FONTS },
@@ -106,6 +106,9 @@ public:
 	{
 		STAT_DRAW_CALLS,
 		STAT_CANVAS_SWITCHES,
+		STAT_SHADER_SWITCHES,
+		STAT_TEXTURE_SWITCHES,
+		STAT_BLEND_MODE_SWITCHES,
 		STAT_CANVASES,
 		STAT_IMAGES,
 		STAT_FONTS,
@@ -125,6 +128,9 @@ public:
 	{
 		int drawCalls;
 		int canvasSwitches;
+		int shaderSwitches;
+		int textureSwitches;
+		int blendModeSwitches;
 		int canvases;
 		int images;
 		int fonts;
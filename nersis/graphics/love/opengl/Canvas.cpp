@@ -21,6 +21,8 @@
 #include "Canvas.h"
 #include "Image.h"
 #include "Graphics.h"
+#include "PrimitiveBatch.h"
+#include "RenderQueue.h"
 #include "common/Matrix.h"
 
 #include <cstring> // For memcpy
@@ -300,8 +302,16 @@ void Canvas::unloadVolatile()
 
 void Canvas::drawv(const Matrix &t, const Vertex *v)
 {
+	if (RenderQueue::isRecordingCurrent())
+	{
+		RenderQueue::current->addQuads(this, texture, t, v, 1);
+		return;
+	}
+
 	OpenGL::TempDebugGroup debuggroup("Canvas draw");
 
+	PrimitiveBatch::flushCurrent();
+
 	OpenGL::TempTransform transform(gl);
 	transform.get() *= t;
 
@@ -379,6 +389,8 @@ void Canvas::setupGrab()
 	if (current == this)
 		return;
 
+	PrimitiveBatch::flushCurrent();
+
 	// cleanup after previous Canvas
 	if (current != nullptr)
 	{
@@ -513,6 +525,8 @@ void Canvas::stopGrab(bool switchingToOtherCanvas)
 
 	OpenGL::TempDebugGroup debuggroup("Canvas un-set");
 
+	PrimitiveBatch::flushCurrent();
+
 	// Make sure the canvas texture is up to date if we're using MSAA.
 	resolveMSAA(false);
 
@@ -19,6 +19,9 @@
  **/
 #include "common/config.h"
 #include "Font.h"
+#include "PrimitiveBatch.h"
+#include "RenderQueue.h"
+#include "GlyphLoader.h"
 #include "font/GlyphData.h"
 
 #include "libraries/utf8/utf8.h"
@@ -30,6 +33,8 @@
 #include <sstream>
 #include <algorithm> // for max
 #include <limits>
+#include <functional>
+#include <iterator>
 
 namespace love
 {
@@ -46,8 +51,12 @@ Font::Font(love::font::Rasterizer *r, const Texture::Filter &filter)
 	, lineHeight(1)
 	, textureWidth(128)
 	, textureHeight(128)
+	, pageLimit(DEFAULT_PAGE_LIMIT)
 	, filter(filter)
 	, useSpacesAsTab(false)
+	, asyncLoading(false)
+	, layoutCacheLimit(DEFAULT_LAYOUT_CACHE_LIMIT)
+	, layoutCacheSize(0)
 	, quadIndices(20) // We make this bigger at draw-time, if needed.
 	, textureCacheID(0)
 	, textureMemorySize(0)
@@ -61,7 +70,7 @@ Font::Font(love::font::Rasterizer *r, const Texture::Filter &filter)
 		if ((height * 0.8) * height * 30 <= textureWidth * textureHeight)
 			break;
 
-		TextureSize nextsize = getNextTextureSize();
+		TextureSize nextsize = getNextTextureSize({textureWidth, textureHeight});
 
 		if (nextsize.width <= textureWidth && nextsize.height <= textureHeight)
 			break;
@@ -77,6 +86,11 @@ Font::Font(love::font::Rasterizer *r, const Texture::Filter &filter)
 	if (!r->hasGlyph(9)) // No tab character in the Rasterizer.
 		useSpacesAsTab = true;
 
+	placeholderGlyph.texture = 0;
+	placeholderGlyph.page = -1;
+	placeholderGlyph.spacing = r->getAdvance();
+	memset(placeholderGlyph.vertices, 0, sizeof(GlyphVertex) * 4);
+
 	loadVolatile();
 
 	++fontCount;
@@ -84,15 +98,16 @@ Font::Font(love::font::Rasterizer *r, const Texture::Filter &filter)
 
 Font::~Font()
 {
+	if (GlyphLoader::current != nullptr)
+		GlyphLoader::current->cancel(this);
+
 	unloadVolatile();
 
 	--fontCount;
 }
 
-Font::TextureSize Font::getNextTextureSize() const
+Font::TextureSize Font::getNextTextureSize(TextureSize size) const
 {
-	TextureSize size = {textureWidth, textureHeight};
-
 	int maxsize = std::min(4096, gl.getMaxTextureSize());
 
 	if (size.width * 2 <= maxsize || size.height * 2 <= maxsize)
@@ -114,32 +129,14 @@ void Font::createTexture()
 	GLenum format = type == FONT_TRUETYPE ? GL_LUMINANCE_ALPHA : GL_RGBA;
 	size_t bpp = format == GL_LUMINANCE_ALPHA ? 2 : 4;
 
-	size_t prevmemsize = textureMemorySize;
-	if (prevmemsize > 0)
-	{
-		textureMemorySize -= (textureWidth * textureHeight * bpp);
-		gl.updateTextureMemorySize(prevmemsize, textureMemorySize);
-	}
-
-	GLuint t = 0;
-	TextureSize size = {textureWidth, textureHeight};
-	TextureSize nextsize = getNextTextureSize();
-	bool recreatetexture = false;
-
-	// If we have an existing texture already, we'll try replacing it with a
-	// larger-sized one rather than creating a second one. Having a single
-	// texture reduces texture switches and draw calls when rendering.
-	if ((nextsize.width > size.width || nextsize.height > size.height)
-		&& !textures.empty())
-	{
-		recreatetexture = true;
-		size = nextsize;
-		t = textures.back();
-	}
-	else
-		glGenTextures(1, &t);
+	TexturePage page;
+	page.texture = 0;
+	page.width = textureWidth;
+	page.height = textureHeight;
+	page.lastUsedFrame = gl.stats.frames;
 
-	gl.bindTexture(t);
+	glGenTextures(1, &page.texture);
+	gl.bindTexture(page.texture);
 
 	gl.setTextureFilter(filter);
 
@@ -152,52 +149,178 @@ void Font::createTexture()
 	if (GLAD_ES_VERSION_2_0 && !GLAD_ES_VERSION_3_0)
 		internalformat = format;
 
-	// Initialize the texture with transparent black.
-	std::vector<GLubyte> emptydata(size.width * size.height * bpp, 0);
-
 	// Clear errors before initializing.
 	while (glGetError() != GL_NO_ERROR);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, internalformat, size.width, size.height, 0,
-	             format, GL_UNSIGNED_BYTE, &emptydata[0]);
+	// The texture is left uninitialized: addGlyph uploads every glyph together
+	// with its transparent padding, which is all that's ever sampled. Filling
+	// a large page up-front would stall the frame that creates it.
+	glTexImage2D(GL_TEXTURE_2D, 0, internalformat, page.width, page.height, 0,
+	             format, GL_UNSIGNED_BYTE, nullptr);
 
 	if (glGetError() != GL_NO_ERROR)
 	{
-		if (!recreatetexture)
-			gl.deleteTexture(t);
+		gl.deleteTexture(page.texture);
 		throw love::Exception("Could not create font texture!");
 	}
 
-	textureWidth  = size.width;
-	textureHeight = size.height;
+	clearPage(page);
+	pages.push_back(page);
 
-	rowHeight = textureX = textureY = TEXTURE_PADDING;
-
-	prevmemsize = textureMemorySize;
-	textureMemorySize += emptydata.size();
+	size_t prevmemsize = textureMemorySize;
+	textureMemorySize += page.width * page.height * bpp;
 	gl.updateTextureMemorySize(prevmemsize, textureMemorySize);
 
-	// Re-add the old glyphs if we re-created the existing texture object.
-	if (recreatetexture)
+	// Existing pages are never resized (which would mean re-adding all of their
+	// glyphs.) Instead each new page is bigger than the last, so fonts with a
+	// lot of glyphs still only need a few textures.
+	TextureSize nextsize = getNextTextureSize(getNextTextureSize({textureWidth, textureHeight}));
+
+	textureWidth = nextsize.width;
+	textureHeight = nextsize.height;
+}
+
+void Font::clearPage(TexturePage &page)
+{
+	for (uint32 g : page.glyphs)
+		glyphs.erase(g);
+
+	page.glyphs.clear();
+
+	page.skyline.clear();
+	page.skyline.push_back({TEXTURE_PADDING, TEXTURE_PADDING, page.width - TEXTURE_PADDING});
+}
+
+bool Font::findPageSpace(const TexturePage &page, int w, int h, int &x, int &y) const
+{
+	const std::vector<SkylineNode> &skyline = page.skyline;
+
+	int besty = std::numeric_limits<int>::max();
+
+	// Bottom-left: pick the lowest position, and the leftmost one of those.
+	for (size_t i = 0; i < skyline.size(); i++)
 	{
-		textureCacheID++;
+		int nodex = skyline[i].x;
+
+		if (nodex + w > page.width)
+			break;
 
-		std::vector<uint32> glyphstoadd;
+		// The rectangle has to sit on top of every node it spans.
+		int nodey = 0;
+		for (size_t j = i; j < skyline.size() && skyline[j].x < nodex + w; j++)
+			nodey = std::max(nodey, skyline[j].y);
 
-		for (const auto &glyphpair : glyphs)
-			glyphstoadd.push_back(glyphpair.first);
+		if (nodey + h <= page.height && nodey < besty)
+		{
+			besty = nodey;
+			x = nodex;
+			y = nodey;
+		}
+	}
 
-		glyphs.clear();
+	return besty != std::numeric_limits<int>::max();
+}
 
-		for (uint32 g : glyphstoadd)
-			addGlyph(g);
+void Font::addPageSpace(TexturePage &page, int x, int y, int w, int h)
+{
+	std::vector<SkylineNode> &skyline = page.skyline;
+
+	size_t i = 0;
+	while (i < skyline.size() && skyline[i].x < x)
+		i++;
+
+	skyline.insert(skyline.begin() + i, {x, y + h, w});
+
+	// Shrink or remove the nodes which are now covered by the new one.
+	while (i + 1 < skyline.size())
+	{
+		SkylineNode &node = skyline[i + 1];
+		int covered = x + w - node.x;
+
+		if (covered <= 0)
+			break;
+
+		if (covered < node.width)
+		{
+			node.x += covered;
+			node.width -= covered;
+			break;
+		}
+
+		skyline.erase(skyline.begin() + i + 1);
 	}
-	else
-		textures.push_back(t);
+
+	// Merge neighbouring nodes at the same height.
+	for (size_t j = 0; j + 1 < skyline.size();)
+	{
+		if (skyline[j].y == skyline[j + 1].y)
+		{
+			skyline[j].width += skyline[j + 1].width;
+			skyline.erase(skyline.begin() + j + 1);
+		}
+		else
+			j++;
+	}
+}
+
+int Font::getGlyphPage(int w, int h, int &x, int &y)
+{
+	// Newer pages are the least likely to be full.
+	for (int i = (int) pages.size() - 1; i >= 0; i--)
+	{
+		if (findPageSpace(pages[i], w, h, x, y))
+			return i;
+	}
+
+	// Every page is full. Once the font has as many pages as it's allowed,
+	// the least recently used page is emptied and reused. Pages used in the
+	// current frame are skipped, otherwise code which restarts text layout
+	// when the texture cache is invalidated could do so forever.
+	if (pageLimit > 0 && (int) pages.size() >= pageLimit)
+	{
+		int lru = -1;
+
+		for (int i = 0; i < (int) pages.size(); i++)
+		{
+			if (pages[i].lastUsedFrame == gl.stats.frames)
+				continue;
+
+			if (lru < 0 || pages[i].lastUsedFrame < pages[lru].lastUsedFrame)
+				lru = i;
+		}
+
+		if (lru >= 0)
+		{
+			clearPage(pages[lru]);
+			textureCacheID++;
+
+			if (findPageSpace(pages[lru], w, h, x, y))
+				return lru;
+		}
+	}
+
+	while (w + TEXTURE_PADDING > textureWidth || h + TEXTURE_PADDING > textureHeight)
+	{
+		TextureSize nextsize = getNextTextureSize({textureWidth, textureHeight});
+
+		if (nextsize.width == textureWidth && nextsize.height == textureHeight)
+			throw love::Exception("Glyph is too large to fit in a font texture.");
+
+		textureWidth = nextsize.width;
+		textureHeight = nextsize.height;
+	}
+
+	createTexture();
+
+	findPageSpace(pages.back(), w, h, x, y);
+
+	return (int) pages.size() - 1;
 }
 
 love::font::GlyphData *Font::getRasterizerGlyphData(uint32 glyph)
 {
+	love::thread::Lock lock(rasterizerMutex);
+
 	// Use spaces for the tab 'glyph'.
 	if (glyph == 9 && useSpacesAsTab)
 	{
@@ -219,53 +342,68 @@ love::font::GlyphData *Font::getRasterizerGlyphData(uint32 glyph)
 
 const Font::Glyph &Font::addGlyph(uint32 glyph)
 {
-	love::font::GlyphData *gd = getRasterizerGlyphData(glyph);
+	return addGlyph(glyph, getRasterizerGlyphData(glyph));
+}
 
+const Font::Glyph &Font::addGlyph(uint32 glyph, love::font::GlyphData *gd)
+{
 	int w = gd->getWidth();
 	int h = gd->getHeight();
 
-	if (textureX + w + TEXTURE_PADDING > textureWidth)
-	{
-		// out of space - new row!
-		textureX = TEXTURE_PADDING;
-		textureY += rowHeight;
-		rowHeight = TEXTURE_PADDING;
-	}
-	if (textureY + h + TEXTURE_PADDING > textureHeight)
+	Glyph g;
+
+	g.texture = 0;
+	g.page = -1;
+	g.spacing = gd->getAdvance();
+
+	memset(g.vertices, 0, sizeof(GlyphVertex) * 4);
+
+	// don't waste space for empty glyphs. also fixes a divide by zero bug with ATI drivers
+	if (w > 0 && h > 0)
 	{
-		// totally out of space - new texture!
+		int x = 0;
+		int y = 0;
+
 		try
 		{
-			createTexture();
+			g.page = getGlyphPage(w + TEXTURE_PADDING, h + TEXTURE_PADDING, x, y);
 		}
 		catch (love::Exception &)
 		{
 			gd->release();
 			throw;
 		}
-	}
 
-	Glyph g;
+		TexturePage &page = pages[g.page];
 
-	g.texture = 0;
-	g.spacing = gd->getAdvance();
+		addPageSpace(page, x, y, w + TEXTURE_PADDING, h + TEXTURE_PADDING);
+		page.glyphs.push_back(glyph);
+		page.lastUsedFrame = gl.stats.frames;
 
-	memset(g.vertices, 0, sizeof(GlyphVertex) * 4);
+		// Upload the glyph surrounded by a border of transparent black, so
+		// the page's texture never has to be cleared.
+		size_t bpp = gd->getPixelSize();
+		int pw = w + TEXTURE_PADDING * 2;
+		int ph = h + TEXTURE_PADDING * 2;
 
-	// don't waste space for empty glyphs. also fixes a divide by zero bug with ATI drivers
-	if (w > 0 && h > 0)
-	{
-		const GLuint t = textures.back();
+		std::vector<GLubyte> padded(pw * ph * bpp, 0);
+		const GLubyte *src = (const GLubyte *) gd->getData();
+
+		for (int row = 0; row < h; row++)
+		{
+			GLubyte *dst = &padded[((row + TEXTURE_PADDING) * pw + TEXTURE_PADDING) * bpp];
+			memcpy(dst, src + row * w * bpp, w * bpp);
+		}
 
-		gl.bindTexture(t);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, textureX, textureY, w, h,
+		gl.bindTexture(page.texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x - TEXTURE_PADDING, y - TEXTURE_PADDING, pw, ph,
 		                (type == FONT_TRUETYPE ? GL_LUMINANCE_ALPHA : GL_RGBA),
-		                GL_UNSIGNED_BYTE, gd->getData());
+		                GL_UNSIGNED_BYTE, &padded[0]);
 
-		g.texture = t;
+		g.texture = page.texture;
 
-		float tX     = (float) textureX,     tY      = (float) textureY;
-		float tWidth = (float) textureWidth, tHeight = (float) textureHeight;
+		float tX     = (float) x,          tY      = (float) y;
+		float tWidth = (float) page.width, tHeight = (float) page.height;
 
 		// 0----2
 		// |  / |
@@ -287,12 +425,6 @@ const Font::Glyph &Font::addGlyph(uint32 glyph)
 		}
 	}
 
-	if (w > 0)
-		textureX += (w + TEXTURE_PADDING);
-
-	if (h > 0)
-		rowHeight = std::max(rowHeight, h + TEXTURE_PADDING);
-
 	gd->release();
 
 	const auto p = glyphs.insert(std::make_pair(glyph, g));
@@ -305,11 +437,50 @@ const Font::Glyph &Font::findGlyph(uint32 glyph)
 	const auto it = glyphs.find(glyph);
 
 	if (it != glyphs.end())
+	{
+		if (it->second.page >= 0)
+			pages[it->second.page].lastUsedFrame = gl.stats.frames;
+
 		return it->second;
+	}
+
+	if (asyncLoading && GlyphLoader::current != nullptr)
+		return requestGlyph(glyph);
 
 	return addGlyph(glyph);
 }
 
+const Font::Glyph &Font::requestGlyph(uint32 glyph)
+{
+	if (loadingGlyphs.insert(glyph).second)
+		GlyphLoader::current->request(this, glyph);
+
+	return placeholderGlyph;
+}
+
+void Font::addLoadedGlyph(uint32 glyph, love::font::GlyphData *gd)
+{
+	loadingGlyphs.erase(glyph);
+
+	// The glyph may have been added synchronously in the meantime.
+	if (glyphs.find(glyph) != glyphs.end())
+	{
+		if (gd != nullptr)
+			gd->release();
+		return;
+	}
+
+	// Rasterizing failed on the loader's thread. Trying again here reports
+	// the error.
+	if (gd == nullptr)
+		addGlyph(glyph);
+	else
+		addGlyph(glyph, gd);
+
+	// Text which was laid out with the placeholder needs to be regenerated.
+	textureCacheID++;
+}
+
 float Font::getHeight() const
 {
 	return (float) height;
@@ -516,11 +687,37 @@ std::vector<Font::DrawCommand> Font::generateVerticesFormatted(const std::string
 	return drawcommands;
 }
 
+void Font::touchPages(const std::vector<DrawCommand> &drawcommands)
+{
+	GLuint lasttexture = 0;
+
+	for (const DrawCommand &cmd : drawcommands)
+	{
+		if (cmd.texture == lasttexture)
+			continue;
+
+		lasttexture = cmd.texture;
+
+		for (TexturePage &page : pages)
+		{
+			if (page.texture == cmd.texture)
+			{
+				page.lastUsedFrame = gl.stats.frames;
+				break;
+			}
+		}
+	}
+}
+
 void Font::drawVertices(const std::vector<DrawCommand> &drawcommands)
 {
 	// Vertex attribute pointers need to be set before calling this function.
 	// This assumes that the attribute pointers are constant for all vertices.
 
+	// Used by both Font::print and Text::draw, so cached layouts keep their
+	// pages from being reused while they're drawn every frame.
+	touchPages(drawcommands);
+
 	int totalverts = 0;
 	for (const DrawCommand &cmd : drawcommands)
 		totalverts = std::max(cmd.startvertex + cmd.vertexcount, totalverts);
@@ -553,8 +750,35 @@ void Font::printv(const Matrix &t, const std::vector<DrawCommand> &drawcommands,
 	if (vertices.empty() || drawcommands.empty())
 		return;
 
+	// Glyph quads go into the queue's merged quad draws, so labels which use
+	// the same texture page share draw calls.
+	if (RenderQueue::isRecordingCurrent())
+	{
+		touchPages(drawcommands);
+
+		for (const DrawCommand &cmd : drawcommands)
+		{
+			queueVertices.resize(cmd.vertexcount);
+
+			for (int i = 0; i < cmd.vertexcount; i++)
+			{
+				const GlyphVertex &g = vertices[cmd.startvertex + i];
+				queueVertices[i].x = g.x;
+				queueVertices[i].y = g.y;
+				queueVertices[i].s = g.s;
+				queueVertices[i].t = g.t;
+			}
+
+			RenderQueue::current->addQuads(this, cmd.texture, t, &queueVertices[0], cmd.vertexcount / 4);
+		}
+
+		return;
+	}
+
 	OpenGL::TempDebugGroup debuggroup("Font print");
 
+	PrimitiveBatch::flushCurrent();
+
 	OpenGL::TempTransform transform(gl);
 	transform.get() *= t;
 
@@ -581,24 +805,139 @@ void Font::printv(const Matrix &t, const std::vector<DrawCommand> &drawcommands,
 
 void Font::print(const std::string &text, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky)
 {
-	std::vector<GlyphVertex> vertices;
-	std::vector<DrawCommand> drawcommands = generateVertices(text, vertices);
+	const Layout &layout = getLayout(text, -1.0f, ALIGN_MAX_ENUM);
 
 	Matrix t;
 	t.setTransformation(ceilf(x), ceilf(y), angle, sx, sy, ox, oy, kx, ky);
 
-	printv(t, drawcommands, vertices);
+	printv(t, layout.drawcommands, layout.vertices);
 }
 
 void Font::printf(const std::string &text, float x, float y, float wrap, AlignMode align, float angle, float sx, float sy, float ox, float oy, float kx, float ky)
 {
-	std::vector<GlyphVertex> vertices;
-	std::vector<DrawCommand> drawcommands = generateVerticesFormatted(text, wrap, align, vertices);
+	const Layout &layout = getLayout(text, wrap, align);
 
 	Matrix t;
 	t.setTransformation(ceilf(x), ceilf(y), angle, sx, sy, ox, oy, kx, ky);
 
-	printv(t, drawcommands, vertices);
+	printv(t, layout.drawcommands, layout.vertices);
+}
+
+const Font::Layout &Font::getLayout(const std::string &text, float wrap, AlignMode align)
+{
+	if (layoutCacheLimit == 0)
+	{
+		generateLayout(uncachedLayout, text, wrap, align);
+		return uncachedLayout;
+	}
+
+	size_t hash = std::hash<std::string>()(text);
+	hash ^= std::hash<float>()(wrap) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	hash ^= std::hash<int>()((int) align) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+	auto indexit = layoutCacheIndex.find(hash);
+
+	if (indexit != layoutCacheIndex.end())
+	{
+		auto it = indexit->second;
+
+		if (it->wrap == wrap && it->align == align && it->text == text)
+		{
+			layoutCache.splice(layoutCache.begin(), layoutCache, it);
+
+			// The glyphs' texture coordinates may have changed since.
+			if (it->textureCacheID != textureCacheID)
+			{
+				layoutCacheSize -= it->memorySize;
+
+				try
+				{
+					generateLayout(*it, text, wrap, align);
+				}
+				catch (love::Exception &)
+				{
+					layoutCacheIndex.erase(indexit);
+					layoutCache.erase(it);
+					throw;
+				}
+
+				layoutCacheSize += it->memorySize;
+			}
+
+			return *it;
+		}
+
+		// A different string with the same hash.
+		removeLayout(it);
+	}
+
+	// Reuse the least recently used layout's memory once the cache is full.
+	if (layoutCacheSize >= layoutCacheLimit && !layoutCache.empty())
+	{
+		auto last = std::prev(layoutCache.end());
+		layoutCacheIndex.erase(last->hash);
+		layoutCacheSize -= last->memorySize;
+		layoutCache.splice(layoutCache.begin(), layoutCache, last);
+	}
+	else
+		layoutCache.emplace_front();
+
+	Layout &layout = layoutCache.front();
+
+	layout.hash = hash;
+	layout.text = text;
+
+	try
+	{
+		generateLayout(layout, text, wrap, align);
+	}
+	catch (love::Exception &)
+	{
+		layoutCache.pop_front();
+		throw;
+	}
+
+	layoutCacheIndex[hash] = layoutCache.begin();
+	layoutCacheSize += layout.memorySize;
+
+	// The layout which was just added is always kept, even if it's bigger
+	// than the limit by itself.
+	while (layoutCacheSize > layoutCacheLimit && layoutCache.size() > 1)
+		removeLayout(std::prev(layoutCache.end()));
+
+	return layout;
+}
+
+void Font::generateLayout(Layout &layout, const std::string &text, float wrap, AlignMode align)
+{
+	layout.wrap = wrap;
+	layout.align = align;
+	layout.vertices.clear();
+
+	if (align == ALIGN_MAX_ENUM)
+		layout.drawcommands = generateVertices(text, layout.vertices);
+	else
+		layout.drawcommands = generateVerticesFormatted(text, wrap, align, layout.vertices);
+
+	layout.textureCacheID = textureCacheID;
+
+	layout.memorySize = sizeof(Layout) + layout.text.capacity()
+		+ layout.vertices.capacity() * sizeof(GlyphVertex)
+		+ layout.drawcommands.capacity() * sizeof(DrawCommand);
+}
+
+void Font::removeLayout(std::list<Layout>::iterator it)
+{
+	layoutCacheIndex.erase(it->hash);
+	layoutCacheSize -= it->memorySize;
+	layoutCache.erase(it);
+}
+
+void Font::clearLayoutCache()
+{
+	layoutCache.clear();
+	layoutCacheIndex.clear();
+	layoutCacheSize = 0;
 }
 
 int Font::getWidth(const std::string &str)
@@ -707,6 +1046,7 @@ void Font::getWrap(const std::string &text, float wrap, std::vector<std::string>
 void Font::setLineHeight(float height)
 {
 	lineHeight = height;
+	clearLayoutCache();
 }
 
 float Font::getLineHeight() const
@@ -721,9 +1061,9 @@ void Font::setFilter(const Texture::Filter &f)
 
 	filter = f;
 
-	for (GLuint texture : textures)
+	for (const TexturePage &page : pages)
 	{
-		gl.bindTexture(texture);
+		gl.bindTexture(page.texture);
 		gl.setTextureFilter(filter);
 	}
 }
@@ -746,10 +1086,17 @@ void Font::unloadVolatile()
 
 	glyphs.clear();
 
-	for (GLuint texture : textures)
-		gl.deleteTexture(texture);
+	// The first page gets its original size back when the font is reloaded.
+	if (!pages.empty())
+	{
+		textureWidth = pages[0].width;
+		textureHeight = pages[0].height;
+	}
+
+	for (const TexturePage &page : pages)
+		gl.deleteTexture(page.texture);
 
-	textures.clear();
+	pages.clear();
 
 	gl.updateTextureMemorySize(textureMemorySize, 0);
 	textureMemorySize = 0;
@@ -773,11 +1120,13 @@ float Font::getBaseline() const
 
 bool Font::hasGlyph(uint32 glyph) const
 {
+	love::thread::Lock lock(rasterizerMutex);
 	return rasterizer->hasGlyph(glyph);
 }
 
 bool Font::hasGlyphs(const std::string &text) const
 {
+	love::thread::Lock lock(rasterizerMutex);
 	return rasterizer->hasGlyphs(text);
 }
 
@@ -786,6 +1135,65 @@ uint32 Font::getTextureCacheID() const
 	return textureCacheID;
 }
 
+void Font::prewarm(const std::string &text)
+{
+	try
+	{
+		utf8::iterator<std::string::const_iterator> i(text.begin(), text.begin(), text.end());
+		utf8::iterator<std::string::const_iterator> end(text.end(), text.begin(), text.end());
+
+		while (i != end)
+		{
+			uint32 g = *i++;
+
+			if (g != '\n')
+				findGlyph(g);
+		}
+	}
+	catch (utf8::exception &e)
+	{
+		throw love::Exception("UTF-8 decoding error: %s", e.what());
+	}
+}
+
+void Font::prewarm(uint32 glyph)
+{
+	findGlyph(glyph);
+}
+
+void Font::setGlyphPageLimit(int limit)
+{
+	pageLimit = std::max(limit, 0);
+}
+
+int Font::getGlyphPageLimit() const
+{
+	return pageLimit;
+}
+
+void Font::setAsyncLoading(bool enable)
+{
+	asyncLoading = enable;
+}
+
+bool Font::isAsyncLoading() const
+{
+	return asyncLoading;
+}
+
+void Font::setLayoutCacheLimit(size_t bytes)
+{
+	layoutCacheLimit = bytes;
+
+	while (layoutCacheSize > layoutCacheLimit && !layoutCache.empty())
+		removeLayout(std::prev(layoutCache.end()));
+}
+
+size_t Font::getLayoutCacheLimit() const
+{
+	return layoutCacheLimit;
+}
+
 bool Font::getConstant(const char *in, AlignMode &out)
 {
 	return alignModes.find(in, out);
@@ -23,16 +23,20 @@
 
 // STD
 #include <unordered_map>
+#include <unordered_set>
+#include <list>
 #include <string>
 #include <vector>
 
 // LOVE
 #include "common/config.h"
 #include "common/Object.h"
+#include "common/math.h"
 #include "common/Matrix.h"
 #include "common/Vector.h"
 
 #include "font/Rasterizer.h"
+#include "thread/threads.h"
 #include "graphics/Texture.h"
 #include "graphics/Volatile.h"
 #include "GLBuffer.h"
@@ -177,6 +181,43 @@ public:
 
 	uint32 getTextureCacheID() const;
 
+	/**
+	 * Rasterizes the glyphs in the string and adds them to the font's texture
+	 * pages ahead of time, so the first draw which uses them doesn't have to.
+	 * If async loading is enabled they are queued for the loader thread.
+	 *
+	 * @param text A UTF-8 string containing the glyphs to add.
+	 **/
+	void prewarm(const std::string &text);
+	void prewarm(uint32 glyph);
+
+	/**
+	 * Sets the number of texture pages the font keeps before it starts reusing
+	 * the least recently used page. Pages which were used in the current frame
+	 * are never reused, so this can be exceeded temporarily. 0 means no limit.
+	 **/
+	void setGlyphPageLimit(int limit);
+	int getGlyphPageLimit() const;
+
+	/**
+	 * Sets whether glyphs the font doesn't have yet are rasterized on a
+	 * background thread instead of while the text using them is drawn. Until
+	 * a glyph has been loaded it's laid out as an empty placeholder, and text
+	 * using it is regenerated once it's there (usually the next frame.)
+	 * Disabled by default, which gives the same result every frame.
+	 **/
+	void setAsyncLoading(bool enable);
+	bool isAsyncLoading() const;
+
+	/**
+	 * Sets how much memory (in bytes) the font may use to remember the
+	 * vertices of strings drawn with print and printf, so drawing the same
+	 * string again doesn't have to lay it out again. The least recently drawn
+	 * strings are dropped first. 0 disables the cache.
+	 **/
+	void setLayoutCacheLimit(size_t bytes);
+	size_t getLayoutCacheLimit() const;
+
 	static bool getConstant(const char *in, AlignMode &out);
 	static bool getConstant(AlignMode in, const char  *&out);
 
@@ -184,6 +225,8 @@ public:
 
 private:
 
+	friend class GlyphLoader;
+
 	enum FontType
 	{
 		FONT_TRUETYPE,
@@ -194,33 +237,84 @@ private:
 	struct Glyph
 	{
 		GLuint texture;
+		int page;
 		int spacing;
 		GlyphVertex vertices[4];
 	};
 
+	// The vertices generated for a string drawn with print or printf.
+	struct Layout
+	{
+		size_t hash;
+		std::string text;
+		float wrap;
+		AlignMode align; // ALIGN_MAX_ENUM if the text isn't formatted.
+		uint32 textureCacheID;
+		std::vector<GlyphVertex> vertices;
+		std::vector<DrawCommand> drawcommands;
+		size_t memorySize;
+	};
+
 	struct TextureSize
 	{
 		int width;
 		int height;
 	};
 
-	TextureSize getNextTextureSize() const;
+	// A segment of a page's skyline: the free space above it starts at y, for
+	// the pixel columns [x, x + width).
+	struct SkylineNode
+	{
+		int x, y;
+		int width;
+	};
+
+	// One texture of the glyph atlas. Glyphs are packed bottom-left along the
+	// page's skyline and never move until the whole page is reused.
+	struct TexturePage
+	{
+		GLuint texture;
+		int width;
+		int height;
+		std::vector<SkylineNode> skyline;
+		std::vector<uint32> glyphs;
+		uint32 lastUsedFrame;
+	};
+
+	TextureSize getNextTextureSize(TextureSize size) const;
 	void createTexture();
+	void clearPage(TexturePage &page);
+	bool findPageSpace(const TexturePage &page, int w, int h, int &x, int &y) const;
+	void addPageSpace(TexturePage &page, int x, int y, int w, int h);
+	int getGlyphPage(int w, int h, int &x, int &y);
 	love::font::GlyphData *getRasterizerGlyphData(uint32 glyph);
 	const Glyph &addGlyph(uint32 glyph);
+	const Glyph &addGlyph(uint32 glyph, love::font::GlyphData *gd);
+	const Glyph &requestGlyph(uint32 glyph);
+	void addLoadedGlyph(uint32 glyph, love::font::GlyphData *gd);
 	const Glyph &findGlyph(uint32 glyph);
+
+	// Marks the pages drawn from by the commands as used in the current
+	// frame. Layouts which are drawn again don't go through findGlyph.
+	void touchPages(const std::vector<DrawCommand> &drawcommands);
 	void printv(const Matrix &t, const std::vector<DrawCommand> &drawcommands, const std::vector<GlyphVertex> &vertices);
+	const Layout &getLayout(const std::string &text, float wrap, AlignMode align);
+	void generateLayout(Layout &layout, const std::string &text, float wrap, AlignMode align);
+	void removeLayout(std::list<Layout>::iterator it);
+	void clearLayoutCache();
 
 	StrongRef<love::font::Rasterizer> rasterizer;
 
 	int height;
 	float lineHeight;
 
+	// Size of the next texture page.
 	int textureWidth;
 	int textureHeight;
 
-	// vector of packed textures
-	std::vector<GLuint> textures;
+	// Texture pages of the glyph atlas, in the order they were created.
+	std::vector<TexturePage> pages;
+	int pageLimit;
 
 	// maps glyphs to glyph texture information
 	std::unordered_map<uint32, Glyph> glyphs;
@@ -228,14 +322,31 @@ private:
 	FontType type;
 	Texture::Filter filter;
 
-	int textureX, textureY;
-	int rowHeight;
-
 	bool useSpacesAsTab;
 
+	// Glyphs requested from the GlyphLoader which haven't been added yet.
+	bool asyncLoading;
+	std::unordered_set<uint32> loadingGlyphs;
+	Glyph placeholderGlyph;
+
+	// Most recently used layouts first.
+	std::list<Layout> layoutCache;
+	std::unordered_map<size_t, std::list<Layout>::iterator> layoutCacheIndex;
+	size_t layoutCacheLimit;
+	size_t layoutCacheSize;
+
+	// Used instead of the cache when it's disabled.
+	Layout uncachedLayout;
+
+	// The GlyphLoader's thread uses the rasterizer too.
+	mutable love::thread::MutexRef rasterizerMutex;
+
 	// Index buffer used for drawing quads with GL_TRIANGLES.
 	VertexIndex quadIndices;
 
+	// Layout vertices converted for the RenderQueue, reused between prints.
+	std::vector<Vertex> queueVertices;
+
 	// ID which is incremented when the texture cache is invalidated.
 	uint32 textureCacheID;
 
@@ -243,6 +354,10 @@ private:
 
 	static const int TEXTURE_PADDING = 1;
 
+	static const int DEFAULT_PAGE_LIMIT = 8;
+
+	static const size_t DEFAULT_LAYOUT_CACHE_LIMIT = 2 * 1024 * 1024;
+
 	// This will be used if the Rasterizer doesn't have a tab character itself.
 	static const int SPACES_PER_TAB = 4;
 
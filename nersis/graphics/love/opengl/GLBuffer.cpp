@@ -34,15 +34,26 @@ namespace graphics
 namespace opengl
 {
 
-GLBuffer::GLBuffer(size_t size, const void *data, GLenum target, GLenum usage)
+GLBuffer::GLBuffer(size_t size, const void *data, GLenum target, GLenum usage, uint32 mapflags)
 	: is_bound(false)
 	, is_mapped(false)
 	, size(size)
 	, target(target)
 	, usage(usage)
+	, map_flags(mapflags)
 	, vbo(0)
 	, memory_map(nullptr)
+	, modified_offset(0)
+	, modified_size(0)
+	, is_ring(false)
+	, ring_base(0)
+	, ring_head(0)
+	, ring_copy(0)
+	, ring_map(nullptr)
 {
+	for (int i = 0; i < RING_SIZE; i++)
+		ring_fences[i] = nullptr;
+
 	try
 	{
 		memory_map = new char[size];
@@ -96,11 +107,78 @@ void GLBuffer::unmapStream()
 	glBufferData(getTarget(), (GLsizeiptr) getSize(), memory_map, getUsage());
 }
 
+void GLBuffer::unmapRing(size_t offset, size_t size)
+{
+	if (size == 0)
+		return;
+
+	// The upload goes after the previous one, and the start of the buffer is
+	// moved so the used range lands there. It can't start before offset, or
+	// the start of the buffer would be before the start of the ring.
+	size_t start = std::max(ring_head, offset);
+
+	// Keep every upload inside one copy, so the fence placed when leaving a
+	// copy covers all draws using it.
+	if (start / getSize() != (start + size - 1) / getSize())
+		start = (start / getSize() + 1) * getSize();
+
+	if (start + size > getSize() * RING_SIZE)
+		start = offset;
+
+	int copy = (int) (start / getSize());
+
+	if (copy != ring_copy)
+		enterRingCopy(copy);
+
+	// The ring is coherent, so the copy is visible to the following commands
+	// without any other GL calls.
+	memcpy(ring_map + start, memory_map + offset, size);
+
+	ring_base = start - offset;
+	ring_head = (start + size + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+}
+
+void GLBuffer::enterRingCopy(int copy)
+{
+	// The commands issued so far are the last ones which can use the copy
+	// being left.
+	if (ring_fences[ring_copy] != nullptr)
+		glDeleteSync(ring_fences[ring_copy]);
+
+	ring_fences[ring_copy] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	ring_copy = copy;
+
+	// The copy being entered was left a whole ring ago. We only have to wait
+	// if the GPU is still that far behind.
+	GLsync &fence = ring_fences[copy];
+
+	if (fence != nullptr)
+	{
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+
+		while (glClientWaitSync(fence, flags, 1000000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
 void GLBuffer::unmap(size_t usedOffset, size_t usedSize)
 {
 	if (!is_mapped)
 		return;
 
+	if (modified_size > 0 && usedOffset == 0 && usedSize == (size_t) -1)
+	{
+		usedOffset = modified_offset;
+		usedSize = modified_size;
+	}
+
+	modified_offset = 0;
+	modified_size = 0;
+
 	usedOffset = std::min(usedOffset, getSize());
 	usedSize = std::min(usedSize, getSize() - usedOffset);
 
@@ -112,6 +190,13 @@ void GLBuffer::unmap(size_t usedOffset, size_t usedSize)
 		is_bound = true;
 	}
 
+	if (is_ring)
+	{
+		unmapRing(usedOffset, usedSize);
+		is_mapped = false;
+		return;
+	}
+
 	switch (getUsage())
 	{
 	case GL_STATIC_DRAW:
@@ -134,6 +219,24 @@ void GLBuffer::unmap(size_t usedOffset, size_t usedSize)
 	is_mapped = false;
 }
 
+void GLBuffer::setMappedRangeModified(size_t offset, size_t modifiedsize)
+{
+	if (!is_mapped || modifiedsize == 0)
+		return;
+
+	if (modified_size == 0)
+	{
+		modified_offset = offset;
+		modified_size = modifiedsize;
+	}
+	else
+	{
+		size_t end = std::max(modified_offset + modified_size, offset + modifiedsize);
+		modified_offset = std::min(modified_offset, offset);
+		modified_size = end - modified_offset;
+	}
+}
+
 void GLBuffer::bind()
 {
 	if (!is_mapped)
@@ -155,13 +258,23 @@ void GLBuffer::fill(size_t offset, size_t size, const void *data)
 {
 	memcpy(memory_map + offset, data, size);
 
-	if (!is_mapped)
+	if (is_mapped)
+		return;
+
+	if (is_ring)
+	{
+		// The GPU may still be reading the ring where the data is drawn
+		// from, so it's uploaded by the next unmap instead.
+		is_mapped = true;
+		setMappedRangeModified(offset, size);
+	}
+	else
 		glBufferSubData(getTarget(), (GLintptr) offset, (GLsizeiptr) size, data);
 }
 
 const void *GLBuffer::getPointer(size_t offset) const
 {
-	return BUFFER_OFFSET(offset);
+	return BUFFER_OFFSET(ring_base + offset);
 }
 
 bool GLBuffer::loadVolatile()
@@ -180,6 +293,17 @@ bool GLBuffer::load(bool restore)
 
 	GLBuffer::Bind bind(*this);
 
+	if (loadRing())
+	{
+		if (restore)
+		{
+			memcpy(ring_map, memory_map, getSize());
+			ring_head = getSize();
+		}
+
+		return true;
+	}
+
 	// Copy the old buffer only if 'restore' was requested.
 	const GLvoid *src = restore ? memory_map : nullptr;
 
@@ -189,9 +313,58 @@ bool GLBuffer::load(bool restore)
 	return true;
 }
 
+bool GLBuffer::loadRing()
+{
+	if (!(map_flags & MAP_STREAM))
+		return false;
+
+	if (!(GLAD_VERSION_4_4 || GLAD_ARB_buffer_storage) || !(GLAD_VERSION_3_2 || GLAD_ARB_sync) || getSize() == 0)
+		return false;
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr ringsize = (GLsizeiptr) (getSize() * RING_SIZE);
+
+	glBufferStorage(getTarget(), ringsize, nullptr, flags);
+	ring_map = (char *) glMapBufferRange(getTarget(), 0, ringsize, flags);
+
+	if (ring_map == nullptr)
+	{
+		// Immutable storage can't be respecified, so start over with a new
+		// buffer object.
+		glDeleteBuffers(1, &vbo);
+		glGenBuffers(1, &vbo);
+		glBindBuffer(getTarget(), vbo);
+		return false;
+	}
+
+	is_ring = true;
+	ring_base = 0;
+	ring_head = 0;
+	ring_copy = 0;
+
+	return true;
+}
+
 void GLBuffer::unload()
 {
 	is_mapped = false;
+	modified_offset = 0;
+	modified_size = 0;
+
+	for (int i = 0; i < RING_SIZE; i++)
+	{
+		if (ring_fences[i] != nullptr)
+			glDeleteSync(ring_fences[i]);
+
+		ring_fences[i] = nullptr;
+	}
+
+	// Deleting the buffer also unmaps the ring.
+	is_ring = false;
+	ring_base = 0;
+	ring_head = 0;
+	ring_copy = 0;
+	ring_map = nullptr;
 
 	glDeleteBuffers(1, &vbo);
 	vbo = 0;
@@ -24,6 +24,7 @@
 
 // LOVE
 #include "common/config.h"
+#include "common/int.h"
 #include "graphics/Volatile.h"
 
 // OpenGL
@@ -47,15 +48,24 @@ class GLBuffer : public Volatile
 {
 public:
 
+	enum MapFlags
+	{
+		// Every unmap replaces the contents which are drawn from, so only the
+		// used range has to be uploaded and the rest of the buffer is never
+		// drawn from again. Lets uploads go through a persistently mapped ring
+		// (see isStreamed.)
+		MAP_STREAM = 0x01
+	};
+
 	/**
 	 * Constructor.
 	 *
 	 * @param size The size of the GLBuffer in bytes.
 	 * @param target The target GLBuffer object, e.g. GL_ARRAY_BUFFER.
 	 * @param usage Usage hint, e.g. GL_DYNAMIC_DRAW.
-	 * @param backing Determines what guarantees are placed on the data.
+	 * @param mapflags A combination of MapFlags.
 	 */
-	GLBuffer(size_t size, const void *data, GLenum target, GLenum usage);
+	GLBuffer(size_t size, const void *data, GLenum target, GLenum usage, uint32 mapflags = 0);
 
 	/**
 	 * Destructor.
@@ -102,6 +112,22 @@ public:
 		return is_mapped;
 	}
 
+	/**
+	 * Whether unmap copies the used range to unused memory in a persistently
+	 * mapped ring. Draws can then only use the range passed to the last
+	 * unmap, so a buffer whose draws use more than what changed has to pass
+	 * the whole range it draws.
+	 */
+	bool isStreamed() const
+	{
+		return is_ring;
+	}
+
+	uint32 getMapFlags() const
+	{
+		return map_flags;
+	}
+
 	/**
 	 * Map the GLBuffer to client memory.
 	 *
@@ -123,9 +149,22 @@ public:
 	 * @param usedOffset The offset into the mapped buffer indicating the
 	 *                   sub-range of data modified. Optional.
 	 * @param usedSize   The size of the sub-range of modified data. Optional.
+	 *                   Without it, the range marked with
+	 *                   setMappedRangeModified is used, or the whole buffer
+	 *                   if no range was marked.
 	 */
 	void unmap(size_t usedOffset = 0, size_t usedSize = -1);
 
+	/**
+	 * Marks a range of the mapped buffer as modified, so unmap only has to
+	 * upload the modified data. Ranges marked during one map are merged into
+	 * the smallest range containing all of them.
+	 *
+	 * @param offset The offset of the modified data, in bytes.
+	 * @param size The size of the modified data, in bytes.
+	 */
+	void setMappedRangeModified(size_t offset, size_t size);
+
 	/**
 	 * Bind the GLBuffer to its specified target.
 	 * (GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, etc).
@@ -239,8 +278,31 @@ private:
 	bool load(bool restore);
 	void unload();
 
+	/**
+	 * Creates persistently mapped storage for RING_SIZE times the buffer's
+	 * size, if the buffer uses MAP_STREAM and the system supports it.
+	 *
+	 * @return True if the ring is used, false to use regular storage.
+	 */
+	bool loadRing();
+
 	void unmapStatic(size_t offset, size_t size);
 	void unmapStream();
+	void unmapRing(size_t offset, size_t size);
+
+	/**
+	 * Fences the commands which can use the copy of the ring being left, and
+	 * waits until the GPU is done with the one being entered.
+	 */
+	void enterRingCopy(int copy);
+
+	// The ring is split into copies the size of the buffer. Uploads go one
+	// after another through a copy, and are fenced once when they move on to
+	// the next one, so the CPU only waits if the GPU is a whole ring behind.
+	static const int RING_SIZE = 3;
+
+	// Uploads to the ring start at multiples of this.
+	static const size_t RING_ALIGNMENT = 16;
 
 	// Whether the buffer is currently bound.
 	bool is_bound;
@@ -257,12 +319,38 @@ private:
 	// Usage hint. GL_[DYNAMIC, STATIC, STREAM]_DRAW.
 	GLenum usage;
 
+	uint32 map_flags;
+
 	// The VBO identifier. Assigned by OpenGL.
 	GLuint vbo;
 
 	// A pointer to mapped memory.
 	char *memory_map;
 
+	// The range marked with setMappedRangeModified since the last unmap.
+	size_t modified_offset;
+	size_t modified_size;
+
+	// Whether every unmap goes to the next copy of a persistently mapped
+	// ring instead of uploading to the buffer.
+	bool is_ring;
+
+	// The offset in the ring which draws use as the start of the buffer, or 0
+	// if there is no ring.
+	size_t ring_base;
+
+	// Where the next upload to the ring can start.
+	size_t ring_head;
+
+	// The copy of the ring which uploads currently go to.
+	int ring_copy;
+
+	// The persistently mapped ring, RING_SIZE times the size of the buffer.
+	char *ring_map;
+
+	// Signaled when the GPU is done with the commands using each copy.
+	GLsync ring_fences[RING_SIZE];
+
 }; // GLBuffer
 
 
@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2006-2015 LOVE Development Team
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#include "GlyphLoader.h"
+#include "Font.h"
+
+// C++
+#include <algorithm>
+
+namespace love
+{
+namespace graphics
+{
+namespace opengl
+{
+
+GlyphLoader *GlyphLoader::current = nullptr;
+
+GlyphLoader::GlyphLoader()
+	: loadingFont(nullptr)
+	, quit(false)
+{
+	threadName = "GlyphLoader";
+}
+
+GlyphLoader::~GlyphLoader()
+{
+	if (current == this)
+		current = nullptr;
+
+	{
+		love::thread::Lock lock(mutex);
+		quit = true;
+		cond->broadcast();
+	}
+
+	wait();
+
+	for (const Job &job : finished)
+	{
+		if (job.data != nullptr)
+			job.data->release();
+	}
+}
+
+void GlyphLoader::threadFunction()
+{
+	while (true)
+	{
+		Job job;
+
+		{
+			love::thread::Lock lock(mutex);
+
+			while (!quit && queued.empty())
+				cond->wait(mutex);
+
+			if (quit)
+				return;
+
+			job = queued.front();
+			queued.pop_front();
+
+			loadingFont = job.font;
+		}
+
+		// cancel() waits for loadingFont to change, so the font stays alive
+		// while its glyph is rasterized.
+		try
+		{
+			job.data = job.font->getRasterizerGlyphData(job.glyph);
+		}
+		catch (love::Exception &)
+		{
+			// The font rasterizes it again on the main thread, which reports
+			// the error.
+			job.data = nullptr;
+		}
+
+		love::thread::Lock lock(mutex);
+
+		finished.push_back(job);
+		loadingFont = nullptr;
+
+		cond->broadcast();
+	}
+}
+
+void GlyphLoader::request(Font *font, uint32 glyph)
+{
+	love::thread::Lock lock(mutex);
+
+	queued.push_back({font, glyph, nullptr});
+
+	if (!isRunning())
+		start();
+
+	cond->broadcast();
+}
+
+void GlyphLoader::cancel(Font *font)
+{
+	love::thread::Lock lock(mutex);
+
+	while (loadingFont == font)
+		cond->wait(mutex);
+
+	auto isfont = [font](const Job &job) { return job.font == font; };
+
+	queued.erase(std::remove_if(queued.begin(), queued.end(), isfont), queued.end());
+
+	for (const Job &job : finished)
+	{
+		if (job.font == font && job.data != nullptr)
+			job.data->release();
+	}
+
+	finished.erase(std::remove_if(finished.begin(), finished.end(), isfont), finished.end());
+}
+
+void GlyphLoader::addFinished()
+{
+	std::vector<Job> jobs;
+
+	{
+		love::thread::Lock lock(mutex);
+		jobs.swap(finished);
+	}
+
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		try
+		{
+			jobs[i].font->addLoadedGlyph(jobs[i].glyph, jobs[i].data);
+		}
+		catch (love::Exception &)
+		{
+			// The remaining glyphs are dropped. They're no longer loading, so
+			// they're requested again the next time they're laid out, and
+			// text which was laid out with the placeholder is regenerated.
+			for (size_t j = i + 1; j < jobs.size(); j++)
+			{
+				if (jobs[j].data != nullptr)
+					jobs[j].data->release();
+
+				jobs[j].font->loadingGlyphs.erase(jobs[j].glyph);
+				jobs[j].font->textureCacheID++;
+			}
+
+			throw;
+		}
+	}
+}
+
+} // opengl
+} // graphics
+} // love
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2006-2015 LOVE Development Team
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#ifndef LOVE_GRAPHICS_OPENGL_GLYPH_LOADER_H
+#define LOVE_GRAPHICS_OPENGL_GLYPH_LOADER_H
+
+// LOVE
+#include "common/config.h"
+#include "common/int.h"
+#include "font/GlyphData.h"
+#include "thread/threads.h"
+
+// C++
+#include <deque>
+#include <vector>
+
+namespace love
+{
+namespace graphics
+{
+namespace opengl
+{
+
+class Font;
+
+/**
+ * Rasterizes glyphs for Fonts on a background thread.
+ *
+ * Fonts with asynchronous loading enabled request the glyphs they're missing
+ * instead of rasterizing them while text is drawn. The rasterized glyphs are
+ * collected until addFinished is called on the main thread (once per frame,
+ * by Graphics::present), which adds all of them to their fonts' textures in
+ * one go.
+ **/
+class GlyphLoader : public love::thread::Threadable
+{
+public:
+
+	// The loader fonts send their requests to. Set by Graphics.
+	static GlyphLoader *current;
+
+	GlyphLoader();
+	virtual ~GlyphLoader();
+
+	// Implements Threadable.
+	void threadFunction();
+
+	/**
+	 * Queues a glyph to be rasterized. Starts the thread if needed.
+	 **/
+	void request(Font *font, uint32 glyph);
+
+	/**
+	 * Drops every queued and finished glyph of the font, waiting for the one
+	 * being rasterized (if any) to finish. Must be called before the font is
+	 * destroyed.
+	 **/
+	void cancel(Font *font);
+
+	/**
+	 * Adds the glyphs rasterized since the last call to their fonts. Must be
+	 * called from the thread which owns the OpenGL context.
+	 **/
+	void addFinished();
+
+private:
+
+	struct Job
+	{
+		Font *font;
+		uint32 glyph;
+		love::font::GlyphData *data;
+	};
+
+	std::deque<Job> queued;
+	std::vector<Job> finished;
+
+	// The font whose glyph is being rasterized right now, if any.
+	Font *loadingFont;
+
+	bool quit;
+
+	love::thread::MutexRef mutex;
+	love::thread::ConditionalRef cond;
+
+}; // GlyphLoader
+
+} // opengl
+} // graphics
+} // love
+
+#endif // LOVE_GRAPHICS_OPENGL_GLYPH_LOADER_H
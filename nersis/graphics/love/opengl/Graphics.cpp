@@ -26,7 +26,6 @@
 #include "Graphics.h"
 #include "window/sdl/Window.h"
 #include "font/Font.h"
-#include "Polyline.h"
 
 // C++
 #include <vector>
@@ -50,7 +49,10 @@ namespace opengl
 {
 
 Graphics::Graphics()
-	: width(0)
+	: primitiveBatch(nullptr)
+	, glyphLoader(nullptr)
+	, renderQueue(nullptr)
+	, width(0)
 	, height(0)
 	, created(false)
 	, active(true)
@@ -61,6 +63,12 @@ Graphics::Graphics()
 	states.reserve(10);
 	states.push_back(DisplayState());
 
+	glyphLoader = new GlyphLoader();
+	GlyphLoader::current = glyphLoader;
+
+	renderQueue = new RenderQueue(this);
+	RenderQueue::current = renderQueue;
+
 	currentWindow = love::window::sdl::Window::createSingleton();
 
 	int w, h;
@@ -78,6 +86,11 @@ Graphics::~Graphics()
 	states.clear();
 	defaultFont.set(nullptr);
 
+	delete renderQueue;
+	delete primitiveBatch;
+
+	glyphLoader->release();
+
 	if (Shader::defaultShader)
 	{
 		Shader::defaultShader->release();
@@ -293,6 +306,12 @@ bool Graphics::setMode(int width, int height, bool &sRGB)
 	if (!Volatile::loadAll())
 		::printf("Could not reload all volatile objects.\n");
 
+	// The batch's buffers are volatile, so it's created after the first load.
+	if (!primitiveBatch)
+		primitiveBatch = new PrimitiveBatch();
+
+	PrimitiveBatch::current = primitiveBatch;
+
 	// Restore the graphics state.
 	restoreState(states.back());
 
@@ -320,6 +339,8 @@ void Graphics::unSetMode()
 	if (!isCreated())
 		return;
 
+	PrimitiveBatch::flushCurrent();
+
 	// Unload all volatile objects. These must be reloaded after the display
 	// mode change.
 	Volatile::unloadAll();
@@ -415,6 +436,8 @@ void Graphics::reset()
 
 void Graphics::clear(Color c)
 {
+	PrimitiveBatch::flushCurrent();
+
 	glClearColor(c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, c.a / 255.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
@@ -427,6 +450,8 @@ void Graphics::clear(const std::vector<Color> &colors)
 	if (states.back().canvases.size() == 0)
 		return clear(colors[0]);
 
+	PrimitiveBatch::flushCurrent();
+
 	if (colors.size() != states.back().canvases.size())
 		throw love::Exception("Number of clear colors must match the number of active canvases (%ld)", states.back().canvases.size());
 
@@ -465,6 +490,8 @@ void Graphics::discard(const std::vector<bool> &colorbuffers, bool stencil)
 	if (!(GLAD_VERSION_4_3 || GLAD_ARB_invalidate_subdata || GLAD_ES_VERSION_3_0 || GLAD_EXT_discard_framebuffer))
 		return;
 
+	PrimitiveBatch::flushCurrent();
+
 	std::vector<GLenum> attachments;
 	attachments.reserve(colorbuffers.size());
 
@@ -509,6 +536,8 @@ void Graphics::present()
 	if (!isActive())
 		return;
 
+	PrimitiveBatch::flushCurrent();
+
 	// Make sure we don't have a canvas active.
 	std::vector<StrongRef<Canvas>> canvases = states.back().canvases;
 	setCanvas();
@@ -530,8 +559,16 @@ void Graphics::present()
 	setCanvas(canvases);
 
 	// Reset the per-frame stat counts.
+	gl.stats.frames++;
 	gl.stats.drawCalls = 0;
 	gl.stats.framebufferBinds = 0;
+	gl.stats.textureBinds = 0;
+	gl.stats.shaderSwitches = 0;
+	gl.stats.blendModeSwitches = 0;
+
+	// Glyphs rasterized in the background during the last frame can be used
+	// from the next one on.
+	glyphLoader->addFinished();
 }
 
 int Graphics::getWidth() const
@@ -553,6 +590,8 @@ void Graphics::setScissor(int x, int y, int width, int height)
 {
 	OpenGL::Viewport box = {x, y, width, height};
 
+	PrimitiveBatch::flushCurrent();
+
 	glEnable(GL_SCISSOR_TEST);
 	// OpenGL's reversed y-coordinate is compensated for in OpenGL::setScissor.
 	gl.setScissor(box);
@@ -563,6 +602,8 @@ void Graphics::setScissor(int x, int y, int width, int height)
 
 void Graphics::setScissor()
 {
+	PrimitiveBatch::flushCurrent();
+
 	states.back().scissor = false;
 	glDisable(GL_SCISSOR_TEST);
 }
@@ -584,6 +625,8 @@ void Graphics::drawToStencilBuffer(bool enable)
 	if (writingToStencil == enable)
 		return;
 
+	PrimitiveBatch::flushCurrent();
+
 	writingToStencil = enable;
 
 	if (!enable)
@@ -621,6 +664,8 @@ void Graphics::setStencilTest(bool enable, bool invert)
 	if (writingToStencil)
 		return;
 
+	PrimitiveBatch::flushCurrent();
+
 	if (!enable)
 	{
 		glDisable(GL_STENCIL_TEST);
@@ -645,6 +690,7 @@ void Graphics::getStencilTest(bool &enable, bool &invert)
 
 void Graphics::clearStencil()
 {
+	PrimitiveBatch::flushCurrent();
 	glClear(GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
@@ -902,6 +948,8 @@ std::vector<Canvas *> Graphics::getCanvas() const
 
 void Graphics::setColorMask(ColorMask mask)
 {
+	PrimitiveBatch::flushCurrent();
+
 	glColorMask(mask.r, mask.g, mask.b, mask.a);
 	states.back().colorMask = mask;
 }
@@ -951,9 +999,15 @@ void Graphics::setBlendMode(Graphics::BlendMode mode)
 		break;
 	}
 
+	if (PrimitiveBatch::current != nullptr)
+		PrimitiveBatch::current->flush();
+
 	glBlendEquation(func);
 	glBlendFuncSeparate(srcRGB, dstRGB, srcA, dstA);
 
+	if (mode != states.back().blendMode)
+		++gl.stats.blendModeSwitches;
+
 	states.back().blendMode = mode;
 }
 
@@ -1035,6 +1089,8 @@ void Graphics::setWireframe(bool enable)
 	if (GLAD_ES_VERSION_2_0)
 		return;
 
+	PrimitiveBatch::flushCurrent();
+
 	glPolygonMode(GL_FRONT_AND_BACK, enable ? GL_LINE : GL_FILL);
 	states.back().wireframe = enable;
 }
@@ -1044,6 +1100,26 @@ bool Graphics::isWireframe() const
 	return states.back().wireframe;
 }
 
+void Graphics::setDeferred(bool enable)
+{
+	renderQueue->setEnabled(enable);
+}
+
+bool Graphics::isDeferred() const
+{
+	return renderQueue->isEnabled();
+}
+
+void Graphics::setDrawLayer(int layer)
+{
+	renderQueue->setLayer(layer);
+}
+
+int Graphics::getDrawLayer() const
+{
+	return renderQueue->getLayer();
+}
+
 void Graphics::print(const std::string &str, float x, float y , float angle, float sx, float sy, float ox, float oy, float kx, float ky)
 {
 	checkSetDefaultFont();
@@ -1070,16 +1146,8 @@ void Graphics::printf(const std::string &str, float x, float y, float wrap, Font
 
 void Graphics::point(float x, float y)
 {
-	OpenGL::TempDebugGroup debuggroup("Graphics point draw");
-
 	GLfloat coord[] = {x, y};
-
-	gl.prepareDraw();
-	gl.bindTexture(gl.getDefaultTexture());
-	glEnableVertexAttribArray(ATTRIB_POS);
-	glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, coord);
-	gl.drawArrays(GL_POINTS, 0, 1);
-	glDisableVertexAttribArray(ATTRIB_POS);
+	primitiveBatch->add(PrimitiveBatch::PRIMITIVE_POINTS, coord, 1);
 }
 
 void Graphics::polyline(const float *coords, size_t count)
@@ -1088,21 +1156,21 @@ void Graphics::polyline(const float *coords, size_t count)
 
 	if (state.lineJoin == LINE_JOIN_NONE)
 	{
-		NoneJoinPolyline line;
+		NoneJoinPolyline line(polylineArena);
 		line.render(coords, count, state.lineWidth * .5f, float(pixel_size_stack.back()), state.lineStyle == LINE_SMOOTH);
-		line.draw();
+		line.draw(*primitiveBatch);
 	}
 	else if (state.lineJoin == LINE_JOIN_BEVEL)
 	{
-		BevelJoinPolyline line;
+		BevelJoinPolyline line(polylineArena);
 		line.render(coords, count, state.lineWidth * .5f, float(pixel_size_stack.back()), state.lineStyle == LINE_SMOOTH);
-		line.draw();
+		line.draw(*primitiveBatch);
 	}
 	else // LINE_JOIN_MITER
 	{
-		MiterJoinPolyline line;
+		MiterJoinPolyline line(polylineArena);
 		line.render(coords, count, state.lineWidth * .5f, float(pixel_size_stack.back()), state.lineStyle == LINE_SMOOTH);
-		line.draw();
+		line.draw(*primitiveBatch);
 	}
 }
 
@@ -1171,14 +1239,7 @@ void Graphics::arc(DrawMode mode, float x, float y, float radius, float angle1,
 	}
 	else
 	{
-		OpenGL::TempDebugGroup debuggroup("Filled arc draw");
-
-		gl.prepareDraw();
-		gl.bindTexture(gl.getDefaultTexture());
-		glEnableVertexAttribArray(ATTRIB_POS);
-		glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, coords);
-		gl.drawArrays(GL_TRIANGLE_FAN, 0, points + 2);
-		glDisableVertexAttribArray(ATTRIB_POS);
+		primitiveBatch->add(PrimitiveBatch::PRIMITIVE_FAN, coords, points + 2);
 	}
 
 	delete[] coords;
@@ -1197,19 +1258,16 @@ void Graphics::polygon(DrawMode mode, const float *coords, size_t count)
 	}
 	else
 	{
-		OpenGL::TempDebugGroup debuggroup("Filled polygon draw");
-
-		gl.prepareDraw();
-		gl.bindTexture(gl.getDefaultTexture());
-		glEnableVertexAttribArray(ATTRIB_POS);
-		glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, coords);
-		gl.drawArrays(GL_TRIANGLE_FAN, 0, (int)count/2-1); // opengl will close the polygon for us
-		glDisableVertexAttribArray(ATTRIB_POS);
+		// The last vertex repeats the first, which a fan doesn't need.
+		if (count >= 8)
+			primitiveBatch->add(PrimitiveBatch::PRIMITIVE_FAN, coords, count / 2 - 1);
 	}
 }
 
 love::image::ImageData *Graphics::newScreenshot(love::image::Image *image, bool copyAlpha)
 {
+	PrimitiveBatch::flushCurrent();
+
 	// Temporarily unbind the currently active canvas (glReadPixels reads the
 	// active framebuffer, not the main one.)
 	std::vector<StrongRef<Canvas>> canvases = states.back().canvases;
@@ -1310,7 +1368,15 @@ Graphics::Stats Graphics::getStats() const
 	Stats stats;
 
 	stats.drawCalls = gl.stats.drawCalls;
+
+	// Primitives waiting in the batch will take one more draw call.
+	if (primitiveBatch && primitiveBatch->isPending())
+		stats.drawCalls++;
+
 	stats.canvasSwitches = gl.stats.framebufferBinds;
+	stats.shaderSwitches = gl.stats.shaderSwitches;
+	stats.textureSwitches = gl.stats.textureBinds;
+	stats.blendModeSwitches = gl.stats.blendModeSwitches;
 	stats.canvases = Canvas::canvasCount;
 	stats.images = Image::imageCount;
 	stats.fonts = Font::fontCount;
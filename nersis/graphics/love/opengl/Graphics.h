@@ -47,6 +47,10 @@
 #include "Shader.h"
 #include "Mesh.h"
 #include "Text.h"
+#include "PrimitiveBatch.h"
+#include "RenderQueue.h"
+#include "GlyphLoader.h"
+#include "Polyline.h"
 
 namespace love
 {
@@ -311,6 +315,28 @@ public:
 	 **/
 	bool isWireframe() const;
 
+	/**
+	 * Sets whether Images, Canvases, Meshes, SpriteBatches, Texts and
+	 * ParticleSystems are queued and drawn sorted by state (within their draw
+	 * layer) instead of in the order they're drawn in.
+	 **/
+	void setDeferred(bool enable);
+
+	/**
+	 * Gets whether deferred drawing is enabled.
+	 **/
+	bool isDeferred() const;
+
+	/**
+	 * Sets the layer deferred draws are added to. Lower layers are drawn first.
+	 **/
+	void setDrawLayer(int layer);
+
+	/**
+	 * Gets the layer deferred draws are added to.
+	 **/
+	int getDrawLayer() const;
+
 	/**
 	 * Draws text at the specified coordinates, with rotation and
 	 * scaling along both axes.
@@ -487,6 +513,16 @@ private:
 
 	StrongRef<Font> defaultFont;
 
+	// Collects consecutive primitives so they're drawn with one draw call.
+	PrimitiveBatch *primitiveBatch;
+	GlyphLoader *glyphLoader;
+
+	// Sorts draws by state when deferred drawing is enabled.
+	RenderQueue *renderQueue;
+
+	// Reused by every line, so tessellating one doesn't allocate.
+	Polyline::Arena polylineArena;
+
 	std::vector<double> pixel_size_stack; // stores current size of a pixel (needed for line drawing)
 
 	int width;
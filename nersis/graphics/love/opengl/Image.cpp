@@ -19,6 +19,8 @@
  **/
 
 #include "Image.h"
+#include "PrimitiveBatch.h"
+#include "RenderQueue.h"
 
 #include "common/int.h"
 
@@ -353,8 +355,16 @@ bool Image::refresh(int xoffset, int yoffset, int w, int h)
 
 void Image::drawv(const Matrix &t, const Vertex *v)
 {
+	if (RenderQueue::isRecordingCurrent())
+	{
+		RenderQueue::current->addQuads(this, texture, t, v, 1);
+		return;
+	}
+
 	OpenGL::TempDebugGroup debuggroup("Image draw");
 
+	PrimitiveBatch::flushCurrent();
+
 	OpenGL::TempTransform transform(gl);
 	transform.get() *= t;
 
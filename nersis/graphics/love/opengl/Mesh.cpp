@@ -23,6 +23,8 @@
 #include "common/Matrix.h"
 #include "common/Exception.h"
 #include "Shader.h"
+#include "PrimitiveBatch.h"
+#include "RenderQueue.h"
 
 // C++
 #include <algorithm>
@@ -81,7 +83,7 @@ Mesh::Mesh(const std::vector<AttribFormat> &vertexformat, const void *data, size
 	if (vertexCount == 0)
 		throw love::Exception("Data size is too small for specified vertex attribute formats.");
 
-	vbo = new GLBuffer(datasize, data, GL_ARRAY_BUFFER, getGLBufferUsage(usage));
+	vbo = new GLBuffer(datasize, data, GL_ARRAY_BUFFER, getGLBufferUsage(usage), getGLBufferMapFlags(usage));
 
 	vertexScratchBuffer = new char[vertexStride];
 }
@@ -108,7 +110,7 @@ Mesh::Mesh(const std::vector<AttribFormat> &vertexformat, int vertexcount, DrawM
 
 	size_t buffersize = vertexCount * vertexStride;
 
-	vbo = new GLBuffer(buffersize, nullptr, GL_ARRAY_BUFFER, getGLBufferUsage(usage));
+	vbo = new GLBuffer(buffersize, nullptr, GL_ARRAY_BUFFER, getGLBufferUsage(usage), getGLBufferMapFlags(usage));
 
 	// Initialize the buffer's contents to 0.
 	GLBuffer::Bind bind(*vbo);
@@ -193,6 +195,8 @@ void Mesh::setVertex(size_t vertindex, const void *data, size_t datasize)
 	size_t offset = vertindex * vertexStride;
 	size_t size = std::min(datasize, vertexStride);
 
+	RenderQueue::flushIfQueued(this);
+
 	GLBuffer::Bind bind(*vbo);
 	uint8 *bufferdata = (uint8 *) vbo->map();
 
@@ -241,6 +245,8 @@ void Mesh::setVertexAttribute(size_t vertindex, int attribindex, const void *dat
 	size_t offset = vertindex * vertexStride + getAttributeOffset(attribindex);
 	size_t size = std::min(datasize, attributeSizes[attribindex]);
 
+	RenderQueue::flushIfQueued(this);
+
 	GLBuffer::Bind bind(*vbo);
 	uint8 *bufferdata = (uint8 *) vbo->map();
 
@@ -303,6 +309,8 @@ Mesh::DataType Mesh::getAttributeInfo(int attribindex, int &components) const
 
 void Mesh::setAttributeEnabled(const std::string &name, bool enable)
 {
+	RenderQueue::flushIfQueued(this);
+
 	auto it = attachedAttributes.find(name);
 
 	if (it == attachedAttributes.end())
@@ -323,6 +331,8 @@ bool Mesh::isAttributeEnabled(const std::string &name) const
 
 void Mesh::attachAttribute(const std::string &name, Mesh *mesh)
 {
+	RenderQueue::flushIfQueued(this);
+
 	if (mesh != this)
 	{
 		for (const auto &it : mesh->attachedAttributes)
@@ -367,12 +377,25 @@ void Mesh::attachAttribute(const std::string &name, Mesh *mesh)
 		oldattrib.mesh->release();
 }
 
+void Mesh::unmapVertexBuffer()
+{
+	// Draws from a streamed buffer can only use the last upload, and the
+	// vertex map can use any vertex, so every vertex is uploaded.
+	if (vbo->isStreamed() && vboUsedSize > 0)
+	{
+		vboUsedOffset = 0;
+		vboUsedSize = vbo->getSize();
+	}
+
+	vbo->unmap(vboUsedOffset, vboUsedSize);
+	vboUsedOffset = vboUsedSize = 0;
+}
+
 void Mesh::flush()
 {
 	{
 		GLBuffer::Bind vbobind(*vbo);
-		vbo->unmap(vboUsedOffset, vboUsedSize);
-		vboUsedOffset = vboUsedSize = 0;
+		unmapVertexBuffer();
 	}
 
 	if (ibo != nullptr)
@@ -401,6 +424,8 @@ static void copyToIndexBuffer(const std::vector<uint32> &indices, GLBuffer::Mapp
 
 void Mesh::setVertexMap(const std::vector<uint32> &map)
 {
+	RenderQueue::flushIfQueued(this);
+
 	size_t maxval = getVertexCount();
 
 	GLenum datatype = getGLDataTypeFromMax(maxval);
@@ -484,11 +509,13 @@ size_t Mesh::getVertexMapCount() const
 
 void Mesh::setTexture(Texture *tex)
 {
+	RenderQueue::flushIfQueued(this);
 	texture.set(tex);
 }
 
 void Mesh::setTexture()
 {
+	RenderQueue::flushIfQueued(this);
 	texture.set(nullptr);
 }
 
@@ -499,6 +526,7 @@ Texture *Mesh::getTexture() const
 
 void Mesh::setDrawMode(DrawMode mode)
 {
+	RenderQueue::flushIfQueued(this);
 	drawMode = mode;
 }
 
@@ -512,12 +540,15 @@ void Mesh::setDrawRange(int min, int max)
 	if (min < 0 || max < 0 || min > max)
 		throw love::Exception("Invalid draw range.");
 
+	RenderQueue::flushIfQueued(this);
+
 	rangeMin = min;
 	rangeMax = max;
 }
 
 void Mesh::setDrawRange()
 {
+	RenderQueue::flushIfQueued(this);
 	rangeMin = rangeMax = -1;
 }
 
@@ -529,8 +560,17 @@ void Mesh::getDrawRange(int &min, int &max) const
 
 void Mesh::draw(float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky)
 {
+	if (RenderQueue::isRecordingCurrent())
+	{
+		GLuint gltexture = texture.get() ? *(GLuint *) texture->getHandle() : gl.getDefaultTexture();
+		RenderQueue::current->add(this, gltexture, x, y, angle, sx, sy, ox, oy, kx, ky);
+		return;
+	}
+
 	OpenGL::TempDebugGroup debuggroup("Mesh draw");
 
+	PrimitiveBatch::flushCurrent();
+
 	std::vector<GLint> attriblocations;
 	attriblocations.reserve(attachedAttributes.size());
 
@@ -562,8 +602,7 @@ void Mesh::draw(float x, float y, float angle, float sx, float sy, float ox, flo
 		GLBuffer::Bind vbobind(*mesh->vbo);
 
 		// Make sure the buffer isn't mapped (sends data to GPU if needed.)
-		mesh->vbo->unmap(mesh->vboUsedOffset, mesh->vboUsedSize);
-		mesh->vboUsedOffset = mesh->vboUsedSize = 0;
+		mesh->unmapVertexBuffer();
 
 		size_t offset = mesh->getAttributeOffset(attrib.second.index);
 		const void *gloffset = mesh->vbo->getPointer(offset);
@@ -723,6 +762,11 @@ GLenum Mesh::getGLBufferUsage(Usage usage)
 	}
 }
 
+uint32 Mesh::getGLBufferMapFlags(Usage usage)
+{
+	return usage == USAGE_STATIC ? 0 : GLBuffer::MAP_STREAM;
+}
+
 bool Mesh::getConstant(const char *in, Usage &out)
 {
 	return usages.find(in, out);
@@ -194,6 +194,12 @@ public:
 
 	static GLenum getGLBufferUsage(Usage usage);
 
+	/**
+	 * Stream and dynamic buffers are uploaded through a persistently mapped
+	 * ring, where possible.
+	 **/
+	static uint32 getGLBufferMapFlags(Usage usage);
+
 	static bool getConstant(const char *in, Usage &out);
 	static bool getConstant(Usage in, const char *&out);
 
@@ -216,6 +222,11 @@ private:
 	void calculateAttributeSizes();
 	size_t getAttributeOffset(size_t attribindex) const;
 
+	/**
+	 * Unmaps the vertex buffer, uploading the vertices which changed.
+	 **/
+	void unmapVertexBuffer();
+
 	static size_t getAttribFormatSize(const AttribFormat &format);
 
 	static GLenum getGLDrawMode(DrawMode mode);
@@ -24,6 +24,7 @@
 
 #include "Shader.h"
 #include "Canvas.h"
+#include "PrimitiveBatch.h"
 #include "common/Exception.h"
 
 // C++
@@ -389,6 +390,8 @@ Color OpenGL::getColor() const
 
 void OpenGL::setViewport(const OpenGL::Viewport &v)
 {
+	PrimitiveBatch::flushCurrent();
+
 	glViewport(v.x, v.y, v.w, v.h);
 	state.viewport = v;
 
@@ -405,6 +408,8 @@ OpenGL::Viewport OpenGL::getViewport() const
 
 void OpenGL::setScissor(const OpenGL::Viewport &v)
 {
+	PrimitiveBatch::flushCurrent();
+
 	if (Canvas::current)
 		glScissor(v.x, v.y, v.w, v.h);
 	else
@@ -424,6 +429,8 @@ OpenGL::Viewport OpenGL::getScissor() const
 
 void OpenGL::setPointSize(float size)
 {
+	PrimitiveBatch::flushCurrent();
+
 	if (GLAD_VERSION_1_0)
 		glPointSize(size);
 
@@ -437,6 +444,8 @@ float OpenGL::getPointSize() const
 
 void OpenGL::setFramebufferSRGB(bool enable)
 {
+	PrimitiveBatch::flushCurrent();
+
 	if (enable)
 		glEnable(GL_FRAMEBUFFER_SRGB);
 	else
@@ -452,6 +461,8 @@ bool OpenGL::hasFramebufferSRGB() const
 
 void OpenGL::bindFramebuffer(GLenum target, GLuint framebuffer)
 {
+	PrimitiveBatch::flushCurrent();
+
 	glBindFramebuffer(target, framebuffer);
 
 	if (target == GL_FRAMEBUFFER)
@@ -493,6 +504,7 @@ void OpenGL::bindTexture(GLuint texture)
 	{
 		state.boundTextures[state.curTextureUnit] = texture;
 		glBindTexture(GL_TEXTURE_2D, texture);
+		++stats.textureBinds;
 	}
 }
 
@@ -508,6 +520,7 @@ void OpenGL::bindTextureToUnit(GLuint texture, int textureunit, bool restoreprev
 
 		state.boundTextures[textureunit] = texture;
 		glBindTexture(GL_TEXTURE_2D, texture);
+		++stats.textureBinds;
 
 		if (restoreprev)
 			setTextureUnit(oldtextureunit);
@@ -23,6 +23,7 @@
 
 // LOVE
 #include "common/config.h"
+#include "common/int.h"
 #include "graphics/Color.h"
 #include "graphics/Texture.h"
 #include "common/Matrix.h"
@@ -37,6 +38,12 @@
 // The last argument to AttribPointer takes a buffer offset casted to a pointer.
 #define BUFFER_OFFSET(i) ((char *) NULL + (i))
 
+// SSE is available on every x86-64 target, and on x86 targets built for it.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LOVE_OPENGL_SSE
+#include <xmmintrin.h>
+#endif
+
 namespace love
 {
 namespace graphics
@@ -157,6 +164,10 @@ public:
 		size_t textureMemory;
 		int    drawCalls;
 		int    framebufferBinds;
+		int    textureBinds;
+		int    shaderSwitches;
+		int    blendModeSwitches;
+		uint32 frames; // Number of presented frames, for per-frame caches.
 	} stats;
 
 	OpenGL();
@@ -25,11 +25,14 @@
 #include "common/math.h"
 #include "modules/math/RandomGenerator.h"
 #include "OpenGL.h"
+#include "PrimitiveBatch.h"
+#include "RenderQueue.h"
 
 // STD
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 
 namespace love
 {
@@ -56,13 +59,18 @@ float calculate_variation(float inner, float outer, float var)
 	return low*(1-r)+high*r;
 }
 
+// Written so a NaN life counts as dead, otherwise the particle would never be
+// removed.
+inline bool isDead(float life)
+{
+	return !(life > 0.0f);
+}
+
 } // anonymous namespace
 
 ParticleSystem::ParticleSystem(Texture *texture, uint32 size)
 	: pMem(nullptr)
-	, pFree(nullptr)
-	, pHead(nullptr)
-	, pTail(nullptr)
+	, particles()
 	, particleVerts(nullptr)
 	, quadIndices(1)
 	, texture(texture)
@@ -109,9 +117,7 @@ ParticleSystem::ParticleSystem(Texture *texture, uint32 size)
 
 ParticleSystem::ParticleSystem(const ParticleSystem &p)
 	: pMem(nullptr)
-	, pFree(nullptr)
-	, pHead(nullptr)
-	, pTail(nullptr)
+	, particles()
 	, particleVerts(nullptr)
 	, quadIndices(p.quadIndices)
 	, texture(p.texture)
@@ -182,7 +188,9 @@ void ParticleSystem::createBuffers(size_t size)
 {
 	try
 	{
-		pFree = pMem = new Particle[size];
+		// Every array starts on a 16 byte boundary.
+		size_t arraysize = (size * 4 + 15) & ~(size_t) 15;
+		pMem = new char[arraysize * PARTICLE_ARRAYS + 15];
 		particleVerts = new love::Vertex[size * 4];
 		maxParticles = (uint32) size;
 	}
@@ -191,6 +199,30 @@ void ParticleSystem::createBuffers(size_t size)
 		deleteBuffers();
 		throw love::Exception("Out of memory");
 	}
+
+	float **floatarrays[] =
+	{
+		&particles.life, &particles.lifetime,
+		&particles.x, &particles.y,
+		&particles.originX, &particles.originY,
+		&particles.velocityX, &particles.velocityY,
+		&particles.linearAccelerationX, &particles.linearAccelerationY,
+		&particles.radialAcceleration, &particles.tangentialAcceleration,
+		&particles.linearDamping,
+		&particles.size, &particles.sizeOffset, &particles.sizeIntervalSize,
+		&particles.rotation, &particles.angle, &particles.spinStart, &particles.spinEnd,
+		&particles.r, &particles.g, &particles.b, &particles.a,
+	};
+
+	const int floatcount = (int) (sizeof(floatarrays) / sizeof(floatarrays[0]));
+	static_assert(sizeof(floatarrays) / sizeof(floatarrays[0]) + 1 == PARTICLE_ARRAYS, "Incorrect number of particle arrays");
+
+	for (int i = 0; i < floatcount; i++)
+		*floatarrays[i] = (float *) getParticleArray(i);
+
+	particles.quadIndex = (int *) getParticleArray(floatcount);
+
+	insertions.reserve(size);
 }
 
 void ParticleSystem::deleteBuffers()
@@ -200,15 +232,25 @@ void ParticleSystem::deleteBuffers()
 	delete[] particleVerts;
 
 	pMem = nullptr;
+	particles = Particles();
 	particleVerts = nullptr;
 	maxParticles = 0;
 	activeParticles = 0;
+	insertions.clear();
+}
+
+char *ParticleSystem::getParticleArray(int index) const
+{
+	size_t arraysize = (maxParticles * 4 + 15) & ~(size_t) 15;
+	char *start = (char *) (((size_t) pMem + 15) & ~(size_t) 15);
+	return start + arraysize * index;
 }
 
 void ParticleSystem::setBufferSize(uint32 size)
 {
 	if (size == 0 || size > MAX_PARTICLES)
 		throw love::Exception("Invalid buffer size");
+	RenderQueue::flushIfQueued(this);
 	quadIndices = VertexIndex(size);
 	deleteBuffers();
 	createBuffers(size);
@@ -225,28 +267,35 @@ void ParticleSystem::addParticle(float t)
 	if (isFull())
 		return;
 
-	// Gets a free particle and updates the allocation pointer.
-	Particle *p = pFree++;
-	initParticle(p, t);
+	uint32 index = activeParticles++;
+	initParticle(index, t);
+
+	Insertion insertion;
+	insertion.index = index;
+
+	// The position among the particles which were there before this batch of
+	// insertions.
+	uint32 existing = index - (uint32) insertions.size();
 
 	switch (insertMode)
 	{
 	default:
 	case INSERT_MODE_TOP:
-		insertTop(p);
+		insertion.position = existing;
 		break;
 	case INSERT_MODE_BOTTOM:
-		insertBottom(p);
+		insertion.position = 0;
 		break;
 	case INSERT_MODE_RANDOM:
-		insertRandom(p);
+		// Nonuniform, but 64-bit is so large nobody will notice. Hopefully.
+		insertion.position = (uint32) (rng.rand() % ((uint64) existing + 1));
 		break;
 	}
 
-	activeParticles++;
+	insertions.push_back(insertion);
 }
 
-void ParticleSystem::initParticle(Particle *p, float t)
+void ParticleSystem::initParticle(uint32 index, float t)
 {
 	float min,max;
 
@@ -256,183 +305,186 @@ void ParticleSystem::initParticle(Particle *p, float t)
 	min = particleLifeMin;
 	max = particleLifeMax;
 	if (min == max)
-		p->life = min;
+		particles.life[index] = min;
 	else
-		p->life = (float) rng.random(min, max);
-	p->lifetime = p->life;
+		particles.life[index] = (float) rng.random(min, max);
+	particles.lifetime[index] = particles.life[index];
 
-	p->position[0] = pos.x;
-	p->position[1] = pos.y;
+	float x = pos.x;
+	float y = pos.y;
 
 	switch (areaSpreadDistribution)
 	{
 	case DISTRIBUTION_UNIFORM:
-		p->position[0] += (float) rng.random(-areaSpread.getX(), areaSpread.getX());
-		p->position[1] += (float) rng.random(-areaSpread.getY(), areaSpread.getY());
+		x += (float) rng.random(-areaSpread.getX(), areaSpread.getX());
+		y += (float) rng.random(-areaSpread.getY(), areaSpread.getY());
 		break;
 	case DISTRIBUTION_NORMAL:
-		p->position[0] += (float) rng.randomNormal(areaSpread.getX());
-		p->position[1] += (float) rng.randomNormal(areaSpread.getY());
+		x += (float) rng.randomNormal(areaSpread.getX());
+		y += (float) rng.randomNormal(areaSpread.getY());
 		break;
 	case DISTRIBUTION_NONE:
 	default:
 		break;
 	}
 
+	particles.x[index] = x;
+	particles.y[index] = y;
+
 	min = direction - spread/2.0f;
 	max = direction + spread/2.0f;
-	p->direction = (float) rng.random(min, max);
+	float dir = (float) rng.random(min, max);
 
-	p->origin = pos;
+	particles.originX[index] = pos.x;
+	particles.originY[index] = pos.y;
 
 	min = speedMin;
 	max = speedMax;
 	float speed = (float) rng.random(min, max);
-	p->velocity = love::Vector(cosf(p->direction), sinf(p->direction));
-	p->velocity *= speed;
+	love::Vector velocity = love::Vector(cosf(dir), sinf(dir));
+	velocity *= speed;
+	particles.velocityX[index] = velocity.x;
+	particles.velocityY[index] = velocity.y;
 
-	p->linearAcceleration.x = (float) rng.random(linearAccelerationMin.x, linearAccelerationMax.x);
-	p->linearAcceleration.y = (float) rng.random(linearAccelerationMin.y, linearAccelerationMax.y);
+	particles.linearAccelerationX[index] = (float) rng.random(linearAccelerationMin.x, linearAccelerationMax.x);
+	particles.linearAccelerationY[index] = (float) rng.random(linearAccelerationMin.y, linearAccelerationMax.y);
 
 	min = radialAccelerationMin;
 	max = radialAccelerationMax;
-	p->radialAcceleration = (float) rng.random(min, max);
+	particles.radialAcceleration[index] = (float) rng.random(min, max);
 
 	min = tangentialAccelerationMin;
 	max = tangentialAccelerationMax;
-	p->tangentialAcceleration = (float) rng.random(min, max);
+	particles.tangentialAcceleration[index] = (float) rng.random(min, max);
 
 	min = linearDampingMin;
 	max = linearDampingMax;
-	p->linearDamping = (float) rng.random(min, max);
+	particles.linearDamping[index] = (float) rng.random(min, max);
 
-	p->sizeOffset       = (float) rng.random(sizeVariation); // time offset for size change
-	p->sizeIntervalSize = (1.0f - (float) rng.random(sizeVariation)) - p->sizeOffset;
-	p->size = sizes[(size_t)(p->sizeOffset - .5f) * (sizes.size() - 1)];
+	float sizeoffset = (float) rng.random(sizeVariation); // time offset for size change
+	particles.sizeOffset[index] = sizeoffset;
+	particles.sizeIntervalSize[index] = (1.0f - (float) rng.random(sizeVariation)) - sizeoffset;
+	particles.size[index] = sizes[(size_t)(sizeoffset - .5f) * (sizes.size() - 1)];
 
 	min = rotationMin;
 	max = rotationMax;
-	p->spinStart = calculate_variation(spinStart, spinEnd, spinVariation);
-	p->spinEnd = calculate_variation(spinEnd, spinStart, spinVariation);
-	p->rotation = (float) rng.random(min, max);
+	particles.spinStart[index] = calculate_variation(spinStart, spinEnd, spinVariation);
+	particles.spinEnd[index] = calculate_variation(spinEnd, spinStart, spinVariation);
+	particles.rotation[index] = (float) rng.random(min, max);
 
-	p->angle = p->rotation;
+	particles.angle[index] = particles.rotation[index];
 	if (relativeRotation)
-		p->angle += atan2f(p->velocity.y, p->velocity.x);
+		particles.angle[index] += atan2f(velocity.y, velocity.x);
 
-	p->color = colors[0];
+	particles.r[index] = colors[0].r;
+	particles.g[index] = colors[0].g;
+	particles.b[index] = colors[0].b;
+	particles.a[index] = colors[0].a;
 
-	p->quadIndex = 0;
+	particles.quadIndex[index] = 0;
 }
 
-void ParticleSystem::insertTop(Particle *p)
+void ParticleSystem::insertParticles()
 {
-	if (pHead == nullptr)
-	{
-		pHead = p;
-		p->prev = nullptr;
-	}
-	else
-	{
-		pTail->next = p;
-		p->prev = pTail;
-	}
-	p->next = nullptr;
-	pTail = p;
-}
+	if (insertions.empty())
+		return;
 
-void ParticleSystem::insertBottom(Particle *p)
-{
-	if (pTail == nullptr)
-	{
-		pTail = p;
-		p->next = nullptr;
-	}
+	// The new particles are after the existing ones, in the order they were
+	// added. Particles inserted at the same position keep that order, except
+	// at the bottom, where each new particle goes below the previous one.
+	if (insertMode == INSERT_MODE_BOTTOM)
+		std::reverse(insertions.begin(), insertions.end());
 	else
+		std::stable_sort(insertions.begin(), insertions.end());
+
+	uint32 count = (uint32) insertions.size();
+	uint32 existing = activeParticles - count;
+
+	// Nothing moves if they all stay on top.
+	if (insertions[0].position == existing && insertMode != INSERT_MODE_BOTTOM)
 	{
-		pHead->prev = p;
-		p->next = pHead;
+		insertions.clear();
+		return;
 	}
-	p->prev = nullptr;
-	pHead = p;
-}
 
-void ParticleSystem::insertRandom(Particle *p)
-{
-	// Nonuniform, but 64-bit is so large nobody will notice. Hopefully.
-	uint64 pos = rng.rand() % ((int64) activeParticles + 1);
+	insertScratch.resize(count);
 
-	// Special case where the particle gets inserted before the head.
-	if (pos == activeParticles)
+	for (int i = 0; i < PARTICLE_ARRAYS; i++)
 	{
-		Particle *pA = pHead;
-		if (pA)
-			pA->prev = p;
-		p->prev = nullptr;
-		p->next = pA;
-		pHead = p;
-		return;
+		uint32 *values = (uint32 *) getParticleArray(i);
+
+		for (uint32 j = 0; j < count; j++)
+			insertScratch[j] = values[insertions[j].index];
+
+		// Starting at the end, shift each run of existing particles up by the
+		// number of new particles which go below it.
+		uint32 end = existing;
+
+		for (uint32 j = count; j > 0; j--)
+		{
+			uint32 start = insertions[j - 1].position;
+
+			memmove(values + start + j, values + start, (end - start) * sizeof(uint32));
+			values[start + j - 1] = insertScratch[j - 1];
+
+			end = start;
+		}
 	}
 
-	// Inserts the particle after the randomly selected particle.
-	Particle *pA = pMem + pos;
-	Particle *pB = pA->next;
-	pA->next = p;
-	if (pB)
-		pB->prev = p;
-	else
-		pTail = p;
-	p->prev = pA;
-	p->next = pB;
+	insertions.clear();
 }
 
-ParticleSystem::Particle *ParticleSystem::removeParticle(Particle *p)
+void ParticleSystem::removeDeadParticles()
 {
-	// The linked list is updated in this function and old pointers may be
-	// invalidated. The returned pointer will inform the caller of the new
-	// pointer to the next particle.
-	Particle *pNext = nullptr;
+	uint32 first = 0;
+	while (first < activeParticles && !isDead(particles.life[first]))
+		first++;
 
-	// Removes the particle from the linked list.
-	if (p->prev)
-		p->prev->next = p->next;
-	else
-		pHead = p->next;
+	if (first == activeParticles)
+		return;
 
-	if (p->next)
+	// Particles before the first dead one stay where they are. The runs of
+	// survivors after it are moved down, keeping their order.
+	survivorRuns.clear();
+
+	uint32 survivors = first;
+
+	for (uint32 i = first; i < activeParticles;)
 	{
-		p->next->prev = p->prev;
-		pNext = p->next;
+		while (i < activeParticles && isDead(particles.life[i]))
+			i++;
+
+		uint32 start = i;
+		while (i < activeParticles && !isDead(particles.life[i]))
+			i++;
+
+		if (i > start)
+		{
+			survivorRuns.push_back(start);
+			survivorRuns.push_back(i - start);
+			survivors += i - start;
+		}
 	}
-	else
-		pTail = p->prev;
 
-	// The (in memory) last particle can now be moved into the free slot.
-	// It will skip the moving if it happens to be the removed particle.
-	pFree--;
-	if (p != pFree)
+	for (int i = 0; i < PARTICLE_ARRAYS; i++)
 	{
-		*p = *pFree;
-		if (pNext == pFree)
-			pNext = p;
-
-		if (p->prev)
-			p->prev->next = p;
-		else
-			pHead = p;
-
-		if (p->next)
-			p->next->prev = p;
-		else
-			pTail = p;
+		uint32 *values = (uint32 *) getParticleArray(i);
+		uint32 dst = first;
+
+		for (size_t j = 0; j < survivorRuns.size(); j += 2)
+		{
+			memmove(values + dst, values + survivorRuns[j], survivorRuns[j + 1] * sizeof(uint32));
+			dst += survivorRuns[j + 1];
+		}
 	}
 
-	activeParticles--;
-	return pNext;
+	activeParticles = survivors;
 }
 
 void ParticleSystem::setTexture(Texture *tex)
 {
+	RenderQueue::flushIfQueued(this);
+
 	texture.set(tex);
 
 	if (defaultOffset)
@@ -737,6 +789,8 @@ std::vector<Color> ParticleSystem::getColor() const
 
 void ParticleSystem::setQuads(const std::vector<Quad *> &newQuads)
 {
+	RenderQueue::flushIfQueued(this);
+
 	std::vector<StrongRef<Quad>> quadlist;
 	quadlist.reserve(newQuads.size());
 
@@ -751,6 +805,7 @@ void ParticleSystem::setQuads(const std::vector<Quad *> &newQuads)
 
 void ParticleSystem::setQuads()
 {
+	RenderQueue::flushIfQueued(this);
 	quads.clear();
 }
 
@@ -802,10 +857,10 @@ void ParticleSystem::reset()
 	if (pMem == nullptr)
 		return;
 
-	pFree = pMem;
-	pHead = nullptr;
-	pTail = nullptr;
+	RenderQueue::flushIfQueued(this);
+
 	activeParticles = 0;
+	insertions.clear();
 	life = lifetime;
 	emitCounter = 0;
 }
@@ -815,10 +870,14 @@ void ParticleSystem::emit(uint32 num)
 	if (!active)
 		return;
 
+	RenderQueue::flushIfQueued(this);
+
 	num = std::min(num, maxParticles - activeParticles);
 
 	while(num--)
 		addParticle(1.0f);
+
+	insertParticles();
 }
 
 bool ParticleSystem::isActive() const
@@ -852,8 +911,16 @@ void ParticleSystem::draw(float x, float y, float angle, float sx, float sy, flo
 	if (pCount == 0 || texture.get() == nullptr || pMem == nullptr || particleVerts == nullptr)
 		return;
 
+	if (RenderQueue::isRecordingCurrent())
+	{
+		RenderQueue::current->add(this, *(GLuint *) texture->getHandle(), x, y, angle, sx, sy, ox, oy, kx, ky);
+		return;
+	}
+
 	OpenGL::TempDebugGroup debuggroup("ParticleSystem draw");
 
+	PrimitiveBatch::flushCurrent();
+
 	Color curcolor = gl.getColor();
 
 	static Matrix t;
@@ -864,35 +931,38 @@ void ParticleSystem::draw(float x, float y, float angle, float sx, float sy, flo
 
 	const Vertex *textureVerts = texture->getVertices();
 	Vertex *pVerts = particleVerts;
-	Particle *p = pHead;
 
 	bool useQuads = !quads.empty();
 
 	// set the vertex data for each particle (transformation, texcoords, color)
-	while (p)
+	for (uint32 i = 0; i < pCount; i++)
 	{
 		if (useQuads)
-			textureVerts = quads[p->quadIndex]->getVertices();
+			textureVerts = quads[particles.quadIndex[i]]->getVertices();
 
 		// particle vertices are image vertices transformed by particle information
-		t.setTransformation(p->position[0], p->position[1], p->angle, p->size, p->size, offset.x, offset.y, 0.0f, 0.0f);
+		t.setTransformation(particles.x[i], particles.y[i], particles.angle[i], particles.size[i], particles.size[i], offset.x, offset.y, 0.0f, 0.0f);
 		t.transform(pVerts, textureVerts, 4);
 
+		// particle colors are stored as floats (0-1) but vertex colors are stored as unsigned bytes (0-255)
+		unsigned char r = (unsigned char) (particles.r[i]*255);
+		unsigned char g = (unsigned char) (particles.g[i]*255);
+		unsigned char b = (unsigned char) (particles.b[i]*255);
+		unsigned char a = (unsigned char) (particles.a[i]*255);
+
 		// set the texture coordinate and color data for particle vertices
 		for (int v = 0; v < 4; v++)
 		{
 			pVerts[v].s = textureVerts[v].s;
 			pVerts[v].t = textureVerts[v].t;
 
-			// particle colors are stored as floats (0-1) but vertex colors are stored as unsigned bytes (0-255)
-			pVerts[v].r = (unsigned char) (p->color.r*255);
-			pVerts[v].g = (unsigned char) (p->color.g*255);
-			pVerts[v].b = (unsigned char) (p->color.b*255);
-			pVerts[v].a = (unsigned char) (p->color.a*255);
+			pVerts[v].r = r;
+			pVerts[v].g = g;
+			pVerts[v].b = b;
+			pVerts[v].a = a;
 		}
 
 		pVerts += 4;
-		p = p->next;
 	}
 
 	gl.bindTexture(*(GLuint *) texture->getHandle());
@@ -924,119 +994,220 @@ void ParticleSystem::update(float dt)
 	if (pMem == nullptr || dt == 0.0f)
 		return;
 
-	// Traverse all particles and update.
-	Particle *p = pHead;
+	RenderQueue::flushIfQueued(this);
 
-	while (p)
-	{
-		// Decrease lifespan.
-		p->life -= dt;
+	// Decrease lifespans, and remove the particles whose life is over.
+	for (uint32 i = 0; i < activeParticles; i++)
+		particles.life[i] -= dt;
 
-		if (p->life <= 0)
-			p = removeParticle(p);
-		else
+	removeDeadParticles();
+
+	updatePositions(dt);
+	updateAppearance(dt);
+
+	// Make some more particles.
+	if (active)
+	{
+		float rate = 1.0f / emissionRate; // the amount of time between each particle emit
+		emitCounter += dt;
+		float total = emitCounter - rate;
+		while (emitCounter > rate)
 		{
-			// Temp variables.
-			love::Vector radial, tangential;
-			love::Vector ppos(p->position[0], p->position[1]);
+			addParticle(1.0f - (emitCounter - rate) / total);
+			emitCounter -= rate;
+		}
+
+		insertParticles();
+		/*int particles = (int)(emissionRate * dt);
+		 for (int i = 0; i != particles; i++)
+		 add();*/
+
+		life -= dt;
+		if (lifetime != -1 && life < 0)
+			stop();
+	}
+
+	prevPosition = position;
+}
+
+void ParticleSystem::updatePositions(float dt)
+{
+	const Particles &p = particles;
+	uint32 i = 0;
 
-			// Get vector from particle center to particle.
-			radial = ppos - p->origin;
-			radial.normalize();
-			tangential = radial;
+#ifdef LOVE_OPENGL_SSE
+	// The same operations as the loop below, four particles at a time.
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signbit = _mm_set1_ps(-0.0f);
+	const __m128 dt4 = _mm_set1_ps(dt);
 
-			// Resize radial acceleration.
-			radial *= p->radialAcceleration;
+	for (; i + 4 <= activeParticles; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(p.x + i);
+		__m128 y = _mm_loadu_ps(p.y + i);
+
+		// Get vector from particle center to particle, and normalize it.
+		__m128 radialx = _mm_sub_ps(x, _mm_loadu_ps(p.originX + i));
+		__m128 radialy = _mm_sub_ps(y, _mm_loadu_ps(p.originY + i));
+
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(radialx, radialx), _mm_mul_ps(radialy, radialy)));
+		__m128 nonzero = _mm_cmpgt_ps(length, zero);
+		__m128 scale = _mm_or_ps(_mm_and_ps(nonzero, _mm_div_ps(one, length)), _mm_andnot_ps(nonzero, one));
+
+		radialx = _mm_mul_ps(radialx, scale);
+		radialy = _mm_mul_ps(radialy, scale);
+
+		// Tangential acceleration is perpendicular to the radial one.
+		__m128 tangential = _mm_loadu_ps(p.tangentialAcceleration + i);
+		__m128 tangentialx = _mm_mul_ps(_mm_xor_ps(radialy, signbit), tangential);
+		__m128 tangentialy = _mm_mul_ps(radialx, tangential);
+
+		__m128 radial = _mm_loadu_ps(p.radialAcceleration + i);
+		radialx = _mm_mul_ps(radialx, radial);
+		radialy = _mm_mul_ps(radialy, radial);
+
+		// Update velocity.
+		__m128 accelx = _mm_add_ps(_mm_add_ps(radialx, tangentialx), _mm_loadu_ps(p.linearAccelerationX + i));
+		__m128 accely = _mm_add_ps(_mm_add_ps(radialy, tangentialy), _mm_loadu_ps(p.linearAccelerationY + i));
+
+		__m128 vx = _mm_add_ps(_mm_loadu_ps(p.velocityX + i), _mm_mul_ps(accelx, dt4));
+		__m128 vy = _mm_add_ps(_mm_loadu_ps(p.velocityY + i), _mm_mul_ps(accely, dt4));
+
+		// Apply damping.
+		__m128 damping = _mm_div_ps(one, _mm_add_ps(one, _mm_mul_ps(_mm_loadu_ps(p.linearDamping + i), dt4)));
+		vx = _mm_mul_ps(vx, damping);
+		vy = _mm_mul_ps(vy, damping);
 
-			// Calculate tangential acceleration.
-			{
-				float a = tangential.getX();
-				tangential.setX(-tangential.getY());
-				tangential.setY(a);
-			}
+		_mm_storeu_ps(p.velocityX + i, vx);
+		_mm_storeu_ps(p.velocityY + i, vy);
 
-			// Resize tangential.
-			tangential *= p->tangentialAcceleration;
+		// Modify position.
+		_mm_storeu_ps(p.x + i, _mm_add_ps(x, _mm_mul_ps(vx, dt4)));
+		_mm_storeu_ps(p.y + i, _mm_add_ps(y, _mm_mul_ps(vy, dt4)));
+	}
+#endif
+
+	for (; i < activeParticles; i++)
+	{
+		// Temp variables.
+		love::Vector radial, tangential;
+		love::Vector ppos(p.x[i], p.y[i]);
+		love::Vector velocity(p.velocityX[i], p.velocityY[i]);
 
-			// Update velocity.
-			p->velocity += (radial + tangential + p->linearAcceleration) * dt;
+		// Get vector from particle center to particle.
+		radial = ppos - love::Vector(p.originX[i], p.originY[i]);
+		radial.normalize();
+		tangential = radial;
 
-			// Apply damping.
-			p->velocity *= 1.0f / (1.0f + p->linearDamping * dt);
+		// Resize radial acceleration.
+		radial *= p.radialAcceleration[i];
 
-			// Modify position.
-			ppos += p->velocity * dt;
+		// Calculate tangential acceleration.
+		{
+			float a = tangential.getX();
+			tangential.setX(-tangential.getY());
+			tangential.setY(a);
+		}
 
-			p->position[0] = ppos.getX();
-			p->position[1] = ppos.getY();
+		// Resize tangential.
+		tangential *= p.tangentialAcceleration[i];
 
-			const float t = 1.0f - p->life / p->lifetime;
+		// Update velocity.
+		velocity += (radial + tangential + love::Vector(p.linearAccelerationX[i], p.linearAccelerationY[i])) * dt;
 
-			// Rotate.
-			p->rotation += (p->spinStart * (1.0f - t) + p->spinEnd * t) * dt;
+		// Apply damping.
+		velocity *= 1.0f / (1.0f + p.linearDamping[i] * dt);
 
-			p->angle = p->rotation;
+		// Modify position.
+		ppos += velocity * dt;
 
-			if (relativeRotation)
-				p->angle += atan2f(p->velocity.y, p->velocity.x);
+		p.velocityX[i] = velocity.x;
+		p.velocityY[i] = velocity.y;
+		p.x[i] = ppos.x;
+		p.y[i] = ppos.y;
+	}
+}
+
+void ParticleSystem::updateAppearance(float dt)
+{
+	const Particles &p = particles;
 
-			// Change size according to given intervals:
-			// i = 0       1       2      3          n-1
-			//     |-------|-------|------|--- ... ---|
-			// t = 0    1/(n-1)        3/(n-1)        1
-			//
-			// `s' is the interpolation variable scaled to the current
-			// interval width, e.g. if n = 5 and t = 0.3, then the current
-			// indices are 1,2 and s = 0.3 - 0.25 = 0.05
-			float s = p->sizeOffset + t * p->sizeIntervalSize; // size variation
+	// Rotate. The angle, size and color all depend on how far the particle is
+	// in its life, 't'.
+	for (uint32 i = 0; i < activeParticles; i++)
+	{
+		const float t = 1.0f - p.life[i] / p.lifetime[i];
+		p.rotation[i] += (p.spinStart[i] * (1.0f - t) + p.spinEnd[i] * t) * dt;
+		p.angle[i] = p.rotation[i];
+	}
+
+	if (relativeRotation)
+	{
+		for (uint32 i = 0; i < activeParticles; i++)
+			p.angle[i] += atan2f(p.velocityY[i], p.velocityX[i]);
+	}
+
+	// Change size according to given intervals:
+	// i = 0       1       2      3          n-1
+	//     |-------|-------|------|--- ... ---|
+	// t = 0    1/(n-1)        3/(n-1)        1
+	//
+	// `s' is the interpolation variable scaled to the current
+	// interval width, e.g. if n = 5 and t = 0.3, then the current
+	// indices are 1,2 and s = 0.3 - 0.25 = 0.05
+	if (sizes.size() == 1)
+		std::fill(p.size, p.size + activeParticles, sizes[0]);
+	else
+	{
+		for (uint32 j = 0; j < activeParticles; j++)
+		{
+			const float t = 1.0f - p.life[j] / p.lifetime[j];
+			float s = p.sizeOffset[j] + t * p.sizeIntervalSize[j]; // size variation
 			s *= (float)(sizes.size() - 1); // 0 <= s < sizes.size()
 			size_t i = (size_t)s;
 			size_t k = (i == sizes.size() - 1) ? i : i + 1; // boundary check (prevents failing on t = 1.0f)
 			s -= (float)i; // transpose s to be in interval [0:1]: i <= s < i + 1 ~> 0 <= s < 1
-			p->size = sizes[i] * (1.0f - s) + sizes[k] * s;
+			p.size[j] = sizes[i] * (1.0f - s) + sizes[k] * s;
+		}
+	}
 
-			// Update color according to given intervals (as above)
-			s = t * (float)(colors.size() - 1);
-			i = (size_t)s;
-			k = (i == colors.size() - 1) ? i : i + 1;
+	// Update color according to given intervals (as above)
+	if (colors.size() == 1)
+	{
+		std::fill(p.r, p.r + activeParticles, colors[0].r);
+		std::fill(p.g, p.g + activeParticles, colors[0].g);
+		std::fill(p.b, p.b + activeParticles, colors[0].b);
+		std::fill(p.a, p.a + activeParticles, colors[0].a);
+	}
+	else
+	{
+		for (uint32 j = 0; j < activeParticles; j++)
+		{
+			const float t = 1.0f - p.life[j] / p.lifetime[j];
+			float s = t * (float)(colors.size() - 1);
+			size_t i = (size_t)s;
+			size_t k = (i == colors.size() - 1) ? i : i + 1;
 			s -= (float)i;                            // 0 <= s <= 1
-			p->color = colors[i] * (1.0f - s) + colors[k] * s;
-
-			// Update the quad index.
-			k = quads.size();
-			if (k > 0)
-			{
-				s = t * (float) k; // [0:numquads-1] (clamped below)
-				i = (s > 0.0f) ? (size_t) s : 0;
-				p->quadIndex = (int) ((i < k) ? i : k - 1);
-			}
-
-			// Next particle.
-			p = p->next;
+			p.r[j] = colors[i].r * (1.0f - s) + colors[k].r * s;
+			p.g[j] = colors[i].g * (1.0f - s) + colors[k].g * s;
+			p.b[j] = colors[i].b * (1.0f - s) + colors[k].b * s;
+			p.a[j] = colors[i].a * (1.0f - s) + colors[k].a * s;
 		}
 	}
 
-	// Make some more particles.
-	if (active)
+	// Update the quad index.
+	size_t k = quads.size();
+	if (k > 0)
 	{
-		float rate = 1.0f / emissionRate; // the amount of time between each particle emit
-		emitCounter += dt;
-		float total = emitCounter - rate;
-		while (emitCounter > rate)
+		for (uint32 j = 0; j < activeParticles; j++)
 		{
-			addParticle(1.0f - (emitCounter - rate) / total);
-			emitCounter -= rate;
+			const float t = 1.0f - p.life[j] / p.lifetime[j];
+			float s = t * (float) k; // [0:numquads-1] (clamped below)
+			size_t i = (s > 0.0f) ? (size_t) s : 0;
+			p.quadIndex[j] = (int) ((i < k) ? i : k - 1);
 		}
-		/*int particles = (int)(emissionRate * dt);
-		 for (int i = 0; i != particles; i++)
-		 add();*/
-
-		life -= dt;
-		if (lifetime != -1 && life < 0)
-			stop();
 	}
-
-	prevPosition = position;
 }
 
 bool ParticleSystem::getConstant(const char *in, AreaSpreadDistribution &out)
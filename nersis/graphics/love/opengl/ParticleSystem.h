@@ -525,53 +525,73 @@ public:
 
 protected:
 
-	// Represents a single particle.
-	struct Particle
+	/**
+	 * The particles, stored as one array per attribute so update can work on
+	 * several particles at once. The arrays are kept in draw order: the first
+	 * particle is drawn first.
+	 **/
+	struct Particles
 	{
-		Particle *prev;
-		Particle *next;
+		float *life;
+		float *lifetime;
 
-		float lifetime;
-		float life;
-
-		float position[2];
-		float direction;
+		float *x, *y;
 
 		// Particles gravitate towards this point.
-		love::Vector origin;
+		float *originX, *originY;
+
+		float *velocityX, *velocityY;
+		float *linearAccelerationX, *linearAccelerationY;
+		float *radialAcceleration;
+		float *tangentialAcceleration;
+
+		float *linearDamping;
+
+		float *size;
+		float *sizeOffset;
+		float *sizeIntervalSize;
+
+		float *rotation; // Amount of rotation applied to the final angle.
+		float *angle;
+		float *spinStart;
+		float *spinEnd;
 
-		love::Vector velocity;
-		love::Vector linearAcceleration;
-		float radialAcceleration;
-		float tangentialAcceleration;
+		float *r, *g, *b, *a;
 
-		float linearDamping;
+		int *quadIndex;
+	};
 
-		float size;
-		float sizeOffset;
-		float sizeIntervalSize;
+	// The number of arrays in Particles. They all have 4 byte elements.
+	static const int PARTICLE_ARRAYS = 25;
 
-		float rotation; // Amount of rotation applied to the final angle.
-		float angle;
-		float spinStart;
-		float spinEnd;
+	// A particle waiting to be moved to its place in the draw order.
+	struct Insertion
+	{
+		// Number of particles before it which were there before the insert.
+		uint32 position;
 
-		Colorf color;
+		// Its current index.
+		uint32 index;
 
-		int quadIndex;
+		bool operator < (const Insertion &other) const
+		{
+			return position < other.position;
+		}
 	};
 
-	// Pointer to the beginning of the allocated memory.
-	Particle *pMem;
+	// Memory for all the arrays in 'particles'.
+	char *pMem;
 
-	// Pointer to a free particle.
-	Particle *pFree;
+	Particles particles;
 
-	// Pointer to the start of the linked list.
-	Particle *pHead;
+	// Particles emitted since the last call to insertParticles.
+	std::vector<Insertion> insertions;
 
-	// Pointer to the end of the linked list.
-	Particle *pTail;
+	// Start and length of each run of particles which survive an update.
+	std::vector<uint32> survivorRuns;
+
+	// Holds the inserted particles' values from one array while it's shifted.
+	std::vector<uint32> insertScratch;
 
 	// array of transformed vertex data for all particles, for drawing
 	Vertex *particleVerts;
@@ -671,14 +691,23 @@ protected:
 	void createBuffers(size_t size);
 	void deleteBuffers();
 
+	/**
+	 * Creates a particle after the last one. insertParticles must be called
+	 * after adding particles, to move them to their place in the draw order.
+	 **/
 	void addParticle(float t);
-	Particle *removeParticle(Particle *p);
+	void insertParticles();
+	void removeDeadParticles();
 
 	// Called by addParticle.
-	void initParticle(Particle *p, float t);
-	void insertTop(Particle *p);
-	void insertBottom(Particle *p);
-	void insertRandom(Particle *p);
+	void initParticle(uint32 index, float t);
+
+	// Called by update, on the particles which are still alive.
+	void updatePositions(float dt);
+	void updateAppearance(float dt);
+
+	// Returns the start of one of the arrays in 'particles'.
+	char *getParticleArray(int index) const;
 
 	static StringMap<AreaSpreadDistribution, DISTRIBUTION_MAX_ENUM>::Entry distributionsEntries[];
 	static StringMap<AreaSpreadDistribution, DISTRIBUTION_MAX_ENUM> distributions;
@@ -39,11 +39,13 @@ namespace opengl
 
 void Polyline::render(const float *coords, size_t count, size_t size_hint, float halfwidth, float pixel_size, bool draw_overdraw)
 {
-	static std::vector<Vector> anchors;
-	anchors.clear();
-	anchors.reserve(size_hint);
+	// The arena keeps its capacity, so this only allocates when a line is
+	// longer than any drawn before.
+	std::vector<Vector> &sleeve = arena.vertices;
+	std::vector<Vector> &normals = arena.normals;
 
-	static std::vector<Vector> normals;
+	sleeve.clear();
+	sleeve.reserve(size_hint);
 	normals.clear();
 	normals.reserve(size_hint);
 
@@ -67,39 +69,33 @@ void Polyline::render(const float *coords, size_t count, size_t size_hint, float
 	{
 		q = r;
 		r = Vector(coords[i + 2], coords[i + 3]);
-		renderEdge(anchors, normals, s, len_s, ns, q, r, halfwidth);
+		renderEdge(sleeve, normals, s, len_s, ns, q, r, halfwidth);
 	}
 
 	q = r;
 	r = is_looping ? Vector(coords[2], coords[3]) : r + s;
-	renderEdge(anchors, normals, s, len_s, ns, q, r, halfwidth);
+	renderEdge(sleeve, normals, s, len_s, ns, q, r, halfwidth);
 
-	vertex_count = normals.size();
-	vertices = new Vector[vertex_count];
-	for (size_t i = 0; i < vertex_count; ++i)
-		vertices[i] = anchors[i] + normals[i];
+	vertex_count = sleeve.size();
+	vertices = &sleeve[0];
 
 	if (draw_overdraw)
 		render_overdraw(normals, pixel_size, is_looping);
 }
 
-void NoneJoinPolyline::renderEdge(std::vector<Vector> &anchors, std::vector<Vector> &normals,
+void NoneJoinPolyline::renderEdge(std::vector<Vector> &sleeve, std::vector<Vector> &normals,
                                 Vector &s, float &len_s, Vector &ns,
                                 const Vector &q, const Vector &r, float hw)
 {
-	anchors.push_back(q);
-	anchors.push_back(q);
-	normals.push_back(ns);
-	normals.push_back(-ns);
+	addEdgeVertex(sleeve, normals, q, ns);
+	addEdgeVertex(sleeve, normals, q, -ns);
 
 	s     = (r - q);
 	len_s = s.getLength();
 	ns    = s.getNormal(hw / len_s);
 
-	anchors.push_back(q);
-	anchors.push_back(q);
-	normals.push_back(-ns);
-	normals.push_back(ns);
+	addEdgeVertex(sleeve, normals, q, -ns);
+	addEdgeVertex(sleeve, normals, q, ns);
 }
 
 
@@ -140,7 +136,7 @@ void NoneJoinPolyline::renderEdge(std::vector<Vector> &anchors, std::vector<Vect
  *
  * the intersection points can be efficiently calculated using Cramer's rule.
  */
-void MiterJoinPolyline::renderEdge(std::vector<Vector> &anchors, std::vector<Vector> &normals,
+void MiterJoinPolyline::renderEdge(std::vector<Vector> &sleeve, std::vector<Vector> &normals,
                                    Vector &s, float &len_s, Vector &ns,
                                    const Vector &q, const Vector &r, float hw)
 {
@@ -148,23 +144,20 @@ void MiterJoinPolyline::renderEdge(std::vector<Vector> &anchors, std::vector<Vec
 	float len_t = t.getLength();
 	Vector nt   = t.getNormal(hw / len_t);
 
-	anchors.push_back(q);
-	anchors.push_back(q);
-
 	float det = s ^ t;
 	if (fabs(det) / (len_s * len_t) < LINES_PARALLEL_EPS && s * t > 0)
 	{
 		// lines parallel, compute as u1 = q + ns * w/2, u2 = q - ns * w/2
-		normals.push_back(ns);
-		normals.push_back(-ns);
+		addEdgeVertex(sleeve, normals, q, ns);
+		addEdgeVertex(sleeve, normals, q, -ns);
 	}
 	else
 	{
 		// cramers rule
 		float lambda = ((nt - ns) ^ t) / det;
 		Vector d = ns + s * lambda;
-		normals.push_back(d);
-		normals.push_back(-d);
+		addEdgeVertex(sleeve, normals, q, d);
+		addEdgeVertex(sleeve, normals, q, -d);
 	}
 
 	s     = t;
@@ -189,7 +182,7 @@ void MiterJoinPolyline::renderEdge(std::vector<Vector> &anchors, std::vector<Vec
  *
  * uh1 = q + ns * w/2, uh2 = q + nt * w/2
  */
-void BevelJoinPolyline::renderEdge(std::vector<Vector> &anchors, std::vector<Vector> &normals,
+void BevelJoinPolyline::renderEdge(std::vector<Vector> &sleeve, std::vector<Vector> &normals,
                                    Vector &s, float &len_s, Vector &ns,
                                    const Vector &q, const Vector &r, float hw)
 {
@@ -201,10 +194,8 @@ void BevelJoinPolyline::renderEdge(std::vector<Vector> &anchors, std::vector<Vec
 	{
 		// lines parallel, compute as u1 = q + ns * w/2, u2 = q - ns * w/2
 		Vector n = t.getNormal(hw / len_t);
-		anchors.push_back(q);
-		anchors.push_back(q);
-		normals.push_back(n);
-		normals.push_back(-n);
+		addEdgeVertex(sleeve, normals, q, n);
+		addEdgeVertex(sleeve, normals, q, -n);
 		s     = t;
 		len_s = len_t;
 		return; // early out
@@ -215,23 +206,19 @@ void BevelJoinPolyline::renderEdge(std::vector<Vector> &anchors, std::vector<Vec
 	float lambda = ((nt - ns) ^ t) / det;
 	Vector d = ns + s * lambda;
 
-	anchors.push_back(q);
-	anchors.push_back(q);
-	anchors.push_back(q);
-	anchors.push_back(q);
 	if (det > 0) // 'left' turn -> intersection on the top
 	{
-		normals.push_back(d);
-		normals.push_back(-ns);
-		normals.push_back(d);
-		normals.push_back(-nt);
+		addEdgeVertex(sleeve, normals, q, d);
+		addEdgeVertex(sleeve, normals, q, -ns);
+		addEdgeVertex(sleeve, normals, q, d);
+		addEdgeVertex(sleeve, normals, q, -nt);
 	}
 	else
 	{
-		normals.push_back(ns);
-		normals.push_back(-d);
-		normals.push_back(nt);
-		normals.push_back(-d);
+		addEdgeVertex(sleeve, normals, q, ns);
+		addEdgeVertex(sleeve, normals, q, -d);
+		addEdgeVertex(sleeve, normals, q, nt);
+		addEdgeVertex(sleeve, normals, q, -d);
 	}
 	s     = t;
 	len_s = len_t;
@@ -241,7 +228,8 @@ void BevelJoinPolyline::renderEdge(std::vector<Vector> &anchors, std::vector<Vec
 void Polyline::render_overdraw(const std::vector<Vector> &normals, float pixel_size, bool is_looping)
 {
 	overdraw_vertex_count = 2 * vertex_count + (is_looping ? 0 : 2);
-	overdraw = new Vector[overdraw_vertex_count];
+	arena.overdraw.resize(overdraw_vertex_count);
+	overdraw = &arena.overdraw[0];
 	// upper segment
 	for (size_t i = 0; i + 1 < vertex_count; i += 2)
 	{
@@ -287,7 +275,8 @@ void Polyline::render_overdraw(const std::vector<Vector> &normals, float pixel_s
 void NoneJoinPolyline::render_overdraw(const std::vector<Vector> &/*normals*/, float pixel_size, bool /*is_looping*/)
 {
 	overdraw_vertex_count = 4 * (vertex_count-2); // less than ideal
-	overdraw = new Vector[overdraw_vertex_count];
+	arena.overdraw.resize(overdraw_vertex_count);
+	overdraw = &arena.overdraw[0];
 	for (size_t i = 2; i + 3 < vertex_count; i += 4)
 	{
 		Vector s = vertices[i] - vertices[i+3];
@@ -318,91 +307,21 @@ void NoneJoinPolyline::render_overdraw(const std::vector<Vector> &/*normals*/, f
 	}
 }
 
-Polyline::~Polyline()
-{
-	if (vertices)
-		delete[] vertices;
-	if (overdraw)
-		delete[] overdraw;
-}
-
-void Polyline::draw()
+void Polyline::draw(PrimitiveBatch &batch)
 {
-	OpenGL::TempDebugGroup debuggroup("Line draw");
-
-	GLushort *indices = nullptr;
-
-	// TODO: We should probably be using a reusable index buffer.
-	if (use_quad_indices)
-	{
-		size_t numindices = (vertex_count / 4) * 6;
-		if (overdraw)
-			numindices = std::max(numindices, (overdraw_vertex_count / 4) * 6);
-
-		try
-		{
-			indices = new GLushort[numindices];
-		}
-		catch (std::bad_alloc &)
-		{
-			throw love::Exception("Out of memory.");
-		}
-
-		// Fill the index array to make 2 triangles from each quad.
-		// NOTE: The triangle vertex ordering here is important!
-		for (size_t i = 0; i < numindices / 6; i++)
-		{
-			// First triangle.
-			indices[i * 6 + 0] = GLushort(i * 4 + 0);
-			indices[i * 6 + 1] = GLushort(i * 4 + 1);
-			indices[i * 6 + 2] = GLushort(i * 4 + 2);
-
-			// Second triangle.
-			indices[i * 6 + 3] = GLushort(i * 4 + 0);
-			indices[i * 6 + 4] = GLushort(i * 4 + 2);
-			indices[i * 6 + 5] = GLushort(i * 4 + 3);
-		}
-	}
-
-	gl.prepareDraw();
+	PrimitiveBatch::Primitive primitive = use_quad_indices ? PrimitiveBatch::PRIMITIVE_QUADS : PrimitiveBatch::PRIMITIVE_STRIP;
 
 	// draw the core line
-	gl.bindTexture(gl.getDefaultTexture());
-	glEnableVertexAttribArray(ATTRIB_POS);
-	glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, vertices);
-
-	if (use_quad_indices)
-		gl.drawElements(draw_mode, (int) (vertex_count / 4) * 6, GL_UNSIGNED_SHORT, indices);
-	else
-		gl.drawArrays(draw_mode, 0, (int) vertex_count);
+	batch.add(primitive, (const float *) vertices, vertex_count);
 
 	if (overdraw)
 	{
 		// prepare colors:
-		Color c = gl.getColor();
-		Color *colors = new Color[overdraw_vertex_count];
-		fill_color_array(colors, c);
-
-		glEnableVertexAttribArray(ATTRIB_COLOR);
-		glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, colors);
-		glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, overdraw);
-
-		if (use_quad_indices)
-			gl.drawElements(draw_mode, (int) (overdraw_vertex_count / 4) * 6, GL_UNSIGNED_SHORT, indices);
-		else
-			gl.drawArrays(draw_mode, 0, (int) overdraw_vertex_count);
+		arena.colors.resize(overdraw_vertex_count);
+		fill_color_array(&arena.colors[0], gl.getColor());
 
-		glDisableVertexAttribArray(ATTRIB_COLOR);
-
-		delete[] colors;
-
-		gl.setColor(c);
+		batch.add(primitive, (const float *) overdraw, overdraw_vertex_count, &arena.colors[0]);
 	}
-
-	glDisableVertexAttribArray(ATTRIB_POS);
-
-	if (indices)
-		delete[] indices;
 }
 
 void Polyline::fill_color_array(Color *colors, const Color &c)
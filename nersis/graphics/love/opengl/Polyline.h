@@ -27,6 +27,7 @@
 
 // OpenGL
 #include "OpenGL.h"
+#include "PrimitiveBatch.h"
 
 // C++
 #include <vector>
@@ -45,15 +46,28 @@ namespace opengl
 class Polyline
 {
 public:
-	Polyline(GLenum mode = GL_TRIANGLE_STRIP, bool quadindices = false)
-		: vertices(NULL)
+	/**
+	 * Scratch memory for tessellating lines. Graphics owns one and reuses it
+	 * for every line, so the vectors only grow when a line is longer than any
+	 * drawn before and drawing a line doesn't allocate otherwise.
+	 **/
+	struct Arena
+	{
+		std::vector<Vector> vertices;
+		std::vector<Vector> normals;
+		std::vector<Vector> overdraw;
+		std::vector<Color> colors;
+	};
+
+	Polyline(Arena &arena, bool quadindices = false)
+		: arena(arena)
+		, vertices(NULL)
 		, overdraw(NULL)
 		, vertex_count(0)
 		, overdraw_vertex_count(0)
-		, draw_mode(mode)
 		, use_quad_indices(quadindices)
 	{}
-	virtual ~Polyline();
+	virtual ~Polyline() {}
 
 	/**
 	 * @param vertices      Vertices defining the core line segments
@@ -65,9 +79,9 @@ public:
 	 */
 	void render(const float *vertices, size_t count, size_t size_hint, float halfwidth, float pixel_size, bool draw_overdraw);
 
-	/** Draws the line on the screen
+	/** Adds the line to a batch of primitives
 	 */
-	void draw();
+	void draw(PrimitiveBatch &batch);
 
 protected:
 	virtual void render_overdraw(const std::vector<Vector> &normals, float pixel_size, bool is_looping);
@@ -75,7 +89,7 @@ protected:
 
 	/** Calculate line boundary points.
 	 *
-	 * @param[out]    anchors Anchor points defining the core line.
+	 * @param[out]    sleeve  Vertices of the sleeve around the core line.
 	 * @param[out]    normals Normals defining the edge of the sleeve.
 	 * @param[in,out] s       Direction of segment pq (updated to the segment qr).
 	 * @param[in,out] len_s   Length of segment pq (updated to the segment qr).
@@ -84,15 +98,22 @@ protected:
 	 * @param[in]     r       Next point on the line.
 	 * @param[in]     hw      Half line width (see Polyline.render()).
 	 */
-	virtual void renderEdge(std::vector<Vector> &anchors, std::vector<Vector> &normals,
+	virtual void renderEdge(std::vector<Vector> &sleeve, std::vector<Vector> &normals,
 	                        Vector &s, float &len_s, Vector &ns,
 	                        const Vector &q, const Vector &r, float hw) = 0;
 
+	// Adds the sleeve vertex at anchor q displaced by the normal n.
+	static void addEdgeVertex(std::vector<Vector> &sleeve, std::vector<Vector> &normals, const Vector &q, const Vector &n)
+	{
+		sleeve.push_back(q + n);
+		normals.push_back(n);
+	}
+
+	Arena &arena;
 	Vector *vertices;
 	Vector *overdraw;
 	size_t vertex_count;
 	size_t overdraw_vertex_count;
-	GLenum draw_mode;
 	bool use_quad_indices;
 
 }; // Polyline
@@ -105,23 +126,22 @@ protected:
 class NoneJoinPolyline : public Polyline
 {
 public:
-	NoneJoinPolyline()
-		: Polyline(GL_TRIANGLES, true)
+	NoneJoinPolyline(Arena &arena)
+		: Polyline(arena, true)
 	{}
 
 	void render(const float *vertices, size_t count, float halfwidth, float pixel_size, bool draw_overdraw)
 	{
 		Polyline::render(vertices, count, 2 * count - 4, halfwidth, pixel_size, draw_overdraw);
 		// discard the first and last two vertices. (these are redundant)
-		for (size_t i = 0; i < vertex_count - 2; ++i)
-			this->vertices[i] = this->vertices[i+2];
-		vertex_count -= 2;
+		this->vertices += 2;
+		vertex_count -= 4;
 	}
 
 protected:
 	virtual void render_overdraw(const std::vector<Vector> &normals, float pixel_size, bool is_looping);
 	virtual void fill_color_array(Color *colors, const Color &c);
-	virtual void renderEdge(std::vector<Vector> &anchors, std::vector<Vector> &normals,
+	virtual void renderEdge(std::vector<Vector> &sleeve, std::vector<Vector> &normals,
 	                        Vector &s, float &len_s, Vector &ns,
 	                        const Vector &q, const Vector &r, float hw);
 };
@@ -134,13 +154,17 @@ protected:
 class MiterJoinPolyline : public Polyline
 {
 public:
+	MiterJoinPolyline(Arena &arena)
+		: Polyline(arena)
+	{}
+
 	void render(const float *vertices, size_t count, float halfwidth, float pixel_size, bool draw_overdraw)
 	{
 		Polyline::render(vertices, count, count, halfwidth, pixel_size, draw_overdraw);
 	}
 
 protected:
-	virtual void renderEdge(std::vector<Vector> &anchors, std::vector<Vector> &normals,
+	virtual void renderEdge(std::vector<Vector> &sleeve, std::vector<Vector> &normals,
 	                        Vector &s, float &len_s, Vector &ns,
 	                        const Vector &q, const Vector &r, float hw);
 };
@@ -153,13 +177,17 @@ protected:
 class BevelJoinPolyline : public Polyline
 {
 public:
+	BevelJoinPolyline(Arena &arena)
+		: Polyline(arena)
+	{}
+
 	void render(const float *vertices, size_t count, float halfwidth, float pixel_size, bool draw_overdraw)
 	{
 		Polyline::render(vertices, count, 2 * count - 4, halfwidth, pixel_size, draw_overdraw);
 	}
 
 protected:
-	virtual void renderEdge(std::vector<Vector> &anchors, std::vector<Vector> &normals,
+	virtual void renderEdge(std::vector<Vector> &sleeve, std::vector<Vector> &normals,
 	                        Vector &s, float &len_s, Vector &ns,
 	                        const Vector &q, const Vector &r, float hw);
 };
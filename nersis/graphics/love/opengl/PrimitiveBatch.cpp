@@ -0,0 +1,313 @@
+/**
+ * Copyright (c) 2006-2015 LOVE Development Team
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#include "PrimitiveBatch.h"
+#include "RenderQueue.h"
+
+// C++
+#include <algorithm>
+
+// C
+#include <cstddef>
+#include <cstring>
+
+namespace love
+{
+namespace graphics
+{
+namespace opengl
+{
+
+const size_t PrimitiveBatch::MAX_VERTICES;
+const size_t PrimitiveBatch::MAX_INDICES;
+
+PrimitiveBatch *PrimitiveBatch::current = nullptr;
+
+PrimitiveBatch::PrimitiveBatch()
+	: vertexBuffer(nullptr)
+	, indexBuffer(nullptr)
+	, vertices(nullptr)
+	, indices(nullptr)
+	, vertexCount(0)
+	, indexCount(0)
+	, mode(GL_TRIANGLES)
+	, transform()
+{
+	vertexBuffer = new GLBuffer(sizeof(ColoredVertex) * MAX_VERTICES, nullptr, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW, GLBuffer::MAP_STREAM);
+
+	try
+	{
+		indexBuffer = new GLBuffer(sizeof(GLushort) * MAX_INDICES, nullptr, GL_ELEMENT_ARRAY_BUFFER, GL_DYNAMIC_DRAW, GLBuffer::MAP_STREAM);
+	}
+	catch (love::Exception &)
+	{
+		delete vertexBuffer;
+		throw;
+	}
+}
+
+PrimitiveBatch::~PrimitiveBatch()
+{
+	if (current == this)
+		current = nullptr;
+
+	delete vertexBuffer;
+	delete indexBuffer;
+}
+
+void PrimitiveBatch::add(Primitive primitive, const float *coords, size_t vertexcount, const Color *colors)
+{
+	// Queued draws were added before this primitive, so they're drawn first.
+	RenderQueue::flushCurrent();
+
+	switch (primitive)
+	{
+	case PRIMITIVE_POINTS:
+		addPoints(coords, vertexcount, colors);
+		break;
+	case PRIMITIVE_FAN:
+		addFan(coords, vertexcount, colors);
+		break;
+	case PRIMITIVE_STRIP:
+		addStrip(coords, vertexcount, colors);
+		break;
+	case PRIMITIVE_QUADS:
+		addQuads(coords, vertexcount, colors);
+		break;
+	default:
+		break;
+	}
+}
+
+void PrimitiveBatch::flush()
+{
+	if (vertexCount == 0)
+		return;
+
+	OpenGL::TempDebugGroup debuggroup("Primitive batch draw");
+
+	// prepareDraw may send uniforms to the active shader, which flushes the
+	// current batch. The counts are reset first so that doesn't recurse.
+	size_t vcount = vertexCount;
+	size_t icount = indexCount;
+
+	vertexCount = 0;
+	indexCount = 0;
+
+	OpenGL::TempTransform temptransform(gl);
+	temptransform.get() = transform;
+
+	gl.prepareDraw();
+	gl.bindTexture(gl.getDefaultTexture());
+
+	GLBuffer::Bind vbobind(*vertexBuffer);
+	vertexBuffer->unmap(0, vcount * sizeof(ColoredVertex));
+
+	glEnableVertexAttribArray(ATTRIB_POS);
+	glEnableVertexAttribArray(ATTRIB_COLOR);
+
+	glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex), vertexBuffer->getPointer(offsetof(ColoredVertex, x)));
+	glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ColoredVertex), vertexBuffer->getPointer(offsetof(ColoredVertex, color)));
+
+	if (mode == GL_POINTS)
+		gl.drawArrays(GL_POINTS, 0, (GLsizei) vcount);
+	else
+	{
+		GLBuffer::Bind ibobind(*indexBuffer);
+		indexBuffer->unmap(0, icount * sizeof(GLushort));
+
+		gl.drawElements(mode, (GLsizei) icount, GL_UNSIGNED_SHORT, indexBuffer->getPointer(0));
+	}
+
+	glDisableVertexAttribArray(ATTRIB_COLOR);
+	glDisableVertexAttribArray(ATTRIB_POS);
+
+	// Disabling the color array leaves the constant color undefined.
+	gl.setColor(gl.getColor());
+}
+
+bool PrimitiveBatch::isPending() const
+{
+	return vertexCount > 0;
+}
+
+void PrimitiveBatch::flushCurrent()
+{
+	RenderQueue::flushCurrent();
+
+	if (current != nullptr && current->vertexCount > 0)
+		current->flush();
+}
+
+size_t PrimitiveBatch::reserve(GLenum drawmode, size_t vertexcount, size_t indexcount)
+{
+	const Matrix &curxform = gl.getTransform();
+
+	if (vertexCount > 0)
+	{
+		if (drawmode != mode
+			|| vertexCount + vertexcount > MAX_VERTICES
+			|| indexCount + indexcount > MAX_INDICES
+			|| memcmp(curxform.getElements(), transform.getElements(), sizeof(float) * 16) != 0)
+		{
+			flush();
+		}
+	}
+
+	if (vertexCount == 0)
+	{
+		mode = drawmode;
+		transform = curxform;
+
+		// The buffers are only mapped while the batch has vertices: a mapped
+		// GLBuffer can't be bound, so it couldn't be reloaded.
+		vertices = (ColoredVertex *) vertexBuffer->map();
+		indices = (GLushort *) indexBuffer->map();
+	}
+
+	size_t first = vertexCount;
+	vertexCount += vertexcount;
+
+	return first;
+}
+
+void PrimitiveBatch::setVertices(size_t first, const float *coords, size_t count, const Color *colors)
+{
+	ColoredVertex *v = vertices + first;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		v[i].x = coords[i * 2 + 0];
+		v[i].y = coords[i * 2 + 1];
+	}
+
+	if (colors != nullptr)
+	{
+		for (size_t i = 0; i < count; i++)
+			v[i].color = colors[i];
+	}
+	else
+	{
+		Color c = gl.getColor();
+		for (size_t i = 0; i < count; i++)
+			v[i].color = c;
+	}
+}
+
+void PrimitiveBatch::addPoints(const float *coords, size_t count, const Color *colors)
+{
+	for (size_t start = 0; start < count;)
+	{
+		size_t n = std::min(count - start, MAX_VERTICES);
+		size_t first = reserve(GL_POINTS, n, 0);
+
+		setVertices(first, coords + start * 2, n, colors ? colors + start : nullptr);
+
+		start += n;
+	}
+}
+
+void PrimitiveBatch::addFan(const float *coords, size_t count, const Color *colors)
+{
+	// Fans which don't fit in one batch are split into smaller fans which all
+	// start with the first vertex.
+	for (size_t start = 1; start + 1 < count;)
+	{
+		size_t n = std::min(count - start, MAX_VERTICES - 1);
+		size_t first = reserve(GL_TRIANGLES, n + 1, (n - 1) * 3);
+
+		setVertices(first, coords, 1, colors);
+		setVertices(first + 1, coords + start * 2, n, colors ? colors + start : nullptr);
+
+		GLushort *idx = indices + indexCount;
+		for (size_t i = 0; i < n - 1; i++)
+		{
+			idx[i * 3 + 0] = GLushort(first);
+			idx[i * 3 + 1] = GLushort(first + i + 1);
+			idx[i * 3 + 2] = GLushort(first + i + 2);
+		}
+
+		indexCount += (n - 1) * 3;
+		start += n - 1;
+	}
+}
+
+void PrimitiveBatch::addStrip(const float *coords, size_t count, const Color *colors)
+{
+	for (size_t start = 0; start + 2 < count;)
+	{
+		size_t n = std::min(count - start, MAX_VERTICES);
+
+		// Split strips at even vertices so every triangle keeps the vertex
+		// order it has in a GL_TRIANGLE_STRIP.
+		if (start + n < count)
+			n &= ~(size_t) 1;
+
+		size_t first = reserve(GL_TRIANGLES, n, (n - 2) * 3);
+
+		setVertices(first, coords + start * 2, n, colors ? colors + start : nullptr);
+
+		GLushort *idx = indices + indexCount;
+		for (size_t i = 0; i < n - 2; i++)
+		{
+			size_t odd = i & 1;
+			idx[i * 3 + 0] = GLushort(first + i + odd);
+			idx[i * 3 + 1] = GLushort(first + i + 1 - odd);
+			idx[i * 3 + 2] = GLushort(first + i + 2);
+		}
+
+		indexCount += (n - 2) * 3;
+		start += n - 2;
+	}
+}
+
+void PrimitiveBatch::addQuads(const float *coords, size_t count, const Color *colors)
+{
+	size_t quads = count / 4;
+
+	for (size_t start = 0; start < quads;)
+	{
+		size_t n = std::min(quads - start, MAX_VERTICES / 4);
+		size_t first = reserve(GL_TRIANGLES, n * 4, n * 6);
+
+		setVertices(first, coords + start * 8, n * 4, colors ? colors + start * 4 : nullptr);
+
+		GLushort *idx = indices + indexCount;
+		for (size_t i = 0; i < n; i++)
+		{
+			GLushort v = GLushort(first + i * 4);
+
+			idx[i * 6 + 0] = v + 0;
+			idx[i * 6 + 1] = v + 1;
+			idx[i * 6 + 2] = v + 2;
+
+			idx[i * 6 + 3] = v + 0;
+			idx[i * 6 + 4] = v + 2;
+			idx[i * 6 + 5] = v + 3;
+		}
+
+		indexCount += n * 6;
+		start += n;
+	}
+}
+
+} // opengl
+} // graphics
+} // love
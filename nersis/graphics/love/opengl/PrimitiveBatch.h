@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2006-2015 LOVE Development Team
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#ifndef LOVE_GRAPHICS_OPENGL_PRIMITIVE_BATCH_H
+#define LOVE_GRAPHICS_OPENGL_PRIMITIVE_BATCH_H
+
+// LOVE
+#include "common/config.h"
+#include "common/Matrix.h"
+#include "graphics/Color.h"
+#include "OpenGL.h"
+#include "GLBuffer.h"
+
+namespace love
+{
+namespace graphics
+{
+namespace opengl
+{
+
+/**
+ * Collects the vertices of consecutive untextured primitives (points, filled
+ * polygons, lines) into one streamed vertex and index buffer, so they can be
+ * drawn with a single draw call.
+ *
+ * The vertices are stored untransformed along with the color that was active
+ * when they were added. Adding a primitive with a different draw mode or
+ * transform flushes the batch first. Everything else a batch depends on
+ * (shader, blend mode, canvas, scissor, stencil, color mask, wireframe, point
+ * size) must flush it before it changes, which is what flushCurrent is for.
+ **/
+class PrimitiveBatch
+{
+public:
+
+	// How the vertices passed to add are connected.
+	enum Primitive
+	{
+		PRIMITIVE_POINTS,
+		PRIMITIVE_FAN,
+		PRIMITIVE_STRIP,
+		PRIMITIVE_QUADS, // 0-1-2, 0-2-3 for each group of 4 vertices.
+		PRIMITIVE_MAX_ENUM
+	};
+
+	struct ColoredVertex
+	{
+		float x, y;
+		Color color;
+	};
+
+	// Vertex indices are 16 bit, which limits the size of one batch.
+	static const size_t MAX_VERTICES = 65535;
+	static const size_t MAX_INDICES = MAX_VERTICES * 3;
+
+	// The batch that flushCurrent flushes. Set by Graphics.
+	static PrimitiveBatch *current;
+
+	PrimitiveBatch();
+	~PrimitiveBatch();
+
+	/**
+	 * Adds a primitive to the batch. Primitives with more vertices than fit
+	 * in one batch are split over several draws.
+	 *
+	 * @param primitive How the vertices are connected.
+	 * @param coords Vertex positions (x1, y1, x2, y2, ...)
+	 * @param vertexcount The number of vertices (half the size of coords.)
+	 * @param colors Per-vertex colors, or null to use the current color.
+	 **/
+	void add(Primitive primitive, const float *coords, size_t vertexcount, const Color *colors = nullptr);
+
+	/**
+	 * Draws everything added since the last flush.
+	 **/
+	void flush();
+
+	/**
+	 * Returns true if there are vertices waiting to be drawn.
+	 **/
+	bool isPending() const;
+
+	/**
+	 * Flushes the current render queue and batch, if there are any. Must be
+	 * called before any OpenGL state a pending batch depends on is changed,
+	 * and before anything else is drawn. Shader and blend mode changes only
+	 * have to flush the batch, since queued draws record those.
+	 **/
+	static void flushCurrent();
+
+private:
+
+	/**
+	 * Makes room for vertexcount vertices and indexcount indices drawn with
+	 * the specified mode, flushing first if needed.
+	 *
+	 * @return The index of the first reserved vertex.
+	 **/
+	size_t reserve(GLenum mode, size_t vertexcount, size_t indexcount);
+
+	void addPoints(const float *coords, size_t count, const Color *colors);
+	void addFan(const float *coords, size_t count, const Color *colors);
+	void addStrip(const float *coords, size_t count, const Color *colors);
+	void addQuads(const float *coords, size_t count, const Color *colors);
+
+	void setVertices(size_t first, const float *coords, size_t count, const Color *colors);
+
+	GLBuffer *vertexBuffer;
+	GLBuffer *indexBuffer;
+
+	// Mapped contents of the buffers.
+	ColoredVertex *vertices;
+	GLushort *indices;
+
+	size_t vertexCount;
+	size_t indexCount;
+
+	// State shared by every vertex in the batch.
+	GLenum mode;
+	Matrix transform;
+
+}; // PrimitiveBatch
+
+} // opengl
+} // graphics
+} // love
+
+#endif // LOVE_GRAPHICS_OPENGL_PRIMITIVE_BATCH_H
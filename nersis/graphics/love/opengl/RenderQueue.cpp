@@ -0,0 +1,406 @@
+/**
+ * Copyright (c) 2006-2015 LOVE Development Team
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#include "RenderQueue.h"
+#include "Graphics.h"
+#include "PrimitiveBatch.h"
+
+// C++
+#include <algorithm>
+
+// C
+#include <cstddef>
+#include <cstring>
+
+namespace love
+{
+namespace graphics
+{
+namespace opengl
+{
+
+// Layout of the sort keys, from the most significant bit down.
+static const int KEY_LAYER_SHIFT = 48;
+static const int KEY_SHADER_SHIFT = 36;
+static const int KEY_TEXTURE_SHIFT = 20;
+static const int KEY_BLEND_SHIFT = 16;
+
+static const size_t MAX_SHADER_IDS = 1 << (KEY_LAYER_SHIFT - KEY_SHADER_SHIFT);
+static const size_t MAX_TEXTURE_IDS = 1 << (KEY_SHADER_SHIFT - KEY_TEXTURE_SHIFT);
+
+// The bits which have to match for two draws to be drawn with the same state.
+static const uint64 KEY_STATE_MASK = ((1ULL << (KEY_LAYER_SHIFT - KEY_BLEND_SHIFT)) - 1) << KEY_BLEND_SHIFT;
+
+static const uint64 KEY_INDEX_MASK = (1ULL << KEY_BLEND_SHIFT) - 1;
+
+const int RenderQueue::MIN_LAYER;
+const int RenderQueue::MAX_LAYER;
+const size_t RenderQueue::MAX_COMMANDS;
+const size_t RenderQueue::MAX_QUADS;
+
+RenderQueue *RenderQueue::current = nullptr;
+
+RenderQueue::RenderQueue(Graphics *graphics)
+	: graphics(graphics)
+	, enabled(false)
+	, flushing(false)
+	, layer(0)
+	, vertexBuffer(nullptr)
+	, indexBuffer(nullptr)
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+	if (current == this)
+		current = nullptr;
+
+	delete vertexBuffer;
+	delete indexBuffer;
+}
+
+void RenderQueue::setEnabled(bool enable)
+{
+	if (!enable)
+		flush();
+
+	enabled = enable;
+}
+
+bool RenderQueue::isEnabled() const
+{
+	return enabled;
+}
+
+void RenderQueue::setLayer(int layer)
+{
+	if (layer < MIN_LAYER || layer > MAX_LAYER)
+		throw love::Exception("Invalid draw layer: %d (must be between %d and %d.)", layer, MIN_LAYER, MAX_LAYER);
+
+	this->layer = layer;
+}
+
+int RenderQueue::getLayer() const
+{
+	return layer;
+}
+
+bool RenderQueue::isRecording() const
+{
+	return enabled && !flushing;
+}
+
+RenderQueue::Command &RenderQueue::addCommand(Object *object, GLuint gltexture)
+{
+	if (commands.size() >= MAX_COMMANDS || shaderIDs.size() >= MAX_SHADER_IDS || textureIDs.size() >= MAX_TEXTURE_IDS)
+		flush();
+
+	// Primitives added before this draw have to be drawn before it.
+	if (PrimitiveBatch::current != nullptr)
+		PrimitiveBatch::current->flush();
+
+	Shader *shader = Shader::current;
+
+	auto shaderid = shaderIDs.insert(std::make_pair(shader, (uint64) shaderIDs.size()));
+	if (shaderid.second)
+		shaders.push_back(shader);
+
+	auto textureid = textureIDs.insert(std::make_pair(gltexture, (uint64) textureIDs.size()));
+
+	Graphics::BlendMode blendmode = graphics->getBlendMode();
+
+	uint64 key = (uint64) (layer - MIN_LAYER) << KEY_LAYER_SHIFT;
+	key |= shaderid.first->second << KEY_SHADER_SHIFT;
+	key |= textureid.first->second << KEY_TEXTURE_SHIFT;
+	key |= (uint64) blendmode << KEY_BLEND_SHIFT;
+	key |= (uint64) commands.size();
+
+	keys.push_back(key);
+
+	Command cmd;
+	cmd.object.set(object);
+	cmd.shader = shader;
+	cmd.blendMode = blendmode;
+	cmd.texture = gltexture;
+	cmd.color = gl.getColor();
+	cmd.index = 0;
+	cmd.quad = false;
+	cmd.quadCount = 0;
+
+	commands.push_back(std::move(cmd));
+
+	return commands.back();
+}
+
+void RenderQueue::addQuads(Object *object, GLuint gltexture, const Matrix &t, const Vertex *v, size_t count)
+{
+	// Merged quads can have different transforms, so they're drawn with the
+	// identity matrix instead.
+	Matrix m = gl.getTransform() * t;
+
+	while (count > 0)
+	{
+		Command &cmd = addCommand(object, gltexture);
+
+		cmd.quad = true;
+		cmd.quadCount = std::min(count, MAX_QUADS);
+		cmd.index = quadVertices.size();
+
+		size_t vertexcount = cmd.quadCount * 4;
+
+		quadVertices.insert(quadVertices.end(), v, v + vertexcount);
+
+		Vertex *verts = &quadVertices[cmd.index];
+
+		for (size_t i = 0; i < vertexcount; i++)
+		{
+			verts[i].r = cmd.color.r;
+			verts[i].g = cmd.color.g;
+			verts[i].b = cmd.color.b;
+			verts[i].a = cmd.color.a;
+		}
+
+		m.transform(verts, verts, (int) vertexcount);
+
+		v += vertexcount;
+		count -= cmd.quadCount;
+	}
+}
+
+void RenderQueue::add(Drawable *drawable, GLuint gltexture, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky)
+{
+	Command &cmd = addCommand(drawable, gltexture);
+
+	cmd.index = drawables.size();
+
+	DrawableParams params = {gl.getTransform(), x, y, angle, sx, sy, ox, oy, kx, ky};
+	drawables.push_back(params);
+
+	queuedDrawables.insert(drawable);
+}
+
+void RenderQueue::flush()
+{
+	if (commands.empty() || flushing)
+		return;
+
+	OpenGL::TempDebugGroup debuggroup("Render queue flush");
+
+	// Draws done from here on shouldn't be queued again, and the state
+	// changes they do shouldn't flush the queue.
+	flushing = true;
+
+	Shader *prevshader = Shader::current;
+	Graphics::BlendMode prevblendmode = graphics->getBlendMode();
+	Color prevcolor = gl.getColor();
+
+	// The index of each command is in the lowest bits of its key, so sorting
+	// the keys sorts the commands.
+	std::sort(keys.begin(), keys.end());
+
+	try
+	{
+		for (size_t i = 0; i < keys.size();)
+		{
+			const Command &cmd = commands[keys[i] & KEY_INDEX_MASK];
+
+			if (Shader::current != cmd.shader && cmd.shader != nullptr)
+				cmd.shader->attach();
+
+			if (graphics->getBlendMode() != cmd.blendMode)
+				graphics->setBlendMode(cmd.blendMode);
+
+			if (cmd.quad)
+			{
+				// Quads with the same state which follow this one are drawn
+				// with it.
+				size_t last = i + 1;
+				while (last < keys.size() && (keys[last] & KEY_STATE_MASK) == (keys[i] & KEY_STATE_MASK)
+				       && commands[keys[last] & KEY_INDEX_MASK].quad)
+				{
+					last++;
+				}
+
+				drawQuads(i, last);
+				i = last;
+			}
+			else
+			{
+				const DrawableParams &p = drawables[cmd.index];
+
+				gl.setColor(cmd.color);
+
+				OpenGL::TempTransform transform(gl);
+				transform.get() = p.transform;
+
+				Drawable *drawable = (Drawable *) cmd.object.get();
+				drawable->draw(p.x, p.y, p.angle, p.sx, p.sy, p.ox, p.oy, p.kx, p.ky);
+
+				i++;
+			}
+		}
+	}
+	catch (love::Exception &)
+	{
+		clearCommands();
+		flushing = false;
+		throw;
+	}
+
+	// Put the state back the way it was when the draws were added.
+	if (Shader::current != prevshader && prevshader != nullptr)
+		prevshader->attach();
+
+	if (graphics->getBlendMode() != prevblendmode)
+		graphics->setBlendMode(prevblendmode);
+
+	gl.setColor(prevcolor);
+
+	clearCommands();
+	flushing = false;
+}
+
+void RenderQueue::clearCommands()
+{
+	commands.clear();
+	keys.clear();
+	quadVertices.clear();
+	drawables.clear();
+	queuedDrawables.clear();
+	shaderIDs.clear();
+	textureIDs.clear();
+	shaders.clear();
+}
+
+void RenderQueue::drawQuads(size_t first, size_t last)
+{
+	OpenGL::TempDebugGroup debuggroup("Render queue quads draw");
+
+	// The buffers are volatile, so they're created after the first load.
+	if (vertexBuffer == nullptr)
+	{
+		vertexBuffer = new GLBuffer(sizeof(Vertex) * 4 * MAX_QUADS, nullptr, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW, GLBuffer::MAP_STREAM);
+
+		std::vector<GLushort> indices(6 * MAX_QUADS);
+
+		for (size_t i = 0; i < MAX_QUADS; i++)
+		{
+			// Each quad is a triangle strip.
+			GLushort v = GLushort(i * 4);
+
+			indices[i * 6 + 0] = v + 0;
+			indices[i * 6 + 1] = v + 1;
+			indices[i * 6 + 2] = v + 2;
+
+			indices[i * 6 + 3] = v + 2;
+			indices[i * 6 + 4] = v + 1;
+			indices[i * 6 + 5] = v + 3;
+		}
+
+		try
+		{
+			indexBuffer = new GLBuffer(sizeof(GLushort) * indices.size(), &indices[0], GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+		}
+		catch (love::Exception &)
+		{
+			delete vertexBuffer;
+			vertexBuffer = nullptr;
+			throw;
+		}
+	}
+
+	const Command &cmd = commands[keys[first] & KEY_INDEX_MASK];
+
+	OpenGL::TempTransform transform(gl);
+	transform.get() = Matrix();
+
+	gl.bindTexture(cmd.texture);
+	gl.prepareDraw();
+
+	GLBuffer::Bind vbobind(*vertexBuffer);
+	GLBuffer::Bind ibobind(*indexBuffer);
+
+	glEnableVertexAttribArray(ATTRIB_POS);
+	glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+	glEnableVertexAttribArray(ATTRIB_COLOR);
+
+	for (size_t i = first; i < last;)
+	{
+		size_t count = 0;
+
+		Vertex *verts = (Vertex *) vertexBuffer->map();
+
+		// Copy the quads of as many commands as fit in one draw.
+		for (; i < last; i++)
+		{
+			const Command &quads = commands[keys[i] & KEY_INDEX_MASK];
+
+			if (count + quads.quadCount > MAX_QUADS)
+				break;
+
+			memcpy(verts + count * 4, &quadVertices[quads.index], sizeof(Vertex) * 4 * quads.quadCount);
+			count += quads.quadCount;
+		}
+
+		vertexBuffer->unmap(0, sizeof(Vertex) * 4 * count);
+
+		glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), vertexBuffer->getPointer(offsetof(Vertex, x)));
+		glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), vertexBuffer->getPointer(offsetof(Vertex, s)));
+		glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), vertexBuffer->getPointer(offsetof(Vertex, r)));
+
+		gl.drawElements(GL_TRIANGLES, (GLsizei) (count * 6), GL_UNSIGNED_SHORT, indexBuffer->getPointer(0));
+	}
+
+	glDisableVertexAttribArray(ATTRIB_COLOR);
+	glDisableVertexAttribArray(ATTRIB_TEXCOORD);
+	glDisableVertexAttribArray(ATTRIB_POS);
+
+	// Disabling the color array leaves the constant color undefined.
+	gl.setColor(gl.getColor());
+}
+
+bool RenderQueue::isPending() const
+{
+	return !commands.empty();
+}
+
+void RenderQueue::flushCurrent()
+{
+	if (current != nullptr && !current->flushing && !current->commands.empty())
+		current->flush();
+}
+
+bool RenderQueue::isRecordingCurrent()
+{
+	return current != nullptr && current->isRecording();
+}
+
+void RenderQueue::flushIfQueued(Drawable *drawable)
+{
+	if (current != nullptr && !current->flushing && !current->queuedDrawables.empty()
+	    && current->queuedDrawables.count(drawable) != 0)
+	{
+		current->flush();
+	}
+}
+
+} // opengl
+} // graphics
+} // love
@@ -0,0 +1,230 @@
+/**
+ * Copyright (c) 2006-2015 LOVE Development Team
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#ifndef LOVE_GRAPHICS_OPENGL_RENDER_QUEUE_H
+#define LOVE_GRAPHICS_OPENGL_RENDER_QUEUE_H
+
+// LOVE
+#include "common/config.h"
+#include "common/int.h"
+#include "common/math.h"
+#include "common/Matrix.h"
+#include "common/Object.h"
+#include "graphics/Color.h"
+#include "graphics/Drawable.h"
+#include "graphics/Graphics.h"
+#include "graphics/Texture.h"
+#include "OpenGL.h"
+#include "GLBuffer.h"
+#include "Shader.h"
+
+// C++
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace love
+{
+namespace graphics
+{
+namespace opengl
+{
+
+class Graphics;
+
+/**
+ * Records Drawable draws instead of drawing them right away, and draws them
+ * sorted by state when the queue is flushed.
+ *
+ * Each draw gets a 64 bit sort key made of (from most to least significant)
+ * its draw layer, shader, texture, blend mode and the order it was added in.
+ * Draws in lower layers are always drawn first, but the order of draws in the
+ * same layer is only kept between draws with the same state. Consecutive
+ * Image, Canvas and Font draws with the same state are merged into one draw
+ * call.
+ *
+ * Each draw records the shader and blend mode it was added with, so the queue
+ * is flushed by the same things which flush the PrimitiveBatch except for
+ * shader and blend mode changes (anything else which affects how draws are
+ * done, and drawing something which isn't queued.) Queued SpriteBatches,
+ * Meshes, Texts and ParticleSystems are drawn with the contents they have
+ * when the queue is flushed, so changing one of them flushes the queue first
+ * (see flushIfQueued.)
+ *
+ * Drawables call isRecordingCurrent in their draw methods, and add themselves
+ * to the current queue instead of drawing when it returns true.
+ **/
+class RenderQueue
+{
+public:
+
+	// Layers are stored in the top 16 bits of the sort key.
+	static const int MIN_LAYER = -32768;
+	static const int MAX_LAYER = 32767;
+
+	// The order draws were added in is stored in the lowest 16 bits of the
+	// sort key, so the queue is flushed when it's full.
+	static const size_t MAX_COMMANDS = 65536;
+
+	// Vertex indices are 16 bit, which limits the size of one merged draw.
+	static const size_t MAX_QUADS = 65536 / 4;
+
+	// The queue that flushCurrent flushes. Set by Graphics.
+	static RenderQueue *current;
+
+	RenderQueue(Graphics *graphics);
+	~RenderQueue();
+
+	/**
+	 * Enables or disables recording draws. Disabling the queue flushes it.
+	 **/
+	void setEnabled(bool enable);
+	bool isEnabled() const;
+
+	/**
+	 * Sets the layer that draws are added to.
+	 **/
+	void setLayer(int layer);
+	int getLayer() const;
+
+	/**
+	 * Returns true if draws should be added to the queue instead of being
+	 * drawn right away. Draws done while the queue is flushed are never
+	 * queued.
+	 **/
+	bool isRecording() const;
+
+	/**
+	 * Adds a draw of quads (4 vertices each, drawn as a triangle strip) using
+	 * the texture, with the current color, shader, blend mode and transform.
+	 *
+	 * @param object The object which owns the texture, kept alive until the
+	 *               quads are drawn.
+	 **/
+	void addQuads(Object *object, GLuint gltexture, const Matrix &t, const Vertex *v, size_t count);
+
+	/**
+	 * Adds a call to drawable->draw, made with the current color, shader, blend
+	 * mode and transform when the queue is flushed.
+	 *
+	 * @param gltexture The texture used by the drawable, used to sort it.
+	 **/
+	void add(Drawable *drawable, GLuint gltexture, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky);
+
+	/**
+	 * Draws everything added since the last flush, sorted.
+	 **/
+	void flush();
+
+	/**
+	 * Returns true if there are draws waiting in the queue.
+	 **/
+	bool isPending() const;
+
+	/**
+	 * Flushes the current queue, if there is one and it isn't already being
+	 * flushed.
+	 **/
+	static void flushCurrent();
+
+	/**
+	 * Returns true if there is a current queue and it's recording.
+	 **/
+	static bool isRecordingCurrent();
+
+	/**
+	 * Flushes the current queue if the drawable was added to it. Called before
+	 * a drawable's contents are changed.
+	 **/
+	static void flushIfQueued(Drawable *drawable);
+
+private:
+
+	struct Command
+	{
+		// The Texture for quads, or the Drawable.
+		StrongRef<Object> object;
+
+		Shader *shader;
+		love::graphics::Graphics::BlendMode blendMode;
+		GLuint texture;
+		Color color;
+
+		// Index of the first vertex in quadVertices for quads, or of the
+		// parameters in drawables.
+		size_t index;
+		bool quad;
+
+		// The number of quads, at most MAX_QUADS.
+		size_t quadCount;
+	};
+
+	struct DrawableParams
+	{
+		Matrix transform;
+		float x, y, angle, sx, sy, ox, oy, kx, ky;
+	};
+
+	/**
+	 * Adds a command with the current state and returns it.
+	 **/
+	Command &addCommand(Object *object, GLuint gltexture);
+
+	/**
+	 * Draws quads [first, last) of the sorted commands, which all have the
+	 * same state, with as few draw calls as possible.
+	 **/
+	void drawQuads(size_t first, size_t last);
+
+	void clearCommands();
+
+	Graphics *graphics;
+
+	bool enabled;
+	bool flushing;
+
+	int layer;
+
+	std::vector<Command> commands;
+	std::vector<uint64> keys;
+
+	std::vector<Vertex> quadVertices;
+	std::vector<DrawableParams> drawables;
+
+	// The drawables with draws in the queue.
+	std::unordered_set<Drawable *> queuedDrawables;
+
+	// Shaders and textures get small ids in the order they're first used, so
+	// they fit in the sort key.
+	std::unordered_map<Shader *, uint64> shaderIDs;
+	std::unordered_map<GLuint, uint64> textureIDs;
+	std::vector<StrongRef<Shader>> shaders;
+
+	// Created the first time merged quads are drawn.
+	GLBuffer *vertexBuffer;
+	GLBuffer *indexBuffer;
+
+}; // RenderQueue
+
+} // opengl
+} // graphics
+} // love
+
+#endif // LOVE_GRAPHICS_OPENGL_RENDER_QUEUE_H
@@ -23,6 +23,7 @@
 
 #include "Shader.h"
 #include "Canvas.h"
+#include "PrimitiveBatch.h"
 
 // C++
 #include <algorithm>
@@ -44,6 +45,9 @@ namespace
 		: curShader(shader)
 		, prevShader(Shader::current)
 		{
+			// Uniforms of the active shader are about to change.
+			PrimitiveBatch::flushCurrent();
+
 			curShader->attach(true);
 		}
 
@@ -380,7 +384,11 @@ void Shader::attach(bool temporary)
 {
 	if (current != this)
 	{
+		if (PrimitiveBatch::current != nullptr)
+			PrimitiveBatch::current->flush();
+
 		glUseProgram(program);
+		++gl.stats.shaderSwitches;
 		current = this;
 		// retain/release happens in Graphics::setShader.
 	}
@@ -411,7 +419,13 @@ void Shader::detach()
 	}
 
 	if (current != nullptr)
+	{
+		if (PrimitiveBatch::current != nullptr)
+			PrimitiveBatch::current->flush();
+
 		glUseProgram(0);
+		++gl.stats.shaderSwitches;
+	}
 
 	current = nullptr;
 }
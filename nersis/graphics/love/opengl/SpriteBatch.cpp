@@ -26,6 +26,8 @@
 
 // LOVE
 #include "GLBuffer.h"
+#include "PrimitiveBatch.h"
+#include "RenderQueue.h"
 #include "graphics/Texture.h"
 
 // C++
@@ -60,7 +62,7 @@ SpriteBatch::SpriteBatch(Texture *texture, int size, Mesh::Usage usage)
 
 	try
 	{
-		array_buf = new GLBuffer(vertex_size, nullptr, GL_ARRAY_BUFFER, gl_usage);
+		array_buf = new GLBuffer(vertex_size, nullptr, GL_ARRAY_BUFFER, gl_usage, Mesh::getGLBufferMapFlags(usage));
 	}
 	catch (love::Exception &)
 	{
@@ -114,8 +116,101 @@ int SpriteBatch::addq(Quad *quad, float x, float y, float a, float sx, float sy,
 	return index;
 }
 
+int SpriteBatch::addMany(const float *sprites, int count, int components, Quad *quad)
+{
+	if (components < 2 || components > 9)
+		throw love::Exception("Invalid number of sprite components: %d (expected 2-9)", components);
+
+	count = std::min(count, size - next);
+
+	if (count <= 0)
+		return 0;
+
+	RenderQueue::flushIfQueued(this);
+
+	// Every sprite starts as a copy of these, so only the positions have to
+	// be written per sprite.
+	const Vertex *v = quad ? quad->getVertices() : texture->getVertices();
+	Vertex sprite[4] = {v[0], v[1], v[2], v[3]};
+	const size_t sprite_size = 4 * sizeof(Vertex); // bytecount
+
+	if (color)
+		setColorv(sprite, *color);
+
+	GLBuffer::Bind bind(*array_buf);
+
+	Vertex *dst = (Vertex *) array_buf->map() + next * 4;
+
+#ifdef LOVE_OPENGL_SSE
+	// The x and y of two corners, in the order the transformed positions are
+	// stored: x0 x0 x1 x1, y0 y0 y1 y1, and the same for corners 2 and 3.
+	const __m128 x01 = _mm_setr_ps(v[0].x, v[0].x, v[1].x, v[1].x);
+	const __m128 y01 = _mm_setr_ps(v[0].y, v[0].y, v[1].y, v[1].y);
+	const __m128 x23 = _mm_setr_ps(v[2].x, v[2].x, v[3].x, v[3].x);
+	const __m128 y23 = _mm_setr_ps(v[2].y, v[2].y, v[3].y, v[3].y);
+#endif
+
+	for (int i = 0; i < count; i++, sprites += components, dst += 4)
+	{
+		// x, y, a, sx, sy, ox, oy, kx, ky, with the defaults of add.
+		float p[9] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+		for (int j = 0; j < components; j++)
+			p[j] = sprites[j];
+
+		if (components == 4)
+			p[4] = p[3];
+
+		// The same affine transform Matrix(x, y, a, ...) builds, without the
+		// trigonometry for unrotated sprites.
+		float c = 1.0f, s = 0.0f;
+		if (p[2] != 0.0f)
+		{
+			c = cosf(p[2]);
+			s = sinf(p[2]);
+		}
+
+		float e0 = c * p[3] - p[8] * s * p[4];
+		float e1 = s * p[3] + p[8] * c * p[4];
+		float e4 = p[7] * c * p[3] - s * p[4];
+		float e5 = p[7] * s * p[3] + c * p[4];
+		float e12 = p[0] - p[5] * e0 - p[6] * e4;
+		float e13 = p[1] - p[5] * e1 - p[6] * e5;
+
+		memcpy(dst, sprite, sprite_size);
+
+#ifdef LOVE_OPENGL_SSE
+		__m128 m0 = _mm_setr_ps(e0, e1, e0, e1);
+		__m128 m1 = _mm_setr_ps(e4, e5, e4, e5);
+		__m128 t = _mm_setr_ps(e12, e13, e12, e13);
+
+		__m128 p01 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x01), _mm_mul_ps(m1, y01)), t);
+		__m128 p23 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x23), _mm_mul_ps(m1, y23)), t);
+
+		_mm_storel_pi((__m64 *) &dst[0].x, p01);
+		_mm_storeh_pi((__m64 *) &dst[1].x, p01);
+		_mm_storel_pi((__m64 *) &dst[2].x, p23);
+		_mm_storeh_pi((__m64 *) &dst[3].x, p23);
+#else
+		for (int j = 0; j < 4; j++)
+		{
+			dst[j].x = (e0 * v[j].x) + (e4 * v[j].y) + e12;
+			dst[j].y = (e1 * v[j].x) + (e5 * v[j].y) + e13;
+		}
+#endif
+	}
+
+	buffer_used_offset = std::min(buffer_used_offset, next * sprite_size);
+	buffer_used_size = std::max(buffer_used_size, (next + count) * sprite_size - buffer_used_offset);
+
+	next += count;
+
+	return count;
+}
+
 void SpriteBatch::clear()
 {
+	RenderQueue::flushIfQueued(this);
+
 	// Reset the position of the next index.
 	next = 0;
 }
@@ -123,13 +218,12 @@ void SpriteBatch::clear()
 void SpriteBatch::flush()
 {
 	GLBuffer::Bind bind(*array_buf);
-	array_buf->unmap(buffer_used_offset, buffer_used_size);
-
-	buffer_used_offset = buffer_used_size = 0;
+	unmapBuffer();
 }
 
 void SpriteBatch::setTexture(Texture *newtexture)
 {
+	RenderQueue::flushIfQueued(this);
 	texture.set(newtexture);
 }
 
@@ -170,6 +264,8 @@ void SpriteBatch::setBufferSize(int newsize)
 	if (newsize == size)
 		return;
 
+	RenderQueue::flushIfQueued(this);
+
 	// Map the old GLBuffer to get a pointer to its data.
 	void *old_data = nullptr;
 	{
@@ -182,7 +278,7 @@ void SpriteBatch::setBufferSize(int newsize)
 
 	try
 	{
-		new_array_buf = new GLBuffer(vertex_size, nullptr, array_buf->getTarget(), array_buf->getUsage());
+		new_array_buf = new GLBuffer(vertex_size, nullptr, array_buf->getTarget(), array_buf->getUsage(), array_buf->getMapFlags());
 
 		// Copy as much of the old data into the new GLBuffer as can fit.
 		GLBuffer::Bind bind(*new_array_buf);
@@ -204,6 +300,10 @@ void SpriteBatch::setBufferSize(int newsize)
 	size = newsize;
 
 	next = std::min(next, newsize);
+
+	// The new buffer has none of the copied sprites yet.
+	buffer_used_offset = 0;
+	buffer_used_size = sizeof(Vertex) * 4 * next;
 }
 
 int SpriteBatch::getBufferSize() const
@@ -220,8 +320,16 @@ void SpriteBatch::draw(float x, float y, float angle, float sx, float sy, float
 	if (next == 0)
 		return;
 
+	if (RenderQueue::isRecordingCurrent())
+	{
+		RenderQueue::current->add(this, *(GLuint *) texture->getHandle(), x, y, angle, sx, sy, ox, oy, kx, ky);
+		return;
+	}
+
 	OpenGL::TempDebugGroup debuggroup("SpriteBatch draw");
 
+	PrimitiveBatch::flushCurrent();
+
 	Matrix t(x, y, angle, sx, sy, ox, oy, kx, ky);
 
 	OpenGL::TempTransform transform(gl);
@@ -233,8 +341,7 @@ void SpriteBatch::draw(float x, float y, float angle, float sx, float sy, float
 	GLBuffer::Bind element_bind(*quad_indices.getBuffer());
 
 	// Make sure the VBO isn't mapped when we draw (sends data to GPU if needed.)
-	array_buf->unmap(buffer_used_offset, buffer_used_size);
-	buffer_used_offset = buffer_used_size = 0;
+	unmapBuffer();
 
 	Color curcolor = gl.getColor();
 
@@ -266,6 +373,8 @@ void SpriteBatch::draw(float x, float y, float angle, float sx, float sy, float
 
 void SpriteBatch::addv(const Vertex *v, const Matrix &m, int index)
 {
+	RenderQueue::flushIfQueued(this);
+
 	// Needed for colors.
 	Vertex sprite[4] = {v[0], v[1], v[2], v[3]};
 	const size_t sprite_size = 4 * sizeof(Vertex); // bytecount
@@ -287,6 +396,20 @@ void SpriteBatch::addv(const Vertex *v, const Matrix &m, int index)
 	buffer_used_size = std::max(buffer_used_size, (index + 1) * sprite_size - buffer_used_offset);
 }
 
+void SpriteBatch::unmapBuffer()
+{
+	// Draws from a streamed buffer can only use the last upload, so every
+	// sprite is uploaded when any of them changed.
+	if (array_buf->isStreamed() && buffer_used_size > 0)
+	{
+		buffer_used_offset = 0;
+		buffer_used_size = next * 4 * sizeof(Vertex);
+	}
+
+	array_buf->unmap(buffer_used_offset, buffer_used_size);
+	buffer_used_offset = buffer_used_size = 0;
+}
+
 void SpriteBatch::setColorv(Vertex *v, const Color &color)
 {
 	for (size_t i = 0; i < 4; ++i)
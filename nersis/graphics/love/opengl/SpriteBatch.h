@@ -54,6 +54,21 @@ public:
 
 	int add(float x, float y, float a, float sx, float sy, float ox, float oy, float kx, float ky, int index = -1);
 	int addq(Quad *quad, float x, float y, float a, float sx, float sy, float ox, float oy, float kx, float ky, int index = -1);
+
+	/**
+	 * Adds many sprites at once, after the last one in the SpriteBatch.
+	 * Each sprite is described by the first few values of the arguments
+	 * of add (x, y, a, sx, sy, ox, oy, kx, ky); the values left out get the
+	 * same defaults as in add.
+	 *
+	 * @param sprites The sprites, components values per sprite.
+	 * @param count The number of sprites.
+	 * @param components The number of values per sprite, 2 to 9.
+	 * @param quad The Quad to use for every sprite, or null for the whole texture.
+	 * @return The number of sprites added, which is less than count if the
+	 *         SpriteBatch is full.
+	 **/
+	int addMany(const float *sprites, int count, int components, Quad *quad = nullptr);
 	void clear();
 
 	void flush();
@@ -105,6 +120,11 @@ private:
 
 	void addv(const Vertex *v, const Matrix &m, int index);
 
+	/**
+	 * Unmaps the vertex buffer, uploading the sprites which changed.
+	 **/
+	void unmapBuffer();
+
 	/**
 	 * Set the color for vertices.
 	 *
@@ -19,6 +19,8 @@
  **/
 
 #include "Text.h"
+#include "PrimitiveBatch.h"
+#include "RenderQueue.h"
 #include "common/Matrix.h"
 
 #include <algorithm>
@@ -33,8 +35,11 @@ namespace opengl
 Text::Text(Font *font, const std::string &text)
 	: font(font)
 	, vbo(nullptr)
+	, draw_commands_dirty(false)
 	, text_info()
+	, vert_first(0)
 	, vert_offset(0)
+	, ring_size(0)
 	, texture_cache_id((uint32) -1)
 {
 	set(text);
@@ -45,28 +50,114 @@ Text::~Text()
 	delete vbo;
 }
 
-void Text::uploadVertices(const std::vector<Font::GlyphVertex> &vertices, size_t vertoffset)
+void Text::generateVertices(TextData &t, std::vector<Font::GlyphVertex> &vertices)
 {
-	size_t offset = vertoffset * sizeof(Font::GlyphVertex);
-	size_t datasize = vertices.size() * sizeof(Font::GlyphVertex);
-	uint8 *vbodata = nullptr;
+	// We only have formatted text if the align mode is valid.
+	if (t.align == Font::ALIGN_MAX_ENUM)
+		t.draw_commands = font->generateVertices(t.text, vertices, 0.0f, Vector(0.0f, 0.0f), &text_info);
+	else
+		t.draw_commands = font->generateVerticesFormatted(t.text, t.wrap, t.align, vertices, &text_info);
+
+	if (t.use_matrix && !vertices.empty())
+		t.matrix.transform(&vertices[0], &vertices[0], (int) vertices.size());
+}
+
+void Text::setVertices(size_t index, const std::vector<Font::GlyphVertex> &vertices)
+{
+	TextData &t = text_data[index];
+
+	ptrdiff_t grow = (ptrdiff_t) vertices.size() - (ptrdiff_t) t.vert_count;
+
+	if (grow != 0)
+	{
+		size_t capacity = vbo != nullptr ? vbo->getSize() / sizeof(Font::GlyphVertex) : 0;
+
+		// Make room by moving whichever side of this text has fewer vertices.
+		// If that side has no room to move into, everything is compacted to
+		// the start of the buffer first, which leaves room at the end.
+		size_t before = t.vert_start - vert_first;
+		size_t after = vert_offset - (t.vert_start + t.vert_count);
+
+		bool movebefore = before < after;
+
+		if (grow > 0)
+		{
+			if (movebefore ? vert_first < (size_t) grow : vert_offset + grow > capacity)
+			{
+				compactVertices(vert_offset - vert_first + grow);
+				movebefore = false;
+			}
+		}
 
-	// If we haven't created a VBO or the vertices are too big, make a new one.
-	if (datasize > 0 && (!vbo || (offset + datasize) > vbo->getSize()))
+		if (movebefore)
+		{
+			moveVertices(vert_first, before, -grow);
+
+			for (size_t i = 0; i <= index; i++)
+				text_data[i].vert_start -= grow;
+
+			vert_first -= grow;
+		}
+		else
+		{
+			moveVertices(t.vert_start + t.vert_count, after, grow);
+
+			for (size_t i = index + 1; i < text_data.size(); i++)
+				text_data[i].vert_start += grow;
+
+			vert_offset += grow;
+		}
+
+		t.vert_count = vertices.size();
+	}
+
+	if (!vertices.empty())
 	{
-		// Make it bigger than necessary to reduce potential future allocations.
-		size_t newsize = size_t((offset + datasize) * 1.5);
-		if (vbo != nullptr)
-			newsize = std::max(size_t(vbo->getSize() * 1.5), newsize);
+		GLBuffer::Bind bind(*vbo);
+		Font::GlyphVertex *vbodata = (Font::GlyphVertex *) vbo->map();
+
+		memcpy(vbodata + t.vert_start, &vertices[0], vertices.size() * sizeof(Font::GlyphVertex));
+
+		// We unmap when we draw, to avoid unnecessary full map()/unmap() calls.
+		vbo->setMappedRangeModified(t.vert_start * sizeof(Font::GlyphVertex), vertices.size() * sizeof(Font::GlyphVertex));
+	}
+
+	draw_commands_dirty = true;
+}
 
-		GLBuffer *new_vbo = new GLBuffer(newsize, nullptr, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
+void Text::moveVertices(size_t start, size_t count, ptrdiff_t distance)
+{
+	if (count == 0 || distance == 0)
+		return;
+
+	GLBuffer::Bind bind(*vbo);
+	Font::GlyphVertex *vbodata = (Font::GlyphVertex *) vbo->map();
+
+	memmove(vbodata + start + distance, vbodata + start, count * sizeof(Font::GlyphVertex));
+	vbo->setMappedRangeModified((start + distance) * sizeof(Font::GlyphVertex), count * sizeof(Font::GlyphVertex));
+}
+
+void Text::compactVertices(size_t count)
+{
+	size_t capacity = vbo != nullptr ? vbo->getSize() / sizeof(Font::GlyphVertex) : 0;
+	size_t used = vert_offset - vert_first;
+
+	// Moves the vertices to the start of the VBO. Make sure that leaves
+	// plenty of room at the end, so adding more text doesn't have to move
+	// everything again right away.
+	if (count + count / 2 > capacity)
+	{
+		size_t newsize = count * 2 * sizeof(Font::GlyphVertex);
+		GLBuffer *new_vbo = new GLBuffer(newsize, nullptr, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW, GLBuffer::MAP_STREAM);
 
-		if (vbo != nullptr)
+		if (vbo != nullptr && used > 0)
 		{
+			const Font::GlyphVertex *vbodata = nullptr;
+
 			try
 			{
 				GLBuffer::Bind bind(*vbo);
-				vbodata = (uint8 *) vbo->map();
+				vbodata = (const Font::GlyphVertex *) vbo->map();
 			}
 			catch (love::Exception &)
 			{
@@ -75,20 +166,57 @@ void Text::uploadVertices(const std::vector<Font::GlyphVertex> &vertices, size_t
 			}
 
 			GLBuffer::Bind bind(*new_vbo);
-			new_vbo->fill(0, vbo->getSize(), vbodata);
+			memcpy(new_vbo->map(), vbodata + vert_first, used * sizeof(Font::GlyphVertex));
+			new_vbo->setMappedRangeModified(0, used * sizeof(Font::GlyphVertex));
 		}
 
 		delete vbo;
 		vbo = new_vbo;
 	}
+	else
+		moveVertices(vert_first, used, -(ptrdiff_t) vert_first);
+
+	for (TextData &t : text_data)
+		t.vert_start -= vert_first;
+
+	vert_offset = used;
+	vert_first = 0;
+}
 
-	if (vbo != nullptr)
+void Text::updateDrawCommands()
+{
+	draw_commands.clear();
+
+	for (const TextData &t : text_data)
 	{
-		GLBuffer::Bind bind(*vbo);
-		vbodata = (uint8 *) vbo->map();
-		memcpy(vbodata + offset, &vertices[0], datasize);
-		// We unmap when we draw, to avoid unnecessary full map()/unmap() calls.
+		if (t.draw_commands.empty())
+			continue;
+
+		auto firstcmd = t.draw_commands.begin();
+
+		// If the first draw command of this text has the same texture as the
+		// last one in the list we're building and its vertices are in-order,
+		// we can combine them (saving a draw call.)
+		if (!draw_commands.empty())
+		{
+			Font::DrawCommand &prevcmd = draw_commands.back();
+			if (prevcmd.texture == firstcmd->texture && (size_t) (prevcmd.startvertex + prevcmd.vertexcount) == t.vert_start + firstcmd->startvertex)
+			{
+				prevcmd.vertexcount += firstcmd->vertexcount;
+				++firstcmd;
+			}
+		}
+
+		// The start vertex should be adjusted to account for the vertex offset.
+		for (auto it = firstcmd; it != t.draw_commands.end(); ++it)
+		{
+			Font::DrawCommand cmd = *it;
+			cmd.startvertex += (int) t.vert_start;
+			draw_commands.push_back(cmd);
+		}
 	}
+
+	draw_commands_dirty = false;
 }
 
 void Text::regenerateVertices()
@@ -97,7 +225,7 @@ void Text::regenerateVertices()
 	// text's vertices, since glyph texcoords might have changed.
 	if (font->getTextureCacheID() != texture_cache_id)
 	{
-		std::vector<TextData> textdata = text_data;
+		std::deque<TextData> textdata = text_data;
 
 		clear();
 
@@ -108,61 +236,46 @@ void Text::regenerateVertices()
 	}
 }
 
-void Text::addTextData(const TextData &t)
+int Text::addTextData(const TextData &t)
 {
-	std::vector<Font::GlyphVertex> vertices;
-	std::vector<Font::DrawCommand> new_commands;
+	RenderQueue::flushIfQueued(this);
 
-	// We only have formatted text if the align mode is valid.
-	if (t.align == Font::ALIGN_MAX_ENUM)
-		new_commands = font->generateVertices(t.text, vertices, 0.0f, Vector(0.0f, 0.0f), &text_info);
-	else
-		new_commands = font->generateVerticesFormatted(t.text, t.wrap, t.align, vertices, &text_info);
-
-	if (t.use_matrix)
-		t.matrix.transform(&vertices[0], &vertices[0], (int) vertices.size());
-
-	size_t voffset = vert_offset;
-
-	if (!t.append_vertices)
+	if (ring_size > 0)
 	{
-		voffset = 0;
-		draw_commands.clear();
+		while ((int) text_data.size() >= ring_size)
+			removeTextData(0);
 	}
 
-	uploadVertices(vertices, voffset);
-
-	if (!new_commands.empty())
-	{
-		// The start vertex should be adjusted to account for the vertex offset.
-		for (Font::DrawCommand &cmd : new_commands)
-			cmd.startvertex += (int) voffset;
+	text_data.push_back(t);
 
-		auto firstcmd = new_commands.begin();
+	TextData &data = text_data.back();
+	data.vert_start = vert_offset;
+	data.vert_count = 0;
 
-		// If the first draw command in the new list has the same texture as the
-		// last one in the existing list we're building and its vertices are
-		// in-order, we can combine them (saving a draw call.)
-		if (!draw_commands.empty())
-		{
-			auto prevcmd = draw_commands.back();
-			if (prevcmd.texture == firstcmd->texture && (prevcmd.startvertex + prevcmd.vertexcount) == firstcmd->startvertex)
-			{
-				draw_commands.back().vertexcount += firstcmd->vertexcount;
-				++firstcmd;
-			}
-		}
+	std::vector<Font::GlyphVertex> vertices;
+	generateVertices(data, vertices);
 
-		// Append the new draw commands to the list we're building.
-		draw_commands.insert(draw_commands.end(), firstcmd, new_commands.end());
-	}
+	setVertices(text_data.size() - 1, vertices);
 
-	vert_offset = voffset + vertices.size();
-	text_data.push_back(t);
+	int index = (int) text_data.size() - 1;
 
 	// Font::generateVertices can invalidate the font's texture cache.
 	if (font->getTextureCacheID() != texture_cache_id)
 		regenerateVertices();
+
+	return index;
+}
+
+void Text::removeTextData(size_t index)
+{
+	RenderQueue::flushIfQueued(this);
+
+	setVertices(index, std::vector<Font::GlyphVertex>());
+
+	text_data.erase(text_data.begin() + index);
+
+	if (text_data.empty())
+		vert_first = vert_offset = 0;
 }
 
 void Text::set(const std::string &text)
@@ -170,7 +283,8 @@ void Text::set(const std::string &text)
 	if (text.empty())
 		return set();
 
-	addTextData({text, -1.0f, Font::ALIGN_MAX_ENUM, false, false, Matrix()});
+	clear();
+	addTextData({text, -1.0f, Font::ALIGN_MAX_ENUM, false, Matrix()});
 }
 
 void Text::set(const std::string &text, float wrap, Font::AlignMode align)
@@ -178,7 +292,8 @@ void Text::set(const std::string &text, float wrap, Font::AlignMode align)
 	if (text.empty())
 		return set();
 
-	addTextData({text, wrap, align, false, false, Matrix()});
+	clear();
+	addTextData({text, wrap, align, false, Matrix()});
 }
 
 void Text::set()
@@ -186,40 +301,87 @@ void Text::set()
 	clear();
 }
 
-void Text::add(const std::string &text, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky)
+int Text::add(const std::string &text, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky)
 {
-	if (text.empty())
-		return;
-
 	Matrix m;
 	m.setTransformation(x, y, angle, sx, sy, ox, oy, kx, ky);
 
-	addTextData({text, -1.0f, Font::ALIGN_MAX_ENUM, true, true, m});
+	return addTextData({text, -1.0f, Font::ALIGN_MAX_ENUM, true, m});
 }
 
-void Text::addf(const std::string &text, float wrap, Font::AlignMode align, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky)
+int Text::addf(const std::string &text, float wrap, Font::AlignMode align, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky)
 {
-	if (text.empty())
-		return;
-
 	Matrix m;
 	m.setTransformation(x, y, angle, sx, sy, ox, oy, kx, ky);
 
-	addTextData({text, wrap, align, true, true, m});
+	return addTextData({text, wrap, align, true, m});
+}
+
+void Text::replace(int index, const std::string &text)
+{
+	if (index < 0 || (size_t) index >= text_data.size())
+		throw love::Exception("Invalid text index: %d", index + 1);
+
+	RenderQueue::flushIfQueued(this);
+
+	TextData &t = text_data[index];
+	t.text = text;
+
+	std::vector<Font::GlyphVertex> vertices;
+	generateVertices(t, vertices);
+
+	setVertices(index, vertices);
+
+	// Font::generateVertices can invalidate the font's texture cache.
+	if (font->getTextureCacheID() != texture_cache_id)
+		regenerateVertices();
+}
+
+void Text::remove(int index)
+{
+	if (index < 0 || (size_t) index >= text_data.size())
+		throw love::Exception("Invalid text index: %d", index + 1);
+
+	removeTextData(index);
+}
+
+int Text::getCount() const
+{
+	return (int) text_data.size();
+}
+
+void Text::setRingSize(int size)
+{
+	ring_size = std::max(size, 0);
+
+	if (ring_size > 0)
+	{
+		while ((int) text_data.size() > ring_size)
+			removeTextData(0);
+	}
+}
+
+int Text::getRingSize() const
+{
+	return ring_size;
 }
 
 void Text::clear()
 {
+	RenderQueue::flushIfQueued(this);
+
 	text_data.clear();
 	draw_commands.clear();
+	draw_commands_dirty = false;
 	texture_cache_id = font->getTextureCacheID();
 	text_info = {};
+	vert_first = 0;
 	vert_offset = 0;
 }
 
 void Text::draw(float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky)
 {
-	if (vbo == nullptr || draw_commands.empty())
+	if (vbo == nullptr || text_data.empty())
 		return;
 
 	OpenGL::TempDebugGroup debuggroup("Text object draw");
@@ -228,6 +390,21 @@ void Text::draw(float x, float y, float angle, float sx, float sy, float ox, flo
 	if (font->getTextureCacheID() != texture_cache_id)
 		regenerateVertices();
 
+	if (draw_commands_dirty)
+		updateDrawCommands();
+
+	if (draw_commands.empty())
+		return;
+
+	// Queued draws are sorted by the texture of the first glyphs.
+	if (RenderQueue::isRecordingCurrent())
+	{
+		RenderQueue::current->add(this, draw_commands[0].texture, x, y, angle, sx, sy, ox, oy, kx, ky);
+		return;
+	}
+
+	PrimitiveBatch::flushCurrent();
+
 	const size_t pos_offset = offsetof(Font::GlyphVertex, x);
 	const size_t tex_offset = offsetof(Font::GlyphVertex, s);
 	const size_t stride = sizeof(Font::GlyphVertex);
@@ -240,7 +417,14 @@ void Text::draw(float x, float y, float angle, float sx, float sy, float ox, flo
 
 	{
 		GLBuffer::Bind bind(*vbo);
-		vbo->unmap(); // Make sure all pending data is flushed to the GPU.
+
+		// Make sure all pending data is flushed to the GPU. Draws from a
+		// streamed buffer can only use the last upload, so it gets every
+		// vertex which is drawn.
+		if (vbo->isStreamed())
+			vbo->unmap(vert_first * stride, (vert_offset - vert_first) * stride);
+		else
+			vbo->unmap();
 
 		// Font::drawVertices expects AttribPointer calls to be done already.
 		glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, stride, vbo->getPointer(pos_offset));
@@ -267,6 +451,8 @@ void Text::draw(float x, float y, float angle, float sx, float sy, float ox, flo
 
 void Text::setFont(Font *f)
 {
+	RenderQueue::flushIfQueued(this);
+
 	font.set(f);
 
 	// Invalidate the texture cache ID since the font is different. We also have
@@ -27,6 +27,9 @@
 #include "Font.h"
 #include "GLBuffer.h"
 
+// C++
+#include <deque>
+
 namespace love
 {
 namespace graphics
@@ -45,8 +48,44 @@ public:
 	void set(const std::string &text, float wrap, Font::AlignMode align);
 	void set();
 
-	void add(const std::string &text, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky);
-	void addf(const std::string &text, float wrap, Font::AlignMode align, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky);
+	/**
+	 * Adds text to the object, keeping the text which is already there.
+	 *
+	 * @return The index of the added text, for use with replace and remove.
+	 *         Indices are positions, so they shift when earlier text is
+	 *         removed, including by the ring size.
+	 **/
+	int add(const std::string &text, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky);
+	int addf(const std::string &text, float wrap, Font::AlignMode align, float x, float y, float angle, float sx, float sy, float ox, float oy, float kx, float ky);
+
+	/**
+	 * Replaces the string of previously added text. Its position, wrap limit
+	 * and alignment stay the same. Only the vertices of that text (and of
+	 * text which has to move to make room for it) are uploaded again.
+	 **/
+	void replace(int index, const std::string &text);
+
+	/**
+	 * Removes previously added text. The indices of the text added after it
+	 * go down by one.
+	 **/
+	void remove(int index);
+
+	/**
+	 * Gets the number of texts which have been added (or set.)
+	 **/
+	int getCount() const;
+
+	/**
+	 * Sets the maximum number of texts to keep. Adding text beyond it removes
+	 * the oldest text first, like a scrolling log, without moving or
+	 * re-uploading the vertices of the rest. 0 (the default) keeps all text.
+	 * Every text removed this way moves the indices of the rest down by one,
+	 * so once the ring is full, add returns the last index every time.
+	 **/
+	void setRingSize(int size);
+	int getRingSize() const;
+
 	void clear();
 
 	// Implements Drawable.
@@ -69,28 +108,57 @@ private:
 
 	struct TextData
 	{
+		TextData(const std::string &text, float wrap, Font::AlignMode align, bool use_matrix, const Matrix &matrix)
+			: text(text)
+			, wrap(wrap)
+			, align(align)
+			, use_matrix(use_matrix)
+			, matrix(matrix)
+			, vert_start(0)
+			, vert_count(0)
+		{
+		}
+
 		std::string text;
 		float wrap;
 		Font::AlignMode align;
 		bool use_matrix;
-		bool append_vertices;
 		Matrix matrix;
+
+		// The text's vertices in the VBO. The start vertices of its draw
+		// commands are relative to vert_start.
+		size_t vert_start;
+		size_t vert_count;
+		std::vector<Font::DrawCommand> draw_commands;
 	};
 
-	void uploadVertices(const std::vector<Font::GlyphVertex> &vertices, size_t vertoffset);
+	void generateVertices(TextData &t, std::vector<Font::GlyphVertex> &vertices);
+	void setVertices(size_t index, const std::vector<Font::GlyphVertex> &vertices);
+	void moveVertices(size_t start, size_t count, ptrdiff_t distance);
+	void compactVertices(size_t count);
+	void updateDrawCommands();
 	void regenerateVertices();
-	void addTextData(const TextData &s);
+	int addTextData(const TextData &t);
+	void removeTextData(size_t index);
 
 	StrongRef<Font> font;
 	GLBuffer *vbo;
 
+	// The draw commands of all text, rebuilt when draw_commands_dirty is set.
 	std::vector<Font::DrawCommand> draw_commands;
+	bool draw_commands_dirty;
 
-	std::vector<TextData> text_data;
+	std::deque<TextData> text_data;
 	Font::TextInfo text_info;
 
+	// The vertices of all text are in [vert_first, vert_offset) of the VBO,
+	// in the order the text was added. Removing the first text only moves
+	// vert_first, so the rest doesn't have to be uploaded again.
+	size_t vert_first;
 	size_t vert_offset;
 
+	int ring_size;
+
 	// Used so we know when the font's texture cache is invalidated.
 	uint32 texture_cache_id;
 
@@ -172,6 +172,73 @@ int w_Font_hasGlyphs(lua_State *L)
 	return 1;
 }
 
+int w_Font_prewarm(lua_State *L)
+{
+	Font *t = luax_checkfont(L, 1);
+
+	int count = std::max(lua_gettop(L) - 1, 1);
+
+	luax_catchexcept(L, [&]() {
+		for (int i = 2; i < count + 2; i++)
+		{
+			if (lua_type(L, i) == LUA_TSTRING)
+				t->prewarm(luax_checkstring(L, i));
+			else
+				t->prewarm((uint32) luaL_checknumber(L, i));
+		}
+	});
+
+	return 0;
+}
+
+int w_Font_setGlyphPageLimit(lua_State *L)
+{
+	Font *t = luax_checkfont(L, 1);
+	int limit = (int) luaL_checknumber(L, 2);
+	if (limit < 0)
+		return luaL_error(L, "Invalid glyph page limit: %d", limit);
+	t->setGlyphPageLimit(limit);
+	return 0;
+}
+
+int w_Font_getGlyphPageLimit(lua_State *L)
+{
+	Font *t = luax_checkfont(L, 1);
+	lua_pushinteger(L, t->getGlyphPageLimit());
+	return 1;
+}
+
+int w_Font_setAsyncLoading(lua_State *L)
+{
+	Font *t = luax_checkfont(L, 1);
+	t->setAsyncLoading(luax_toboolean(L, 2));
+	return 0;
+}
+
+int w_Font_isAsyncLoading(lua_State *L)
+{
+	Font *t = luax_checkfont(L, 1);
+	luax_pushboolean(L, t->isAsyncLoading());
+	return 1;
+}
+
+int w_Font_setLayoutCacheLimit(lua_State *L)
+{
+	Font *t = luax_checkfont(L, 1);
+	lua_Number bytes = luaL_checknumber(L, 2);
+	if (bytes < 0)
+		return luaL_error(L, "Invalid layout cache limit: %f", bytes);
+	t->setLayoutCacheLimit((size_t) bytes);
+	return 0;
+}
+
+int w_Font_getLayoutCacheLimit(lua_State *L)
+{
+	Font *t = luax_checkfont(L, 1);
+	lua_pushnumber(L, (lua_Number) t->getLayoutCacheLimit());
+	return 1;
+}
+
 static const luaL_Reg functions[] =
 {
 	{ "getHeight", w_Font_getHeight },
@@ -185,6 +252,13 @@ static const luaL_Reg functions[] =
 	{ "getDescent", w_Font_getDescent },
 	{ "getBaseline", w_Font_getBaseline },
 	{ "hasGlyphs", w_Font_hasGlyphs },
+	{ "prewarm", w_Font_prewarm },
+	{ "setGlyphPageLimit", w_Font_setGlyphPageLimit },
+	{ "getGlyphPageLimit", w_Font_getGlyphPageLimit },
+	{ "setAsyncLoading", w_Font_setAsyncLoading },
+	{ "isAsyncLoading", w_Font_isAsyncLoading },
+	{ "setLayoutCacheLimit", w_Font_setLayoutCacheLimit },
+	{ "getLayoutCacheLimit", w_Font_getLayoutCacheLimit },
 	{ 0, 0 }
 };
 
@@ -44,6 +44,13 @@ int w_Font_getAscent(lua_State *L);
 int w_Font_getDescent(lua_State *L);
 int w_Font_getBaseline(lua_State *L);
 int w_Font_hasGlyphs(lua_State *L);
+int w_Font_prewarm(lua_State *L);
+int w_Font_setGlyphPageLimit(lua_State *L);
+int w_Font_getGlyphPageLimit(lua_State *L);
+int w_Font_setAsyncLoading(lua_State *L);
+int w_Font_isAsyncLoading(lua_State *L);
+int w_Font_setLayoutCacheLimit(lua_State *L);
+int w_Font_getLayoutCacheLimit(lua_State *L);
 extern "C" int luaopen_font(lua_State *L);
 
 } // opengl
@@ -1122,6 +1122,32 @@ int w_isWireframe(lua_State *L)
 	return 1;
 }
 
+int w_setDeferred(lua_State *L)
+{
+	bool enable = luax_toboolean(L, 1);
+	luax_catchexcept(L, [&](){ instance()->setDeferred(enable); });
+	return 0;
+}
+
+int w_isDeferred(lua_State *L)
+{
+	luax_pushboolean(L, instance()->isDeferred());
+	return 1;
+}
+
+int w_setDrawLayer(lua_State *L)
+{
+	int layer = (int) luaL_optinteger(L, 1, 0);
+	luax_catchexcept(L, [&](){ instance()->setDrawLayer(layer); });
+	return 0;
+}
+
+int w_getDrawLayer(lua_State *L)
+{
+	lua_pushinteger(L, instance()->getDrawLayer());
+	return 1;
+}
+
 int w_newScreenshot(lua_State *L)
 {
 	love::image::Image *image = luax_getmodule<love::image::Image>(L, MODULE_IMAGE_ID);
@@ -1356,6 +1382,18 @@ int w_getStats(lua_State *L)
 	lua_pushinteger(L, stats.canvasSwitches);
 	lua_setfield(L, -2, sname);
 
+	Graphics::getConstant(Graphics::STAT_SHADER_SWITCHES, sname);
+	lua_pushinteger(L, stats.shaderSwitches);
+	lua_setfield(L, -2, sname);
+
+	Graphics::getConstant(Graphics::STAT_TEXTURE_SWITCHES, sname);
+	lua_pushinteger(L, stats.textureSwitches);
+	lua_setfield(L, -2, sname);
+
+	Graphics::getConstant(Graphics::STAT_BLEND_MODE_SWITCHES, sname);
+	lua_pushinteger(L, stats.blendModeSwitches);
+	lua_setfield(L, -2, sname);
+
 	Graphics::getConstant(Graphics::STAT_CANVASES, sname);
 	lua_pushinteger(L, stats.canvases);
 	lua_setfield(L, -2, sname);
@@ -1726,6 +1764,10 @@ static const luaL_Reg functions[] =
 	{ "getPointSize", w_getPointSize },
 	{ "setWireframe", w_setWireframe },
 	{ "isWireframe", w_isWireframe },
+	{ "setDeferred", w_setDeferred },
+	{ "isDeferred", w_isDeferred },
+	{ "setDrawLayer", w_setDrawLayer },
+	{ "getDrawLayer", w_getDrawLayer },
 	{ "newScreenshot", w_newScreenshot },
 	{ "setCanvas", w_setCanvas },
 	{ "getCanvas", w_getCanvas },
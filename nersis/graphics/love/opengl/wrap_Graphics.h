@@ -90,6 +90,10 @@ int w_setPointSize(lua_State *L);
 int w_getPointSize(lua_State *L);
 int w_setWireframe(lua_State *L);
 int w_isWireframe(lua_State *L);
+int w_setDeferred(lua_State *L);
+int w_isDeferred(lua_State *L);
+int w_setDrawLayer(lua_State *L);
+int w_getDrawLayer(lua_State *L);
 int w_newScreenshot(lua_State *L);
 int w_setCanvas(lua_State *L);
 int w_getCanvas(lua_State *L);
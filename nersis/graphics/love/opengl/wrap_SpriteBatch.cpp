@@ -26,6 +26,8 @@
 
 // C++
 #include <typeinfo>
+#include <algorithm>
+#include <vector>
 
 namespace love
 {
@@ -111,6 +113,55 @@ int w_SpriteBatch_set(lua_State *L)
 	return 0;
 }
 
+int w_SpriteBatch_addMany(lua_State *L)
+{
+	SpriteBatch *t = luax_checkspritebatch(L, 1);
+	Quad *quad = nullptr;
+	int startidx = 2;
+
+	if (luax_istype(L, 2, GRAPHICS_QUAD_ID))
+	{
+		quad = luax_totype<Quad>(L, 2, GRAPHICS_QUAD_ID);
+		startidx = 3;
+	}
+
+	int components = luaL_optint(L, startidx + 1, 2);
+	if (components < 2 || components > 9)
+		return luaL_argerror(L, startidx + 1, "expected 2 to 9 components per sprite");
+
+	int count = 0;
+
+	if (luax_istype(L, startidx, DATA_ID))
+	{
+		// Sprites come directly from a Data object, as 32 bit floats.
+		Data *data = luax_checktype<Data>(L, startidx, DATA_ID);
+		const float *sprites = (const float *) data->getData();
+		int numsprites = (int) (data->getSize() / (sizeof(float) * components));
+
+		luax_catchexcept(L, [&]() { count = t->addMany(sprites, numsprites, components, quad); });
+	}
+	else
+	{
+		// Flat table of sprite values.
+		luaL_checktype(L, startidx, LUA_TTABLE);
+
+		int numsprites = std::min((int) lua_objlen(L, startidx) / components, t->getBufferSize() - t->getCount());
+		std::vector<float> sprites(std::max(numsprites, 0) * components);
+
+		for (size_t i = 0; i < sprites.size(); i++)
+		{
+			lua_rawgeti(L, startidx, (int) i + 1);
+			sprites[i] = (float) luaL_checknumber(L, -1);
+			lua_pop(L, 1);
+		}
+
+		luax_catchexcept(L, [&]() { count = t->addMany(sprites.data(), numsprites, components, quad); });
+	}
+
+	lua_pushinteger(L, count);
+	return 1;
+}
+
 int w_SpriteBatch_clear(lua_State *L)
 {
 	SpriteBatch *t = luax_checkspritebatch(L, 1);
@@ -226,6 +277,7 @@ int w_SpriteBatch_getBufferSize(lua_State *L)
 static const luaL_Reg functions[] =
 {
 	{ "add", w_SpriteBatch_add },
+	{ "addMany", w_SpriteBatch_addMany },
 	{ "set", w_SpriteBatch_set },
 	{ "clear", w_SpriteBatch_clear },
 	{ "flush", w_SpriteBatch_flush },
@@ -98,8 +98,11 @@ int w_Text_add(lua_State *L)
 	float kx = (float) luaL_optnumber(L, 10, 0.0);
 	float ky = (float) luaL_optnumber(L, 11, 0.0);
 
-	luax_catchexcept(L, [&](){ t->add(text, x, y, a, sx, sy, ox, oy, kx, ky); });
-	return 0;
+	int index = 0;
+	luax_catchexcept(L, [&](){ index = t->add(text, x, y, a, sx, sy, ox, oy, kx, ky); });
+
+	lua_pushinteger(L, index + 1);
+	return 1;
 }
 
 int w_Text_addf(lua_State *L)
@@ -124,10 +127,52 @@ int w_Text_addf(lua_State *L)
 	float kx = (float) luaL_optnumber(L, 12, 0.0);
 	float ky = (float) luaL_optnumber(L, 13, 0.0);
 
-	luax_catchexcept(L, [&](){ t->addf(text, wrap, align, x, y, a, sx, sy, ox, oy, kx, ky); });
+	int index = 0;
+	luax_catchexcept(L, [&](){ index = t->addf(text, wrap, align, x, y, a, sx, sy, ox, oy, kx, ky); });
+
+	lua_pushinteger(L, index + 1);
+	return 1;
+}
+
+int w_Text_replace(lua_State *L)
+{
+	Text *t = luax_checktext(L, 1);
+	int index = (int) luaL_checkinteger(L, 2) - 1;
+	std::string text = luax_checkstring(L, 3);
+	luax_catchexcept(L, [&](){ t->replace(index, text); });
 	return 0;
 }
 
+int w_Text_remove(lua_State *L)
+{
+	Text *t = luax_checktext(L, 1);
+	int index = (int) luaL_checkinteger(L, 2) - 1;
+	luax_catchexcept(L, [&](){ t->remove(index); });
+	return 0;
+}
+
+int w_Text_getCount(lua_State *L)
+{
+	Text *t = luax_checktext(L, 1);
+	lua_pushinteger(L, t->getCount());
+	return 1;
+}
+
+int w_Text_setRingSize(lua_State *L)
+{
+	Text *t = luax_checktext(L, 1);
+	int size = (int) luaL_optinteger(L, 2, 0);
+	luax_catchexcept(L, [&](){ t->setRingSize(size); });
+	return 0;
+}
+
+int w_Text_getRingSize(lua_State *L)
+{
+	Text *t = luax_checktext(L, 1);
+	lua_pushinteger(L, t->getRingSize());
+	return 1;
+}
+
 int w_Text_clear(lua_State *L)
 {
 	Text *t = luax_checktext(L, 1);
@@ -171,6 +216,11 @@ static const luaL_Reg functions[] =
 	{ "setf", w_Text_setf },
 	{ "add", w_Text_add },
 	{ "addf", w_Text_addf },
+	{ "replace", w_Text_replace },
+	{ "remove", w_Text_remove },
+	{ "getCount", w_Text_getCount },
+	{ "setRingSize", w_Text_setRingSize },
+	{ "getRingSize", w_Text_getRingSize },
 	{ "clear", w_Text_clear },
 	{ "setFont", w_Text_setFont },
 	{ "getFont", w_Text_getFont },
@@ -36,6 +36,11 @@ int w_Text_set(lua_State *L);
 int w_Text_setf(lua_State *L);
 int w_Text_add(lua_State *L);
 int w_Text_addf(lua_State *L);
+int w_Text_replace(lua_State *L);
+int w_Text_remove(lua_State *L);
+int w_Text_getCount(lua_State *L);
+int w_Text_setRingSize(lua_State *L);
+int w_Text_getRingSize(lua_State *L);
 int w_Text_clear(lua_State *L);
 int w_Text_setFont(lua_State *L);
 int w_Text_getFont(lua_State *L);
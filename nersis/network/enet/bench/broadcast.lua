@@ -0,0 +1,84 @@
+--[[
+Measures the CPU time of broadcasting a 16 KB reliable state to 256 peers.
+
+All hosts are attached to a loopback network, so only the host side of the
+library is timed. Run it with a LuaJIT that can require the enet module:
+
+	luajit broadcast.lua [rounds = 200] [peers = 256] [size = 16384]
+]]
+
+local enet = require "enet"
+
+local rounds = tonumber(arg and arg[1]) or 200
+local peer_count = tonumber(arg and arg[2]) or 256
+local size = tonumber(arg and arg[3]) or 16384
+
+local net = enet.loopback_network()
+local server = enet.host_create(nil, peer_count, 1)
+local address = net:attach(server)
+
+local clients = {}
+for i = 1, peer_count do
+	local client = enet.host_create(nil, 1, 1)
+	net:attach(client)
+	client:connect(address, 1)
+	clients[i] = client
+end
+
+local function service_clients()
+	local received = 0
+	for i = 1, peer_count do
+		local event = clients[i]:service(0)
+		while event do
+			if event.type == "receive" then
+				received = received + 1
+			end
+			event = clients[i]:service(0)
+		end
+	end
+	return received
+end
+
+local connected = 0
+while connected < peer_count do
+	local event = server:service(0)
+	while event do
+		if event.type == "connect" then
+			connected = connected + 1
+		end
+		event = server:service(0)
+	end
+	service_clients()
+end
+
+local state = {}
+for i = 1, size do
+	state[i] = string.char(i % 251)
+end
+state = table.concat(state)
+
+local broadcast_time, flush_time, received = 0, 0, 0
+for round = 1, rounds do
+	local start = os.clock()
+	server:broadcast(state, 0, "reliable")
+	broadcast_time = broadcast_time + os.clock() - start
+
+	start = os.clock()
+	server:flush()
+	flush_time = flush_time + os.clock() - start
+
+	-- deliver the fragments and their acknowledgements before the next round
+	received = received + service_clients()
+	while server:service(0) do end
+end
+
+for i = 1, 100 do
+	if received == rounds * peer_count then
+		break
+	end
+	received = received + service_clients()
+	while server:service(0) do end
+end
+
+print(string.format("%d x %d bytes to %d peers: broadcast %.1f us, flush %.1f us per round (%d/%d delivered)",
+	rounds, size, peer_count, broadcast_time / rounds * 1e6, flush_time / rounds * 1e6, received, rounds * peer_count))
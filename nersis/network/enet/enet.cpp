@@ -21,6 +21,7 @@
  * THE SOFTWARE.
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -35,9 +36,169 @@ extern "C" {
 #define check_host(l, idx)\
 	*(ENetHost**)luaL_checkudata(l, idx, "enet_host")
 
+#define check_host_data(l, idx)\
+	(host_data*)luaL_checkudata(l, idx, "enet_host")
+
 #define check_peer(l, idx)\
 	*(ENetPeer**)luaL_checkudata(l, idx, "enet_peer")
 
+#define check_loopback(l, idx)\
+	*(ENetLoopbackNetwork**)luaL_checkudata(l, idx, "enet_loopback")
+
+#define check_sharded_host(l, idx)\
+	*(ENetShardedHost**)luaL_checkudata(l, idx, "enet_sharded_host")
+
+#define check_snapshot(l, idx)\
+	*(ENetSnapshotHistory**)luaL_checkudata(l, idx, "enet_snapshot")
+
+/**
+ * Small messages sent on a coalescing channel are appended to a per peer,
+ * per channel packet, each prefixed with its length as a varint, and the
+ * packet is sent on the next flush. The receiving end unpacks it into one
+ * receive event per message.
+ */
+struct coalesce_buffer {
+	ENetPacket *packet; // NULL until a message is queued
+	size_t length;
+};
+
+struct peer_data {
+	struct host_data *owner;
+	size_t limit; // largest batch, chosen to fit one datagram
+	int dirty;
+	size_t channel_count;
+	enet_uint32 coalesced[(ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT + 31) / 32];
+	coalesce_buffer channels[1]; // channel_count entries
+};
+
+// The userdata of an enet_host; check_host reads the first field.
+struct host_data {
+	ENetHost *host;
+
+	ENetPeer **dirty; // peers with queued batches, may hold stale entries
+	size_t dirty_count;
+	size_t dirty_capacity;
+
+	// batch being unpacked into receive events
+	ENetPacket *pending;
+	ENetPeer *pending_peer;
+	enet_uint8 pending_channel;
+	size_t pending_offset;
+};
+
+static int is_coalesced(ENetPeer *peer, enet_uint8 channel_id) {
+	peer_data *data = (peer_data *) peer->data;
+	return data != NULL && channel_id < data->channel_count &&
+		(data->coalesced[channel_id / 32] & (1u << (channel_id % 32))) != 0;
+}
+
+static void flush_channel(ENetPeer *peer, peer_data *data, size_t channel_id) {
+	coalesce_buffer *buffer = &data->channels[channel_id];
+	if (buffer->packet == NULL) return;
+
+	buffer->packet->dataLength = buffer->length;
+	if (enet_peer_send(peer, (enet_uint8) channel_id, buffer->packet) < 0) {
+		enet_packet_destroy(buffer->packet);
+	}
+	buffer->packet = NULL;
+	buffer->length = 0;
+}
+
+static void flush_peer(ENetPeer *peer) {
+	peer_data *data = (peer_data *) peer->data;
+	if (data == NULL || !data->dirty) return;
+
+	for (size_t i = 0; i < data->channel_count; i++) {
+		flush_channel(peer, data, i);
+	}
+	data->dirty = 0;
+}
+
+static void flush_coalesced(host_data *host) {
+	for (size_t i = 0; i < host->dirty_count; i++) {
+		flush_peer(host->dirty[i]);
+	}
+	host->dirty_count = 0;
+}
+
+static void free_peer_data(ENetPeer *peer) {
+	peer_data *data = (peer_data *) peer->data;
+	if (data == NULL) return;
+
+	for (size_t i = 0; i < data->channel_count; i++) {
+		if (data->channels[i].packet != NULL) {
+			enet_packet_destroy(data->channels[i].packet);
+		}
+	}
+	free(data);
+	peer->data = NULL;
+}
+
+/**
+ * Queue a message on a coalescing channel, sending the batch first if the
+ * message would not fit or has different flags
+ */
+static int coalesce_message(ENetPeer *peer, enet_uint8 channel_id, const void *message, size_t size, enet_uint32 flags) {
+	peer_data *data = (peer_data *) peer->data;
+	coalesce_buffer *buffer = &data->channels[channel_id];
+	size_t framed = size + 1;
+	for (size_t rest = size >> 7; rest > 0; rest >>= 7) framed++;
+
+	if (buffer->packet != NULL &&
+		(buffer->packet->flags != flags || buffer->length + framed > data->limit)) {
+		flush_channel(peer, data, channel_id);
+	}
+
+	if (buffer->packet == NULL) {
+		buffer->packet = enet_packet_create(NULL, framed > data->limit ? framed : data->limit, flags);
+		if (buffer->packet == NULL) return -1;
+		buffer->length = 0;
+	}
+
+	enet_uint8 *out = buffer->packet->data + buffer->length;
+	size_t rest = size;
+	while (rest >= 0x80) {
+		*out++ = (enet_uint8) (rest | 0x80);
+		rest >>= 7;
+	}
+	*out++ = (enet_uint8) rest;
+	memcpy(out, message, size);
+	buffer->length += framed;
+
+	if (!data->dirty) {
+		host_data *host = data->owner;
+		if (host->dirty_count == host->dirty_capacity) {
+			size_t capacity = host->dirty_capacity ? host->dirty_capacity * 2 : 16;
+			ENetPeer **dirty = (ENetPeer **) realloc(host->dirty, capacity * sizeof(ENetPeer *));
+			if (dirty == NULL) return -1;
+			host->dirty = dirty;
+			host->dirty_capacity = capacity;
+		}
+		host->dirty[host->dirty_count++] = peer;
+		data->dirty = 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Send a packet to a peer, through its batch if the channel is coalescing.
+ * Takes ownership of the packet. Returns -1 only if the batch could not be
+ * allocated; a packet the peer refuses is dropped like peer:send does.
+ */
+static int send_packet(ENetPeer *peer, enet_uint8 channel_id, ENetPacket *packet) {
+	if (is_coalesced(peer, channel_id)) {
+		int result = coalesce_message(peer, channel_id, packet->data, packet->dataLength, packet->flags);
+		enet_packet_destroy(packet);
+		return result;
+	}
+
+	if (enet_peer_send(peer, channel_id, packet) < 0) {
+		enet_packet_destroy(packet);
+	}
+	return 0;
+}
+
 /**
  * Parse address string, eg:
  *	*:5959
@@ -123,7 +284,65 @@ static void push_peer(lua_State *l, ENetPeer *peer) {
 	lua_remove(l, -2); // remove enet_peers
 }
 
-static void push_event(lua_State *l, ENetEvent *event) {
+/**
+ * Push the next message of the batch being unpacked as a receive event
+ * Returns 0 once the batch is exhausted or found malformed
+ */
+static int push_coalesced(lua_State *l, host_data *host) {
+	ENetPacket *packet = host->pending;
+	if (packet == NULL) return 0;
+
+	size_t offset = host->pending_offset, size = 0;
+	int shift = 0;
+	while (offset < packet->dataLength && shift < 32) {
+		enet_uint8 byte = packet->data[offset++];
+		size |= (size_t) (byte & 0x7F) << shift;
+		shift += 7;
+		if (!(byte & 0x80)) break;
+	}
+
+	if (offset == host->pending_offset || (packet->data[offset - 1] & 0x80) ||
+		size > packet->dataLength - offset) {
+		enet_packet_destroy(packet);
+		host->pending = NULL;
+		return 0;
+	}
+
+	lua_createtable(l, 0, 4);
+	push_peer(l, host->pending_peer);
+	lua_setfield(l, -2, "peer");
+	lua_pushlstring(l, (const char *)packet->data + offset, size);
+	lua_setfield(l, -2, "data");
+	lua_pushinteger(l, host->pending_channel);
+	lua_setfield(l, -2, "channel");
+	lua_pushstring(l, "receive");
+	lua_setfield(l, -2, "type");
+
+	host->pending_offset = offset + size;
+	if (host->pending_offset == packet->dataLength) {
+		enet_packet_destroy(packet);
+		host->pending = NULL;
+	}
+
+	return 1;
+}
+
+/**
+ * Push an event table, returns 0 if the event was an empty batch
+ */
+static int push_event(lua_State *l, host_data *host, ENetEvent *event) {
+	if (event->type == ENET_EVENT_TYPE_RECEIVE && is_coalesced(event->peer, event->channelID)) {
+		host->pending = event->packet;
+		host->pending_peer = event->peer;
+		host->pending_channel = event->channelID;
+		host->pending_offset = 0;
+		return push_coalesced(l, host);
+	}
+
+	if (event->type == ENET_EVENT_TYPE_DISCONNECT) {
+		free_peer_data(event->peer);
+	}
+
 	lua_newtable(l); // event table
 
 	if (event->peer) {
@@ -151,6 +370,14 @@ static void push_event(lua_State *l, ENetEvent *event) {
 			lua_pushinteger(l, event->channelID);
 			lua_setfield(l, -2, "channel");
 
+			if (event->packet->flags & ENET_PACKET_FLAG_STREAM_CHUNK) {
+				lua_pushinteger(l, event->data);
+				lua_setfield(l, -2, "stream_length");
+
+				lua_pushboolean(l, (event->packet->flags & ENET_PACKET_FLAG_STREAM_END) != 0);
+				lua_setfield(l, -2, "stream_end");
+			}
+
 			lua_pushstring(l, "receive");
 
 			enet_packet_destroy(event->packet);
@@ -161,17 +388,15 @@ static void push_event(lua_State *l, ENetEvent *event) {
 	}
 
 	lua_setfield(l, -2, "type");
+	return 1;
 }
 
 /**
- * Read a packet off the stack as a string
+ * Read the channel and flags following a packet string on the stack
  * idx is position of string
  */
-static ENetPacket *read_packet(lua_State *l, int idx, enet_uint8 *channel_id) {
-	size_t size;
+static enet_uint32 read_packet_flags(lua_State *l, int idx, enet_uint8 *channel_id) {
 	int argc = lua_gettop(l);
-	const void *data = luaL_checklstring(l, idx, &size);
-	ENetPacket *packet;
 
 	enet_uint32 flags = ENET_PACKET_FLAG_RELIABLE;
 	*channel_id = 0;
@@ -193,7 +418,19 @@ static ENetPacket *read_packet(lua_State *l, int idx, enet_uint8 *channel_id) {
 		*channel_id = luaL_checkint(l, idx+1);
 	}
 
-	packet = enet_packet_create(data, size, flags);
+	return flags;
+}
+
+/**
+ * Read a packet off the stack as a string
+ * idx is position of string
+ */
+static ENetPacket *read_packet(lua_State *l, int idx, enet_uint8 *channel_id) {
+	size_t size;
+	const void *data = luaL_checklstring(l, idx, &size);
+	enet_uint32 flags = read_packet_flags(l, idx, channel_id);
+
+	ENetPacket *packet = enet_packet_create(data, size, flags);
 	if (packet == NULL) {
 		luaL_error(l, "Failed to create packet");
 	}
@@ -246,10 +483,19 @@ static int host_create(lua_State *l) {
 		return 2;
 	}
 
-	*(ENetHost**)lua_newuserdata(l, sizeof(void*)) = host;
+	host_data *data = (host_data *)lua_newuserdata(l, sizeof(host_data));
+	memset(data, 0, sizeof(host_data));
+	data->host = host;
 	luaL_getmetatable(l, "enet_host");
 	lua_setmetatable(l, -2);
 
+	// let peer:coalesce find the userdata of the peer's host
+	lua_getfield(l, LUA_REGISTRYINDEX, "enet_hosts");
+	lua_pushlightuserdata(l, host);
+	lua_pushvalue(l, -3);
+	lua_settable(l, -3);
+	lua_pop(l, 1);
+
 	return 1;
 }
 
@@ -261,6 +507,92 @@ static int linked_version(lua_State *l) {
 	return 1;
 }
 
+/**
+ * Report the allocation statistics of the libenet packet/command pool
+ * Args:
+ *	[table to fill, a new one is created if nil]
+ *	[reset = false] clear the cumulative counters after reading them
+ */
+static int pool_stats(lua_State *l) {
+	ENetPoolStats stats;
+	enet_pool_get_stats(&stats);
+
+	if (lua_istable(l, 1)) {
+		lua_settop(l, 1);
+	} else {
+		lua_createtable(l, 0, 8);
+	}
+
+	lua_pushnumber(l, stats.allocations);
+	lua_setfield(l, -2, "allocations");
+	lua_pushnumber(l, stats.frees);
+	lua_setfield(l, -2, "frees");
+	lua_pushnumber(l, stats.hits);
+	lua_setfield(l, -2, "hits");
+	lua_pushnumber(l, stats.misses);
+	lua_setfield(l, -2, "misses");
+	lua_pushnumber(l, stats.oversized);
+	lua_setfield(l, -2, "oversized");
+	lua_pushnumber(l, stats.liveBlocks);
+	lua_setfield(l, -2, "live_blocks");
+	lua_pushnumber(l, stats.cachedBlocks);
+	lua_setfield(l, -2, "cached_blocks");
+	lua_pushnumber(l, stats.cachedBytes);
+	lua_setfield(l, -2, "cached_bytes");
+
+	if (lua_toboolean(l, 2)) {
+		enet_pool_reset_stats();
+	}
+
+	return 1;
+}
+
+/**
+ * Release the memory held in the pool's freelists
+ * Returns the number of bytes released
+ */
+static int pool_trim(lua_State *l) {
+	ENetPoolStats before, after;
+	enet_pool_get_stats(&before);
+	enet_pool_trim();
+	enet_pool_get_stats(&after);
+
+	lua_pushnumber(l, (lua_Number) (before.cachedBytes - after.cachedBytes));
+	return 1;
+}
+
+/**
+ * Build an lz4 compression dictionary from recorded packets
+ * Args:
+ *	array of sample packet strings
+ *	[size = 32768] maximum dictionary size in bytes
+ * Returns the dictionary as a string, to be passed to host:compress
+ */
+static int train_dictionary(lua_State *l) {
+	luaL_checktype(l, 1, LUA_TTABLE);
+	size_t limit = (size_t) luaL_optint(l, 2, ENET_LZ4_MAXIMUM_DICTIONARY);
+	size_t sample_count = lua_objlen(l, 1);
+
+	if (limit > ENET_LZ4_MAXIMUM_DICTIONARY) {
+		limit = ENET_LZ4_MAXIMUM_DICTIONARY;
+	}
+
+	// the sample strings stay referenced by the table at index 1, so
+	// their data pointers remain valid while training
+	ENetBuffer *samples = (ENetBuffer *) lua_newuserdata(l, sample_count * sizeof(ENetBuffer) + 1);
+	for (size_t i = 0; i < sample_count; i++) {
+		lua_rawgeti(l, 1, (int) i + 1);
+		samples[i].data = (void *) luaL_checklstring(l, -1, &samples[i].dataLength);
+		lua_pop(l, 1);
+	}
+
+	enet_uint8 *dictionary = (enet_uint8 *) lua_newuserdata(l, limit + 1);
+	size_t length = enet_lz4_train_dictionary(samples, sample_count, dictionary, limit);
+
+	lua_pushlstring(l, (const char *) dictionary, length);
+	return 1;
+}
+
 /**
  * Serice a host
  * Args:
@@ -271,7 +603,8 @@ static int linked_version(lua_State *l) {
  *	an event table on event
  */
 static int host_service(lua_State *l) {
-	ENetHost *host = check_host(l, 1);
+	host_data *data = check_host_data(l, 1);
+	ENetHost *host = data->host;
 	if (!host) {
 		return luaL_error(l, "Tried to index a nil host!");
 	}
@@ -281,29 +614,33 @@ static int host_service(lua_State *l) {
 	if (lua_gettop(l) > 1)
 		timeout = luaL_checkint(l, 2);
 
+	if (push_coalesced(l, data)) return 1;
+	flush_coalesced(data);
+
 	out = enet_host_service(host, &event, timeout);
 	if (out == 0) return 0;
 	if (out < 0) return luaL_error(l, "Error during service");
 
-	push_event(l, &event);
-	return 1;
+	return push_event(l, data, &event);
 }
 
 /**
  * Dispatch a single event if available
  */
 static int host_check_events(lua_State *l) {
-	ENetHost *host = check_host(l, 1);
+	host_data *data = check_host_data(l, 1);
+	ENetHost *host = data->host;
 	if (!host) {
 		return luaL_error(l, "Tried to index a nil host!");
 	}
+	if (push_coalesced(l, data)) return 1;
+
 	ENetEvent event;
 	int out = enet_host_check_events(host, &event);
 	if (out == 0) return 0;
 	if (out < 0) return luaL_error(l, "Error checking event");
 
-	push_event(l, &event);
-	return 1;
+	return push_event(l, data, &event);
 }
 
 /**
@@ -326,6 +663,68 @@ static int host_compress_with_range_coder(lua_State *l) {
 	return 1;
 }
 
+/**
+ * Select the compressor for the transmitted data of all peers. The peers on
+ * the other end must select the same compressor and dictionary, since
+ * packets are only flagged as compressed, not tagged with the codec.
+ * Args:
+ *	codec ["lz4", "range_coder", nil], nil disables compression
+ *	[dictionary string for lz4, see enet.train_dictionary]
+ */
+static int host_compress(lua_State *l) {
+	ENetHost *host = check_host(l, 1);
+	if (!host) {
+		return luaL_error(l, "Tried to index a nil host!");
+	}
+
+	int result = 0;
+	if (lua_isnoneornil(l, 2)) {
+		enet_host_compress (host, NULL);
+	} else {
+		const char *codec = luaL_checkstring(l, 2);
+		if (strcmp(codec, "lz4") == 0) {
+			size_t dictionary_length = 0;
+			const char *dictionary = luaL_optlstring(l, 3, NULL, &dictionary_length);
+			result = enet_host_compress_with_lz4 (host, dictionary, dictionary_length);
+		} else if (strcmp(codec, "range_coder") == 0) {
+			result = enet_host_compress_with_range_coder (host);
+		} else {
+			return luaL_error(l, "Unknown compressor: %s", codec);
+		}
+	}
+
+	lua_pushboolean (l, result == 0);
+	return 1;
+}
+
+/**
+ * Select the checksum appended to every datagram sent and verified on every
+ * datagram received. Both ends of a connection must select the same one.
+ * Args:
+ *	algorithm ["crc32c", "crc32", nil], nil disables checksums
+ */
+static int host_enable_checksum(lua_State *l) {
+	ENetHost *host = check_host(l, 1);
+	if (!host) {
+		return luaL_error(l, "Tried to index a nil host!");
+	}
+
+	if (lua_isnoneornil(l, 2)) {
+		host->checksum = NULL;
+	} else {
+		const char *algorithm = luaL_checkstring(l, 2);
+		if (strcmp(algorithm, "crc32c") == 0) {
+			host->checksum = enet_crc32c;
+		} else if (strcmp(algorithm, "crc32") == 0) {
+			host->checksum = enet_crc32;
+		} else {
+			return luaL_error(l, "Unknown checksum: %s", algorithm);
+		}
+	}
+
+	return 0;
+}
+
 /**
  * Connect a host to an address
  * Args:
@@ -366,23 +765,97 @@ static int host_connect(lua_State *l) {
 }
 
 static int host_flush(lua_State *l) {
-	ENetHost *host = check_host(l, 1);
+	host_data *data = check_host_data(l, 1);
+	ENetHost *host = data->host;
 	if (!host) {
 		return luaL_error(l, "Tried to index a nil host!");
 	}
+	flush_coalesced(data);
 	enet_host_flush(host);
 	return 0;
 }
 
+/**
+ * Send a lua string to every connected peer, or to a subset of them
+ * Args:
+ *	packet data, string
+ *	channel id
+ *	flags ["reliable", nil]
+ *	[peers] array of peers to send to (interest set)
+ */
 static int host_broadcast(lua_State *l) {
 	ENetHost *host = check_host(l, 1);
 	if (!host) {
 		return luaL_error(l, "Tried to index a nil host!");
 	}
 
+	ENetPeer *peer_buffer[256];
+	ENetPeer **peers = NULL;
+	size_t peer_count = 0;
+
+	// collect the peers before creating the packet so a bad argument can't leak it
+	if (lua_gettop(l) >= 5 && !lua_isnil(l, 5)) {
+		luaL_checktype(l, 5, LUA_TTABLE);
+		peer_count = lua_objlen(l, 5);
+		peers = peer_buffer;
+		if (peer_count > sizeof(peer_buffer) / sizeof(peer_buffer[0])) {
+			// left on the stack so it stays anchored until we return
+			peers = (ENetPeer**)lua_newuserdata(l, peer_count * sizeof(ENetPeer*));
+		}
+
+		for (size_t i = 0; i < peer_count; i++) {
+			lua_rawgeti(l, 5, i + 1);
+			peers[i] = *(ENetPeer**)luaL_checkudata(l, -1, "enet_peer");
+			lua_pop(l, 1);
+		}
+	}
+
+	size_t size;
+	const void *message = luaL_checklstring(l, 2, &size);
 	enet_uint8 channel_id;
-	ENetPacket *packet = read_packet(l, 2, &channel_id);
-	enet_host_broadcast(host, channel_id, packet);
+	enet_uint32 flags = read_packet_flags(l, 2, &channel_id);
+
+	// peers coalescing the channel get the message in their batch, so only
+	// the others share the packet
+	size_t candidate_count = peers != NULL ? peer_count : host->peerCount;
+	size_t coalesced_count = 0;
+	for (size_t i = 0; i < candidate_count; i++) {
+		ENetPeer *peer = peers != NULL ? peers[i] : &host->peers[i];
+		if (peer->host == host && is_coalesced(peer, channel_id)) {
+			coalesced_count++;
+		}
+	}
+
+	if (coalesced_count > 0) {
+		ENetPeer **direct = (ENetPeer**)lua_newuserdata(l, (candidate_count - coalesced_count + 1) * sizeof(ENetPeer*));
+		size_t direct_count = 0;
+
+		for (size_t i = 0; i < candidate_count; i++) {
+			ENetPeer *peer = peers != NULL ? peers[i] : &host->peers[i];
+			if (peer->host != host || peer->state != ENET_PEER_STATE_CONNECTED) continue;
+
+			if (!is_coalesced(peer, channel_id)) {
+				direct[direct_count++] = peer;
+			} else if (coalesce_message(peer, channel_id, message, size, flags) < 0) {
+				return luaL_error(l, "Failed to create packet");
+			}
+		}
+
+		if (direct_count == 0) return 0;
+		peers = direct;
+		peer_count = direct_count;
+	}
+
+	ENetPacket *packet = enet_packet_create(message, size, flags);
+	if (packet == NULL) {
+		return luaL_error(l, "Failed to create packet");
+	}
+
+	if (peers != NULL) {
+		enet_host_broadcast_peers(host, channel_id, packet, peers, peer_count);
+	} else {
+		enet_host_broadcast(host, channel_id, packet);
+	}
 	return 0;
 }
 
@@ -397,6 +870,75 @@ static int host_channel_limit(lua_State *l) {
 	return 0;
 }
 
+/**
+ * Deliver large reliable packets on a channel fragment by fragment.
+ * Each receive event then carries stream_length and stream_end fields.
+ * Args: channel:number, enable:boolean
+ */
+static int host_stream_channel(lua_State *l) {
+	ENetHost *host = check_host(l, 1);
+	if (!host) {
+		return luaL_error(l, "Tried to index a nil host!");
+	}
+	int channel_id = luaL_checkint(l, 2);
+	if (channel_id < 0 || channel_id >= ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT) {
+		return luaL_argerror(l, 2, "channel out of range");
+	}
+	enet_host_stream_channel(host, (enet_uint8)channel_id, lua_isnoneornil(l, 3) || lua_toboolean(l, 3));
+	return 0;
+}
+
+/**
+ * Require connecting peers to echo a stateless cookie before a peer slot is
+ * allocated for them, so forged source addresses cannot fill the host.
+ * Clients need no configuration.
+ * Args:
+ *	[enable = true]
+ *	[key] 16 byte secret shared by hosts behind one address, random if nil
+ */
+static int host_require_cookies(lua_State *l) {
+	ENetHost *host = check_host(l, 1);
+	if (!host) {
+		return luaL_error(l, "Tried to index a nil host!");
+	}
+	int enable = lua_isnoneornil(l, 2) || lua_toboolean(l, 2);
+	const enet_uint8 *key = NULL;
+
+	if (!lua_isnoneornil(l, 3)) {
+		size_t key_length;
+		key = (const enet_uint8 *)luaL_checklstring(l, 3, &key_length);
+		if (key_length != 16) {
+			return luaL_argerror(l, 3, "key must be 16 bytes");
+		}
+	}
+
+	if (enet_host_require_cookies(host, enable, key) < 0) {
+		return luaL_error(l, "Failed to configure cookies");
+	}
+	return 0;
+}
+
+/**
+ * Limit connect attempts per source address. Datagrams over the limit are
+ * dropped before they are parsed.
+ * Args:
+ *	rate attempts per second, 0 disables the limit
+ *	[burst = rate]
+ */
+static int host_limit_connections(lua_State *l) {
+	ENetHost *host = check_host(l, 1);
+	if (!host) {
+		return luaL_error(l, "Tried to index a nil host!");
+	}
+	enet_uint32 rate = luaL_checkint(l, 2);
+	enet_uint32 burst = luaL_optint(l, 3, rate);
+
+	if (enet_host_limit_connections(host, rate, burst) < 0) {
+		return luaL_error(l, "Failed to configure connection limit");
+	}
+	return 0;
+}
+
 static int host_bandwidth_limit(lua_State *l) {
 	ENetHost *host = check_host(l, 1);
 	if (!host) {
@@ -414,7 +956,11 @@ static int host_get_socket_address(lua_State *l) {
 		return luaL_error(l, "Tried to index a nil host!");
 	}
 	ENetAddress address;
-	enet_socket_get_address (host->socket, &address);
+	if (host->socket != ENET_SOCKET_NULL) {
+		enet_socket_get_address (host->socket, &address);
+	} else {
+		address = host->address;
+	}
 
 	lua_pushfstring(l, "%d.%d.%d.%d:%d",
 			((address.host) & 0xFF),
@@ -467,29 +1013,113 @@ static int host_peer_count(lua_State *l) {
 	return 1;
 }
 
-static int host_get_peer(lua_State *l) {
+static void set_stat(lua_State *l, const char *name, lua_Number value) {
+	lua_pushnumber(l, value);
+	lua_setfield(l, -2, name);
+}
+
+/**
+ * Store a histogram as an array in the field `name` of the table on top of
+ * the stack, reusing the array already there so that sampling stats every
+ * tick does not allocate.
+ */
+static void set_histogram(lua_State *l, const char *name, const enet_uint32 *histogram) {
+	lua_getfield(l, -1, name);
+	if (!lua_istable(l, -1)) {
+		lua_pop(l, 1);
+		lua_createtable(l, ENET_PEER_HISTOGRAM_BUCKETS, 0);
+		lua_pushvalue(l, -1);
+		lua_setfield(l, -3, name);
+	}
+
+	for (int i = 0; i < ENET_PEER_HISTOGRAM_BUCKETS; i++) {
+		lua_pushnumber(l, histogram[i]);
+		lua_rawseti(l, -2, i + 1);
+	}
+	lua_pop(l, 1);
+}
+
+/**
+ * Report the host's peer counts, traffic totals, and round trip time and
+ * send queue latency histograms accumulated over all peers. Histogram entry
+ * i counts samples in [2^(i-2), 2^(i-1)) milliseconds, entry 1 counts 0 ms
+ * and the last entry everything above.
+ * Args:
+ *	[table to fill, a new one is created if nil]
+ *	[reset = false] clear the histograms after reading them
+ */
+static int host_stats(lua_State *l) {
 	ENetHost *host = check_host(l, 1);
 	if (!host) {
 		return luaL_error(l, "Tried to index a nil host!");
 	}
 
-	int peer_index = luaL_checkint(l, 2) - 1;
+	ENetHostStats stats;
+	enet_host_get_stats(host, &stats);
 
-	if (peer_index < 0 || ((size_t) peer_index) >= host->peerCount) {
-		luaL_argerror (l, 2, "Invalid peer index");
+	if (lua_istable(l, 2)) {
+		lua_settop(l, 2);
+	} else {
+		lua_createtable(l, 0, 14);
 	}
 
-	ENetPeer *peer = &(host->peers[peer_index]);
+	set_stat(l, "peer_count", stats.peerCount);
+	set_stat(l, "connected_peers", stats.connectedPeers);
+	set_stat(l, "bandwidth_limited_peers", stats.bandwidthLimitedPeers);
+	set_stat(l, "peers_with_outgoing_data", stats.peersWithOutgoingData);
+	set_stat(l, "scheduled_peers", stats.scheduledPeers);
+	set_stat(l, "total_sent_data", stats.totalSentData);
+	set_stat(l, "total_sent_packets", stats.totalSentPackets);
+	set_stat(l, "total_received_data", stats.totalReceivedData);
+	set_stat(l, "total_received_packets", stats.totalReceivedPackets);
+	set_stat(l, "connects_limited", stats.connectsLimited);
+	set_stat(l, "challenges_sent", stats.challengesSent);
+	set_stat(l, "cookies_rejected", stats.cookiesRejected);
+	set_histogram(l, "round_trip_time_histogram", stats.roundTripTimeHistogram);
+	set_histogram(l, "send_latency_histogram", stats.sendLatencyHistogram);
+
+	if (lua_toboolean(l, 3)) {
+		enet_host_reset_stats(host);
+	}
 
-	push_peer (l, peer);
 	return 1;
 }
 
-static int host_gc(lua_State *l) {
-	// We have to manually grab the userdata so that we can set it to NULL.
-	ENetHost** host = (ENetHost**)luaL_checkudata(l, 1, "enet_host");
-	// We don't want to crash by destroying a non-existant host.
-	if (*host) {
+static int host_get_peer(lua_State *l) {
+	ENetHost *host = check_host(l, 1);
+	if (!host) {
+		return luaL_error(l, "Tried to index a nil host!");
+	}
+
+	int peer_index = luaL_checkint(l, 2) - 1;
+
+	if (peer_index < 0 || ((size_t) peer_index) >= host->peerCount) {
+		luaL_argerror (l, 2, "Invalid peer index");
+	}
+
+	ENetPeer *peer = &(host->peers[peer_index]);
+
+	push_peer (l, peer);
+	return 1;
+}
+
+static int host_gc(lua_State *l) {
+	// We have to manually grab the userdata so that we can set it to NULL.
+	host_data *data = check_host_data(l, 1);
+	ENetHost** host = &data->host;
+	// We don't want to crash by destroying a non-existant host.
+	if (*host) {
+		if (data->pending != NULL) {
+			enet_packet_destroy(data->pending);
+			data->pending = NULL;
+		}
+		for (size_t i = 0; i < (*host)->peerCount; i++) {
+			free_peer_data(&(*host)->peers[i]);
+		}
+		free(data->dirty);
+		data->dirty = NULL;
+		data->dirty_count = data->dirty_capacity = 0;
+
 		enet_host_destroy(*host);
 	}
 	*host = NULL;
@@ -550,6 +1180,97 @@ static int peer_last_round_trip_time(lua_State *l) {
 	return 1;
 }
 
+/**
+ * Report everything the peer tracks about its connection: round trip time,
+ * packet loss and throttle (as ratios of 65536 and 32), reliable data in
+ * transit, window size, queue lengths summed over all channels, and the
+ * round trip time and send queue latency histograms (see host:stats).
+ * Args:
+ *	[table to fill, a new one is created if nil]
+ *	[reset = false] clear the histograms and retransmission count after reading them
+ */
+static int peer_stats(lua_State *l) {
+	ENetPeer *peer = check_peer(l, 1);
+
+	ENetPeerStats stats;
+	enet_peer_get_stats(peer, &stats);
+
+	if (lua_istable(l, 2)) {
+		lua_settop(l, 2);
+	} else {
+		lua_createtable(l, 0, 28);
+	}
+
+	set_stat(l, "round_trip_time", stats.roundTripTime);
+	set_stat(l, "round_trip_time_variance", stats.roundTripTimeVariance);
+	set_stat(l, "lowest_round_trip_time", stats.lowestRoundTripTime);
+	set_stat(l, "last_round_trip_time", stats.lastRoundTripTime);
+	set_stat(l, "packet_loss", stats.packetLoss);
+	set_stat(l, "packet_loss_variance", stats.packetLossVariance);
+	set_stat(l, "packet_throttle", stats.packetThrottle);
+	set_stat(l, "packet_throttle_limit", stats.packetThrottleLimit);
+	set_stat(l, "packets_sent", stats.packetsSent);
+	set_stat(l, "packets_lost", stats.packetsLost);
+	set_stat(l, "packets_retransmitted", stats.packetsRetransmitted);
+	set_stat(l, "reliable_data_in_transit", stats.reliableDataInTransit);
+	set_stat(l, "window_size", stats.windowSize);
+	set_stat(l, "mtu", stats.mtu);
+	set_stat(l, "incoming_bandwidth", stats.incomingBandwidth);
+	set_stat(l, "outgoing_bandwidth", stats.outgoingBandwidth);
+	set_stat(l, "incoming_data_total", stats.incomingDataTotal);
+	set_stat(l, "outgoing_data_total", stats.outgoingDataTotal);
+	set_stat(l, "acknowledgements", stats.acknowledgements);
+	set_stat(l, "outgoing_reliable_commands", stats.outgoingReliableCommands);
+	set_stat(l, "outgoing_unreliable_commands", stats.outgoingUnreliableCommands);
+	set_stat(l, "sent_reliable_commands", stats.sentReliableCommands);
+	set_stat(l, "incoming_reliable_commands", stats.incomingReliableCommands);
+	set_stat(l, "incoming_unreliable_commands", stats.incomingUnreliableCommands);
+	set_stat(l, "incoming_fragmented_packets", stats.incomingFragmentedPackets);
+	set_stat(l, "dispatched_commands", stats.dispatchedCommands);
+	set_histogram(l, "round_trip_time_histogram", stats.roundTripTimeHistogram);
+	set_histogram(l, "send_latency_histogram", stats.sendLatencyHistogram);
+
+	if (lua_toboolean(l, 3)) {
+		enet_peer_reset_stats(peer);
+	}
+
+	return 1;
+}
+
+/**
+ * Report the sequencing and reassembly state of one channel
+ * Args:
+ *	channel number, starting at 0
+ *	[table to fill, a new one is created if nil]
+ */
+static int peer_channel_stats(lua_State *l) {
+	ENetPeer *peer = check_peer(l, 1);
+	size_t channel_id = (size_t) luaL_checkint(l, 2);
+
+	ENetChannelStats stats;
+	if (enet_peer_get_channel_stats(peer, channel_id, &stats) < 0) {
+		return luaL_argerror(l, 2, "Invalid channel");
+	}
+
+	if (lua_istable(l, 3)) {
+		lua_settop(l, 3);
+	} else {
+		lua_createtable(l, 0, 9);
+	}
+
+	set_stat(l, "outgoing_reliable_sequence_number", stats.outgoingReliableSequenceNumber);
+	set_stat(l, "outgoing_unreliable_sequence_number", stats.outgoingUnreliableSequenceNumber);
+	set_stat(l, "incoming_reliable_sequence_number", stats.incomingReliableSequenceNumber);
+	set_stat(l, "incoming_unreliable_sequence_number", stats.incomingUnreliableSequenceNumber);
+	set_stat(l, "used_reliable_windows", stats.usedReliableWindows);
+	set_stat(l, "incoming_reliable_commands", stats.incomingReliableCommands);
+	set_stat(l, "incoming_unreliable_commands", stats.incomingUnreliableCommands);
+	set_stat(l, "incoming_fragmented_packets", stats.incomingFragmentedPackets);
+	set_stat(l, "incoming_fragment_bytes", stats.incomingFragmentBytes);
+
+	return 1;
+}
+
 static int peer_ping_interval(lua_State *l) {
 	ENetPeer *peer = check_peer(l, 1);
 
@@ -592,6 +1313,7 @@ static int peer_disconnect(lua_State *l) {
 	ENetPeer *peer = check_peer(l, 1);
 
 	enet_uint32 data = lua_gettop(l) > 1 ? luaL_checkint(l, 2) : 0;
+	flush_peer(peer);
 	enet_peer_disconnect(peer, data);
 	return 0;
 }
@@ -600,6 +1322,7 @@ static int peer_disconnect_now(lua_State *l) {
 	ENetPeer *peer = check_peer(l, 1);
 
 	enet_uint32 data = lua_gettop(l) > 1 ? luaL_checkint(l, 2) : 0;
+	free_peer_data(peer);
 	enet_peer_disconnect_now(peer, data);
 	return 0;
 }
@@ -608,6 +1331,7 @@ static int peer_disconnect_later(lua_State *l) {
 	ENetPeer *peer = check_peer(l, 1);
 
 	enet_uint32 data = lua_gettop(l) > 1 ? luaL_checkint(l, 2) : 0;
+	flush_peer(peer);
 	enet_peer_disconnect_later(peer, data);
 	return 0;
 }
@@ -673,6 +1397,7 @@ static int peer_connect_id(lua_State *l) {
 
 static int peer_reset(lua_State *l) {
 	ENetPeer *peer = check_peer(l, 1);
+	free_peer_data(peer);
 	enet_peer_reset(peer);
 	return 0;
 }
@@ -708,96 +1433,2063 @@ static int peer_receive(lua_State *l) {
 static int peer_send(lua_State *l) {
 	ENetPeer *peer = check_peer(l, 1);
 
+	size_t size;
+	const void *data = luaL_checklstring(l, 2, &size);
 	enet_uint8 channel_id;
-	ENetPacket *packet = read_packet(l, 2, &channel_id);
+	enet_uint32 flags = read_packet_flags(l, 2, &channel_id);
+
+	if (is_coalesced(peer, channel_id)) {
+		if (coalesce_message(peer, channel_id, data, size, flags) < 0) {
+			return luaL_error(l, "Failed to create packet");
+		}
+		return 0;
+	}
+
+	ENetPacket *packet = enet_packet_create(data, size, flags);
+	if (packet == NULL) {
+		return luaL_error(l, "Failed to create packet");
+	}
 
 	// printf("sending, channel_id=%d\n", channel_id);
 	enet_peer_send(peer, channel_id, packet);
 	return 0;
 }
 
-static const struct luaL_Reg enet_funcs [] = {
-	{"host_create", host_create},
-	{"linked_version", linked_version},
-	{NULL, NULL}
-};
+/**
+ * Pack the small messages sent on a channel into one packet per flush, and
+ * unpack the packets received on it. Both ends must enable it for the
+ * channel, so it can't be used with a sharded host. Everything sent to the
+ * peer on the channel, broadcasts and snapshots included, goes through the
+ * batch. Batches go out on host:service or host:flush, and messages larger
+ * than the limit are sent alone. peer:receive returns whole batches.
+ * Args:
+ *	channel id
+ *	[enable = true]
+ *	[limit] largest batch in bytes, defaults to what fits one datagram
+ */
+static int peer_coalesce(lua_State *l) {
+	ENetPeer *peer = check_peer(l, 1);
+	int channel_id = luaL_checkint(l, 2);
+	int enable = lua_isnoneornil(l, 3) || lua_toboolean(l, 3);
 
-static const struct luaL_Reg enet_host_funcs [] = {
-	{"service", host_service},
-	{"check_events", host_check_events},
-	{"compress_with_range_coder", host_compress_with_range_coder},
-	{"connect", host_connect},
-	{"flush", host_flush},
-	{"broadcast", host_broadcast},
-	{"channel_limit", host_channel_limit},
-	{"bandwidth_limit", host_bandwidth_limit},
-	// Since ENetSocket isn't part of enet-lua, we should try to keep
-	// naming conventions the same as the rest of the lib.
-	{"get_socket_address", host_get_socket_address},
-	// TODO: Remove the line below in future versions, it's for backward
-	// compatibility only.
-	{"socket_get_address", host_get_socket_address},
-	// We need this function to free up our ports when needed!
-	{"destroy", host_gc},
+	if (channel_id < 0 || (size_t) channel_id >= peer->channelCount) {
+		return luaL_argerror(l, 2, "Invalid channel");
+	}
 
-	// additional convenience functions (mostly accessors)
-	{"total_sent_data", host_total_sent_data},
-	{"total_received_data", host_total_received_data},
-	{"service_time", host_service_time},
-	{"peer_count", host_peer_count},
-	{"get_peer", host_get_peer},
-	{NULL, NULL}
-};
+	peer_data *data = (peer_data *) peer->data;
+	if (data == NULL) {
+		if (!enable) return 0;
+
+		lua_getfield(l, LUA_REGISTRYINDEX, "enet_hosts");
+		lua_pushlightuserdata(l, peer->host);
+		lua_gettable(l, -2);
+		host_data *owner = (host_data *) lua_touserdata(l, -1);
+		lua_pop(l, 2);
+		if (owner == NULL) {
+			return luaL_error(l, "Peer's host is not an enet host");
+		}
 
-static const struct luaL_Reg enet_peer_funcs [] = {
-	{"disconnect", peer_disconnect},
-	{"disconnect_now", peer_disconnect_now},
-	{"disconnect_later", peer_disconnect_later},
-	{"reset", peer_reset},
-	{"ping", peer_ping},
-	{"receive", peer_receive},
-	{"send", peer_send},
-	{"throttle_configure", peer_throttle_configure},
-	{"ping_interval", peer_ping_interval},
-	{"timeout", peer_timeout},
+		size_t size = sizeof(peer_data) + (peer->channelCount - 1) * sizeof(coalesce_buffer);
+		data = (peer_data *) malloc(size);
+		if (data == NULL) {
+			return luaL_error(l, "Failed to allocate coalescing buffers");
+		}
+		memset(data, 0, size);
+		data->owner = owner;
+		data->channel_count = peer->channelCount;
+		peer->data = data;
+	}
 
-	// additional convenience functions to member variables
-	{"index", peer_index},
-	{"state", peer_state},
-	{"connect_id", peer_connect_id},
-	{"round_trip_time", peer_round_trip_time},
-	{"last_round_trip_time", peer_last_round_trip_time},
-	{NULL, NULL}
-};
+	if (enable) {
+		data->coalesced[channel_id / 32] |= 1u << (channel_id % 32);
+	} else {
+		flush_peer(peer);
+		data->coalesced[channel_id / 32] &= ~(1u << (channel_id % 32));
+	}
 
-int luaopen_enet(lua_State *l) {
-	enet_initialize();
-	atexit(enet_deinitialize);
+	data->limit = (size_t) luaL_optint(l, 4, peer->mtu - sizeof(ENetProtocolHeader) -
+		sizeof(ENetProtocolSendFragment) - sizeof(enet_uint32));
+	return 0;
+}
 
-	// create metatables
-	luaL_newmetatable(l, "enet_host");
-	lua_newtable(l); // index
-	luaL_register(l, NULL, enet_host_funcs);
-	lua_setfield(l, -2, "__index");
-	lua_pushcfunction(l, host_gc);
-	lua_setfield(l, -2, "__gc");
+/**
+ * Create a snapshot history, one end of a delta compressed snapshot stream.
+ * The server keeps one per peer.
+ * Args:
+ *	field count, fields per entity
+ *	entity capacity, maximum entities per snapshot
+ */
+static int snapshot_history(lua_State *l) {
+	size_t field_count = luaL_checkint(l, 1);
+	size_t entity_capacity = luaL_checkint(l, 2);
 
-	luaL_newmetatable(l, "enet_peer");
-	lua_newtable(l);
-	luaL_register(l, NULL, enet_peer_funcs);
-	lua_setfield(l, -2, "__index");
-	lua_pushcfunction(l, peer_tostring);
-	lua_setfield(l, -2, "__tostring");
+	ENetSnapshotHistory *history = enet_snapshot_history_create(field_count, entity_capacity);
+	if (history == NULL) {
+		return luaL_error(l, "Failed to create snapshot history");
+	}
 
-	// set up peer table
-	lua_newtable(l);
+	*(ENetSnapshotHistory**)lua_newuserdata(l, sizeof(void*)) = history;
+	luaL_getmetatable(l, "enet_snapshot");
+	lua_setmetatable(l, -2);
 
-	lua_newtable(l); // metatable
-	lua_pushstring(l, "v");
-	lua_setfield(l, -2, "__mode");
+	return 1;
+}
+
+/**
+ * Delta encode a snapshot against the last acknowledged one and send it
+ * unreliably to a peer
+ * Args:
+ *	peer
+ *	channel id
+ *	columns, an array of field_count arrays of integer (fixed-point) values
+ * Returns the snapshot's sequence number and encoded size
+ */
+static int snapshot_send(lua_State *l) {
+	ENetSnapshotHistory *history = check_snapshot(l, 1);
+	ENetPeer *peer = check_peer(l, 2);
+	enet_uint8 channel_id = luaL_checkint(l, 3);
+	luaL_checktype(l, 4, LUA_TTABLE);
+
+	lua_rawgeti(l, 4, 1);
+	size_t entity_count = lua_istable(l, -1) ? lua_objlen(l, -1) : 0;
+	lua_pop(l, 1);
+
+	if (entity_count > history->entityCapacity) {
+		return luaL_error(l, "Snapshot exceeds the entity capacity");
+	}
+
+	enet_uint32 *values = (enet_uint32 *) lua_newuserdata(l, history->fieldCount * entity_count * sizeof(enet_uint32) + 1);
+	const enet_uint32 *columns[ENET_SNAPSHOT_MAXIMUM_FIELDS];
+
+	for (size_t field = 0; field < history->fieldCount; field++) {
+		enet_uint32 *column = &values[field * entity_count];
+		columns[field] = column;
+
+		lua_rawgeti(l, 4, (int) field + 1);
+		luaL_checktype(l, -1, LUA_TTABLE);
+		for (size_t i = 0; i < entity_count; i++) {
+			lua_rawgeti(l, -1, (int) i + 1);
+			column[i] = (enet_uint32) (int) lua_tointeger(l, -1);
+			lua_pop(l, 1);
+		}
+		lua_pop(l, 1);
+	}
+
+	ENetPacket *packet = enet_snapshot_encode(history, columns, entity_count, 0);
+	if (packet == NULL) {
+		return luaL_error(l, "Failed to encode snapshot");
+	}
+
+	lua_pushnumber(l, history->nextSequence - 1);
+	lua_pushinteger(l, packet->dataLength);
+	if (send_packet(peer, channel_id, packet) < 0) {
+		return luaL_error(l, "Failed to create packet");
+	}
+	return 2;
+}
+
+/**
+ * Record that the receiver got a snapshot, making it the next baseline
+ * Args:
+ *	sequence number sent back by the receiver
+ */
+static int snapshot_acknowledge(lua_State *l) {
+	ENetSnapshotHistory *history = check_snapshot(l, 1);
+	enet_uint32 sequence = (enet_uint32) luaL_checknumber(l, 2);
+
+	lua_pushboolean(l, enet_snapshot_acknowledge(history, sequence) == 0);
+	return 1;
+}
+
+/**
+ * Decode a received snapshot. The returned sequence number should be sent
+ * back to the sender, which passes it to acknowledge.
+ * Args:
+ *	packet data, string
+ *	[columns table to fill, a new one is created if nil]
+ * Returns the columns, entity count and sequence number, or nil if the
+ * snapshot is stale, malformed or its baseline is no longer known
+ */
+static int snapshot_receive(lua_State *l) {
+	ENetSnapshotHistory *history = check_snapshot(l, 1);
+	size_t size;
+	const enet_uint8 *data = (const enet_uint8 *) luaL_checklstring(l, 2, &size);
+
+	size_t entity_count;
+	enet_uint32 sequence;
+	if (enet_snapshot_decode(history, data, size, NULL, &entity_count, &sequence) < 0) {
+		lua_pushnil(l);
+		return 1;
+	}
+
+	if (lua_istable(l, 3)) {
+		lua_settop(l, 3);
+	} else {
+		lua_settop(l, 2);
+		lua_createtable(l, history->fieldCount, 0);
+	}
+
+	// the decoded snapshot is the newest frame of the history
+	const ENetSnapshotFrame *frame = &history->frames[sequence % ENET_SNAPSHOT_HISTORY];
+	for (size_t field = 0; field < history->fieldCount; field++) {
+		const enet_uint32 *column = &frame->fields[field * history->entityCapacity];
+
+		lua_rawgeti(l, -1, (int) field + 1);
+		if (!lua_istable(l, -1)) {
+			lua_pop(l, 1);
+			lua_createtable(l, entity_count, 0);
+			lua_pushvalue(l, -1);
+			lua_rawseti(l, -3, (int) field + 1);
+		}
+
+		size_t old_count = lua_objlen(l, -1);
+		for (size_t i = 0; i < entity_count; i++) {
+			lua_pushinteger(l, (int) column[i]);
+			lua_rawseti(l, -2, (int) i + 1);
+		}
+		// drop stale entries left over from a larger snapshot
+		for (size_t i = entity_count + 1; i <= old_count; i++) {
+			lua_pushnil(l);
+			lua_rawseti(l, -2, (int) i);
+		}
+		lua_pop(l, 1);
+	}
+
+	lua_pushinteger(l, entity_count);
+	lua_pushnumber(l, sequence);
+	return 3;
+}
+
+static int snapshot_gc(lua_State *l) {
+	ENetSnapshotHistory **history = (ENetSnapshotHistory**)luaL_checkudata(l, 1, "enet_snapshot");
+	enet_snapshot_history_destroy(*history);
+	*history = NULL;
+	return 0;
+}
+
+/**
+ * Interest grid: tracks which entities each peer of a host can see, so the
+ * server sends every peer a snapshot of only its surroundings. Entities are
+ * numbered from 1 like the rows of the snapshot columns.
+ */
+typedef struct interest_grid {
+	ENetInterestGrid *grid;
+	size_t field_count;
+	size_t entity_count;
+	enet_uint32 *columns; // field_count columns of the last update
+	enet_uint32 *gathered; // field_count + 1 columns, the last holding entity numbers
+} interest_grid;
+
+#define check_interest(l, idx)\
+	((interest_grid*)luaL_checkudata(l, idx, "enet_interest"))
+
+static size_t interest_viewer(lua_State *l, interest_grid *grid, int idx) {
+	ENetPeer *peer = check_peer(l, idx);
+	size_t viewer = peer - peer->host->peers;
+	if (viewer >= grid->grid->viewerCapacity) {
+		luaL_error(l, "Peer index exceeds the interest grid's viewer capacity");
+	}
+	return viewer;
+}
+
+static enet_uint32 interest_option(lua_State *l, int idx, const char *name, lua_Number def) {
+	lua_getfield(l, idx, name);
+	enet_uint32 value = (enet_uint32) (int64_t) (lua_isnil(l, -1) ? def : luaL_checknumber(l, -1));
+	lua_pop(l, 1);
+	return value;
+}
+
+/**
+ * Create an interest grid
+ * Args:
+ *	options table:
+ *		fields, fields per entity as passed to update
+ *		entities, entity capacity
+ *		viewers, viewer capacity, usually the host's peer count
+ *		cell_shift, cells are 2^cell_shift fixed-point units on a side
+ *		width, height, size of the grid in cells
+ *		radius, cells around a peer's cell in which entities become visible
+ *		[hysteresis], further cells an entity may move before it is hidden, default 1
+ *		[origin_x], [origin_y], fixed-point position of the grid's corner, default 0
+ */
+static int interest_grid_create(lua_State *l) {
+	luaL_checktype(l, 1, LUA_TTABLE);
+
+	size_t field_count = interest_option(l, 1, "fields", 0);
+	size_t entity_capacity = interest_option(l, 1, "entities", 0);
+	if (field_count + 1 > ENET_SNAPSHOT_MAXIMUM_FIELDS) {
+		return luaL_error(l, "Interest grid fields exceed the snapshot field limit");
+	}
+
+	interest_grid *grid = (interest_grid *) lua_newuserdata(l, sizeof(interest_grid));
+	memset(grid, 0, sizeof(interest_grid));
+	luaL_getmetatable(l, "enet_interest");
 	lua_setmetatable(l, -2);
 
-	lua_setfield(l, LUA_REGISTRYINDEX, "enet_peers");
+	grid->field_count = field_count;
+	grid->grid = enet_interest_grid_create(interest_option(l, 1, "origin_x", 0),
+		interest_option(l, 1, "origin_y", 0),
+		interest_option(l, 1, "cell_shift", 16),
+		interest_option(l, 1, "width", 0),
+		interest_option(l, 1, "height", 0),
+		entity_capacity,
+		interest_option(l, 1, "viewers", 0),
+		interest_option(l, 1, "radius", 1),
+		interest_option(l, 1, "hysteresis", 1));
+	grid->columns = (enet_uint32 *) enet_malloc(field_count * entity_capacity * sizeof(enet_uint32) + 1);
+	grid->gathered = (enet_uint32 *) enet_malloc((field_count + 1) * entity_capacity * sizeof(enet_uint32));
+	if (grid->grid == NULL || grid->columns == NULL || grid->gathered == NULL) {
+		return luaL_error(l, "Failed to create interest grid");
+	}
+
+	return 1;
+}
+
+/**
+ * Store the entities' fields and move each to its position. Entities past
+ * the new count are removed.
+ * Args:
+ *	columns, an array of field_count arrays of integer (fixed-point) values
+ *	x field, y field, the 1-based columns holding positions
+ */
+static int interest_update(lua_State *l) {
+	interest_grid *grid = check_interest(l, 1);
+	luaL_checktype(l, 2, LUA_TTABLE);
+	size_t x_field = luaL_checkint(l, 3) - 1;
+	size_t y_field = luaL_checkint(l, 4) - 1;
+	size_t capacity = grid->grid->entityCapacity;
+
+	if (x_field >= grid->field_count || y_field >= grid->field_count) {
+		return luaL_error(l, "Position field out of range");
+	}
+
+	lua_rawgeti(l, 2, 1);
+	size_t entity_count = lua_istable(l, -1) ? lua_objlen(l, -1) : 0;
+	lua_pop(l, 1);
+
+	if (entity_count > capacity) {
+		return luaL_error(l, "Update exceeds the entity capacity");
+	}
+
+	for (size_t field = 0; field < grid->field_count; field++) {
+		enet_uint32 *column = &grid->columns[field * capacity];
+
+		lua_rawgeti(l, 2, (int) field + 1);
+		luaL_checktype(l, -1, LUA_TTABLE);
+		for (size_t i = 0; i < entity_count; i++) {
+			lua_rawgeti(l, -1, (int) i + 1);
+			column[i] = (enet_uint32) (int) lua_tointeger(l, -1);
+			lua_pop(l, 1);
+		}
+		lua_pop(l, 1);
+	}
+
+	const enet_uint32 *xs = &grid->columns[x_field * capacity];
+	const enet_uint32 *ys = &grid->columns[y_field * capacity];
+	for (size_t i = 0; i < entity_count; i++) {
+		enet_interest_grid_move_entity(grid->grid, i, xs[i], ys[i]);
+	}
+	for (size_t i = entity_count; i < grid->entity_count; i++) {
+		enet_interest_grid_remove_entity(grid->grid, i);
+	}
+
+	grid->entity_count = entity_count;
+	return 0;
+}
+
+/**
+ * Move a single entity without touching its stored fields
+ * Args:
+ *	entity number
+ *	x, y, fixed-point position
+ */
+static int interest_move(lua_State *l) {
+	interest_grid *grid = check_interest(l, 1);
+	size_t entity = luaL_checkint(l, 2) - 1;
+	enet_uint32 x = (enet_uint32) luaL_checkint(l, 3);
+	enet_uint32 y = (enet_uint32) luaL_checkint(l, 4);
+
+	enet_interest_grid_move_entity(grid->grid, entity, x, y);
+	return 0;
+}
+
+/**
+ * Remove an entity, hiding it from every peer
+ * Args:
+ *	entity number
+ */
+static int interest_remove(lua_State *l) {
+	interest_grid *grid = check_interest(l, 1);
+	size_t entity = luaL_checkint(l, 2) - 1;
+
+	enet_interest_grid_remove_entity(grid->grid, entity);
+	return 0;
+}
+
+/**
+ * Set the position a peer views the world from
+ * Args:
+ *	peer
+ *	x, y, fixed-point position
+ */
+static int interest_view(lua_State *l) {
+	interest_grid *grid = check_interest(l, 1);
+	size_t viewer = interest_viewer(l, grid, 2);
+	enet_uint32 x = (enet_uint32) luaL_checkint(l, 3);
+	enet_uint32 y = (enet_uint32) luaL_checkint(l, 4);
+
+	enet_interest_grid_move_viewer(grid->grid, viewer, x, y);
+	return 0;
+}
+
+/**
+ * Stop tracking a peer, e.g. when it disconnects
+ * Args:
+ *	peer
+ */
+static int interest_unview(lua_State *l) {
+	interest_grid *grid = check_interest(l, 1);
+	size_t viewer = interest_viewer(l, grid, 2);
+
+	enet_interest_grid_remove_viewer(grid->grid, viewer);
+	return 0;
+}
+
+/**
+ * List the entities a peer sees, in increasing order
+ * Args:
+ *	peer
+ *	[table to fill, a new one is created if nil]
+ * Returns the table and the entity count
+ */
+static int interest_visible(lua_State *l) {
+	interest_grid *grid = check_interest(l, 1);
+	size_t viewer = interest_viewer(l, grid, 2);
+	enet_uint32 *entities = grid->gathered;
+
+	size_t count = enet_interest_grid_gather(grid->grid, viewer, NULL, 0, NULL, entities, grid->grid->entityCapacity);
+
+	if (lua_istable(l, 3)) {
+		lua_settop(l, 3);
+	} else {
+		lua_settop(l, 2);
+		lua_createtable(l, count, 0);
+	}
+
+	size_t old_count = lua_objlen(l, -1);
+	for (size_t i = 0; i < count; i++) {
+		lua_pushinteger(l, entities[i] + 1);
+		lua_rawseti(l, -2, (int) i + 1);
+	}
+	for (size_t i = count + 1; i <= old_count; i++) {
+		lua_pushnil(l);
+		lua_rawseti(l, -2, (int) i);
+	}
+
+	lua_pushinteger(l, count);
+	return 2;
+}
+
+/**
+ * Send a peer a delta compressed snapshot of the entities it sees. Each row
+ * holds the stored fields followed by the entity number, so the history
+ * needs one more field than the grid. Peers seeing more entities than the
+ * history holds get the lowest numbered ones.
+ * Args:
+ *	snapshot history of the peer
+ *	peer
+ *	channel id
+ * Returns the snapshot's sequence number, encoded size and entity count
+ */
+static int interest_send(lua_State *l) {
+	interest_grid *grid = check_interest(l, 1);
+	ENetSnapshotHistory *history = check_snapshot(l, 2);
+	size_t viewer = interest_viewer(l, grid, 3);
+	ENetPeer *peer = check_peer(l, 3);
+	enet_uint8 channel_id = luaL_checkint(l, 4);
+	size_t capacity = grid->grid->entityCapacity;
+
+	if (history->fieldCount != grid->field_count + 1) {
+		return luaL_error(l, "Snapshot history must have one more field than the interest grid");
+	}
+
+	const enet_uint32 *columns[ENET_SNAPSHOT_MAXIMUM_FIELDS];
+	enet_uint32 *out[ENET_SNAPSHOT_MAXIMUM_FIELDS];
+	for (size_t field = 0; field <= grid->field_count; field++) {
+		columns[field] = &grid->columns[field * capacity];
+		out[field] = &grid->gathered[field * capacity];
+	}
+
+	size_t count = enet_interest_grid_gather(grid->grid, viewer, columns, grid->field_count, out,
+		out[grid->field_count], history->entityCapacity);
+	for (size_t i = 0; i < count; i++) {
+		out[grid->field_count][i]++;
+	}
+
+	ENetPacket *packet = enet_snapshot_encode(history, (const enet_uint32 * const *) out, count, 0);
+	if (packet == NULL) {
+		return luaL_error(l, "Failed to encode snapshot");
+	}
+
+	lua_pushnumber(l, history->nextSequence - 1);
+	lua_pushinteger(l, packet->dataLength);
+	lua_pushinteger(l, count);
+	if (send_packet(peer, channel_id, packet) < 0) {
+		return luaL_error(l, "Failed to create packet");
+	}
+	return 3;
+}
+
+/**
+ * Returns a table of visibility changes since the grid was created:
+ * entered, left, cell_changes
+ */
+static int interest_stats(lua_State *l) {
+	interest_grid *grid = check_interest(l, 1);
+
+	lua_createtable(l, 0, 3);
+	lua_pushnumber(l, grid->grid->entered);
+	lua_setfield(l, -2, "entered");
+	lua_pushnumber(l, grid->grid->left);
+	lua_setfield(l, -2, "left");
+	lua_pushnumber(l, grid->grid->cellChanges);
+	lua_setfield(l, -2, "cell_changes");
+	return 1;
+}
+
+static int interest_gc(lua_State *l) {
+	interest_grid *grid = check_interest(l, 1);
+	enet_interest_grid_destroy(grid->grid);
+	enet_free(grid->columns);
+	enet_free(grid->gathered);
+	grid->grid = NULL;
+	grid->columns = NULL;
+	grid->gathered = NULL;
+	return 0;
+}
+
+/**
+ * Lockstep session: exchanges each player's per-tick inputs and drives a
+ * world given as a table of functions:
+ *	world.save(tick), save the world as it is before tick
+ *	world.load(tick), restore the world saved before tick
+ *	world.simulate(tick, inputs), inputs holds one string per player
+ * Players and ticks are numbered as on the wire, players from 1.
+ */
+typedef struct lockstep_data {
+	ENetLockstep *lockstep;
+	lua_State *l; // set while advancing, the world table is at index 2
+	int failed; // a world function raised an error, its message is on top of l
+} lockstep_data;
+
+#define check_lockstep(l, idx)\
+	((lockstep_data*)luaL_checkudata(l, idx, "enet_lockstep"))
+
+/**
+ * Errors must not unwind through enet_lockstep_advance, so world functions
+ * are called in protected mode; once one fails the rest of the advance
+ * skips them and lockstep_advance raises the error when it returns.
+ */
+static void lockstep_call(lockstep_data *data, const char *name, enet_uint32 tick) {
+	lua_State *l = data->l;
+	if (data->failed) return;
+	lua_getfield(l, 2, name);
+	lua_pushnumber(l, tick);
+	data->failed = lua_pcall(l, 1, 0, 0) != 0;
+}
+
+static void ENET_CALLBACK lockstep_save(void *context, enet_uint32 tick) {
+	lockstep_call((lockstep_data *) context, "save", tick);
+}
+
+static void ENET_CALLBACK lockstep_load(void *context, enet_uint32 tick) {
+	lockstep_call((lockstep_data *) context, "load", tick);
+}
+
+static void ENET_CALLBACK lockstep_simulate(void *context, enet_uint32 tick, const enet_uint8 *inputs) {
+	lockstep_data *data = (lockstep_data *) context;
+	lua_State *l = data->l;
+	size_t player_count = data->lockstep->playerCount;
+	size_t input_size = data->lockstep->inputSize;
+	if (data->failed) return;
+
+	lua_getfield(l, 2, "simulate");
+	lua_pushnumber(l, tick);
+	lua_createtable(l, player_count, 0);
+	for (size_t i = 0; i < player_count; i++) {
+		lua_pushlstring(l, (const char *) &inputs[i * input_size], input_size);
+		lua_rawseti(l, -2, (int) i + 1);
+	}
+	data->failed = lua_pcall(l, 2, 0, 0) != 0;
+}
+
+/**
+ * Create a lockstep session
+ * Args:
+ *	options table:
+ *		players, number of players
+ *		player, the local player
+ *		input_size, bytes of one player's input for one tick
+ *		[delay], ticks between adding an input and the tick it applies to, default 2
+ *		[prediction], ticks the simulation may run ahead of missing inputs,
+ *			0 for plain lockstep, default 8
+ */
+static int lockstep_create(lua_State *l) {
+	luaL_checktype(l, 1, LUA_TTABLE);
+
+	lua_getfield(l, 1, "players");
+	lua_getfield(l, 1, "player");
+	lua_getfield(l, 1, "input_size");
+	lua_getfield(l, 1, "delay");
+	lua_getfield(l, 1, "prediction");
+	size_t player_count = luaL_checkint(l, -5);
+	size_t local_player = luaL_checkint(l, -4) - 1;
+	size_t input_size = luaL_checkint(l, -3);
+	enet_uint32 delay = luaL_optint(l, -2, 2);
+	enet_uint32 prediction = luaL_optint(l, -1, 8);
+	lua_pop(l, 5);
+
+	lockstep_data *data = (lockstep_data *) lua_newuserdata(l, sizeof(lockstep_data));
+	memset(data, 0, sizeof(lockstep_data));
+	luaL_getmetatable(l, "enet_lockstep");
+	lua_setmetatable(l, -2);
+
+	ENetLockstepWorld world;
+	world.context = data;
+	world.save = lockstep_save;
+	world.load = lockstep_load;
+	world.simulate = lockstep_simulate;
+
+	data->lockstep = enet_lockstep_create(player_count, local_player, input_size, delay, prediction, &world);
+	if (data->lockstep == NULL) {
+		return luaL_error(l, "Failed to create lockstep session");
+	}
+
+	return 1;
+}
+
+/**
+ * Add the local player's input for the next tick
+ * Args:
+ *	input, string of input_size bytes
+ * Returns the tick the input applies to, or nil if the other players are
+ * too far behind and the input must be added again later
+ */
+static int lockstep_input(lua_State *l) {
+	lockstep_data *data = check_lockstep(l, 1);
+	size_t size;
+	const char *input = luaL_checklstring(l, 2, &size);
+
+	if (size != data->lockstep->inputSize) {
+		return luaL_error(l, "Input must be %d bytes", (int) data->lockstep->inputSize);
+	}
+
+	if (enet_lockstep_add_input(data->lockstep, input) < 0) {
+		lua_pushnil(l);
+		return 1;
+	}
+
+	lua_pushnumber(l, data->lockstep->players[data->lockstep->localPlayer].confirmedTicks - 1);
+	return 1;
+}
+
+/**
+ * Send a player the local inputs it has not acknowledged, unreliably. Call
+ * once per tick for every other player.
+ * Args:
+ *	peer connected to the player
+ *	player
+ *	[channel id], default 0
+ * Returns the number of inputs sent
+ */
+static int lockstep_send(lua_State *l) {
+	lockstep_data *data = check_lockstep(l, 1);
+	ENetPeer *peer = check_peer(l, 2);
+	size_t player = luaL_checkint(l, 3) - 1;
+	enet_uint8 channel_id = luaL_optint(l, 4, 0);
+
+	ENetPacket *packet = enet_lockstep_encode(data->lockstep, player, 0);
+	if (packet == NULL) {
+		return luaL_error(l, "Failed to encode lockstep inputs");
+	}
+
+	lua_pushinteger(l, packet->data[ENET_LOCKSTEP_HEADER_SIZE - 1]);
+	if (send_packet(peer, channel_id, packet) < 0) {
+		return luaL_error(l, "Failed to create packet");
+	}
+	return 1;
+}
+
+/**
+ * Store the inputs received from another player
+ * Args:
+ *	packet data, string
+ * Returns the sending player, or nil if the packet is malformed
+ */
+static int lockstep_receive(lua_State *l) {
+	lockstep_data *data = check_lockstep(l, 1);
+	size_t size;
+	const enet_uint8 *packet = (const enet_uint8 *) luaL_checklstring(l, 2, &size);
+
+	int player = enet_lockstep_receive(data->lockstep, packet, size);
+	if (player < 0) {
+		lua_pushnil(l);
+		return 1;
+	}
+
+	lua_pushinteger(l, player + 1);
+	return 1;
+}
+
+/**
+ * Roll back and resimulate if a late input corrected a prediction, then
+ * simulate the next tick if the inputs allow it
+ * Args:
+ *	world table
+ * Returns true if a tick was simulated, false if waiting for inputs
+ */
+static int lockstep_advance(lua_State *l) {
+	lockstep_data *data = check_lockstep(l, 1);
+	luaL_checktype(l, 2, LUA_TTABLE);
+	lua_settop(l, 2);
+
+	data->l = l;
+	data->failed = 0;
+	int simulated = enet_lockstep_advance(data->lockstep);
+	data->l = NULL;
+
+	if (data->failed) {
+		return lua_error(l);
+	}
+
+	lua_pushboolean(l, simulated);
+	return 1;
+}
+
+/**
+ * Returns the next tick to simulate
+ */
+static int lockstep_tick(lua_State *l) {
+	lockstep_data *data = check_lockstep(l, 1);
+
+	lua_pushnumber(l, data->lockstep->currentTick);
+	return 1;
+}
+
+/**
+ * Returns a table of counters since the session was created:
+ * simulated_ticks, resimulated_ticks, rollbacks, max_rollback, stalls,
+ * predicted_inputs, mispredicted_inputs, late_inputs, input_lateness,
+ * max_input_lateness, with lateness in ticks
+ */
+static int lockstep_stats(lua_State *l) {
+	ENetLockstep *lockstep = check_lockstep(l, 1)->lockstep;
+
+	lua_createtable(l, 0, 10);
+	lua_pushnumber(l, lockstep->simulatedTicks);
+	lua_setfield(l, -2, "simulated_ticks");
+	lua_pushnumber(l, lockstep->resimulatedTicks);
+	lua_setfield(l, -2, "resimulated_ticks");
+	lua_pushnumber(l, lockstep->rollbacks);
+	lua_setfield(l, -2, "rollbacks");
+	lua_pushnumber(l, lockstep->maximumRollback);
+	lua_setfield(l, -2, "max_rollback");
+	lua_pushnumber(l, lockstep->stalls);
+	lua_setfield(l, -2, "stalls");
+	lua_pushnumber(l, lockstep->predictedInputs);
+	lua_setfield(l, -2, "predicted_inputs");
+	lua_pushnumber(l, lockstep->mispredictedInputs);
+	lua_setfield(l, -2, "mispredicted_inputs");
+	lua_pushnumber(l, lockstep->lateInputs);
+	lua_setfield(l, -2, "late_inputs");
+	lua_pushnumber(l, lockstep->inputLateness);
+	lua_setfield(l, -2, "input_lateness");
+	lua_pushnumber(l, lockstep->maximumInputLateness);
+	lua_setfield(l, -2, "max_input_lateness");
+	return 1;
+}
+
+static int lockstep_gc(lua_State *l) {
+	lockstep_data *data = check_lockstep(l, 1);
+	enet_lockstep_destroy(data->lockstep);
+	data->lockstep = NULL;
+	return 0;
+}
+
+/**
+ * Schema codec: a message layout registered from Lua, encoded to a compact
+ * binary form directly in an ENetPacket and decoded into reused tables or
+ * FFI structs.
+ *
+ * Wire format of a message: the schema's bool fields as a bitfield, lowest
+ * bit first, then every other field in order. Integers are varints (zigzag
+ * for signed ones), fixed point fields are signed varints in units of their
+ * precision, strings and arrays are prefixed with a varint count and bool
+ * arrays are bitpacked as well. Fixed width integers, floats and doubles are
+ * big endian.
+ */
+enum schema_type {
+	SCHEMA_UINT,
+	SCHEMA_INT,
+	SCHEMA_FIXED,
+	SCHEMA_U8,
+	SCHEMA_U16,
+	SCHEMA_U32,
+	SCHEMA_FLOAT,
+	SCHEMA_DOUBLE,
+	SCHEMA_BOOL,
+	SCHEMA_STRING,
+	SCHEMA_STRUCT
+};
+
+static const char *const schema_type_names[] = {
+	"uint", "int", "fixed", "u8", "u16", "u32", "float", "double", "bool", "string", NULL
+};
+
+// C type and size of each scalar type in an FFI struct, see schema:cdef
+static const char *const schema_ctype_names[] = {
+	"uint32_t", "int32_t", "double", "uint8_t", "uint16_t", "uint32_t", "float", "double", "bool"
+};
+static const size_t schema_ctype_sizes[] = {4, 4, 8, 1, 2, 4, 4, 8, 1};
+
+// LuaJIT's type tag for FFI cdata, which lua.h does not export
+#define SCHEMA_TCDATA 10
+
+struct schema;
+
+struct schema_field {
+	schema_type type;
+	int array;
+	double precision; // SCHEMA_FIXED
+	schema *nested; // SCHEMA_STRUCT
+	size_t offset; // within the FFI struct
+};
+
+struct schema {
+	size_t field_count;
+	size_t bool_count; // bitpacked bool fields, not counting arrays
+	int flat; // no strings, arrays or nested schemas, so usable as an FFI struct
+	size_t ffi_size;
+	schema_field fields[1]; // field_count entries
+};
+
+struct schema_writer {
+	ENetPacket *packet;
+	size_t length;
+	const char *error;
+};
+
+struct schema_reader {
+	const enet_uint8 *data;
+	size_t size;
+	size_t offset;
+};
+
+#define check_schema(l, idx)\
+	(schema*)luaL_checkudata(l, idx, "enet_schema")
+
+static enet_uint8 *schema_reserve(schema_writer *w, size_t size) {
+	if (w->length + size > w->packet->dataLength) {
+		size_t capacity = w->packet->dataLength * 2;
+		if (capacity < w->length + size) capacity = w->length + size;
+		if (enet_packet_resize(w->packet, capacity) < 0) {
+			w->error = "out of memory";
+			return NULL;
+		}
+	}
+	enet_uint8 *out = w->packet->data + w->length;
+	w->length += size;
+	return out;
+}
+
+static int schema_write_varint(schema_writer *w, uint64_t value) {
+	enet_uint8 *out = schema_reserve(w, 10);
+	if (out == NULL) return -1;
+
+	size_t size = 0;
+	while (value >= 0x80) {
+		out[size++] = (enet_uint8) (value | 0x80);
+		value >>= 7;
+	}
+	out[size++] = (enet_uint8) value;
+	w->length -= 10 - size;
+	return 0;
+}
+
+static int schema_read_varint(schema_reader *r, uint64_t *value) {
+	uint64_t result = 0;
+	for (int shift = 0; shift < 64 && r->offset < r->size; shift += 7) {
+		enet_uint8 byte = r->data[r->offset++];
+		result |= (uint64_t) (byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			*value = result;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static uint64_t zigzag_encode(int64_t value) {
+	return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t value) {
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static int schema_write_fixed(schema_writer *w, const void *value, size_t size) {
+	enet_uint8 *out = schema_reserve(w, size);
+	if (out == NULL) return -1;
+	memcpy(out, value, size);
+	return 0;
+}
+
+/**
+ * Encode one number of a scalar type; bools are handled by the callers
+ * since they are bitpacked
+ */
+static int schema_write_number(schema_writer *w, const schema_field *field, lua_Number value) {
+	// converting NaN, infinities or values out of the integer's range is undefined
+	switch (field->type) {
+		case SCHEMA_UINT:
+			if (!(value < 18446744073709551616.0)) break;
+			return schema_write_varint(w, value > 0 ? (uint64_t) value : 0);
+		case SCHEMA_INT:
+			if (!(value >= -9223372036854775808.0 && value < 9223372036854775808.0)) break;
+			return schema_write_varint(w, zigzag_encode((int64_t) value));
+		case SCHEMA_FIXED: {
+			lua_Number units = value / field->precision;
+			units = units < 0 ? units - 0.5 : units + 0.5;
+			if (!(units >= -9223372036854775808.0 && units < 9223372036854775808.0)) break;
+			return schema_write_varint(w, zigzag_encode((int64_t) units));
+		}
+		case SCHEMA_U8: {
+			if (!(value >= 0 && value < 4294967296.0)) break;
+			enet_uint8 v = (enet_uint8) (enet_uint32) value;
+			return schema_write_fixed(w, &v, 1);
+		}
+		case SCHEMA_U16: {
+			if (!(value >= 0 && value < 4294967296.0)) break;
+			enet_uint16 v = ENET_HOST_TO_NET_16((enet_uint16) (enet_uint32) value);
+			return schema_write_fixed(w, &v, 2);
+		}
+		case SCHEMA_U32: {
+			if (!(value >= 0 && value < 4294967296.0)) break;
+			enet_uint32 v = ENET_HOST_TO_NET_32((enet_uint32) value);
+			return schema_write_fixed(w, &v, 4);
+		}
+		case SCHEMA_FLOAT: {
+			float f = (float) value;
+			enet_uint32 v;
+			memcpy(&v, &f, 4);
+			v = ENET_HOST_TO_NET_32(v);
+			return schema_write_fixed(w, &v, 4);
+		}
+		case SCHEMA_DOUBLE: {
+			uint64_t u;
+			memcpy(&u, &value, 8);
+			enet_uint32 v[2] = {ENET_HOST_TO_NET_32((enet_uint32) (u >> 32)), ENET_HOST_TO_NET_32((enet_uint32) u)};
+			return schema_write_fixed(w, v, 8);
+		}
+		default:
+			w->error = "not a number field";
+			return -1;
+	}
+
+	w->error = "number out of range";
+	return -1;
+}
+
+static int schema_read_number(schema_reader *r, const schema_field *field, lua_Number *value) {
+	uint64_t v;
+	switch (field->type) {
+		case SCHEMA_UINT:
+			if (schema_read_varint(r, &v) < 0) return -1;
+			*value = (lua_Number) v;
+			return 0;
+		case SCHEMA_INT:
+			if (schema_read_varint(r, &v) < 0) return -1;
+			*value = (lua_Number) zigzag_decode(v);
+			return 0;
+		case SCHEMA_FIXED:
+			if (schema_read_varint(r, &v) < 0) return -1;
+			*value = (lua_Number) zigzag_decode(v) * field->precision;
+			return 0;
+		case SCHEMA_U8:
+			if (r->size - r->offset < 1) return -1;
+			*value = r->data[r->offset++];
+			return 0;
+		case SCHEMA_U16: {
+			enet_uint16 u;
+			if (r->size - r->offset < 2) return -1;
+			memcpy(&u, r->data + r->offset, 2);
+			r->offset += 2;
+			*value = ENET_NET_TO_HOST_16(u);
+			return 0;
+		}
+		case SCHEMA_U32: {
+			enet_uint32 u;
+			if (r->size - r->offset < 4) return -1;
+			memcpy(&u, r->data + r->offset, 4);
+			r->offset += 4;
+			*value = ENET_NET_TO_HOST_32(u);
+			return 0;
+		}
+		case SCHEMA_FLOAT: {
+			enet_uint32 u;
+			float f;
+			if (r->size - r->offset < 4) return -1;
+			memcpy(&u, r->data + r->offset, 4);
+			r->offset += 4;
+			u = ENET_NET_TO_HOST_32(u);
+			memcpy(&f, &u, 4);
+			*value = f;
+			return 0;
+		}
+		case SCHEMA_DOUBLE: {
+			enet_uint32 u[2];
+			if (r->size - r->offset < 8) return -1;
+			memcpy(u, r->data + r->offset, 8);
+			r->offset += 8;
+			uint64_t d = (uint64_t) ENET_NET_TO_HOST_32(u[0]) << 32 | ENET_NET_TO_HOST_32(u[1]);
+			memcpy(value, &d, 8);
+			return 0;
+		}
+		default:
+			return -1;
+	}
+}
+
+/**
+ * Push the name of field i of the schema at index env_idx's environment
+ */
+static void schema_push_name(lua_State *l, int env_idx, size_t i) {
+	lua_rawgeti(l, env_idx, (int) i + 1);
+}
+
+static int schema_encode_table(lua_State *l, schema_writer *w, schema *s, int env_idx, int table_idx);
+
+/**
+ * Encode the value on top of the stack as field i, popping it
+ */
+static int schema_encode_value(lua_State *l, schema_writer *w, schema *s, int env_idx, size_t i, enet_uint8 *bools, size_t *bool_index) {
+	const schema_field *field = &s->fields[i];
+	int type = lua_type(l, -1);
+	int result = 0;
+
+	if (field->type == SCHEMA_BOOL) {
+		if (lua_toboolean(l, -1)) bools[*bool_index / 8] |= 1 << (*bool_index % 8);
+		++*bool_index;
+	} else if (field->type == SCHEMA_STRING) {
+		size_t size = 0;
+		const char *data = "";
+		if (type == LUA_TSTRING) {
+			data = lua_tolstring(l, -1, &size);
+		} else if (type != LUA_TNIL) {
+			w->error = "string expected";
+			result = -1;
+		}
+		if (result == 0 && (result = schema_write_varint(w, size)) == 0) {
+			result = schema_write_fixed(w, data, size);
+		}
+	} else if (field->type == SCHEMA_STRUCT) {
+		if (type == LUA_TTABLE) {
+			lua_rawgeti(l, env_idx, (int) (s->field_count + i + 1));
+			lua_getfenv(l, -1);
+			result = schema_encode_table(l, w, field->nested, lua_gettop(l), lua_gettop(l) - 2);
+			lua_pop(l, 2);
+		} else {
+			w->error = "table expected for nested schema";
+			result = -1;
+		}
+	} else if (type == LUA_TNUMBER || type == LUA_TNIL) {
+		result = schema_write_number(w, field, lua_tonumber(l, -1));
+	} else {
+		w->error = "number expected";
+		result = -1;
+	}
+
+	lua_pop(l, 1);
+	return result;
+}
+
+static int schema_encode_table(lua_State *l, schema_writer *w, schema *s, int env_idx, int table_idx) {
+	size_t bool_offset = w->length, bool_index = 0;
+	enet_uint8 *bools = schema_reserve(w, (s->bool_count + 7) / 8);
+	if (bools == NULL) return -1;
+	memset(bools, 0, (s->bool_count + 7) / 8);
+
+	for (size_t i = 0; i < s->field_count; i++) {
+		const schema_field *field = &s->fields[i];
+
+		schema_push_name(l, env_idx, i);
+		lua_rawget(l, table_idx);
+
+		if (!field->array) {
+			// the packet may have moved while encoding the previous field
+			bools = w->packet->data + bool_offset;
+			if (schema_encode_value(l, w, s, env_idx, i, bools, &bool_index) < 0) return -1;
+			continue;
+		}
+
+		if (!lua_istable(l, -1)) {
+			if (!lua_isnil(l, -1)) {
+				w->error = "table expected for array";
+				return -1;
+			}
+			lua_pop(l, 1);
+			if (schema_write_varint(w, 0) < 0) return -1;
+			continue;
+		}
+
+		int array_idx = lua_gettop(l);
+		size_t count = lua_objlen(l, array_idx);
+		if (schema_write_varint(w, count) < 0) return -1;
+
+		size_t element_bools_offset = w->length, element_bool_index = 0;
+		if (field->type == SCHEMA_BOOL) {
+			enet_uint8 *element_bools = schema_reserve(w, (count + 7) / 8);
+			if (element_bools == NULL) return -1;
+			memset(element_bools, 0, (count + 7) / 8);
+		}
+
+		for (size_t j = 0; j < count; j++) {
+			lua_rawgeti(l, array_idx, (int) j + 1);
+			if (schema_encode_value(l, w, s, env_idx, i, w->packet->data + element_bools_offset, &element_bool_index) < 0) return -1;
+		}
+		lua_pop(l, 1);
+	}
+
+	return 0;
+}
+
+static int schema_encode_struct(schema_writer *w, schema *s, const enet_uint8 *base) {
+	size_t bool_offset = w->length, bool_index = 0;
+	enet_uint8 *bools = schema_reserve(w, (s->bool_count + 7) / 8);
+	if (bools == NULL) return -1;
+	memset(bools, 0, (s->bool_count + 7) / 8);
+
+	for (size_t i = 0; i < s->field_count; i++) {
+		const schema_field *field = &s->fields[i];
+		const enet_uint8 *p = base + field->offset;
+		lua_Number value;
+
+		switch (field->type) {
+			case SCHEMA_BOOL:
+				if (*p) w->packet->data[bool_offset + bool_index / 8] |= 1 << (bool_index % 8);
+				bool_index++;
+				continue;
+			case SCHEMA_UINT:
+			case SCHEMA_U32: { enet_uint32 v; memcpy(&v, p, 4); value = v; break; }
+			case SCHEMA_INT: { int32_t v; memcpy(&v, p, 4); value = v; break; }
+			case SCHEMA_U8: value = *p; break;
+			case SCHEMA_U16: { enet_uint16 v; memcpy(&v, p, 2); value = v; break; }
+			case SCHEMA_FLOAT: { float v; memcpy(&v, p, 4); value = v; break; }
+			default: memcpy(&value, p, 8); break;
+		}
+
+		if (schema_write_number(w, field, value) < 0) return -1;
+	}
+
+	return 0;
+}
+
+static int schema_decode_table(lua_State *l, schema_reader *r, schema *s, int env_idx, int table_idx);
+
+/**
+ * Decode field i and leave its value on top of the stack; a nested table is
+ * decoded into the table already at reuse_idx, if any
+ */
+static int schema_decode_value(lua_State *l, schema_reader *r, schema *s, int env_idx, size_t i, const enet_uint8 *bools, size_t *bool_index, int reuse_idx) {
+	const schema_field *field = &s->fields[i];
+
+	if (field->type == SCHEMA_BOOL) {
+		lua_pushboolean(l, (bools[*bool_index / 8] >> (*bool_index % 8)) & 1);
+		++*bool_index;
+	} else if (field->type == SCHEMA_STRING) {
+		uint64_t size;
+		if (schema_read_varint(r, &size) < 0 || size > r->size - r->offset) return -1;
+		lua_pushlstring(l, (const char *) r->data + r->offset, (size_t) size);
+		r->offset += (size_t) size;
+	} else if (field->type == SCHEMA_STRUCT) {
+		if (reuse_idx != 0 && lua_istable(l, reuse_idx)) {
+			lua_pushvalue(l, reuse_idx);
+		} else {
+			lua_createtable(l, 0, (int) field->nested->field_count);
+		}
+		lua_rawgeti(l, env_idx, (int) (s->field_count + i + 1));
+		lua_getfenv(l, -1);
+		int result = schema_decode_table(l, r, field->nested, lua_gettop(l), lua_gettop(l) - 2);
+		lua_pop(l, 2);
+		if (result < 0) return -1;
+	} else {
+		lua_Number value;
+		if (schema_read_number(r, field, &value) < 0) return -1;
+		lua_pushnumber(l, value);
+	}
+
+	return 0;
+}
+
+static int schema_decode_table(lua_State *l, schema_reader *r, schema *s, int env_idx, int table_idx) {
+	size_t bool_size = (s->bool_count + 7) / 8, bool_index = 0;
+	if (bool_size > r->size - r->offset) return -1;
+	const enet_uint8 *bools = r->data + r->offset;
+	r->offset += bool_size;
+
+	for (size_t i = 0; i < s->field_count; i++) {
+		const schema_field *field = &s->fields[i];
+
+		schema_push_name(l, env_idx, i);
+		int name_idx = lua_gettop(l);
+
+		if (!field->array) {
+			int reuse_idx = 0;
+			if (field->type == SCHEMA_STRUCT) {
+				lua_pushvalue(l, name_idx);
+				lua_rawget(l, table_idx);
+				reuse_idx = lua_gettop(l);
+			}
+			if (schema_decode_value(l, r, s, env_idx, i, bools, &bool_index, reuse_idx) < 0) return -1;
+			if (reuse_idx != 0) lua_remove(l, reuse_idx);
+			lua_rawset(l, table_idx);
+			continue;
+		}
+
+		// every element takes at least a byte, except bitpacked bools
+		uint64_t count;
+		if (schema_read_varint(r, &count) < 0) return -1;
+		uint64_t min_size = field->type == SCHEMA_BOOL ? count / 8 + (count % 8 != 0) : count;
+		if (min_size > r->size - r->offset) return -1;
+
+		// reuse the array from a previous decode
+		lua_pushvalue(l, name_idx);
+		lua_rawget(l, table_idx);
+		if (!lua_istable(l, -1)) {
+			lua_pop(l, 1);
+			lua_createtable(l, (int) count, 0);
+		}
+		int array_idx = lua_gettop(l);
+		size_t old_count = lua_objlen(l, array_idx);
+
+		const enet_uint8 *element_bools = r->data + r->offset;
+		size_t element_bool_index = 0;
+		if (field->type == SCHEMA_BOOL) {
+			r->offset += (size_t) min_size;
+		}
+
+		for (size_t j = 0; j < count; j++) {
+			int reuse_idx = 0;
+			if (field->type == SCHEMA_STRUCT) {
+				lua_rawgeti(l, array_idx, (int) j + 1);
+				reuse_idx = lua_gettop(l);
+			}
+			if (schema_decode_value(l, r, s, env_idx, i, element_bools, &element_bool_index, reuse_idx) < 0) return -1;
+			if (reuse_idx != 0) lua_remove(l, reuse_idx);
+			lua_rawseti(l, array_idx, (int) j + 1);
+		}
+		// drop stale entries left over from a longer array
+		for (size_t j = count + 1; j <= old_count; j++) {
+			lua_pushnil(l);
+			lua_rawseti(l, array_idx, (int) j);
+		}
+
+		lua_rawset(l, table_idx);
+	}
+
+	return 0;
+}
+
+static int schema_decode_struct(schema_reader *r, schema *s, enet_uint8 *base) {
+	size_t bool_size = (s->bool_count + 7) / 8, bool_index = 0;
+	if (bool_size > r->size - r->offset) return -1;
+	const enet_uint8 *bools = r->data + r->offset;
+	r->offset += bool_size;
+
+	for (size_t i = 0; i < s->field_count; i++) {
+		const schema_field *field = &s->fields[i];
+		enet_uint8 *p = base + field->offset;
+		lua_Number value;
+
+		if (field->type == SCHEMA_BOOL) {
+			*p = (bools[bool_index / 8] >> (bool_index % 8)) & 1;
+			bool_index++;
+			continue;
+		}
+
+		if (schema_read_number(r, field, &value) < 0) return -1;
+
+		switch (field->type) {
+			case SCHEMA_UINT:
+			case SCHEMA_U32: { enet_uint32 v = (enet_uint32) value; memcpy(p, &v, 4); break; }
+			case SCHEMA_INT: { int32_t v = (int32_t) value; memcpy(p, &v, 4); break; }
+			case SCHEMA_U8: *p = (enet_uint8) value; break;
+			case SCHEMA_U16: { enet_uint16 v = (enet_uint16) value; memcpy(p, &v, 2); break; }
+			case SCHEMA_FLOAT: { float v = (float) value; memcpy(p, &v, 4); break; }
+			default: memcpy(p, &value, 8); break;
+		}
+	}
+
+	return 0;
+}
+
+static int is_schema(lua_State *l, int idx) {
+	if (lua_type(l, idx) != LUA_TUSERDATA || !lua_getmetatable(l, idx)) return 0;
+	luaL_getmetatable(l, "enet_schema");
+	int result = lua_rawequal(l, -1, -2);
+	lua_pop(l, 2);
+	return result;
+}
+
+/**
+ * Register a message schema
+ * Args:
+ *	array of fields, each {name, type, [param]} where type is one of
+ *	"uint", "int" (varints), "fixed" (param is the precision, eg 1/64),
+ *	"u8", "u16", "u32", "float", "double", "bool", "string", or another
+ *	schema for a nested table. Append "[]" to a type name, or set the
+ *	field's array = true, for an array of that type.
+ */
+static int schema_create(lua_State *l) {
+	luaL_checktype(l, 1, LUA_TTABLE);
+	size_t field_count = lua_objlen(l, 1);
+	if (field_count == 0) {
+		return luaL_argerror(l, 1, "schema has no fields");
+	}
+
+	schema *s = (schema *) lua_newuserdata(l, sizeof(schema) + (field_count - 1) * sizeof(schema_field));
+	memset(s, 0, sizeof(schema) + (field_count - 1) * sizeof(schema_field));
+	s->field_count = field_count;
+	s->flat = 1;
+	int schema_idx = lua_gettop(l);
+
+	// environment: field names at 1..n, nested schemas at n+1..2n
+	lua_createtable(l, (int) field_count * 2, 0);
+	int env_idx = lua_gettop(l);
+
+	size_t alignment = 1;
+	for (size_t i = 0; i < field_count; i++) {
+		schema_field *field = &s->fields[i];
+
+		lua_rawgeti(l, 1, (int) i + 1);
+		if (!lua_istable(l, -1)) {
+			return luaL_error(l, "schema field %d is not a table", (int) i + 1);
+		}
+		int def_idx = lua_gettop(l);
+
+		lua_rawgeti(l, def_idx, 1);
+		if (lua_type(l, -1) != LUA_TSTRING) {
+			return luaL_error(l, "schema field %d has no name", (int) i + 1);
+		}
+		lua_rawseti(l, env_idx, (int) i + 1);
+
+		lua_getfield(l, def_idx, "array");
+		field->array = lua_toboolean(l, -1);
+		lua_pop(l, 1);
+
+		lua_rawgeti(l, def_idx, 2);
+		if (lua_type(l, -1) == LUA_TSTRING) {
+			size_t length;
+			const char *name = lua_tolstring(l, -1, &length);
+			if (length > 2 && strcmp(name + length - 2, "[]") == 0) {
+				field->array = 1;
+				length -= 2;
+			}
+			int type = -1;
+			for (int t = 0; schema_type_names[t] != NULL; t++) {
+				if (strlen(schema_type_names[t]) == length && strncmp(name, schema_type_names[t], length) == 0) type = t;
+			}
+			if (type < 0) {
+				return luaL_error(l, "schema field %d has unknown type %s", (int) i + 1, name);
+			}
+			field->type = (schema_type) type;
+		} else if (is_schema(l, -1)) {
+			field->type = SCHEMA_STRUCT;
+			field->nested = (schema *) lua_touserdata(l, -1);
+			lua_pushvalue(l, -1);
+			lua_rawseti(l, env_idx, (int) (field_count + i + 1));
+		} else {
+			return luaL_error(l, "schema field %d has no type", (int) i + 1);
+		}
+		lua_pop(l, 1);
+
+		if (field->type == SCHEMA_FIXED) {
+			lua_rawgeti(l, def_idx, 3);
+			field->precision = luaL_optnumber(l, -1, 1.0 / 256);
+			lua_pop(l, 1);
+			if (field->precision <= 0) {
+				return luaL_error(l, "schema field %d has a non-positive precision", (int) i + 1);
+			}
+		}
+		lua_pop(l, 1);
+
+		if (field->type == SCHEMA_BOOL && !field->array) s->bool_count++;
+
+		if (field->array || field->type == SCHEMA_STRING || field->type == SCHEMA_STRUCT) {
+			s->flat = 0;
+		} else {
+			size_t size = schema_ctype_sizes[field->type];
+			s->ffi_size = (s->ffi_size + size - 1) / size * size;
+			field->offset = s->ffi_size;
+			s->ffi_size += size;
+			if (size > alignment) alignment = size;
+		}
+	}
+	s->ffi_size = (s->ffi_size + alignment - 1) / alignment * alignment;
+
+	lua_setfenv(l, schema_idx);
+	luaL_getmetatable(l, "enet_schema");
+	lua_setmetatable(l, schema_idx);
+	return 1;
+}
+
+/**
+ * Get the address of the FFI struct at idx, checking that it has the size of
+ * the schema's struct so that a cdata of another type isn't read or written
+ * past its end
+ */
+static enet_uint8 *schema_check_struct(lua_State *l, schema *s, int idx) {
+	if (!s->flat) {
+		luaL_error(l, "Only schemas of scalar fields map to FFI structs");
+	}
+
+	// the ffi module is loaded, since there is a cdata
+	lua_getfield(l, LUA_REGISTRYINDEX, "_LOADED");
+	lua_getfield(l, -1, "ffi");
+	lua_getfield(l, -1, "sizeof");
+	lua_pushvalue(l, idx);
+	lua_call(l, 1, 1);
+	int matches = lua_type(l, -1) == LUA_TNUMBER && (size_t) lua_tonumber(l, -1) == s->ffi_size;
+	lua_pop(l, 3);
+
+	if (!matches) {
+		luaL_error(l, "FFI value is not a struct of the schema (see schema:cdef)");
+	}
+	return (enet_uint8 *) lua_topointer(l, idx);
+}
+
+/**
+ * Encode the table or FFI struct at idx into a new packet
+ */
+static ENetPacket *schema_encode_packet(lua_State *l, schema *s, int idx, enet_uint32 flags) {
+	const enet_uint8 *base = NULL;
+	if (lua_type(l, idx) == SCHEMA_TCDATA) {
+		base = schema_check_struct(l, s, idx);
+	} else {
+		luaL_checktype(l, idx, LUA_TTABLE);
+	}
+
+	schema_writer w;
+	w.packet = enet_packet_create(NULL, 64, flags);
+	w.length = 0;
+	w.error = NULL;
+	if (w.packet == NULL) {
+		luaL_error(l, "Failed to create packet");
+	}
+
+	int result;
+	if (base != NULL) {
+		result = schema_encode_struct(&w, s, base);
+	} else {
+		lua_getfenv(l, 1);
+		result = schema_encode_table(l, &w, s, lua_gettop(l), idx);
+	}
+
+	if (result < 0) {
+		enet_packet_destroy(w.packet);
+		luaL_error(l, "Failed to encode message: %s", w.error ? w.error : "bad value");
+	}
+
+	w.packet->dataLength = w.length;
+	return w.packet;
+}
+
+/**
+ * Encode a message to a string
+ * Args:
+ *	table, or FFI struct of a flat schema (see schema:cdef)
+ */
+static int schema_encode(lua_State *l) {
+	schema *s = check_schema(l, 1);
+	ENetPacket *packet = schema_encode_packet(l, s, 2, 0);
+	lua_pushlstring(l, (const char *) packet->data, packet->dataLength);
+	enet_packet_destroy(packet);
+	return 1;
+}
+
+/**
+ * Encode a message straight into a packet and send it to a peer
+ * Args:
+ *	peer
+ *	table, or FFI struct of a flat schema
+ *	channel id
+ *	flags ["reliable", nil]
+ * Returns the encoded size
+ */
+static int schema_send(lua_State *l) {
+	schema *s = check_schema(l, 1);
+	ENetPeer *peer = check_peer(l, 2);
+	enet_uint8 channel_id = 0;
+	enet_uint32 flags = read_packet_flags(l, 3, &channel_id);
+
+	ENetPacket *packet = schema_encode_packet(l, s, 3, flags);
+	size_t size = packet->dataLength;
+
+	if (send_packet(peer, channel_id, packet) < 0) {
+		return luaL_error(l, "Failed to create packet");
+	}
+
+	lua_pushinteger(l, size);
+	return 1;
+}
+
+/**
+ * Decode a message
+ * Args:
+ *	packet data, string
+ *	[table to fill, a new one is created if nil; nested tables and arrays
+ *	 already in it are reused. Or an FFI struct of a flat schema]
+ * Returns the table or struct, or nil if the data is malformed
+ */
+static int schema_decode(lua_State *l) {
+	schema *s = check_schema(l, 1);
+	schema_reader r;
+	r.data = (const enet_uint8 *) luaL_checklstring(l, 2, &r.size);
+	r.offset = 0;
+
+	if (lua_type(l, 3) == SCHEMA_TCDATA) {
+		lua_settop(l, 3);
+		if (schema_decode_struct(&r, s, schema_check_struct(l, s, 3)) < 0) {
+			lua_pushnil(l);
+		}
+		return 1;
+	}
+
+	if (lua_istable(l, 3)) {
+		lua_settop(l, 3);
+	} else {
+		lua_settop(l, 2);
+		lua_createtable(l, 0, (int) s->field_count);
+	}
+
+	lua_getfenv(l, 1);
+	int result = schema_decode_table(l, &r, s, 4, 3);
+	lua_settop(l, 3);
+	if (result < 0) {
+		lua_pushnil(l);
+	}
+	return 1;
+}
+
+/**
+ * Describe the FFI struct a flat schema encodes from and decodes into
+ * Args:
+ *	type name
+ * Returns a typedef for ffi.cdef
+ */
+static int schema_cdef(lua_State *l) {
+	schema *s = check_schema(l, 1);
+	const char *name = luaL_checkstring(l, 2);
+	if (!s->flat) {
+		return luaL_error(l, "Only schemas of scalar fields map to FFI structs");
+	}
+
+	lua_settop(l, 2);
+	lua_getfenv(l, 1);
+	lua_pushstring(l, "typedef struct { ");
+	for (size_t i = 0; i < s->field_count; i++) {
+		lua_pushstring(l, schema_ctype_names[s->fields[i].type]);
+		lua_pushstring(l, " ");
+		lua_rawgeti(l, 3, (int) i + 1);
+		lua_pushstring(l, "; ");
+		lua_concat(l, 5);
+	}
+	lua_pushfstring(l, "} %s;", name);
+	lua_concat(l, 2);
+	return 1;
+}
+
+static void read_loopback_conditions(lua_State *l, int idx, ENetLoopbackConditions *conditions) {
+	memset(conditions, 0, sizeof(ENetLoopbackConditions));
+	if (lua_isnoneornil(l, idx)) return;
+	luaL_checktype(l, idx, LUA_TTABLE);
+
+	lua_getfield(l, idx, "latency");
+	conditions->latency = (enet_uint32) luaL_optnumber(l, -1, 0);
+	lua_getfield(l, idx, "jitter");
+	conditions->jitter = (enet_uint32) luaL_optnumber(l, -1, 0);
+	lua_getfield(l, idx, "loss");
+	conditions->loss = (enet_uint32) (luaL_optnumber(l, -1, 0) * ENET_LOOPBACK_PROBABILITY_SCALE);
+	lua_getfield(l, idx, "reorder");
+	conditions->reorder = (enet_uint32) (luaL_optnumber(l, -1, 0) * ENET_LOOPBACK_PROBABILITY_SCALE);
+	lua_pop(l, 4);
+}
+
+/**
+ * Create an in-process network that hosts can be attached to instead of
+ * UDP sockets, for tests and benchmarks
+ * Args:
+ *	[conditions table {latency = ms, jitter = ms, loss = 0..1, reorder = 0..1}]
+ *	[seed = 0]
+ */
+static int loopback_network(lua_State *l) {
+	ENetLoopbackConditions conditions;
+	read_loopback_conditions(l, 1, &conditions);
+
+	ENetLoopbackNetwork *network = enet_loopback_network_create(&conditions, (enet_uint32) luaL_optnumber(l, 2, 0));
+	if (network == NULL) {
+		return luaL_error(l, "Failed to create loopback network");
+	}
+
+	*(ENetLoopbackNetwork**)lua_newuserdata(l, sizeof(void*)) = network;
+	luaL_getmetatable(l, "enet_loopback");
+	lua_setmetatable(l, -2);
+
+	return 1;
+}
+
+/**
+ * Attach a host to the network, replacing its socket
+ * Args:
+ *	host
+ *	[port = 0] pick an unused port if 0
+ * Returns the address other hosts on the network connect to, or nil
+ */
+static int loopback_attach(lua_State *l) {
+	ENetLoopbackNetwork *network = check_loopback(l, 1);
+	ENetHost *host = check_host(l, 2);
+	if (!host) {
+		return luaL_error(l, "Tried to index a nil host!");
+	}
+
+	if (enet_host_loopback(host, network, (enet_uint16) luaL_optint(l, 3, 0)) < 0) {
+		lua_pushnil(l);
+		return 1;
+	}
+
+	lua_pushfstring(l, "127.0.0.1:%d", host->address.port);
+	return 1;
+}
+
+/**
+ * Change the simulated conditions for datagrams sent from now on
+ * Args:
+ *	conditions table, as for enet.loopback_network
+ */
+static int loopback_set_conditions(lua_State *l) {
+	ENetLoopbackNetwork *network = check_loopback(l, 1);
+	ENetLoopbackConditions conditions;
+	read_loopback_conditions(l, 2, &conditions);
+
+	enet_loopback_network_set_conditions(network, &conditions);
+	return 0;
+}
+
+static int loopback_gc(lua_State *l) {
+	ENetLoopbackNetwork **network = (ENetLoopbackNetwork**)luaL_checkudata(l, 1, "enet_loopback");
+	// attached hosts keep the network alive until they are destroyed
+	if (*network) {
+		enet_loopback_network_destroy(*network);
+	}
+	*network = NULL;
+	return 0;
+}
+
+/**
+ * Create a sharded server: several hosts bound to the same port, each
+ * serviced on its own thread. Peers are not exposed as enet_peer objects,
+ * since they belong to the shards' threads; events identify them by a
+ * peer id and connect id instead, which are passed back to send and
+ * disconnect. Shard peers can't coalesce channels, so its clients must not
+ * enable peer:coalesce either.
+ * Args:
+ *	address
+ *	[shard_count = 1]
+ *	[peer_count = 64] per shard
+ *	[channel_count = 1]
+ *	[in_bandwidth = 0] per shard
+ *	[out_bandwidth = 0] per shard
+ */
+static int sharded_host_create(lua_State *l) {
+	ENetAddress address;
+	parse_address(l, luaL_checkstring(l, 1), &address);
+
+	ENetShardedHost *sharded_host = enet_sharded_host_create(&address,
+			luaL_optint(l, 2, 1), luaL_optint(l, 3, 64), luaL_optint(l, 4, 1),
+			luaL_optint(l, 5, 0), luaL_optint(l, 6, 0));
+
+	if (sharded_host == NULL) {
+		lua_pushnil (l);
+		lua_pushstring(l, "enet: failed to create sharded host (already listening?)");
+		return 2;
+	}
+
+	*(ENetShardedHost**)lua_newuserdata(l, sizeof(void*)) = sharded_host;
+	luaL_getmetatable(l, "enet_sharded_host");
+	lua_setmetatable(l, -2);
+
+	return 1;
+}
+
+static ENetShardedHost *check_live_sharded_host(lua_State *l, int idx) {
+	ENetShardedHost *sharded_host = check_sharded_host(l, idx);
+	if (!sharded_host) {
+		luaL_error(l, "Tried to index a nil sharded host!");
+	}
+	return sharded_host;
+}
+
+static ENetPeer *check_shard_peer(lua_State *l, ENetShardedHost *sharded_host, int idx) {
+	size_t id = (size_t) luaL_checknumber(l, idx);
+	size_t shard = id / ENET_PROTOCOL_MAXIMUM_PEER_ID, peer = id % ENET_PROTOCOL_MAXIMUM_PEER_ID;
+
+	if (shard >= sharded_host->shardCount || peer >= sharded_host->shards[shard].host->peerCount) {
+		luaL_error(l, "Invalid peer id");
+	}
+
+	return &sharded_host->shards[shard].host->peers[peer];
+}
+
+/**
+ * Take the next event of any shard
+ * Returns an event table {type, peer = peer id, connect_id, data, channel}
+ * or nil if no event is pending
+ */
+static int sharded_host_receive(lua_State *l) {
+	ENetShardedHost *sharded_host = check_live_sharded_host(l, 1);
+	ENetShardEvent event;
+
+	if (enet_sharded_host_receive(sharded_host, &event) <= 0) {
+		lua_pushnil(l);
+		return 1;
+	}
+
+	lua_newtable(l);
+
+	lua_pushnumber(l, event.shard * ENET_PROTOCOL_MAXIMUM_PEER_ID + event.peer->incomingPeerID);
+	lua_setfield(l, -2, "peer");
+	lua_pushnumber(l, event.connectID);
+	lua_setfield(l, -2, "connect_id");
+
+	switch (event.type) {
+		case ENET_EVENT_TYPE_CONNECT:
+			lua_pushinteger(l, event.data);
+			lua_setfield(l, -2, "data");
+
+			lua_pushstring(l, "connect");
+			break;
+		case ENET_EVENT_TYPE_DISCONNECT:
+			lua_pushinteger(l, event.data);
+			lua_setfield(l, -2, "data");
+
+			lua_pushstring(l, "disconnect");
+			break;
+		case ENET_EVENT_TYPE_RECEIVE:
+			lua_pushlstring(l, (const char *)event.packet->data, event.packet->dataLength);
+			lua_setfield(l, -2, "data");
+
+			lua_pushinteger(l, event.channelID);
+			lua_setfield(l, -2, "channel");
+
+			lua_pushstring(l, "receive");
+
+			enet_packet_destroy(event.packet);
+			break;
+		default:
+			lua_pushstring(l, "none");
+			break;
+	}
+
+	lua_setfield(l, -2, "type");
+	return 1;
+}
+
+/**
+ * Queue a lua string to be sent to a peer of one of the shards
+ * Args:
+ *	peer id, from an event
+ *	connect id, from the same event
+ *	packet data, string
+ *	channel id
+ *	flags ["reliable", nil]
+ */
+static int sharded_host_send(lua_State *l) {
+	ENetShardedHost *sharded_host = check_live_sharded_host(l, 1);
+	ENetPeer *peer = check_shard_peer(l, sharded_host, 2);
+	enet_uint32 connect_id = (enet_uint32) luaL_checknumber(l, 3);
+
+	enet_uint8 channel_id;
+	ENetPacket *packet = read_packet(l, 4, &channel_id);
+
+	if (enet_sharded_host_send(sharded_host, peer, connect_id, channel_id, packet) < 0) {
+		enet_packet_destroy(packet);
+	}
+	return 0;
+}
+
+/**
+ * Queue a disconnection request for a peer of one of the shards
+ * Args:
+ *	peer id
+ *	connect id
+ *	[data = 0]
+ */
+static int sharded_host_disconnect(lua_State *l) {
+	ENetShardedHost *sharded_host = check_live_sharded_host(l, 1);
+	ENetPeer *peer = check_shard_peer(l, sharded_host, 2);
+	enet_uint32 connect_id = (enet_uint32) luaL_checknumber(l, 3);
+
+	enet_sharded_host_disconnect(sharded_host, peer, connect_id, luaL_optint(l, 4, 0));
+	return 0;
+}
+
+/**
+ * Queue a lua string to be sent to all peers of all shards
+ * Args:
+ *	packet data, string
+ *	channel id
+ *	flags ["reliable", nil]
+ */
+static int sharded_host_broadcast(lua_State *l) {
+	ENetShardedHost *sharded_host = check_live_sharded_host(l, 1);
+
+	enet_uint8 channel_id;
+	ENetPacket *packet = read_packet(l, 2, &channel_id);
+
+	if (enet_sharded_host_broadcast(sharded_host, channel_id, packet) < 0) {
+		enet_packet_destroy(packet);
+		return luaL_error(l, "Failed to queue broadcast");
+	}
+	return 0;
+}
+
+/**
+ * Get the address all shards are bound to
+ */
+static int sharded_host_get_socket_address(lua_State *l) {
+	ENetShardedHost *sharded_host = check_live_sharded_host(l, 1);
+	ENetAddress address = sharded_host->shards[0].host->address;
+
+	lua_pushfstring(l, "%d.%d.%d.%d:%d",
+			((address.host) & 0xFF),
+			((address.host >> 8) & 0xFF),
+			((address.host >> 16) & 0xFF),
+			(address.host >> 24& 0xFF),
+			address.port);
+	return 1;
+}
+
+static int sharded_host_gc(lua_State *l) {
+	ENetShardedHost **sharded_host = (ENetShardedHost**)luaL_checkudata(l, 1, "enet_sharded_host");
+	// stops and joins the shard threads
+	enet_sharded_host_destroy(*sharded_host);
+	*sharded_host = NULL;
+	return 0;
+}
+
+static const struct luaL_Reg enet_funcs [] = {
+	{"host_create", host_create},
+	{"linked_version", linked_version},
+	{"pool_stats", pool_stats},
+	{"pool_trim", pool_trim},
+	{"train_dictionary", train_dictionary},
+	{"snapshot_history", snapshot_history},
+	{"interest_grid", interest_grid_create},
+	{"lockstep", lockstep_create},
+	{"schema", schema_create},
+	{"loopback_network", loopback_network},
+	{"sharded_host_create", sharded_host_create},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg enet_host_funcs [] = {
+	{"service", host_service},
+	{"check_events", host_check_events},
+	{"compress", host_compress},
+	{"compress_with_range_coder", host_compress_with_range_coder},
+	{"enable_checksum", host_enable_checksum},
+	{"connect", host_connect},
+	{"flush", host_flush},
+	{"broadcast", host_broadcast},
+	{"channel_limit", host_channel_limit},
+	{"stream_channel", host_stream_channel},
+	{"bandwidth_limit", host_bandwidth_limit},
+	{"require_cookies", host_require_cookies},
+	{"limit_connections", host_limit_connections},
+	// Since ENetSocket isn't part of enet-lua, we should try to keep
+	// naming conventions the same as the rest of the lib.
+	{"get_socket_address", host_get_socket_address},
+	// TODO: Remove the line below in future versions, it's for backward
+	// compatibility only.
+	{"socket_get_address", host_get_socket_address},
+	// We need this function to free up our ports when needed!
+	{"destroy", host_gc},
+
+	// additional convenience functions (mostly accessors)
+	{"total_sent_data", host_total_sent_data},
+	{"total_received_data", host_total_received_data},
+	{"service_time", host_service_time},
+	{"peer_count", host_peer_count},
+	{"stats", host_stats},
+	{"get_peer", host_get_peer},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg enet_peer_funcs [] = {
+	{"disconnect", peer_disconnect},
+	{"disconnect_now", peer_disconnect_now},
+	{"disconnect_later", peer_disconnect_later},
+	{"reset", peer_reset},
+	{"ping", peer_ping},
+	{"receive", peer_receive},
+	{"send", peer_send},
+	{"coalesce", peer_coalesce},
+	{"throttle_configure", peer_throttle_configure},
+	{"ping_interval", peer_ping_interval},
+	{"timeout", peer_timeout},
+
+	// additional convenience functions to member variables
+	{"index", peer_index},
+	{"state", peer_state},
+	{"connect_id", peer_connect_id},
+	{"round_trip_time", peer_round_trip_time},
+	{"last_round_trip_time", peer_last_round_trip_time},
+	{"stats", peer_stats},
+	{"channel_stats", peer_channel_stats},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg enet_sharded_host_funcs [] = {
+	{"receive", sharded_host_receive},
+	{"send", sharded_host_send},
+	{"disconnect", sharded_host_disconnect},
+	{"broadcast", sharded_host_broadcast},
+	{"get_socket_address", sharded_host_get_socket_address},
+	{"destroy", sharded_host_gc},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg enet_loopback_funcs [] = {
+	{"attach", loopback_attach},
+	{"set_conditions", loopback_set_conditions},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg enet_schema_funcs [] = {
+	{"encode", schema_encode},
+	{"decode", schema_decode},
+	{"send", schema_send},
+	{"cdef", schema_cdef},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg enet_interest_funcs [] = {
+	{"update", interest_update},
+	{"move", interest_move},
+	{"remove", interest_remove},
+	{"view", interest_view},
+	{"unview", interest_unview},
+	{"visible", interest_visible},
+	{"send", interest_send},
+	{"stats", interest_stats},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg enet_lockstep_funcs [] = {
+	{"input", lockstep_input},
+	{"send", lockstep_send},
+	{"receive", lockstep_receive},
+	{"advance", lockstep_advance},
+	{"tick", lockstep_tick},
+	{"stats", lockstep_stats},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg enet_snapshot_funcs [] = {
+	{"send", snapshot_send},
+	{"acknowledge", snapshot_acknowledge},
+	{"receive", snapshot_receive},
+	{NULL, NULL}
+};
+
+int luaopen_enet(lua_State *l) {
+	enet_initialize();
+	atexit(enet_deinitialize);
+
+	// create metatables
+	luaL_newmetatable(l, "enet_host");
+	lua_newtable(l); // index
+	luaL_register(l, NULL, enet_host_funcs);
+	lua_setfield(l, -2, "__index");
+	lua_pushcfunction(l, host_gc);
+	lua_setfield(l, -2, "__gc");
+
+	luaL_newmetatable(l, "enet_peer");
+	lua_newtable(l);
+	luaL_register(l, NULL, enet_peer_funcs);
+	lua_setfield(l, -2, "__index");
+	lua_pushcfunction(l, peer_tostring);
+	lua_setfield(l, -2, "__tostring");
+
+	luaL_newmetatable(l, "enet_sharded_host");
+	lua_newtable(l);
+	luaL_register(l, NULL, enet_sharded_host_funcs);
+	lua_setfield(l, -2, "__index");
+	lua_pushcfunction(l, sharded_host_gc);
+	lua_setfield(l, -2, "__gc");
+
+	luaL_newmetatable(l, "enet_loopback");
+	lua_newtable(l);
+	luaL_register(l, NULL, enet_loopback_funcs);
+	lua_setfield(l, -2, "__index");
+	lua_pushcfunction(l, loopback_gc);
+	lua_setfield(l, -2, "__gc");
+
+	luaL_newmetatable(l, "enet_snapshot");
+	lua_newtable(l);
+	luaL_register(l, NULL, enet_snapshot_funcs);
+	lua_setfield(l, -2, "__index");
+	lua_pushcfunction(l, snapshot_gc);
+	lua_setfield(l, -2, "__gc");
+
+	luaL_newmetatable(l, "enet_interest");
+	lua_newtable(l);
+	luaL_register(l, NULL, enet_interest_funcs);
+	lua_setfield(l, -2, "__index");
+	lua_pushcfunction(l, interest_gc);
+	lua_setfield(l, -2, "__gc");
+
+	luaL_newmetatable(l, "enet_lockstep");
+	lua_newtable(l);
+	luaL_register(l, NULL, enet_lockstep_funcs);
+	lua_setfield(l, -2, "__index");
+	lua_pushcfunction(l, lockstep_gc);
+	lua_setfield(l, -2, "__gc");
+
+	luaL_newmetatable(l, "enet_schema");
+	lua_newtable(l);
+	luaL_register(l, NULL, enet_schema_funcs);
+	lua_setfield(l, -2, "__index");
+
+	// set up peer table
+	lua_newtable(l);
+
+	lua_newtable(l); // metatable
+	lua_pushstring(l, "v");
+	lua_setfield(l, -2, "__mode");
+	lua_setmetatable(l, -2);
+
+	lua_setfield(l, LUA_REGISTRYINDEX, "enet_peers");
+
+	// set up host table, the same way
+	lua_newtable(l);
+
+	lua_newtable(l); // metatable
+	lua_pushstring(l, "v");
+	lua_setfield(l, -2, "__mode");
+	lua_setmetatable(l, -2);
+
+	lua_setfield(l, LUA_REGISTRYINDEX, "enet_hosts");
 
 	luaL_register(l, "enet", enet_funcs);
 
@@ -0,0 +1,94 @@
+--[[
+Checks that schema messages round trip, with an array of every element type,
+and that malformed data and mismatched FFI values are rejected. Run it with a
+LuaJIT that can require the enet module:
+
+	luajit schema.lua
+]]
+
+local enet = require "enet"
+local ffi = require "ffi"
+
+local function equal(a, b)
+	if type(a) ~= "table" or type(b) ~= "table" then
+		return a == b
+	end
+	for k, v in pairs(a) do
+		if not equal(v, b[k]) then return false end
+	end
+	for k in pairs(b) do
+		if a[k] == nil then return false end
+	end
+	return true
+end
+
+local vec = enet.schema{ {"x", "fixed", 1/64}, {"y", "fixed", 1/64} }
+
+-- each array is the last field, so its bound check is against the end of the data
+local arrays = {
+	uint = {0, 1, 127, 128, 300, 4000000000},
+	int = {0, -1, 1, -64, 64, -2000000000},
+	fixed = {0, 0.5, -0.25, 1000.015625},
+	u8 = {0, 1, 255},
+	u16 = {0, 256, 65535},
+	u32 = {0, 65536, 4294967295},
+	float = {0, 0.5, -2.25, 1e10},
+	double = {0, 1.5e300, -1/3},
+	bool = {true, false, true, true, false, false, false, false, true},
+	string = {"", "a", string.rep("b", 300)},
+	[vec] = {{x = 1, y = 2}, {x = -1.5, y = 0.015625}},
+}
+
+for element_type, values in pairs(arrays) do
+	local name = type(element_type) == "string" and element_type or "nested"
+	local s = enet.schema{ {"id", "uint"}, {"values", element_type, array = true} }
+
+	for count = 0, #values do
+		local message = {id = count, values = {unpack(values, 1, count)}}
+		local data = s:encode(message)
+		assert(equal(s:decode(data), message), name .. " array of " .. count .. " did not round trip")
+
+		if count > 0 then
+			assert(s:decode(data:sub(1, -2)) == nil, "truncated " .. name .. " array was accepted")
+		end
+	end
+
+	-- a count larger than the data that follows it
+	assert(s:decode("\1\100") == nil, "oversized " .. name .. " array was accepted")
+end
+
+-- 9 bools take 2 bytes, fewer than their count
+local bools = enet.schema{ {"flags", "bool[]"} }
+assert(#bools:encode{flags = arrays.bool} == 3)
+
+-- floats and doubles are big endian like the fixed width integers
+assert(enet.schema{ {"f", "float"} }:encode{f = 1} == "\63\128\0\0")
+assert(enet.schema{ {"d", "double"} }:encode{d = 1} == "\63\240\0\0\0\0\0\0")
+
+-- numbers that do not convert to the field's integer type
+for _, t in ipairs{"uint", "int", "fixed", "u8", "u16", "u32"} do
+	local s = enet.schema{ {"v", t, 1/64} }
+	for _, v in ipairs{0/0, 1/0, -1/0, 2^70, -2^70} do
+		if not (t == "uint" and v < 0) then
+			assert(not pcall(s.encode, s, {v = v}), t .. " field accepted " .. v)
+		end
+	end
+end
+
+-- FFI structs of flat schemas
+local player = enet.schema{ {"id", "uint"}, {"x", "fixed", 1/64}, {"alive", "bool"}, {"hp", "u8"}, {"f", "float"}, {"w", "u16"} }
+ffi.cdef(player:cdef("schema_test_player"))
+local fields = {id = 7, x = 1.25, alive = true, hp = 9, f = 2.5, w = 1000}
+local data = player:encode(ffi.new("schema_test_player", fields))
+assert(data == player:encode(fields))
+
+local decoded = player:decode(data, ffi.new("schema_test_player"))
+for k, v in pairs(fields) do
+	assert(decoded[k] == v, "FFI field " .. k .. " did not round trip")
+end
+
+assert(not pcall(player.encode, player, ffi.new("uint8_t[2]")))
+assert(not pcall(player.decode, player, data, ffi.new("uint8_t[2]")))
+assert(not pcall(player.decode, player, data, ffi.new("schema_test_player *")))
+
+print("ok")
@@ -0,0 +1,315 @@
+/**
+ @file  admission.c
+ @brief ENet connection admission: cookie handshake and per-address rate limits
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/time.h"
+#include "enet/enet.h"
+
+/** @defgroup admission ENet connection admission
+
+    Without admission control a host allocates a peer and its channels for
+    the first CONNECT datagram from any address, so a flood of forged
+    connects fills every peer slot before a single one is verified.
+
+    With cookies required, a CONNECT is answered with a CONNECT_CHALLENGE
+    carrying a cookie: a SipHash-2-4 MAC, under a key only the host knows,
+    of the source address, the connect ID and the current period of
+    1 << ENET_ADMISSION_COOKIE_SHIFT milliseconds.  The host stores nothing.
+    The connecting side resends its connect as a CONNECT_COOKIE echoing the
+    cookie, which proves it receives datagrams at its source address; only
+    then is a peer allocated.  A cookie is accepted during its period and
+    the next one.
+
+    The rate limit gives each source address a token bucket, refilled at
+    rate attempts per second up to burst attempts, kept in a set associative
+    table of ENET_ADMISSION_SETS sets of ENET_ADMISSION_WAYS entries where
+    an unknown address replaces the entry seen least recently.  Every
+    datagram addressed to no peer takes a token before it is decompressed,
+    checksummed or parsed; a handshake with cookies takes two.
+    @{
+*/
+
+typedef unsigned long long enet_admission_word;
+
+#define ENET_ADMISSION_ROTATE(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define ENET_ADMISSION_SIPROUND \
+{ \
+    v0 += v1; v1 = ENET_ADMISSION_ROTATE (v1, 13); v1 ^= v0; v0 = ENET_ADMISSION_ROTATE (v0, 32); \
+    v2 += v3; v3 = ENET_ADMISSION_ROTATE (v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ENET_ADMISSION_ROTATE (v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ENET_ADMISSION_ROTATE (v1, 17); v1 ^= v2; v2 = ENET_ADMISSION_ROTATE (v2, 32); \
+}
+
+/** SipHash-2-4 of a two word message. */
+static enet_admission_word
+enet_admission_mac (const enet_uint32 * key, enet_admission_word m0, enet_admission_word m1)
+{
+    enet_admission_word k0 = key [0] | ((enet_admission_word) key [1] << 32),
+                        k1 = key [2] | ((enet_admission_word) key [3] << 32),
+                        v0 = k0 ^ 0x736f6d6570736575ULL,
+                        v1 = k1 ^ 0x646f72616e646f6dULL,
+                        v2 = k0 ^ 0x6c7967656e657261ULL,
+                        v3 = k1 ^ 0x7465646279746573ULL,
+                        last = (enet_admission_word) 16 << 56;
+
+    v3 ^= m0;
+    ENET_ADMISSION_SIPROUND;
+    ENET_ADMISSION_SIPROUND;
+    v0 ^= m0;
+
+    v3 ^= m1;
+    ENET_ADMISSION_SIPROUND;
+    ENET_ADMISSION_SIPROUND;
+    v0 ^= m1;
+
+    v3 ^= last;
+    ENET_ADMISSION_SIPROUND;
+    ENET_ADMISSION_SIPROUND;
+    v0 ^= last;
+
+    v2 ^= 0xFF;
+    ENET_ADMISSION_SIPROUND;
+    ENET_ADMISSION_SIPROUND;
+    ENET_ADMISSION_SIPROUND;
+    ENET_ADMISSION_SIPROUND;
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static void
+enet_admission_cookie (ENetHost * host, enet_uint32 connectID, enet_uint32 period, enet_uint8 * cookie)
+{
+    enet_admission_word mac = enet_admission_mac (host -> admission -> key,
+                                                  host -> receivedAddress.host | ((enet_admission_word) host -> receivedAddress.port << 32),
+                                                  connectID | ((enet_admission_word) period << 32));
+
+    memcpy (cookie, & mac, ENET_PROTOCOL_COOKIE_SIZE);
+}
+
+static ENetAdmission *
+enet_admission_create (ENetHost * host)
+{
+    if (host -> admission != NULL)
+      return host -> admission;
+
+    host -> admission = (ENetAdmission *) enet_malloc (sizeof (ENetAdmission));
+    if (host -> admission == NULL)
+      return NULL;
+
+    memset (host -> admission, 0, sizeof (ENetAdmission));
+
+    return host -> admission;
+}
+
+/** Requires connecting peers to echo a cookie before a peer is allocated for them.
+    @param host host to configure
+    @param enable 1 to require cookies, 0 to accept connects directly
+    @param key 16 byte secret key for the cookies; if NULL, one is derived from the host's random seed and the time
+    @returns 0 on success, < 0 on failure
+    @remarks Hosts sharing an address behind a load balancer should share a key.
+    The connecting side needs no configuration.
+*/
+int
+enet_host_require_cookies (ENetHost * host, int enable, const enet_uint8 * key)
+{
+    ENetAdmission * admission = enet_admission_create (host);
+    int keyIndex;
+
+    if (admission == NULL)
+      return -1;
+
+    admission -> cookies = enable;
+
+    if (key != NULL)
+    {
+        memcpy (admission -> key, key, sizeof (admission -> key));
+
+        return 0;
+    }
+
+    for (keyIndex = 0; keyIndex < 4; ++ keyIndex)
+    {
+        enet_uint32 seed = (host -> randomSeed += 0x9E3779B9U) ^ enet_host_random_seed () ^ (enet_time_get () << (keyIndex * 8));
+
+        seed = (seed ^ (seed >> 16)) * 0x85EBCA6BU;
+        seed = (seed ^ (seed >> 13)) * 0xC2B2AE35U;
+        admission -> key [keyIndex] ^= seed ^ (seed >> 16) ^ (enet_uint32) (size_t) admission;
+    }
+
+    return 0;
+}
+
+/** Limits how often one source address may attempt to connect.
+    @param host host to configure
+    @param rate attempts per second allowed from one address, or 0 for no limit
+    @param burst attempts allowed at once after an address has been idle
+    @returns 0 on success, < 0 on failure
+    @remarks Each connect datagram is one attempt, including retransmissions, and a
+    handshake with cookies takes two.
+*/
+int
+enet_host_limit_connections (ENetHost * host, enet_uint32 rate, enet_uint32 burst)
+{
+    ENetAdmission * admission = enet_admission_create (host);
+
+    if (admission == NULL)
+      return -1;
+
+    admission -> rate = rate;
+    admission -> burst = burst > 0 ? burst : 1;
+
+    memset (admission -> entries, 0, sizeof (admission -> entries));
+
+    return 0;
+}
+
+/** Takes a token from the bucket of the address of the datagram just received.
+    @returns 1 if the datagram may be processed, 0 if it must be dropped
+*/
+int
+enet_host_admit (ENetHost * host)
+{
+    ENetAdmission * admission = host -> admission;
+    ENetAdmissionEntry * set, * entry, * oldest;
+    enet_uint32 address = host -> receivedAddress.host,
+                capacity, elapsed;
+    int way;
+
+    if (admission == NULL || admission -> rate == 0)
+      return 1;
+
+    capacity = admission -> burst * 1000;
+    set = admission -> entries [((address * 0x9E3779B1U) >> 24) & (ENET_ADMISSION_SETS - 1)];
+    oldest = set;
+
+    for (way = 0, entry = set; way < ENET_ADMISSION_WAYS; ++ way, ++ entry)
+    {
+        if (entry -> address == address)
+          break;
+
+        if (entry -> address == 0 ||
+            (oldest -> address != 0 && ENET_TIME_LESS (entry -> lastTime, oldest -> lastTime)))
+          oldest = entry;
+    }
+
+    if (way >= ENET_ADMISSION_WAYS)
+    {
+        entry = oldest;
+        entry -> address = address;
+        entry -> tokens = capacity;
+    }
+    else
+    {
+        elapsed = ENET_TIME_DIFFERENCE (host -> serviceTime, entry -> lastTime);
+        if (elapsed >= capacity / admission -> rate + 1)
+          entry -> tokens = capacity;
+        else
+        {
+            entry -> tokens += elapsed * admission -> rate;
+            if (entry -> tokens > capacity)
+              entry -> tokens = capacity;
+        }
+    }
+
+    entry -> lastTime = host -> serviceTime;
+
+    if (entry -> tokens < 1000)
+    {
+        ++ admission -> connectsLimited;
+
+        return 0;
+    }
+
+    entry -> tokens -= 1000;
+
+    return 1;
+}
+
+static void
+enet_admission_send_challenge (ENetHost * host, const ENetProtocol * command, const enet_uint8 * cookie)
+{
+    enet_uint8 data [sizeof (ENetProtocolHeader) + sizeof (enet_uint32) + sizeof (ENetProtocolConnectChallenge)];
+    ENetProtocolHeader * header = (ENetProtocolHeader *) data;
+    ENetProtocolConnectChallenge * challenge;
+    enet_uint32 * checksum = NULL;
+    ENetBuffer buffer;
+    int sentLength;
+
+    buffer.data = data;
+    buffer.dataLength = (size_t) & ((ENetProtocolHeader *) 0) -> sentTime;
+
+    header -> peerID = ENET_HOST_TO_NET_16 (ENET_NET_TO_HOST_16 (command -> connect.outgoingPeerID) & ENET_PROTOCOL_MAXIMUM_PEER_ID);
+
+    if (host -> checksum != NULL)
+    {
+        checksum = (enet_uint32 *) & data [buffer.dataLength];
+        * checksum = command -> connect.connectID;
+        buffer.dataLength += sizeof (enet_uint32);
+    }
+
+    challenge = (ENetProtocolConnectChallenge *) & data [buffer.dataLength];
+    challenge -> header.command = ENET_PROTOCOL_COMMAND_CONNECT_CHALLENGE;
+    challenge -> header.channelID = 0xFF;
+    challenge -> header.reliableSequenceNumber = 0;
+    challenge -> connectID = command -> connect.connectID;
+    memcpy (challenge -> cookie, cookie, ENET_PROTOCOL_COOKIE_SIZE);
+    buffer.dataLength += sizeof (ENetProtocolConnectChallenge);
+
+    if (checksum != NULL)
+      * checksum = host -> checksum (& buffer, 1);
+
+    if (host -> transport.send != NULL)
+      sentLength = (* host -> transport.send) (host -> transport.context, & host -> receivedAddress, & buffer, 1);
+    else
+      sentLength = enet_socket_send (host -> socket, & host -> receivedAddress, & buffer, 1);
+
+    if (sentLength > 0)
+    {
+        host -> totalSentData += sentLength;
+        host -> totalSentPackets ++;
+    }
+
+    ++ host -> admission -> challengesSent;
+}
+
+/** Checks the cookie of a connect command, answering with a challenge if it has none or a wrong one.
+    @returns 1 if a peer may be allocated for the connect, 0 otherwise
+*/
+int
+enet_host_check_cookie (ENetHost * host, const ENetProtocol * command)
+{
+    enet_uint32 period = host -> serviceTime >> ENET_ADMISSION_COOKIE_SHIFT, age;
+    enet_uint8 cookie [ENET_PROTOCOL_COOKIE_SIZE];
+
+    if (host -> admission == NULL || ! host -> admission -> cookies)
+      return 1;
+
+    if ((command -> header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_CONNECT_COOKIE)
+    {
+        for (age = 0; age < 2; ++ age)
+        {
+            enet_uint8 difference = 0;
+            int byteIndex;
+
+            enet_admission_cookie (host, command -> connect.connectID, period - age, cookie);
+
+            for (byteIndex = 0; byteIndex < ENET_PROTOCOL_COOKIE_SIZE; ++ byteIndex)
+              difference |= cookie [byteIndex] ^ command -> connectCookie.cookie [byteIndex];
+
+            if (difference == 0)
+              return 1;
+        }
+
+        ++ host -> admission -> cookiesRejected;
+    }
+
+    enet_admission_cookie (host, command -> connect.connectID, period, cookie);
+    enet_admission_send_challenge (host, command, cookie);
+
+    return 0;
+}
+
+/** @} */
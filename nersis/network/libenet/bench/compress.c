@@ -0,0 +1,219 @@
+/**
+ @file bench/compress.c
+ @brief Compares the LZ4 and range coder packet compressors
+
+ Build from the libenet directory with, for example:
+
+    cc -O2 -Iinclude bench/compress.c *.c -lpthread -o compress-bench
+
+ For each kind of packet, prints the compression and decompression speed in MB
+ of uncompressed data per second of CPU time, and the compressed size as a
+ share of the original.  Packets that do not shrink are counted at their
+ original size, as the host would send them uncompressed.
+*/
+#define ENET_BUILDING_LIB 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "enet/enet.h"
+
+enum
+{
+    BENCH_PACKETS = 2048,
+    BENCH_ROUNDS  = 20
+};
+
+typedef struct _BenchCodec
+{
+    const char * name;
+    void * context;
+    size_t (* compress) (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
+    size_t (* decompress) (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+} BenchCodec;
+
+static enet_uint32 benchSeed = 12345;
+
+static enet_uint32
+bench_random (void)
+{
+    benchSeed = benchSeed * 1103515245 + 12345;
+    return benchSeed >> 16;
+}
+
+/* 32 entities of id, position, velocity, health and flags, moving a little each packet */
+static size_t
+bench_snapshot (enet_uint8 * data, size_t index)
+{
+    size_t entity, length = 0;
+
+    for (entity = 0; entity < 32; ++ entity)
+    {
+        float state [4] = { (float) (entity * 37 + index / 4), (float) (entity * 11 % 50), 1.5f, (entity + index / 64) % 3 ? 0.0f : -2.25f };
+        enet_uint16 id = (enet_uint16) (entity + 1000), health = (enet_uint16) (100 - (entity + index / 16) % 40);
+
+        memcpy (& data [length], & id, sizeof (id)); length += sizeof (id);
+        memcpy (& data [length], state, sizeof (state)); length += sizeof (state);
+        memcpy (& data [length], & health, sizeof (health)); length += sizeof (health);
+        data [length ++] = (enet_uint8) (entity % 4 == 0);
+    }
+
+    return length;
+}
+
+/* a few textual game events */
+static size_t
+bench_events (enet_uint8 * data, size_t index)
+{
+    static const char * const names [] = { "alice", "bob", "carol", "dave", "erin" };
+    static const char * const kinds [] = { "hit", "pickup", "chat", "spawn" };
+    size_t event, length = 0;
+
+    for (event = 0; event < 4; ++ event)
+      length += sprintf ((char *) & data [length],
+                         "{\"type\":\"%s\",\"player\":\"%s\",\"tick\":%u,\"x\":%u,\"y\":%u}",
+                         kinds [(index + event) % 4], names [(index * 3 + event) % 5],
+                         (unsigned) (index * 4 + event), (unsigned) (bench_random () % 1000), (unsigned) (bench_random () % 1000));
+
+    return length;
+}
+
+static size_t
+bench_noise (enet_uint8 * data, size_t index)
+{
+    size_t length;
+
+    (void) index;
+
+    for (length = 0; length < 1024; ++ length)
+      data [length] = (enet_uint8) (bench_random () >> 8);
+
+    return length;
+}
+
+static void
+bench_run (const char * workload, const BenchCodec * codec, enet_uint8 * const * packets, const size_t * lengths)
+{
+    static enet_uint8 compressed [BENCH_PACKETS][ENET_PROTOCOL_MAXIMUM_MTU];
+    static size_t compressedLengths [BENCH_PACKETS];
+    enet_uint8 out [ENET_PROTOCOL_MAXIMUM_MTU];
+    size_t packet, round, totalIn = 0, totalOut = 0, totalDecompressed = 0;
+    clock_t start;
+    double compressTime, decompressTime;
+
+    start = clock ();
+    for (round = 0; round < BENCH_ROUNDS; ++ round)
+      for (packet = 0; packet < BENCH_PACKETS; ++ packet)
+      {
+         ENetBuffer buffer;
+
+         buffer.data = packets [packet];
+         buffer.dataLength = lengths [packet];
+
+         compressedLengths [packet] = codec -> compress (codec -> context, & buffer, 1, lengths [packet], compressed [packet], lengths [packet]);
+      }
+    compressTime = (double) (clock () - start) / CLOCKS_PER_SEC;
+
+    start = clock ();
+    for (round = 0; round < BENCH_ROUNDS; ++ round)
+      for (packet = 0; packet < BENCH_PACKETS; ++ packet)
+      {
+         if (compressedLengths [packet] == 0)
+           continue;
+
+         if (codec -> decompress (codec -> context, compressed [packet], compressedLengths [packet], out, sizeof (out)) != lengths [packet] ||
+             memcmp (out, packets [packet], lengths [packet]) != 0)
+         {
+            fprintf (stderr, "%s: %s failed to round trip packet %u\n", workload, codec -> name, (unsigned) packet);
+            exit (EXIT_FAILURE);
+         }
+      }
+    decompressTime = (double) (clock () - start) / CLOCKS_PER_SEC;
+
+    for (packet = 0; packet < BENCH_PACKETS; ++ packet)
+    {
+       totalIn += lengths [packet];
+       if (compressedLengths [packet] > 0)
+       {
+          totalOut += compressedLengths [packet];
+          totalDecompressed += lengths [packet];
+       }
+       else
+         totalOut += lengths [packet];
+    }
+
+    printf ("%-9s %-15s %8.1f MB/s", workload, codec -> name, totalIn * (double) BENCH_ROUNDS / compressTime / 1e6);
+    /* only packets that shrank are decompressed */
+    if (totalDecompressed > 0 && decompressTime > 0)
+      printf (" %8.1f MB/s", totalDecompressed * (double) BENCH_ROUNDS / decompressTime / 1e6);
+    else
+      printf (" %13s", "-");
+    printf (" %6.1f%%\n", 100.0 * totalOut / totalIn);
+}
+
+int
+main (void)
+{
+    static const struct
+    {
+       const char * name;
+       size_t (* generate) (enet_uint8 *, size_t);
+    } workloads [] =
+    {
+       { "snapshot", bench_snapshot },
+       { "events", bench_events },
+       { "noise", bench_noise }
+    };
+    static enet_uint8 storage [BENCH_PACKETS][ENET_PROTOCOL_MAXIMUM_MTU],
+                      sampleStorage [BENCH_PACKETS / 4][ENET_PROTOCOL_MAXIMUM_MTU];
+    enet_uint8 * packets [BENCH_PACKETS];
+    size_t lengths [BENCH_PACKETS], workload, packet;
+
+    printf ("%-9s %-15s %13s %13s %7s\n", "packets", "codec", "compress", "decompress", "size");
+
+    for (workload = 0; workload < sizeof (workloads) / sizeof (workloads [0]); ++ workload)
+    {
+       ENetBuffer samples [BENCH_PACKETS / 4];
+       enet_uint8 dictionary [ENET_LZ4_MAXIMUM_DICTIONARY];
+       size_t dictionaryLength, codec;
+       BenchCodec codecs [3];
+
+       for (packet = 0; packet < BENCH_PACKETS; ++ packet)
+       {
+          packets [packet] = storage [packet];
+          lengths [packet] = workloads [workload].generate (packets [packet], packet);
+       }
+
+       /* train on packets from later in the stream, as if recorded from an earlier session */
+       for (packet = 0; packet < BENCH_PACKETS / 4; ++ packet)
+       {
+          samples [packet].data = sampleStorage [packet];
+          samples [packet].dataLength = workloads [workload].generate (sampleStorage [packet], BENCH_PACKETS + packet * 4);
+       }
+       dictionaryLength = enet_lz4_train_dictionary (samples, BENCH_PACKETS / 4, dictionary, sizeof (dictionary));
+
+       codecs [0].name = "range_coder";
+       codecs [0].context = enet_range_coder_create ();
+       codecs [0].compress = enet_range_coder_compress;
+       codecs [0].decompress = enet_range_coder_decompress;
+
+       codecs [1].name = "lz4";
+       codecs [1].context = enet_lz4_create (NULL, 0);
+       codecs [1].compress = enet_lz4_compress;
+       codecs [1].decompress = enet_lz4_decompress;
+
+       codecs [2].name = "lz4+dictionary";
+       codecs [2].context = enet_lz4_create (dictionary, dictionaryLength);
+       codecs [2].compress = enet_lz4_compress;
+       codecs [2].decompress = enet_lz4_decompress;
+
+       for (codec = 0; codec < 3; ++ codec)
+         bench_run (workloads [workload].name, & codecs [codec], packets, lengths);
+
+       enet_range_coder_destroy (codecs [0].context);
+       enet_lz4_destroy (codecs [1].context);
+       enet_lz4_destroy (codecs [2].context);
+    }
+
+    return 0;
+}
@@ -5,7 +5,7 @@
 #define ENET_BUILDING_LIB 1
 #include "enet/enet.h"
 
-static ENetCallbacks callbacks = { malloc, free, abort };
+static ENetCallbacks callbacks = { malloc, free, abort, enet_pool_default_malloc, enet_pool_default_free };
 
 int
 enet_initialize_with_callbacks (ENetVersion version, const ENetCallbacks * inits)
@@ -25,6 +25,15 @@ enet_initialize_with_callbacks (ENetVersion version, const ENetCallbacks * inits
    if (inits -> no_memory != NULL)
      callbacks.no_memory = inits -> no_memory;
 
+   if (inits -> pool_malloc != NULL || inits -> pool_free != NULL)
+   {
+      if (inits -> pool_malloc == NULL || inits -> pool_free == NULL)
+        return -1;
+
+      callbacks.pool_malloc = inits -> pool_malloc;
+      callbacks.pool_free = inits -> pool_free;
+   }
+
    return enet_initialize ();
 }
 
@@ -51,3 +60,15 @@ enet_free (void * memory)
    callbacks.free (memory);
 }
 
+void *
+enet_pool_malloc (size_t size)
+{
+   return callbacks.pool_malloc (size);
+}
+
+void
+enet_pool_free (void * memory)
+{
+   callbacks.pool_free (memory);
+}
+
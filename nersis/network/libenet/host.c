@@ -30,6 +30,7 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
 {
     ENetHost * host;
     ENetPeer * currentPeer;
+    int level, slot;
 
     if (peerCount > ENET_PROTOCOL_MAXIMUM_PEER_ID)
       return NULL;
@@ -106,9 +107,28 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
     host -> compressor.decompress = NULL;
     host -> compressor.destroy = NULL;
 
+    host -> transport.context = NULL;
+    host -> transport.send = NULL;
+    host -> transport.receive = NULL;
+    host -> transport.wait = NULL;
+    host -> transport.destroy = NULL;
+
     host -> intercept = NULL;
 
+    host -> admission = NULL;
+
     enet_list_clear (& host -> dispatchQueue);
+    enet_list_clear (& host -> sendQueue);
+    enet_list_clear (& host -> visitQueue);
+    enet_list_clear (& host -> timerOverflow);
+
+    for (level = 0; level < ENET_HOST_TIMER_WHEEL_LEVELS; ++ level)
+      for (slot = 0; slot < ENET_HOST_TIMER_WHEEL_SLOTS; ++ slot)
+        enet_list_clear (& host -> timerWheel [level][slot]);
+
+    host -> serviceTime = enet_time_get ();
+    host -> timerTime = host -> serviceTime;
+    host -> timerCount = 0;
 
     for (currentPeer = host -> peers;
          currentPeer < & host -> peers [host -> peerCount];
@@ -143,7 +163,8 @@ enet_host_destroy (ENetHost * host)
     if (host == NULL)
       return;
 
-    enet_socket_destroy (host -> socket);
+    if (host -> socket != ENET_SOCKET_NULL)
+      enet_socket_destroy (host -> socket);
 
     for (currentPeer = host -> peers;
          currentPeer < & host -> peers [host -> peerCount];
@@ -155,6 +176,12 @@ enet_host_destroy (ENetHost * host)
     if (host -> compressor.context != NULL && host -> compressor.destroy)
       (* host -> compressor.destroy) (host -> compressor.context);
 
+    if (host -> transport.context != NULL && host -> transport.destroy)
+      (* host -> transport.destroy) (host -> transport.context);
+
+    if (host -> admission != NULL)
+      enet_free (host -> admission);
+
     enet_free (host -> peers);
     enet_free (host);
 }
@@ -258,13 +285,34 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
 void
 enet_host_broadcast (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
 {
-    ENetPeer * currentPeer;
+    enet_host_broadcast_peers (host, channelID, packet, NULL, 0);
+}
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+/** Queues a packet to be sent to a subset of the peers associated with the host.
+    @param host host on which to broadcast the packet
+    @param channelID channel on which to broadcast
+    @param packet packet to broadcast
+    @param peers peers to send the packet to; if NULL, all peers of the host are used
+    @param peerCount number of entries in peers
+    @remarks Peers that are not connected are skipped.  A packet that has to be
+    fragmented is laid out once per distinct fragment length, and the fragment
+    commands queued to each peer share those headers, so each further peer only
+    costs its commands and their sequence numbers.
+*/
+void
+enet_host_broadcast_peers (ENetHost * host, enet_uint8 channelID, ENetPacket * packet, ENetPeer * const * peers, size_t peerCount)
+{
+    size_t peerIndex;
+
+    if (peers == NULL)
+      peerCount = host -> peerCount;
+
+    for (peerIndex = 0; peerIndex < peerCount; ++ peerIndex)
     {
-       if (currentPeer -> state != ENET_PEER_STATE_CONNECTED)
+       ENetPeer * currentPeer = peers != NULL ? peers [peerIndex] : & host -> peers [peerIndex];
+
+       if (currentPeer -> state != ENET_PEER_STATE_CONNECTED ||
+           currentPeer -> host != host)
          continue;
 
        enet_peer_send (currentPeer, channelID, packet);
@@ -290,6 +338,62 @@ enet_host_compress (ENetHost * host, const ENetCompressor * compressor)
       host -> compressor.context = NULL;
 }
 
+/** Replaces the host's UDP socket with another datagram transport.
+    @param host host to set the transport of
+    @param transport callbacks for the transport
+    @remarks The host's socket is closed and cannot be restored, so this should be
+    called right after enet_host_create(), before any peers are connected.  host -> address
+    should be updated to the address the transport receives on.
+*/
+void
+enet_host_transport (ENetHost * host, const ENetTransport * transport)
+{
+    if (host -> transport.context != NULL && host -> transport.destroy)
+      (* host -> transport.destroy) (host -> transport.context);
+
+    host -> transport = * transport;
+
+    if (host -> socket != ENET_SOCKET_NULL)
+    {
+        enet_socket_destroy (host -> socket);
+        host -> socket = ENET_SOCKET_NULL;
+    }
+}
+
+/** Fills in a snapshot of a host's peer counts, traffic totals and the histograms accumulated over all of its peers.
+    @param host host to query
+    @param stats receives the snapshot
+*/
+void
+enet_host_get_stats (ENetHost * host, ENetHostStats * stats)
+{
+    stats -> peerCount = host -> peerCount;
+    stats -> connectedPeers = host -> connectedPeers;
+    stats -> bandwidthLimitedPeers = host -> bandwidthLimitedPeers;
+    stats -> peersWithOutgoingData = enet_list_size (& host -> sendQueue);
+    stats -> scheduledPeers = host -> timerCount;
+    stats -> totalSentData = host -> totalSentData;
+    stats -> totalSentPackets = host -> totalSentPackets;
+    stats -> totalReceivedData = host -> totalReceivedData;
+    stats -> totalReceivedPackets = host -> totalReceivedPackets;
+    stats -> connectsLimited = host -> admission != NULL ? host -> admission -> connectsLimited : 0;
+    stats -> challengesSent = host -> admission != NULL ? host -> admission -> challengesSent : 0;
+    stats -> cookiesRejected = host -> admission != NULL ? host -> admission -> cookiesRejected : 0;
+
+    memcpy (stats -> roundTripTimeHistogram, host -> roundTripTimeHistogram, sizeof (stats -> roundTripTimeHistogram));
+    memcpy (stats -> sendLatencyHistogram, host -> sendLatencyHistogram, sizeof (stats -> sendLatencyHistogram));
+}
+
+/** Clears a host's accumulated round trip time and send latency histograms.
+    @remarks the per-peer histograms are left alone; see enet_peer_reset_stats().
+*/
+void
+enet_host_reset_stats (ENetHost * host)
+{
+    memset (host -> roundTripTimeHistogram, 0, sizeof (host -> roundTripTimeHistogram));
+    memset (host -> sendLatencyHistogram, 0, sizeof (host -> sendLatencyHistogram));
+}
+
 /** Limits the maximum allowed channels of future incoming connections.
     @param host host to limit
     @param channelLimit the maximum number of channels allowed; if 0, then this is equivalent to ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT
@@ -306,6 +410,24 @@ enet_host_channel_limit (ENetHost * host, size_t channelLimit)
     host -> channelLimit = channelLimit;
 }
 
+/** Switches a channel between buffered and streamed delivery of incoming reliable fragmented packets.
+    @param host host whose channel to change
+    @param channelID channel to change
+    @param enable if non-zero, each fragment is received on its own as soon as it is in order
+    @remarks Streamed fragments are flagged ENET_PACKET_FLAG_STREAM_CHUNK, with ENET_PACKET_FLAG_STREAM_END
+    on the last one, and the event's data holds the total length of the message, so a large transfer
+    never has to be buffered whole.  Unreliable fragments are still reassembled.  Only change a channel
+    while no fragmented packet is arriving on it.
+*/
+void
+enet_host_stream_channel (ENetHost * host, enet_uint8 channelID, int enable)
+{
+    if (enable)
+      host -> streamedChannels [channelID / 32] |= 1u << (channelID % 32);
+    else
+      host -> streamedChannels [channelID / 32] &= ~ (1u << (channelID % 32));
+}
+
 
 /** Adjusts the bandwidth limits of a host.
     @param host host to adjust
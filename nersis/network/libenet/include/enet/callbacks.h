@@ -12,6 +12,8 @@ typedef struct _ENetCallbacks
     void * (ENET_CALLBACK * malloc) (size_t size);
     void (ENET_CALLBACK * free) (void * memory);
     void (ENET_CALLBACK * no_memory) (void);
+    void * (ENET_CALLBACK * pool_malloc) (size_t size);
+    void (ENET_CALLBACK * pool_free) (void * memory);
 } ENetCallbacks;
 
 /** @defgroup callbacks ENet internal callbacks
@@ -20,6 +22,10 @@ typedef struct _ENetCallbacks
 */
 extern void * enet_malloc (size_t);
 extern void   enet_free (void *);
+extern void * enet_pool_malloc (size_t);
+extern void   enet_pool_free (void *);
+extern void * enet_pool_default_malloc (size_t);
+extern void   enet_pool_default_free (void *);
 
 /** @} */
 
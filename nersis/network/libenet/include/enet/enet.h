@@ -62,7 +62,8 @@ typedef enum _ENetSocketOption
    ENET_SOCKOPT_RCVTIMEO  = 6,
    ENET_SOCKOPT_SNDTIMEO  = 7,
    ENET_SOCKOPT_ERROR     = 8,
-   ENET_SOCKOPT_NODELAY   = 9
+   ENET_SOCKOPT_NODELAY   = 9,
+   ENET_SOCKOPT_REUSEPORT = 10
 } ENetSocketOption;
 
 typedef enum _ENetSocketShutdown
@@ -115,6 +116,11 @@ typedef enum _ENetPacketFlag
    /** packet will be fragmented using unreliable (instead of reliable) sends
      * if it exceeds the MTU */
    ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT = (1 << 3),
+   /** received packet is one in-order fragment of a larger message on a channel
+     * streamed with enet_host_stream_channel() */
+   ENET_PACKET_FLAG_STREAM_CHUNK = (1 << 4),
+   /** received packet is the last fragment of a streamed message */
+   ENET_PACKET_FLAG_STREAM_END = (1 << 5),
 
    /** whether the packet has been sent from all queues it has been entered into */
    ENET_PACKET_FLAG_SENT = (1<<8)
@@ -122,6 +128,21 @@ typedef enum _ENetPacketFlag
 
 typedef void (ENET_CALLBACK * ENetPacketFreeCallback) (struct _ENetPacket *);
 
+/**
+ * Fragment headers of a packet that does not fit into one datagram.
+ *
+ * A packet is laid out once for each fragment length it is sent with, and the
+ * fragment commands queued to every peer only point at their header in the
+ * layout; the headers are copied from it when the commands are sent.
+ */
+typedef struct _ENetFragmentLayout
+{
+   struct _ENetFragmentLayout * next;
+   size_t                       fragmentLength;
+   enet_uint32                  fragmentCount;
+   ENetProtocolSendFragment     fragments [1];
+} ENetFragmentLayout;
+
 /**
  * ENet packet structure.
  *
@@ -138,9 +159,13 @@ typedef void (ENET_CALLBACK * ENetPacketFreeCallback) (struct _ENetPacket *);
  *    (not supported for reliable packets)
  *
  *    ENET_PACKET_FLAG_NO_ALLOCATE - packet will not allocate data, and user must supply it instead
+ *
+ *    ENET_PACKET_FLAG_STREAM_CHUNK, ENET_PACKET_FLAG_STREAM_END - set on received
+ *    fragments of messages on streamed channels
  
    @sa ENetPacketFlag
  */
+
 typedef struct _ENetPacket
 {
    size_t                   referenceCount;  /**< internal use only */
@@ -149,6 +174,7 @@ typedef struct _ENetPacket
    size_t                   dataLength;      /**< length of data */
    ENetPacketFreeCallback   freeCallback;    /**< function to be called when the packet is no longer in use */
    void *                   userData;        /**< application private data, may be freely modified */
+   ENetFragmentLayout *     fragmentLayouts; /**< internal use only */
 } ENetPacket;
 
 typedef struct _ENetAcknowledgement
@@ -166,10 +192,12 @@ typedef struct _ENetOutgoingCommand
    enet_uint32  sentTime;
    enet_uint32  roundTripTimeout;
    enet_uint32  roundTripTimeoutLimit;
+   enet_uint32  queueTime;
    enet_uint32  fragmentOffset;
    enet_uint16  fragmentLength;
    enet_uint16  sendAttempts;
    ENetProtocol command;
+   const ENetProtocolSendFragment * fragmentHeader; /**< header in the packet's fragment layout, or NULL if not a fragment */
    ENetPacket * packet;
 } ENetOutgoingCommand;
 
@@ -229,7 +257,34 @@ enum
    ENET_PEER_FREE_UNSEQUENCED_WINDOWS     = 32,
    ENET_PEER_RELIABLE_WINDOWS             = 16,
    ENET_PEER_RELIABLE_WINDOW_SIZE         = 0x1000,
-   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8
+   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8,
+
+   ENET_PEER_HISTOGRAM_BUCKETS            = 16,
+
+   ENET_HOST_TIMER_WHEEL_LEVELS           = 4,
+   ENET_HOST_TIMER_WHEEL_BITS             = 6,
+   ENET_HOST_TIMER_WHEEL_SLOTS            = 1 << ENET_HOST_TIMER_WHEEL_BITS,
+
+   ENET_POOL_MINIMUM_BLOCK_SIZE           = 64,
+   ENET_POOL_SIZE_CLASSES                 = 11,
+   ENET_POOL_MAXIMUM_CACHED_BYTES         = 1024 * 1024,
+
+   ENET_LZ4_MAXIMUM_DICTIONARY            = 32768,
+
+   ENET_SNAPSHOT_HISTORY                  = 32,
+   ENET_SNAPSHOT_MAXIMUM_FIELDS           = 32,
+   ENET_SNAPSHOT_HEADER_SIZE              = 6,
+
+   ENET_LOCKSTEP_WINDOW                   = 64,
+   ENET_LOCKSTEP_MAXIMUM_PLAYERS          = 32,
+   ENET_LOCKSTEP_MAXIMUM_INPUT_SIZE       = 256,
+   ENET_LOCKSTEP_HEADER_SIZE              = 10,
+
+   ENET_LOOPBACK_PROBABILITY_SCALE        = 0x10000,
+
+   ENET_ADMISSION_SETS                    = 256,
+   ENET_ADMISSION_WAYS                    = 4,
+   ENET_ADMISSION_COOKIE_SHIFT            = 12
 };
 
 typedef struct _ENetChannel
@@ -298,6 +353,9 @@ typedef struct _ENetPeer
    enet_uint32   mtu;
    enet_uint32   windowSize;
    enet_uint32   reliableDataInTransit;
+   enet_uint32   packetsRetransmitted;     /**< reliable commands resent after a timeout since the peer was reset */
+   enet_uint32   roundTripTimeHistogram [ENET_PEER_HISTOGRAM_BUCKETS]; /**< round trip time samples, bucketed as in ENetPeerStats */
+   enet_uint32   sendLatencyHistogram [ENET_PEER_HISTOGRAM_BUCKETS];   /**< time commands waited in the outgoing queues before their first transmission */
    enet_uint16   outgoingReliableSequenceNumber;
    ENetList      acknowledgements;
    ENetList      sentReliableCommands;
@@ -306,12 +364,271 @@ typedef struct _ENetPeer
    ENetList      outgoingUnreliableCommands;
    ENetList      dispatchedCommands;
    int           needsDispatch;
+   ENetListNode  sendList;
+   int           needsSend;
+   ENetListNode  timerList;
+   enet_uint32   timerDeadline;
+   int           timerScheduled;
    enet_uint16   incomingUnsequencedGroup;
    enet_uint16   outgoingUnsequencedGroup;
    enet_uint32   unsequencedWindow [ENET_PEER_UNSEQUENCED_WINDOW_SIZE / 32]; 
    enet_uint32   eventData;
 } ENetPeer;
 
+/**
+ * Allocation statistics of the size-classed pool that backs packets, packet
+ * data and protocol commands.  Counters are kept per thread, except for the
+ * live block count.
+
+   @sa enet_pool_get_stats()
+ */
+typedef struct _ENetPoolStats
+{
+   size_t allocations;   /**< blocks handed out by the pool */
+   size_t frees;         /**< blocks returned to the pool */
+   size_t hits;          /**< allocations served from a freelist */
+   size_t misses;        /**< allocations that had to go to enet_malloc() */
+   size_t oversized;     /**< allocations too large for any size class */
+   size_t liveBlocks;    /**< blocks currently in use, allocated by any thread */
+   size_t cachedBlocks;  /**< blocks currently held in freelists */
+   size_t cachedBytes;   /**< bytes currently held in freelists */
+} ENetPoolStats;
+
+/**
+ * Snapshot of a peer's connection state, filled by enet_peer_get_stats().
+ * Histogram bucket 0 counts samples of 0 ms and bucket i > 0 those in
+ * [2^(i-1), 2^i) ms; the last bucket also holds everything above it.
+ */
+typedef struct _ENetPeerStats
+{
+   enet_uint32 roundTripTime;
+   enet_uint32 roundTripTimeVariance;
+   enet_uint32 lowestRoundTripTime;
+   enet_uint32 lastRoundTripTime;
+   enet_uint32 packetLoss;                 /**< ratio with respect to ENET_PEER_PACKET_LOSS_SCALE */
+   enet_uint32 packetLossVariance;
+   enet_uint32 packetThrottle;             /**< ratio with respect to ENET_PEER_PACKET_THROTTLE_SCALE */
+   enet_uint32 packetThrottleLimit;
+   enet_uint32 packetsSent;                /**< since the start of the current packet loss interval */
+   enet_uint32 packetsLost;
+   enet_uint32 packetsRetransmitted;
+   enet_uint32 reliableDataInTransit;
+   enet_uint32 windowSize;
+   enet_uint32 mtu;
+   enet_uint32 incomingBandwidth;
+   enet_uint32 outgoingBandwidth;
+   enet_uint32 incomingDataTotal;          /**< since the last bandwidth throttle epoch */
+   enet_uint32 outgoingDataTotal;
+   size_t      acknowledgements;
+   size_t      outgoingReliableCommands;
+   size_t      outgoingUnreliableCommands;
+   size_t      sentReliableCommands;
+   size_t      incomingReliableCommands;   /**< summed over all channels */
+   size_t      incomingUnreliableCommands;
+   size_t      incomingFragmentedPackets;  /**< packets still waiting for fragments */
+   size_t      dispatchedCommands;
+   enet_uint32 roundTripTimeHistogram [ENET_PEER_HISTOGRAM_BUCKETS];
+   enet_uint32 sendLatencyHistogram [ENET_PEER_HISTOGRAM_BUCKETS];
+} ENetPeerStats;
+
+/**
+ * Snapshot of one channel of a peer, filled by enet_peer_get_channel_stats().
+ */
+typedef struct _ENetChannelStats
+{
+   enet_uint16 outgoingReliableSequenceNumber;
+   enet_uint16 outgoingUnreliableSequenceNumber;
+   enet_uint16 incomingReliableSequenceNumber;
+   enet_uint16 incomingUnreliableSequenceNumber;
+   enet_uint16 usedReliableWindows;        /**< bitmask of reliable windows with commands in flight */
+   size_t      incomingReliableCommands;
+   size_t      incomingUnreliableCommands;
+   size_t      incomingFragmentedPackets;
+   size_t      incomingFragmentBytes;      /**< bytes of the packets still being reassembled */
+} ENetChannelStats;
+
+/**
+ * Host-wide counters, filled by enet_host_get_stats().  The histograms
+ * accumulate the samples of every peer.
+ */
+typedef struct _ENetHostStats
+{
+   size_t      peerCount;
+   size_t      connectedPeers;
+   size_t      bandwidthLimitedPeers;
+   size_t      peersWithOutgoingData;
+   size_t      scheduledPeers;
+   enet_uint32 totalSentData;
+   enet_uint32 totalSentPackets;
+   enet_uint32 totalReceivedData;
+   enet_uint32 totalReceivedPackets;
+   enet_uint32 connectsLimited;      /**< datagrams to no peer dropped by the per-address rate limit */
+   enet_uint32 challengesSent;       /**< connects answered with a cookie challenge */
+   enet_uint32 cookiesRejected;      /**< connects carrying a wrong or expired cookie */
+   enet_uint32 roundTripTimeHistogram [ENET_PEER_HISTOGRAM_BUCKETS];
+   enet_uint32 sendLatencyHistogram [ENET_PEER_HISTOGRAM_BUCKETS];
+} ENetHostStats;
+
+typedef struct _ENetSnapshotFrame
+{
+   enet_uint32   sequence;
+   size_t        entityCount;
+   enet_uint32 * fields;        /**< fieldCount columns of entityCapacity values */
+} ENetSnapshotFrame;
+
+/**
+ * A ring of recently sent or received snapshots, from which snapshots are
+ * delta encoded or decoded.  One end of a snapshot stream.
+
+   @sa enet_snapshot_history_create()
+   @sa enet_snapshot_encode()
+   @sa enet_snapshot_acknowledge()
+   @sa enet_snapshot_decode()
+ */
+typedef struct _ENetSnapshotHistory
+{
+   size_t            fieldCount;
+   size_t            entityCapacity;
+   enet_uint32       nextSequence;
+   enet_uint32       acknowledgedSequence;  /**< baseline for the next delta, 0 if none */
+   enet_uint8 *      scratch;
+   ENetSnapshotFrame frames [ENET_SNAPSHOT_HISTORY];
+} ENetSnapshotHistory;
+
+#define ENET_INTEREST_NONE 0xFFFFFFFFU
+
+typedef struct _ENetInterestEntity
+{
+   enet_uint32 x, y;
+   enet_uint32 cell;            /**< ENET_INTEREST_NONE while the entity is not in the grid */
+   enet_uint32 next, previous;  /**< neighbours in the cell's entity list */
+} ENetInterestEntity;
+
+typedef struct _ENetInterestViewer
+{
+   enet_uint32   x, y;
+   enet_uint32   cell;          /**< ENET_INTEREST_NONE while the viewer is not in the grid */
+   enet_uint32   next, previous;
+   size_t        visibleCount;
+   enet_uint32 * visible;       /**< bitset of visible entities */
+} ENetInterestViewer;
+
+/**
+ * A uniform grid of cells over a bounded area, tracking which entities each
+ * viewer can see.  Visibility changes only when an entity or viewer crosses
+ * a cell boundary, and is kept with hysteresis: an entity becomes visible
+ * within radius cells of a viewer and stays visible until it is more than
+ * radius + hysteresis cells away.
+
+   @sa enet_interest_grid_create()
+   @sa enet_interest_grid_move_entity()
+   @sa enet_interest_grid_move_viewer()
+   @sa enet_interest_grid_gather()
+ */
+typedef struct _ENetInterestGrid
+{
+   enet_uint32          originX, originY;     /**< fixed-point position of the corner of cell 0 */
+   enet_uint32          cellShift;            /**< cells are 1 << cellShift fixed-point units wide */
+   enet_uint32          cellsWide, cellsHigh;
+   enet_uint32          radius;
+   enet_uint32          hysteresis;
+   size_t               entityCapacity;
+   size_t               viewerCapacity;
+   enet_uint32 *        entityCells;          /**< first entity of each cell */
+   enet_uint32 *        viewerCells;          /**< first viewer of each cell */
+   ENetInterestEntity * entities;
+   ENetInterestViewer * viewers;
+   enet_uint32          entered;              /**< entities that became visible to a viewer */
+   enet_uint32          left;                 /**< entities that stopped being visible to a viewer */
+   enet_uint32          cellChanges;          /**< entity and viewer moves that crossed a cell boundary */
+} ENetInterestGrid;
+
+/** The game world driven by a lockstep session.  Saved worlds are keyed by
+    tick; the session only ever loads one of the last ENET_LOCKSTEP_WINDOW
+    ticks saved.
+
+    @sa enet_lockstep_create()
+ */
+typedef struct _ENetLockstepWorld
+{
+   /** Context data for the world. */
+   void * context;
+   /** Saves the world as it is before tick is simulated. May be NULL if the session never predicts. */
+   void (ENET_CALLBACK * save) (void * context, enet_uint32 tick);
+   /** Restores the world saved before tick. May be NULL if the session never predicts. */
+   void (ENET_CALLBACK * load) (void * context, enet_uint32 tick);
+   /** Simulates tick from the inputs of every player, playerCount inputs of inputSize bytes each. */
+   void (ENET_CALLBACK * simulate) (void * context, enet_uint32 tick, const enet_uint8 * inputs);
+} ENetLockstepWorld;
+
+typedef struct _ENetLockstepPlayer
+{
+   enet_uint32 confirmedTicks;     /**< the player's inputs for every tick below this have arrived */
+   enet_uint32 acknowledgedTicks;  /**< the player has the local inputs for every tick below this */
+} ENetLockstepPlayer;
+
+/**
+ * A deterministic lockstep session: exchanges every player's input for each
+ * tick and simulates ticks in order.  Inputs that have not arrived are
+ * predicted by repeating the player's last one; when a late input differs
+ * from its prediction the world is rolled back and resimulated.
+
+   @sa enet_lockstep_create()
+   @sa enet_lockstep_add_input()
+   @sa enet_lockstep_encode()
+   @sa enet_lockstep_receive()
+   @sa enet_lockstep_advance()
+ */
+typedef struct _ENetLockstep
+{
+   size_t             playerCount;
+   size_t             localPlayer;
+   size_t             inputSize;
+   enet_uint32        inputDelay;
+   enet_uint32        maximumPrediction;   /**< ticks the simulation may run ahead of the slowest player's inputs */
+   enet_uint32        currentTick;         /**< next tick to simulate */
+   enet_uint32        rollbackTick;        /**< earliest simulated tick whose inputs were corrected, currentTick if none */
+   enet_uint8 *       inputs;              /**< ENET_LOCKSTEP_WINDOW ticks of playerCount inputs */
+   ENetLockstepWorld  world;
+   ENetLockstepPlayer players [ENET_LOCKSTEP_MAXIMUM_PLAYERS];
+   enet_uint32        simulatedTicks;      /**< ticks simulated for the first time */
+   enet_uint32        resimulatedTicks;    /**< ticks simulated again after a rollback */
+   enet_uint32        rollbacks;
+   enet_uint32        maximumRollback;     /**< most ticks resimulated by one rollback */
+   enet_uint32        stalls;              /**< advances that waited for inputs */
+   enet_uint32        predictedInputs;     /**< remote inputs simulated before they arrived */
+   enet_uint32        mispredictedInputs;
+   enet_uint32        lateInputs;          /**< remote inputs that arrived after their tick was simulated */
+   enet_uint32        inputLateness;       /**< total ticks by which late inputs missed their tick */
+   enet_uint32        maximumInputLateness;
+} ENetLockstep;
+
+typedef struct _ENetAdmissionEntry
+{
+   enet_uint32 address;
+   enet_uint32 lastTime;
+   enet_uint32 tokens;       /**< thousandths of a connection attempt */
+} ENetAdmissionEntry;
+
+/**
+ * Connection admission state of a host: the cookie key and the per-address
+ * rate limit table, checked before any peer is allocated.
+
+   @sa enet_host_require_cookies()
+   @sa enet_host_limit_connections()
+ */
+typedef struct _ENetAdmission
+{
+   int                cookies;         /**< answer connects without a valid cookie with a challenge */
+   enet_uint32        key [4];
+   enet_uint32        rate;            /**< connection attempts per second from one address, 0 for no limit */
+   enet_uint32        burst;
+   enet_uint32        connectsLimited;
+   enet_uint32        challengesSent;
+   enet_uint32        cookiesRejected;
+   ENetAdmissionEntry entries [ENET_ADMISSION_SETS][ENET_ADMISSION_WAYS];
+} ENetAdmission;
+
 /** An ENet packet compressor for compressing UDP packets before socket sends or receives.
  */
 typedef struct _ENetCompressor
@@ -326,6 +643,39 @@ typedef struct _ENetCompressor
    void (ENET_CALLBACK * destroy) (void * context);
 } ENetCompressor;
 
+/** A datagram transport used by a host in place of its UDP socket.
+
+    @sa enet_host_transport()
+    @sa enet_host_loopback()
+ */
+typedef struct _ENetTransport
+{
+   /** Context data for the transport. Must be non-NULL. */
+   void * context;
+   /** Sends the datagram held in buffers[0:bufferCount-1] to address. Should return the number of bytes sent, 0 if the send would block, or < 0 on failure. */
+   int (ENET_CALLBACK * send) (void * context, const ENetAddress * address, const ENetBuffer * buffers, size_t bufferCount);
+   /** Receives one datagram into buffers[0:bufferCount-1], storing its source in address. Should return its length, 0 if none is available, or < 0 on failure. */
+   int (ENET_CALLBACK * receive) (void * context, ENetAddress * address, ENetBuffer * buffers, size_t bufferCount);
+   /** Waits at most timeout milliseconds for one of the ENET_SOCKET_WAIT conditions, as enet_socket_wait() does. Should return 0 on success, < 0 on failure. */
+   int (ENET_CALLBACK * wait) (void * context, enet_uint32 * condition, enet_uint32 timeout);
+   /** Destroys the context when the host is destroyed or the transport replaced. May be NULL. */
+   void (ENET_CALLBACK * destroy) (void * context);
+} ENetTransport;
+
+/** Network conditions simulated by a loopback network.
+
+    @sa enet_loopback_network_create()
+ */
+typedef struct _ENetLoopbackConditions
+{
+   enet_uint32 latency;      /**< one way delay of every datagram, in milliseconds */
+   enet_uint32 jitter;       /**< maximum additional random delay, in milliseconds */
+   enet_uint32 loss;         /**< probability a datagram is dropped, out of ENET_LOOPBACK_PROBABILITY_SCALE */
+   enet_uint32 reorder;      /**< probability a datagram is held back behind later ones, out of ENET_LOOPBACK_PROBABILITY_SCALE */
+} ENetLoopbackConditions;
+
+typedef struct _ENetLoopbackNetwork ENetLoopbackNetwork;
+
 /** Callback that computes the checksum of the data held in buffers[0:bufferCount-1] */
 typedef enet_uint32 (ENET_CALLBACK * ENetChecksumCallback) (const ENetBuffer * buffers, size_t bufferCount);
 
@@ -342,11 +692,19 @@ typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, st
     @sa enet_host_service()
     @sa enet_host_flush()
     @sa enet_host_broadcast()
+    @sa enet_host_broadcast_peers()
     @sa enet_host_compress()
     @sa enet_host_compress_with_range_coder()
+    @sa enet_host_compress_with_lz4()
+    @sa enet_host_transport()
+    @sa enet_host_loopback()
     @sa enet_host_channel_limit()
+    @sa enet_host_stream_channel()
     @sa enet_host_bandwidth_limit()
+    @sa enet_host_require_cookies()
+    @sa enet_host_limit_connections()
     @sa enet_host_bandwidth_throttle()
+    @sa enet_host_get_stats()
   */
 typedef struct _ENetHost
 {
@@ -363,6 +721,12 @@ typedef struct _ENetHost
    size_t               channelLimit;                /**< maximum number of channels allowed for connected peers */
    enet_uint32          serviceTime;
    ENetList             dispatchQueue;
+   ENetList             sendQueue;                   /**< peers with acknowledgements or outgoing commands to send */
+   ENetList             visitQueue;
+   ENetList             timerWheel [ENET_HOST_TIMER_WHEEL_LEVELS][ENET_HOST_TIMER_WHEEL_SLOTS]; /**< peers waiting for their next timeout or ping */
+   ENetList             timerOverflow;
+   enet_uint32          timerTime;
+   size_t               timerCount;
    int                  continueSending;
    size_t               packetSize;
    enet_uint16          headerFlags;
@@ -372,6 +736,8 @@ typedef struct _ENetHost
    size_t               bufferCount;
    ENetChecksumCallback checksum;                    /**< callback the user can set to enable packet checksums for this host */
    ENetCompressor       compressor;
+   ENetTransport        transport;                   /**< datagram transport replacing the socket, if send is non-NULL */
+   ENetAdmission *      admission;                   /**< cookie and rate limit state, NULL until enabled */
    enet_uint8           packetData [2][ENET_PROTOCOL_MAXIMUM_MTU];
    ENetAddress          receivedAddress;
    enet_uint8 *         receivedData;
@@ -384,6 +750,9 @@ typedef struct _ENetHost
    size_t               connectedPeers;
    size_t               bandwidthLimitedPeers;
    size_t               duplicatePeers;              /**< optional number of allowed peers from duplicate IPs, defaults to ENET_PROTOCOL_MAXIMUM_PEER_ID */
+   enet_uint32          streamedChannels [(ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT + 31) / 32]; /**< bitmask of channels set with enet_host_stream_channel() */
+   enet_uint32          roundTripTimeHistogram [ENET_PEER_HISTOGRAM_BUCKETS];
+   enet_uint32          sendLatencyHistogram [ENET_PEER_HISTOGRAM_BUCKETS];
 } ENetHost;
 
 /**
@@ -412,7 +781,8 @@ typedef enum _ENetEventType
      * peer which sent the packet.  The channelID field specifies the channel
      * number upon which the packet was received.  The packet field contains
      * the packet that was received; this packet must be destroyed with
-     * enet_packet_destroy after use.
+     * enet_packet_destroy after use.  For a fragment of a message on a
+     * streamed channel, the data field contains the message's total length.
      */
    ENET_EVENT_TYPE_RECEIVE    = 3
 } ENetEventType;
@@ -431,6 +801,59 @@ typedef struct _ENetEvent
    ENetPacket *         packet;    /**< packet associated with the event, if appropriate */
 } ENetEvent;
 
+/** Callback run on a thread started with enet_thread_create(). */
+typedef void (ENET_CALLBACK * ENetThreadCallback) (void * data);
+
+/**
+ * An event delivered from a shard of an ENetShardedHost to the thread
+ * polling it.  The peer belongs to the shard's thread and must not be
+ * accessed directly; it only identifies the connection, together with
+ * connectID, when passed back to enet_sharded_host_send() and
+ * enet_sharded_host_disconnect().
+
+   @sa enet_sharded_host_receive()
+ */
+typedef struct _ENetShardEvent
+{
+   ENetAtomicQueueNode  queueNode;
+   ENetEventType        type;      /**< type of the event */
+   size_t               shard;     /**< index of the shard the peer is connected to */
+   ENetPeer *           peer;      /**< peer that generated the event */
+   enet_uint32          connectID; /**< connection the event belongs to, distinguishing reuses of the same peer */
+   enet_uint8           channelID; /**< channel on the peer that generated the event, if appropriate */
+   enet_uint32          data;      /**< data associated with the event, if appropriate */
+   ENetPacket *         packet;    /**< packet associated with the event, if appropriate; owned by the receiver */
+} ENetShardEvent;
+
+typedef struct _ENetShard
+{
+   struct _ENetShardedHost * shardedHost;
+   size_t               index;
+   ENetHost *           host;
+   ENetThread           thread;
+   int                  threadStarted;
+   ENetAtomicQueue      commands;       /**< sends and disconnects queued for the shard's thread */
+   enet_uint32 *        connectIDs;     /**< connect ID of each of the host's peers, kept by the shard's thread */
+} ENetShard;
+
+/** A server made of several hosts bound to the same port, each serviced on its own thread.
+
+    The operating system spreads incoming datagrams across the hosts' sockets
+    by source address, so every connection stays on one shard.  Events of all
+    shards are funneled into a single queue for one consuming thread, and
+    sends from any thread are queued to the owning shard.
+
+    @sa enet_sharded_host_create()
+ */
+typedef struct _ENetShardedHost
+{
+   ENetShard *          shards;
+   size_t               shardCount;
+   ENetAtomicQueue      events;
+   long                 running;
+   enet_uint32          serviceTimeout; /**< milliseconds each shard waits for traffic, bounding the latency of queued sends */
+} ENetShardedHost;
+
 /** @defgroup global ENet global functions
     @{ 
 */
@@ -497,6 +920,14 @@ ENET_API int        enet_socketset_select (ENetSocket, ENetSocketSet *, ENetSock
 
 /** @} */
 
+/** @defgroup thread ENet thread functions
+    @{
+*/
+ENET_API int        enet_thread_create (ENetThread *, ENetThreadCallback, void *);
+ENET_API void       enet_thread_join (ENetThread);
+
+/** @} */
+
 /** @defgroup Address ENet address functions
     @{
 */
@@ -532,10 +963,37 @@ ENET_API int enet_address_get_host (const ENetAddress * address, char * hostName
 
 /** @} */
 
+ENET_API void         enet_pool_get_stats (ENetPoolStats *);
+ENET_API void         enet_pool_reset_stats (void);
+ENET_API void         enet_pool_trim (void);
+
+ENET_API ENetSnapshotHistory * enet_snapshot_history_create (size_t, size_t);
+ENET_API void                  enet_snapshot_history_destroy (ENetSnapshotHistory *);
+ENET_API ENetPacket *          enet_snapshot_encode (ENetSnapshotHistory *, const enet_uint32 * const *, size_t, enet_uint32);
+ENET_API int                   enet_snapshot_acknowledge (ENetSnapshotHistory *, enet_uint32);
+ENET_API int                   enet_snapshot_decode (ENetSnapshotHistory *, const enet_uint8 *, size_t, enet_uint32 * const *, size_t *, enet_uint32 *);
+
+ENET_API ENetLockstep * enet_lockstep_create (size_t, size_t, size_t, enet_uint32, enet_uint32, const ENetLockstepWorld *);
+ENET_API void           enet_lockstep_destroy (ENetLockstep *);
+ENET_API int            enet_lockstep_add_input (ENetLockstep *, const void *);
+ENET_API ENetPacket *   enet_lockstep_encode (ENetLockstep *, size_t, enet_uint32);
+ENET_API int            enet_lockstep_receive (ENetLockstep *, const enet_uint8 *, size_t);
+ENET_API int            enet_lockstep_advance (ENetLockstep *);
+
+ENET_API ENetInterestGrid * enet_interest_grid_create (enet_uint32, enet_uint32, enet_uint32, enet_uint32, enet_uint32, size_t, size_t, enet_uint32, enet_uint32);
+ENET_API void               enet_interest_grid_destroy (ENetInterestGrid *);
+ENET_API void               enet_interest_grid_move_entity (ENetInterestGrid *, size_t, enet_uint32, enet_uint32);
+ENET_API void               enet_interest_grid_remove_entity (ENetInterestGrid *, size_t);
+ENET_API void               enet_interest_grid_move_viewer (ENetInterestGrid *, size_t, enet_uint32, enet_uint32);
+ENET_API void               enet_interest_grid_remove_viewer (ENetInterestGrid *, size_t);
+ENET_API size_t             enet_interest_grid_gather (ENetInterestGrid *, size_t, const enet_uint32 * const *, size_t, enet_uint32 * const *, enet_uint32 *, size_t);
+
 ENET_API ENetPacket * enet_packet_create (const void *, size_t, enet_uint32);
 ENET_API void         enet_packet_destroy (ENetPacket *);
 ENET_API int          enet_packet_resize  (ENetPacket *, size_t);
+extern const ENetFragmentLayout * enet_packet_fragment_layout (ENetPacket *, size_t);
 ENET_API enet_uint32  enet_crc32 (const ENetBuffer *, size_t);
+ENET_API enet_uint32  enet_crc32c (const ENetBuffer *, size_t);
                 
 ENET_API ENetHost * enet_host_create (const ENetAddress *, size_t, size_t, enet_uint32, enet_uint32);
 ENET_API void       enet_host_destroy (ENetHost *);
@@ -544,12 +1002,35 @@ ENET_API int        enet_host_check_events (ENetHost *, ENetEvent *);
 ENET_API int        enet_host_service (ENetHost *, ENetEvent *, enet_uint32);
 ENET_API void       enet_host_flush (ENetHost *);
 ENET_API void       enet_host_broadcast (ENetHost *, enet_uint8, ENetPacket *);
+ENET_API void       enet_host_broadcast_peers (ENetHost *, enet_uint8, ENetPacket *, ENetPeer * const *, size_t);
 ENET_API void       enet_host_compress (ENetHost *, const ENetCompressor *);
 ENET_API int        enet_host_compress_with_range_coder (ENetHost * host);
+ENET_API int        enet_host_compress_with_lz4 (ENetHost * host, const void * dictionary, size_t dictionaryLength);
+ENET_API void       enet_host_transport (ENetHost *, const ENetTransport *);
+ENET_API int        enet_host_loopback (ENetHost *, ENetLoopbackNetwork *, enet_uint16);
+
+ENET_API void       enet_host_get_stats (ENetHost *, ENetHostStats *);
+ENET_API void       enet_host_reset_stats (ENetHost *);
 ENET_API void       enet_host_channel_limit (ENetHost *, size_t);
+ENET_API void       enet_host_stream_channel (ENetHost *, enet_uint8, int);
 ENET_API void       enet_host_bandwidth_limit (ENetHost *, enet_uint32, enet_uint32);
+ENET_API int        enet_host_require_cookies (ENetHost *, int, const enet_uint8 *);
+ENET_API int        enet_host_limit_connections (ENetHost *, enet_uint32, enet_uint32);
 extern   void       enet_host_bandwidth_throttle (ENetHost *);
 extern  enet_uint32 enet_host_random_seed (void);
+extern   void       enet_host_schedule_peer (ENetHost *, ENetPeer *, enet_uint32);
+extern   void       enet_host_unschedule_peer (ENetHost *, ENetPeer *);
+extern   void       enet_host_expire_timers (ENetHost *, enet_uint32);
+extern   int        enet_host_next_timer (ENetHost *, enet_uint32 *);
+extern   int        enet_host_admit (ENetHost *);
+extern   int        enet_host_check_cookie (ENetHost *, const ENetProtocol *);
+
+ENET_API ENetShardedHost * enet_sharded_host_create (const ENetAddress *, size_t, size_t, size_t, enet_uint32, enet_uint32);
+ENET_API void              enet_sharded_host_destroy (ENetShardedHost *);
+ENET_API int               enet_sharded_host_receive (ENetShardedHost *, ENetShardEvent *);
+ENET_API int               enet_sharded_host_send (ENetShardedHost *, ENetPeer *, enet_uint32, enet_uint8, ENetPacket *);
+ENET_API int               enet_sharded_host_disconnect (ENetShardedHost *, ENetPeer *, enet_uint32, enet_uint32);
+ENET_API int               enet_sharded_host_broadcast (ENetShardedHost *, enet_uint8, ENetPacket *);
 
 ENET_API int                 enet_peer_send (ENetPeer *, enet_uint8, ENetPacket *);
 ENET_API ENetPacket *        enet_peer_receive (ENetPeer *, enet_uint8 * channelID);
@@ -561,9 +1042,15 @@ ENET_API void                enet_peer_disconnect (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_now (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_later (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_throttle_configure (ENetPeer *, enet_uint32, enet_uint32, enet_uint32);
+ENET_API void                enet_peer_get_stats (ENetPeer *, ENetPeerStats *);
+ENET_API int                 enet_peer_get_channel_stats (ENetPeer *, size_t, ENetChannelStats *);
+ENET_API void                enet_peer_reset_stats (ENetPeer *);
 extern int                   enet_peer_throttle (ENetPeer *, enet_uint32);
 extern void                  enet_peer_reset_queues (ENetPeer *);
+extern void                  enet_peer_mark_outgoing (ENetPeer *);
 extern void                  enet_peer_setup_outgoing_command (ENetPeer *, ENetOutgoingCommand *);
+extern size_t                enet_peer_fragment_length (ENetPeer *);
+extern int                   enet_peer_send_fragments (ENetPeer *, enet_uint8, ENetPacket *, size_t);
 extern ENetOutgoingCommand * enet_peer_queue_outgoing_command (ENetPeer *, const ENetProtocol *, ENetPacket *, enet_uint32, enet_uint16);
 extern ENetIncomingCommand * enet_peer_queue_incoming_command (ENetPeer *, const ENetProtocol *, ENetPacket *, enet_uint32);
 extern ENetAcknowledgement * enet_peer_queue_acknowledgement (ENetPeer *, const ENetProtocol *, enet_uint16);
@@ -571,11 +1058,23 @@ extern void                  enet_peer_dispatch_incoming_unreliable_commands (EN
 extern void                  enet_peer_dispatch_incoming_reliable_commands (ENetPeer *, ENetChannel *);
 extern void                  enet_peer_on_connect (ENetPeer *);
 extern void                  enet_peer_on_disconnect (ENetPeer *);
+extern void                  enet_peer_sample_round_trip_time (ENetPeer *, enet_uint32);
+extern void                  enet_peer_sample_send_latency (ENetPeer *, enet_uint32);
 
 ENET_API void * enet_range_coder_create (void);
 ENET_API void   enet_range_coder_destroy (void *);
 ENET_API size_t enet_range_coder_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
 ENET_API size_t enet_range_coder_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+
+ENET_API void * enet_lz4_create (const void *, size_t);
+ENET_API void   enet_lz4_destroy (void *);
+ENET_API size_t enet_lz4_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_lz4_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_lz4_train_dictionary (const ENetBuffer *, size_t, enet_uint8 *, size_t);
+
+ENET_API ENetLoopbackNetwork * enet_loopback_network_create (const ENetLoopbackConditions *, enet_uint32);
+ENET_API void                  enet_loopback_network_destroy (ENetLoopbackNetwork *);
+ENET_API void                  enet_loopback_network_set_conditions (ENetLoopbackNetwork *, const ENetLoopbackConditions *);
    
 extern size_t enet_protocol_command_size (enet_uint8);
 
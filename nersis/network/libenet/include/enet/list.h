@@ -6,6 +6,7 @@
 #define __ENET_LIST_H__
 
 #include <stdlib.h>
+#include <stddef.h>
 
 typedef struct _ENetListNode
 {
@@ -28,6 +29,24 @@ extern ENetListIterator enet_list_move (ENetListIterator, void *, void *);
 
 extern size_t enet_list_size (ENetList *);
 
+/** Node of an ENetAtomicQueue, placed at the start of the queued structure. */
+typedef struct _ENetAtomicQueueNode
+{
+   struct _ENetAtomicQueueNode * next;
+} ENetAtomicQueueNode;
+
+/** Lock-free intrusive queue with any number of producer threads and a single consumer thread. */
+typedef struct _ENetAtomicQueue
+{
+   ENetAtomicQueueNode * head;
+   ENetAtomicQueueNode * tail;
+   ENetAtomicQueueNode   stub;
+} ENetAtomicQueue;
+
+extern void enet_atomic_queue_clear (ENetAtomicQueue *);
+extern void enet_atomic_queue_push (ENetAtomicQueue *, void *);
+extern void * enet_atomic_queue_pop (ENetAtomicQueue *);
+
 #define enet_list_begin(list) ((list) -> sentinel.next)
 #define enet_list_end(list) (& (list) -> sentinel)
 
@@ -39,5 +58,7 @@ extern size_t enet_list_size (ENetList *);
 #define enet_list_front(list) ((void *) (list) -> sentinel.next)
 #define enet_list_back(list) ((void *) (list) -> sentinel.previous)
 
+#define enet_list_entry(iterator, type, member) ((type *) ((char *) (iterator) - offsetof (type, member)))
+
 #endif /* __ENET_LIST_H__ */
 
@@ -18,7 +18,8 @@ enum
    ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT   = 255,
    ENET_PROTOCOL_MAXIMUM_PEER_ID         = 0xFFF,
    ENET_PROTOCOL_MAXIMUM_PACKET_SIZE     = 1024 * 1024 * 1024,
-   ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT  = 1024 * 1024
+   ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT  = 1024 * 1024,
+   ENET_PROTOCOL_COOKIE_SIZE             = 8
 };
 
 typedef enum _ENetProtocolCommand
@@ -36,7 +37,9 @@ typedef enum _ENetProtocolCommand
    ENET_PROTOCOL_COMMAND_BANDWIDTH_LIMIT    = 10,
    ENET_PROTOCOL_COMMAND_THROTTLE_CONFIGURE = 11,
    ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT = 12,
-   ENET_PROTOCOL_COMMAND_COUNT              = 13,
+   ENET_PROTOCOL_COMMAND_CONNECT_CHALLENGE  = 13,
+   ENET_PROTOCOL_COMMAND_CONNECT_COOKIE     = 14,
+   ENET_PROTOCOL_COMMAND_COUNT              = 15,
 
    ENET_PROTOCOL_COMMAND_MASK               = 0x0F
 } ENetProtocolCommand;
@@ -101,6 +104,32 @@ typedef struct _ENetProtocolConnect
    enet_uint32 data;
 } ENET_PACKED ENetProtocolConnect;
 
+typedef struct _ENetProtocolConnectChallenge
+{
+   ENetProtocolCommandHeader header;
+   enet_uint32 connectID;
+   enet_uint8  cookie [ENET_PROTOCOL_COOKIE_SIZE];
+} ENET_PACKED ENetProtocolConnectChallenge;
+
+typedef struct _ENetProtocolConnectCookie
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 outgoingPeerID;
+   enet_uint8  incomingSessionID;
+   enet_uint8  outgoingSessionID;
+   enet_uint32 mtu;
+   enet_uint32 windowSize;
+   enet_uint32 channelCount;
+   enet_uint32 incomingBandwidth;
+   enet_uint32 outgoingBandwidth;
+   enet_uint32 packetThrottleInterval;
+   enet_uint32 packetThrottleAcceleration;
+   enet_uint32 packetThrottleDeceleration;
+   enet_uint32 connectID;
+   enet_uint32 data;
+   enet_uint8  cookie [ENET_PROTOCOL_COOKIE_SIZE];
+} ENET_PACKED ENetProtocolConnectCookie;
+
 typedef struct _ENetProtocolVerifyConnect
 {
    ENetProtocolCommandHeader header;
@@ -180,6 +209,8 @@ typedef union _ENetProtocol
    ENetProtocolCommandHeader header;
    ENetProtocolAcknowledge acknowledge;
    ENetProtocolConnect connect;
+   ENetProtocolConnectChallenge connectChallenge;
+   ENetProtocolConnectCookie connectCookie;
    ENetProtocolVerifyConnect verifyConnect;
    ENetProtocolDisconnect disconnect;
    ENetProtocolPing ping;
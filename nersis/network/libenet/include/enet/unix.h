@@ -11,6 +11,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #ifdef MSG_MAXIOVLEN
 #define ENET_BUFFER_MAXIMUM MSG_MAXIOVLEN
@@ -36,6 +37,17 @@ typedef struct
 
 #define ENET_API extern
 
+#define ENET_THREAD_LOCAL __thread
+
+typedef pthread_t ENetThread;
+
+#define ENET_ATOMIC_LOAD(pointer)                         __atomic_load_n ((pointer), __ATOMIC_ACQUIRE)
+#define ENET_ATOMIC_STORE(pointer, value)                 __atomic_store_n ((pointer), (value), __ATOMIC_RELEASE)
+#define ENET_ATOMIC_EXCHANGE(pointer, value)              __atomic_exchange_n ((pointer), (value), __ATOMIC_ACQ_REL)
+#define ENET_ATOMIC_COMPARE_EXCHANGE(pointer, expected, value) __sync_bool_compare_and_swap ((pointer), (expected), (value))
+#define ENET_ATOMIC_INCREMENT(pointer)                    __atomic_add_fetch ((pointer), 1, __ATOMIC_ACQ_REL)
+#define ENET_ATOMIC_DECREMENT(pointer)                    __atomic_sub_fetch ((pointer), 1, __ATOMIC_ACQ_REL)
+
 typedef fd_set ENetSocketSet;
 
 #define ENET_SOCKETSET_EMPTY(sockset)          FD_ZERO (& (sockset))
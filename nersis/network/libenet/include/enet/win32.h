@@ -46,6 +46,18 @@ typedef struct
 #define ENET_API extern
 #endif /* ENET_DLL */
 
+#define ENET_THREAD_LOCAL __declspec( thread )
+
+typedef HANDLE ENetThread;
+
+#define ENET_ATOMIC_LOAD(pointer)                         (MemoryBarrier (), * (pointer))
+#define ENET_ATOMIC_STORE(pointer, value)                 (MemoryBarrier (), * (pointer) = (value), MemoryBarrier ())
+#define ENET_ATOMIC_EXCHANGE(pointer, value)              InterlockedExchangePointer ((PVOID volatile *) (pointer), (value))
+#define ENET_ATOMIC_COMPARE_EXCHANGE(pointer, expected, value) \
+    (InterlockedCompareExchangePointer ((PVOID volatile *) (pointer), (value), (expected)) == (expected))
+#define ENET_ATOMIC_INCREMENT(pointer)                    InterlockedIncrement (pointer)
+#define ENET_ATOMIC_DECREMENT(pointer)                    InterlockedDecrement (pointer)
+
 typedef fd_set ENetSocketSet;
 
 #define ENET_SOCKETSET_EMPTY(sockset)          FD_ZERO (& (sockset))
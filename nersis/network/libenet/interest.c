@@ -0,0 +1,511 @@
+/**
+ @file  interest.c
+ @brief ENet area of interest grid
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+
+/** @defgroup interest ENet area of interest functions
+
+    Entities and viewers are linked into per-cell lists of a bounded grid.
+    When an entity crosses into another cell, only the viewers within
+    radius + hysteresis cells of its old or new cell are checked; when a
+    viewer crosses into another cell, only the entities in the cells it
+    stops or starts covering are.  Moves within a cell cost nothing beyond
+    storing the position.
+
+    Positions are 32-bit fixed-point values, such as snapshot fields, read
+    as two's complement relative to the grid origin.  Positions outside the
+    grid are clamped to its border cells.
+    @{
+*/
+
+#define ENET_INTEREST_CELL_X(grid, cell) ((cell) % (grid) -> cellsWide)
+#define ENET_INTEREST_CELL_Y(grid, cell) ((cell) / (grid) -> cellsWide)
+
+#define ENET_INTEREST_IS_VISIBLE(viewer, entity) \
+    ((viewer) -> visible [(entity) / 32] & (1u << ((entity) % 32)))
+
+static enet_uint32
+enet_interest_coordinate (enet_uint32 position, enet_uint32 origin, enet_uint32 shift, enet_uint32 limit)
+{
+    enet_uint32 offset = position - origin;
+
+    if (offset & 0x80000000)
+      return 0;
+
+    offset >>= shift;
+
+    return offset >= limit ? limit - 1 : offset;
+}
+
+static enet_uint32
+enet_interest_cell (ENetInterestGrid * grid, enet_uint32 x, enet_uint32 y)
+{
+    return enet_interest_coordinate (y, grid -> originY, grid -> cellShift, grid -> cellsHigh) * grid -> cellsWide +
+           enet_interest_coordinate (x, grid -> originX, grid -> cellShift, grid -> cellsWide);
+}
+
+/** Returns the Chebyshev distance between two cells, in cells. */
+static enet_uint32
+enet_interest_distance (ENetInterestGrid * grid, enet_uint32 a, enet_uint32 b)
+{
+    enet_uint32 ax = ENET_INTEREST_CELL_X (grid, a), ay = ENET_INTEREST_CELL_Y (grid, a),
+                bx = ENET_INTEREST_CELL_X (grid, b), by = ENET_INTEREST_CELL_Y (grid, b),
+                dx = ax > bx ? ax - bx : bx - ax,
+                dy = ay > by ? ay - by : by - ay;
+
+    return dx > dy ? dx : dy;
+}
+
+/** Returns whether a cell lies within range cells of center, which may be ENET_INTEREST_NONE. */
+static int
+enet_interest_covers (ENetInterestGrid * grid, enet_uint32 center, enet_uint32 range, enet_uint32 cell)
+{
+    return center != ENET_INTEREST_NONE && enet_interest_distance (grid, center, cell) <= range;
+}
+
+/** Clips the square of cells within range of center to the grid. */
+static void
+enet_interest_square (ENetInterestGrid * grid, enet_uint32 center, enet_uint32 range,
+                      enet_uint32 * left, enet_uint32 * top, enet_uint32 * right, enet_uint32 * bottom)
+{
+    enet_uint32 x = ENET_INTEREST_CELL_X (grid, center),
+                y = ENET_INTEREST_CELL_Y (grid, center);
+
+    * left = x > range ? x - range : 0;
+    * top = y > range ? y - range : 0;
+    * right = grid -> cellsWide - 1 - x > range ? x + range : grid -> cellsWide - 1;
+    * bottom = grid -> cellsHigh - 1 - y > range ? y + range : grid -> cellsHigh - 1;
+}
+
+static void
+enet_interest_set_visible (ENetInterestGrid * grid, ENetInterestViewer * viewer, enet_uint32 entity, int visible)
+{
+    if (! ENET_INTEREST_IS_VISIBLE (viewer, entity) == ! visible)
+      return;
+
+    viewer -> visible [entity / 32] ^= 1u << (entity % 32);
+
+    if (visible)
+    {
+       ++ viewer -> visibleCount;
+       ++ grid -> entered;
+    }
+    else
+    {
+       -- viewer -> visibleCount;
+       ++ grid -> left;
+    }
+}
+
+/** Creates an area of interest grid.
+    @param originX fixed-point x coordinate of the corner of the first cell
+    @param originY fixed-point y coordinate of the corner of the first cell
+    @param cellShift cells are 1 << cellShift fixed-point units on a side
+    @param cellsWide number of cells along x
+    @param cellsHigh number of cells along y
+    @param entityCapacity number of entities, indexed from 0
+    @param viewerCapacity number of viewers, indexed from 0; usually the host's peer count
+    @param radius cells around a viewer's cell in which entities become visible
+    @param hysteresis further cells an entity may move away before it stops being visible
+    @returns the grid on success, NULL on failure
+*/
+ENetInterestGrid *
+enet_interest_grid_create (enet_uint32 originX, enet_uint32 originY, enet_uint32 cellShift, enet_uint32 cellsWide, enet_uint32 cellsHigh,
+                           size_t entityCapacity, size_t viewerCapacity, enet_uint32 radius, enet_uint32 hysteresis)
+{
+    ENetInterestGrid * grid;
+    size_t cellCount = (size_t) cellsWide * cellsHigh,
+           visibleWords = (entityCapacity + 31) / 32,
+           index;
+
+    if (cellShift >= 32 || cellsWide <= 0 || cellsHigh <= 0 || cellCount >= ENET_INTEREST_NONE ||
+        entityCapacity <= 0 || entityCapacity >= ENET_INTEREST_NONE || viewerCapacity <= 0 || viewerCapacity >= ENET_INTEREST_NONE)
+      return NULL;
+
+    grid = (ENetInterestGrid *) enet_malloc (sizeof (ENetInterestGrid));
+    if (grid == NULL)
+      return NULL;
+
+    memset (grid, 0, sizeof (ENetInterestGrid));
+
+    grid -> originX = originX;
+    grid -> originY = originY;
+    grid -> cellShift = cellShift;
+    grid -> cellsWide = cellsWide;
+    grid -> cellsHigh = cellsHigh;
+    grid -> radius = radius;
+    grid -> hysteresis = hysteresis;
+    grid -> entityCapacity = entityCapacity;
+    grid -> viewerCapacity = viewerCapacity;
+
+    grid -> entityCells = (enet_uint32 *) enet_malloc (cellCount * sizeof (enet_uint32));
+    grid -> viewerCells = (enet_uint32 *) enet_malloc (cellCount * sizeof (enet_uint32));
+    grid -> entities = (ENetInterestEntity *) enet_malloc (entityCapacity * sizeof (ENetInterestEntity));
+    grid -> viewers = (ENetInterestViewer *) enet_malloc (viewerCapacity * sizeof (ENetInterestViewer));
+    if (grid -> entityCells == NULL || grid -> viewerCells == NULL || grid -> entities == NULL || grid -> viewers == NULL)
+    {
+       enet_interest_grid_destroy (grid);
+
+       return NULL;
+    }
+
+    memset (grid -> entityCells, 0xFF, cellCount * sizeof (enet_uint32));
+    memset (grid -> viewerCells, 0xFF, cellCount * sizeof (enet_uint32));
+    memset (grid -> entities, 0xFF, entityCapacity * sizeof (ENetInterestEntity));
+    memset (grid -> viewers, 0, viewerCapacity * sizeof (ENetInterestViewer));
+
+    for (index = 0; index < viewerCapacity; ++ index)
+    {
+       ENetInterestViewer * viewer = & grid -> viewers [index];
+
+       viewer -> cell = ENET_INTEREST_NONE;
+       viewer -> visible = (enet_uint32 *) enet_malloc (visibleWords * sizeof (enet_uint32));
+       if (viewer -> visible == NULL)
+       {
+          enet_interest_grid_destroy (grid);
+
+          return NULL;
+       }
+
+       memset (viewer -> visible, 0, visibleWords * sizeof (enet_uint32));
+    }
+
+    return grid;
+}
+
+/** Destroys an area of interest grid.
+    @param grid grid to destroy
+*/
+void
+enet_interest_grid_destroy (ENetInterestGrid * grid)
+{
+    size_t index;
+
+    if (grid == NULL)
+      return;
+
+    if (grid -> viewers != NULL)
+    {
+       for (index = 0; index < grid -> viewerCapacity; ++ index)
+         if (grid -> viewers [index].visible != NULL)
+           enet_free (grid -> viewers [index].visible);
+
+       enet_free (grid -> viewers);
+    }
+
+    if (grid -> entities != NULL)
+      enet_free (grid -> entities);
+    if (grid -> viewerCells != NULL)
+      enet_free (grid -> viewerCells);
+    if (grid -> entityCells != NULL)
+      enet_free (grid -> entityCells);
+
+    enet_free (grid);
+}
+
+/** Checks the viewers around an entity that moved from one cell to another.
+    Viewers that see the entity are within radius + hysteresis of its old
+    cell, and viewers that may start seeing it are within radius of its new
+    one, so only the viewers in those two squares can change.
+*/
+static void
+enet_interest_update_entity (ENetInterestGrid * grid, enet_uint32 entity, enet_uint32 oldCell, enet_uint32 newCell)
+{
+    enet_uint32 range = grid -> radius + grid -> hysteresis,
+                centers [2],
+                centerIndex,
+                left, top, right, bottom, x, y;
+
+    centers [0] = oldCell;
+    centers [1] = newCell;
+
+    for (centerIndex = 0; centerIndex < 2; ++ centerIndex)
+    {
+       enet_uint32 center = centers [centerIndex];
+
+       if (center == ENET_INTEREST_NONE)
+         continue;
+
+       enet_interest_square (grid, center, range, & left, & top, & right, & bottom);
+
+       for (y = top; y <= bottom; ++ y)
+         for (x = left; x <= right; ++ x)
+         {
+            enet_uint32 cell = y * grid -> cellsWide + x,
+                        viewerIndex;
+
+            /* cells covered by both squares are visited with the first */
+            if (centerIndex == 1 && enet_interest_covers (grid, oldCell, range, cell))
+              continue;
+
+            for (viewerIndex = grid -> viewerCells [cell];
+                 viewerIndex != ENET_INTEREST_NONE;
+                 viewerIndex = grid -> viewers [viewerIndex].next)
+            {
+               ENetInterestViewer * viewer = & grid -> viewers [viewerIndex];
+
+               if (newCell == ENET_INTEREST_NONE)
+                 enet_interest_set_visible (grid, viewer, entity, 0);
+               else
+               {
+                  enet_uint32 distance = enet_interest_distance (grid, viewer -> cell, newCell);
+
+                  if (distance <= grid -> radius)
+                    enet_interest_set_visible (grid, viewer, entity, 1);
+                  else
+                  if (distance > range)
+                    enet_interest_set_visible (grid, viewer, entity, 0);
+               }
+            }
+         }
+    }
+}
+
+/** Sets the position of an entity, adding it to the grid if it was not in it.
+    @param grid grid to update
+    @param entity index of the entity
+    @param x fixed-point x coordinate
+    @param y fixed-point y coordinate
+*/
+void
+enet_interest_grid_move_entity (ENetInterestGrid * grid, size_t entity, enet_uint32 x, enet_uint32 y)
+{
+    ENetInterestEntity * current;
+    enet_uint32 oldCell, newCell;
+
+    if (entity >= grid -> entityCapacity)
+      return;
+
+    current = & grid -> entities [entity];
+    current -> x = x;
+    current -> y = y;
+
+    oldCell = current -> cell;
+    newCell = enet_interest_cell (grid, x, y);
+    if (newCell == oldCell)
+      return;
+
+    if (oldCell != ENET_INTEREST_NONE)
+    {
+       if (current -> previous != ENET_INTEREST_NONE)
+         grid -> entities [current -> previous].next = current -> next;
+       else
+         grid -> entityCells [oldCell] = current -> next;
+
+       if (current -> next != ENET_INTEREST_NONE)
+         grid -> entities [current -> next].previous = current -> previous;
+    }
+
+    current -> cell = newCell;
+    current -> previous = ENET_INTEREST_NONE;
+    current -> next = grid -> entityCells [newCell];
+    if (current -> next != ENET_INTEREST_NONE)
+      grid -> entities [current -> next].previous = (enet_uint32) entity;
+    grid -> entityCells [newCell] = (enet_uint32) entity;
+
+    ++ grid -> cellChanges;
+
+    enet_interest_update_entity (grid, (enet_uint32) entity, oldCell, newCell);
+}
+
+/** Removes an entity from the grid, hiding it from every viewer.
+    @param grid grid to update
+    @param entity index of the entity
+*/
+void
+enet_interest_grid_remove_entity (ENetInterestGrid * grid, size_t entity)
+{
+    ENetInterestEntity * current;
+    enet_uint32 oldCell;
+
+    if (entity >= grid -> entityCapacity)
+      return;
+
+    current = & grid -> entities [entity];
+    oldCell = current -> cell;
+    if (oldCell == ENET_INTEREST_NONE)
+      return;
+
+    if (current -> previous != ENET_INTEREST_NONE)
+      grid -> entities [current -> previous].next = current -> next;
+    else
+      grid -> entityCells [oldCell] = current -> next;
+
+    if (current -> next != ENET_INTEREST_NONE)
+      grid -> entities [current -> next].previous = current -> previous;
+
+    current -> cell = ENET_INTEREST_NONE;
+
+    enet_interest_update_entity (grid, (enet_uint32) entity, oldCell, ENET_INTEREST_NONE);
+}
+
+/** Sets the position of a viewer, adding it to the grid if it was not in it.
+    @param grid grid to update
+    @param viewer index of the viewer
+    @param x fixed-point x coordinate
+    @param y fixed-point y coordinate
+*/
+void
+enet_interest_grid_move_viewer (ENetInterestGrid * grid, size_t viewer, enet_uint32 x, enet_uint32 y)
+{
+    ENetInterestViewer * current;
+    enet_uint32 range = grid -> radius + grid -> hysteresis,
+                oldCell, newCell,
+                left, top, right, bottom, cellX, cellY;
+
+    if (viewer >= grid -> viewerCapacity)
+      return;
+
+    current = & grid -> viewers [viewer];
+    current -> x = x;
+    current -> y = y;
+
+    oldCell = current -> cell;
+    newCell = enet_interest_cell (grid, x, y);
+    if (newCell == oldCell)
+      return;
+
+    if (oldCell != ENET_INTEREST_NONE)
+    {
+       if (current -> previous != ENET_INTEREST_NONE)
+         grid -> viewers [current -> previous].next = current -> next;
+       else
+         grid -> viewerCells [oldCell] = current -> next;
+
+       if (current -> next != ENET_INTEREST_NONE)
+         grid -> viewers [current -> next].previous = current -> previous;
+    }
+
+    current -> cell = newCell;
+    current -> previous = ENET_INTEREST_NONE;
+    current -> next = grid -> viewerCells [newCell];
+    if (current -> next != ENET_INTEREST_NONE)
+      grid -> viewers [current -> next].previous = (enet_uint32) viewer;
+    grid -> viewerCells [newCell] = (enet_uint32) viewer;
+
+    ++ grid -> cellChanges;
+
+    /* entities seen from the old cell that are now out of range */
+    if (oldCell != ENET_INTEREST_NONE && current -> visibleCount > 0)
+    {
+       enet_interest_square (grid, oldCell, range, & left, & top, & right, & bottom);
+
+       for (cellY = top; cellY <= bottom; ++ cellY)
+         for (cellX = left; cellX <= right; ++ cellX)
+         {
+            enet_uint32 cell = cellY * grid -> cellsWide + cellX,
+                        entity;
+
+            if (enet_interest_distance (grid, newCell, cell) <= range)
+              continue;
+
+            for (entity = grid -> entityCells [cell]; entity != ENET_INTEREST_NONE; entity = grid -> entities [entity].next)
+              enet_interest_set_visible (grid, current, entity, 0);
+         }
+    }
+
+    /* entities newly in range */
+    enet_interest_square (grid, newCell, grid -> radius, & left, & top, & right, & bottom);
+
+    for (cellY = top; cellY <= bottom; ++ cellY)
+      for (cellX = left; cellX <= right; ++ cellX)
+      {
+         enet_uint32 cell = cellY * grid -> cellsWide + cellX,
+                     entity;
+
+         if (enet_interest_covers (grid, oldCell, grid -> radius, cell))
+           continue;
+
+         for (entity = grid -> entityCells [cell]; entity != ENET_INTEREST_NONE; entity = grid -> entities [entity].next)
+           enet_interest_set_visible (grid, current, entity, 1);
+      }
+}
+
+/** Removes a viewer from the grid, hiding every entity from it.
+    @param grid grid to update
+    @param viewer index of the viewer
+*/
+void
+enet_interest_grid_remove_viewer (ENetInterestGrid * grid, size_t viewer)
+{
+    ENetInterestViewer * current;
+
+    if (viewer >= grid -> viewerCapacity)
+      return;
+
+    current = & grid -> viewers [viewer];
+    if (current -> cell == ENET_INTEREST_NONE)
+      return;
+
+    if (current -> previous != ENET_INTEREST_NONE)
+      grid -> viewers [current -> previous].next = current -> next;
+    else
+      grid -> viewerCells [current -> cell] = current -> next;
+
+    if (current -> next != ENET_INTEREST_NONE)
+      grid -> viewers [current -> next].previous = current -> previous;
+
+    current -> cell = ENET_INTEREST_NONE;
+
+    grid -> left += current -> visibleCount;
+    current -> visibleCount = 0;
+    memset (current -> visible, 0, (grid -> entityCapacity + 31) / 32 * sizeof (enet_uint32));
+}
+
+/** Gathers the rows of the entities a viewer sees, in increasing entity order.
+    @param grid grid to query
+    @param viewer index of the viewer
+    @param columns fieldCount columns holding the fields of every entity, or NULL if fieldCount is 0
+    @param fieldCount number of columns to gather
+    @param outColumns fieldCount columns that receive the fields of the visible entities
+    @param outEntities if not NULL, receives the index of each visible entity
+    @param capacity maximum number of entities to gather
+    @returns the number of entities gathered
+    @remarks The gathered columns can be passed straight to enet_snapshot_encode() to
+    send each peer only what it can see.
+*/
+size_t
+enet_interest_grid_gather (ENetInterestGrid * grid, size_t viewer, const enet_uint32 * const * columns, size_t fieldCount,
+                           enet_uint32 * const * outColumns, enet_uint32 * outEntities, size_t capacity)
+{
+    ENetInterestViewer * current;
+    size_t count = 0, word, field;
+
+    if (viewer >= grid -> viewerCapacity)
+      return 0;
+
+    current = & grid -> viewers [viewer];
+
+    for (word = 0; word < (grid -> entityCapacity + 31) / 32 && count < current -> visibleCount && count < capacity; ++ word)
+    {
+       enet_uint32 bits = current -> visible [word];
+
+       while (bits != 0 && count < capacity)
+       {
+          enet_uint32 entity = (enet_uint32) word * 32,
+                      bit = bits & (~ bits + 1);
+
+          while (! (bit & 1))
+          {
+             bit >>= 1;
+             ++ entity;
+          }
+          bits &= bits - 1;
+
+          for (field = 0; field < fieldCount; ++ field)
+            outColumns [field][count] = columns [field][entity];
+
+          if (outEntities != NULL)
+            outEntities [count] = entity;
+
+          ++ count;
+       }
+    }
+
+    return count;
+}
+
+/** @} */
@@ -72,4 +72,62 @@ enet_list_size (ENetList * list)
    return size;
 }
 
+/** Initializes an empty atomic queue.  Must not be called while other threads use the queue. */
+void
+enet_atomic_queue_clear (ENetAtomicQueue * queue)
+{
+   queue -> stub.next = NULL;
+   queue -> head = queue -> tail = & queue -> stub;
+}
+
+/** Appends a node to the queue.  May be called from any thread. */
+void
+enet_atomic_queue_push (ENetAtomicQueue * queue, void * data)
+{
+   ENetAtomicQueueNode * node = (ENetAtomicQueueNode *) data,
+                       * previous;
+
+   node -> next = NULL;
+   previous = (ENetAtomicQueueNode *) ENET_ATOMIC_EXCHANGE (& queue -> head, node);
+   ENET_ATOMIC_STORE (& previous -> next, node);
+}
+
+/** Removes the oldest node from the queue.  Must only be called from the consuming thread.
+    @returns the node, or NULL if the queue is empty or a producer has not finished pushing yet
+*/
+void *
+enet_atomic_queue_pop (ENetAtomicQueue * queue)
+{
+   ENetAtomicQueueNode * tail = queue -> tail,
+                       * next = ENET_ATOMIC_LOAD (& tail -> next);
+
+   if (tail == & queue -> stub)
+   {
+      if (next == NULL)
+        return NULL;
+
+      queue -> tail = tail = next;
+      next = ENET_ATOMIC_LOAD (& tail -> next);
+   }
+
+   if (next != NULL)
+   {
+      queue -> tail = next;
+      return tail;
+   }
+
+   /* a producer has swapped the head but not yet linked its node */
+   if (tail != ENET_ATOMIC_LOAD (& queue -> head))
+     return NULL;
+
+   enet_atomic_queue_push (queue, & queue -> stub);
+
+   next = ENET_ATOMIC_LOAD (& tail -> next);
+   if (next == NULL)
+     return NULL;
+
+   queue -> tail = next;
+   return tail;
+}
+
 /** @} */
@@ -0,0 +1,343 @@
+/**
+ @file  lockstep.c
+ @brief ENet lockstep input synchronization
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+
+/** @defgroup lockstep ENet lockstep functions
+
+    Every player adds one input per tick, which is scheduled inputDelay
+    ticks ahead so it usually reaches the other players before they need
+    it.  Each packet sent to a player repeats all the local inputs that
+    player has not acknowledged yet, so packets can travel unreliably: a
+    lost packet is covered by the next one.
+
+    A tick is simulated once the local input for it exists and every other
+    player's inputs are at most maximumPrediction ticks behind.  Missing
+    inputs are predicted by repeating the player's newest one.  When an
+    input arrives for a tick already simulated and differs from what was
+    predicted, the next advance loads the world saved before that tick and
+    simulates forward again.  With maximumPrediction 0 nothing is ever
+    predicted, which is plain lockstep.
+
+    Packet layout:
+
+        enet_uint32 ticks of the receiver's inputs the sender has   (network byte order)
+        enet_uint32 tick of the first input                         (network byte order)
+        enet_uint8  sending player
+        enet_uint8  number of inputs
+        inputs, inputSize bytes each
+    @{
+*/
+
+#define ENET_LOCKSTEP_INPUT(lockstep, tick, player) \
+    (& (lockstep) -> inputs [(((tick) % ENET_LOCKSTEP_WINDOW) * (lockstep) -> playerCount + (player)) * (lockstep) -> inputSize])
+
+/** Creates a lockstep session.
+    @param playerCount number of players, at most ENET_LOCKSTEP_MAXIMUM_PLAYERS
+    @param localPlayer index of the player whose inputs are added locally
+    @param inputSize size of one player's input for one tick, at most ENET_LOCKSTEP_MAXIMUM_INPUT_SIZE
+    @param inputDelay ticks between adding an input and the tick it applies to; inputs of the first inputDelay ticks are all zero
+    @param maximumPrediction ticks the simulation may run ahead of the slowest player's inputs, less than ENET_LOCKSTEP_WINDOW / 2
+    @param world callbacks that save, load and simulate the world; copied into the session
+    @returns the session on success, NULL on failure
+*/
+ENetLockstep *
+enet_lockstep_create (size_t playerCount, size_t localPlayer, size_t inputSize, enet_uint32 inputDelay, enet_uint32 maximumPrediction,
+                      const ENetLockstepWorld * world)
+{
+    ENetLockstep * lockstep;
+    size_t playerIndex;
+
+    if (playerCount <= 0 || playerCount > ENET_LOCKSTEP_MAXIMUM_PLAYERS || localPlayer >= playerCount ||
+        inputSize <= 0 || inputSize > ENET_LOCKSTEP_MAXIMUM_INPUT_SIZE ||
+        inputDelay >= ENET_LOCKSTEP_WINDOW / 2 || maximumPrediction >= ENET_LOCKSTEP_WINDOW / 2 ||
+        world == NULL || world -> simulate == NULL ||
+        (maximumPrediction > 0 && (world -> save == NULL || world -> load == NULL)))
+      return NULL;
+
+    lockstep = (ENetLockstep *) enet_malloc (sizeof (ENetLockstep));
+    if (lockstep == NULL)
+      return NULL;
+
+    memset (lockstep, 0, sizeof (ENetLockstep));
+
+    lockstep -> inputs = (enet_uint8 *) enet_malloc (ENET_LOCKSTEP_WINDOW * playerCount * inputSize);
+    if (lockstep -> inputs == NULL)
+    {
+       enet_free (lockstep);
+
+       return NULL;
+    }
+
+    memset (lockstep -> inputs, 0, ENET_LOCKSTEP_WINDOW * playerCount * inputSize);
+
+    lockstep -> playerCount = playerCount;
+    lockstep -> localPlayer = localPlayer;
+    lockstep -> inputSize = inputSize;
+    lockstep -> inputDelay = inputDelay;
+    lockstep -> maximumPrediction = maximumPrediction;
+    lockstep -> world = * world;
+
+    for (playerIndex = 0; playerIndex < playerCount; ++ playerIndex)
+    {
+       lockstep -> players [playerIndex].confirmedTicks = inputDelay;
+       lockstep -> players [playerIndex].acknowledgedTicks = inputDelay;
+    }
+
+    return lockstep;
+}
+
+/** Destroys a lockstep session.
+    @param lockstep session to destroy
+*/
+void
+enet_lockstep_destroy (ENetLockstep * lockstep)
+{
+    if (lockstep == NULL)
+      return;
+
+    enet_free (lockstep -> inputs);
+    enet_free (lockstep);
+}
+
+/** Returns the oldest tick whose inputs are still needed: to simulate,
+    to resimulate, to predict from or to resend.
+*/
+static enet_uint32
+enet_lockstep_oldest_tick (ENetLockstep * lockstep)
+{
+    enet_uint32 oldest = lockstep -> rollbackTick;
+    size_t playerIndex;
+
+    for (playerIndex = 0; playerIndex < lockstep -> playerCount; ++ playerIndex)
+    {
+       ENetLockstepPlayer * player = & lockstep -> players [playerIndex];
+
+       if (player -> confirmedTicks - 1 < oldest)
+         oldest = player -> confirmedTicks - 1;
+
+       if (playerIndex != lockstep -> localPlayer && player -> acknowledgedTicks < oldest)
+         oldest = player -> acknowledgedTicks;
+    }
+
+    return oldest;
+}
+
+/** Adds the local player's input for the next tick, inputDelay ticks after the last one added.
+    @param lockstep session
+    @param input inputSize bytes
+    @returns 0 on success, < 0 if the other players are a whole window behind and the input must wait
+*/
+int
+enet_lockstep_add_input (ENetLockstep * lockstep, const void * input)
+{
+    ENetLockstepPlayer * player = & lockstep -> players [lockstep -> localPlayer];
+
+    if (player -> confirmedTicks - enet_lockstep_oldest_tick (lockstep) >= ENET_LOCKSTEP_WINDOW)
+      return -1;
+
+    memcpy (ENET_LOCKSTEP_INPUT (lockstep, player -> confirmedTicks, lockstep -> localPlayer), input, lockstep -> inputSize);
+
+    ++ player -> confirmedTicks;
+
+    return 0;
+}
+
+/** Creates a packet of the local inputs a player has not acknowledged yet.
+    @param lockstep session
+    @param playerIndex player the packet is for
+    @param flags packet flags for the created packet, usually 0 for an unreliable, sequenced send
+    @returns a packet ready to be sent with enet_peer_send(), NULL on failure
+    @remarks Send one to every other player each tick, even when there is no new
+    input, since the packet also acknowledges the player's inputs.
+*/
+ENetPacket *
+enet_lockstep_encode (ENetLockstep * lockstep, size_t playerIndex, enet_uint32 flags)
+{
+    ENetLockstepPlayer * player, * local = & lockstep -> players [lockstep -> localPlayer];
+    ENetPacket * packet;
+    enet_uint32 tick, count;
+    enet_uint8 * output;
+
+    if (playerIndex >= lockstep -> playerCount || playerIndex == lockstep -> localPlayer)
+      return NULL;
+
+    player = & lockstep -> players [playerIndex];
+    count = local -> confirmedTicks - player -> acknowledgedTicks;
+
+    packet = enet_packet_create (NULL, ENET_LOCKSTEP_HEADER_SIZE + count * lockstep -> inputSize, flags);
+    if (packet == NULL)
+      return NULL;
+
+    output = packet -> data;
+    * (enet_uint32 *) output = ENET_HOST_TO_NET_32 (player -> confirmedTicks);
+    output += sizeof (enet_uint32);
+    * (enet_uint32 *) output = ENET_HOST_TO_NET_32 (player -> acknowledgedTicks);
+    output += sizeof (enet_uint32);
+    * output ++ = (enet_uint8) lockstep -> localPlayer;
+    * output ++ = (enet_uint8) count;
+
+    for (tick = player -> acknowledgedTicks; tick != local -> confirmedTicks; ++ tick)
+    {
+       memcpy (output, ENET_LOCKSTEP_INPUT (lockstep, tick, lockstep -> localPlayer), lockstep -> inputSize);
+       output += lockstep -> inputSize;
+    }
+
+    return packet;
+}
+
+/** Stores the inputs and acknowledgement of a packet created by another player's enet_lockstep_encode().
+    @param lockstep session
+    @param data packet data
+    @param dataLength packet length
+    @returns the sending player on success, < 0 if the packet is malformed
+    @remarks An input that arrives for a tick already simulated and differs from
+    its prediction schedules a rollback, carried out by the next enet_lockstep_advance().
+*/
+int
+enet_lockstep_receive (ENetLockstep * lockstep, const enet_uint8 * data, size_t dataLength)
+{
+    ENetLockstepPlayer * player;
+    enet_uint32 acknowledged, firstTick, count, tick, oldest;
+    size_t playerIndex;
+
+    if (dataLength < ENET_LOCKSTEP_HEADER_SIZE)
+      return -1;
+
+    acknowledged = ENET_NET_TO_HOST_32 (* (const enet_uint32 *) & data [0]);
+    firstTick = ENET_NET_TO_HOST_32 (* (const enet_uint32 *) & data [4]);
+    playerIndex = data [8];
+    count = data [9];
+
+    if (playerIndex >= lockstep -> playerCount || playerIndex == lockstep -> localPlayer ||
+        dataLength != ENET_LOCKSTEP_HEADER_SIZE + count * lockstep -> inputSize ||
+        acknowledged > lockstep -> players [lockstep -> localPlayer].confirmedTicks)
+      return -1;
+
+    player = & lockstep -> players [playerIndex];
+    data += ENET_LOCKSTEP_HEADER_SIZE;
+
+    if (acknowledged > player -> acknowledgedTicks)
+      player -> acknowledgedTicks = acknowledged;
+
+    /* inputs after a gap wait for the packet that fills it */
+    if (firstTick > player -> confirmedTicks || firstTick + count <= player -> confirmedTicks)
+      return (int) playerIndex;
+
+    oldest = enet_lockstep_oldest_tick (lockstep);
+
+    for (tick = player -> confirmedTicks, data += (tick - firstTick) * lockstep -> inputSize;
+         tick != firstTick + count && tick - oldest < ENET_LOCKSTEP_WINDOW;
+         ++ tick, data += lockstep -> inputSize)
+    {
+       enet_uint8 * input = ENET_LOCKSTEP_INPUT (lockstep, tick, playerIndex);
+
+       if (tick < lockstep -> currentTick)
+       {
+          enet_uint32 lateness = lockstep -> currentTick - tick;
+
+          ++ lockstep -> lateInputs;
+          lockstep -> inputLateness += lateness;
+          if (lateness > lockstep -> maximumInputLateness)
+            lockstep -> maximumInputLateness = lateness;
+
+          if (memcmp (input, data, lockstep -> inputSize) != 0)
+          {
+             ++ lockstep -> mispredictedInputs;
+
+             if (tick < lockstep -> rollbackTick)
+               lockstep -> rollbackTick = tick;
+          }
+       }
+
+       memcpy (input, data, lockstep -> inputSize);
+    }
+
+    player -> confirmedTicks = tick;
+
+    return (int) playerIndex;
+}
+
+static void
+enet_lockstep_simulate (ENetLockstep * lockstep, enet_uint32 tick, int resimulating)
+{
+    size_t playerIndex;
+
+    for (playerIndex = 0; playerIndex < lockstep -> playerCount; ++ playerIndex)
+    {
+       enet_uint32 confirmedTicks = lockstep -> players [playerIndex].confirmedTicks;
+
+       if (tick < confirmedTicks)
+         continue;
+
+       memcpy (ENET_LOCKSTEP_INPUT (lockstep, tick, playerIndex),
+               ENET_LOCKSTEP_INPUT (lockstep, confirmedTicks - 1, playerIndex),
+               lockstep -> inputSize);
+
+       if (! resimulating)
+         ++ lockstep -> predictedInputs;
+    }
+
+    lockstep -> world.simulate (lockstep -> world.context, tick, ENET_LOCKSTEP_INPUT (lockstep, tick, 0));
+}
+
+/** Rolls back and resimulates if a late input corrected a prediction, then
+    simulates the next tick if the inputs allow it.
+    @param lockstep session
+    @returns 1 if a tick was simulated, 0 if the session must wait for inputs
+*/
+int
+enet_lockstep_advance (ENetLockstep * lockstep)
+{
+    enet_uint32 tick, slowest = lockstep -> players [lockstep -> localPlayer].confirmedTicks;
+    size_t playerIndex;
+
+    if (lockstep -> rollbackTick != lockstep -> currentTick)
+    {
+       enet_uint32 depth = lockstep -> currentTick - lockstep -> rollbackTick;
+
+       ++ lockstep -> rollbacks;
+       lockstep -> resimulatedTicks += depth;
+       if (depth > lockstep -> maximumRollback)
+         lockstep -> maximumRollback = depth;
+
+       lockstep -> world.load (lockstep -> world.context, lockstep -> rollbackTick);
+
+       for (tick = lockstep -> rollbackTick; tick != lockstep -> currentTick; ++ tick)
+       {
+          if (tick != lockstep -> rollbackTick)
+            lockstep -> world.save (lockstep -> world.context, tick);
+
+          enet_lockstep_simulate (lockstep, tick, 1);
+       }
+
+       lockstep -> rollbackTick = lockstep -> currentTick;
+    }
+
+    for (playerIndex = 0; playerIndex < lockstep -> playerCount; ++ playerIndex)
+      if (playerIndex != lockstep -> localPlayer &&
+          lockstep -> players [playerIndex].confirmedTicks + lockstep -> maximumPrediction < slowest)
+        slowest = lockstep -> players [playerIndex].confirmedTicks + lockstep -> maximumPrediction;
+
+    if (lockstep -> currentTick >= slowest)
+    {
+       ++ lockstep -> stalls;
+
+       return 0;
+    }
+
+    if (lockstep -> maximumPrediction > 0)
+      lockstep -> world.save (lockstep -> world.context, lockstep -> currentTick);
+
+    enet_lockstep_simulate (lockstep, lockstep -> currentTick, 0);
+
+    ++ lockstep -> simulatedTicks;
+    lockstep -> rollbackTick = ++ lockstep -> currentTick;
+
+    return 1;
+}
+
+/** @} */
@@ -0,0 +1,469 @@
+/**
+ @file  loopback.c
+ @brief ENet in-process loopback transport
+*/
+#define ENET_BUILDING_LIB 1
+#include <string.h>
+#include "enet/utility.h"
+#include "enet/time.h"
+#include "enet/enet.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+/** @defgroup loopback ENet loopback transport
+
+    A loopback network connects hosts within one process without sockets,
+    for reproducible protocol tests and benchmarks.  Every attached host owns
+    an endpoint with an inbox, a lock-free multi-producer single-consumer
+    queue, so hosts may be serviced from different threads.  Datagrams are
+    stamped with a delivery time on send, according to the simulated latency,
+    jitter and reordering, and the receiving host only sees them once that
+    time has passed.  Random decisions are taken from a generator seeded per
+    endpoint from the network's seed and the endpoint's port, so a given
+    traffic pattern loses and delays the same datagrams on every run, while
+    delivery times still follow enet_time_get().
+
+    Every endpoint has the address 127.0.0.1 and its own port, so hosts on a
+    loopback network connect to each other with enet_host_connect() as usual.
+
+    A sender on another thread may have looked up an endpoint just as its host
+    is destroyed, so endpoints are never freed while the network lives.  A
+    destroyed host only detaches from its endpoint, which is reused by the
+    next host attached to the same port and freed with the network.
+    @{
+*/
+
+typedef struct _ENetLoopbackDatagram
+{
+   ENetAtomicQueueNode inboxNode;
+   struct _ENetLoopbackDatagram * next;
+   enet_uint32 deliveryTime;
+   ENetAddress source;
+   size_t      dataLength;
+} ENetLoopbackDatagram;
+
+typedef struct _ENetLoopbackEndpoint
+{
+   ENetLoopbackNetwork *  network;
+   ENetHost *             host;            /**< attached host, NULL once it is destroyed */
+   ENetAddress            address;
+   enet_uint32            randomSeed;
+   ENetAtomicQueue        inbox;
+   ENetLoopbackDatagram * pending;         /**< datagrams taken from the inbox, in order of delivery time */
+   ENetLoopbackDatagram * pendingTail;
+} ENetLoopbackEndpoint;
+
+struct _ENetLoopbackNetwork
+{
+   ENetLoopbackConditions conditions;
+   long                   conditionsVersion; /**< odd while the conditions are being changed */
+   void *                 conditionsWriter;  /**< set while a thread changes the conditions */
+   enet_uint32            seed;
+   long                   nextPort;
+   long                   referenceCount;    /**< the creator's reference plus one per attached endpoint */
+   ENetLoopbackEndpoint * endpoints [0x10000];
+};
+
+#ifdef _WIN32
+#define ENET_LOOPBACK_SLEEP(milliseconds) Sleep (milliseconds)
+#else
+#define ENET_LOOPBACK_SLEEP(milliseconds) \
+{ \
+    struct timespec duration; \
+    duration.tv_sec = (milliseconds) / 1000; \
+    duration.tv_nsec = ((milliseconds) % 1000) * 1000000; \
+    nanosleep (& duration, NULL); \
+}
+#endif
+
+/** Creates a loopback network.
+    @param conditions network conditions to simulate, or NULL for a perfect network
+    @param seed seed for the random decisions of the simulation
+    @returns the network on success, NULL on failure
+*/
+ENetLoopbackNetwork *
+enet_loopback_network_create (const ENetLoopbackConditions * conditions, enet_uint32 seed)
+{
+    ENetLoopbackNetwork * network = (ENetLoopbackNetwork *) enet_malloc (sizeof (ENetLoopbackNetwork));
+    if (network == NULL)
+      return NULL;
+
+    memset (network, 0, sizeof (ENetLoopbackNetwork));
+
+    if (conditions != NULL)
+      network -> conditions = * conditions;
+    network -> seed = seed;
+    network -> nextPort = 0;
+    network -> referenceCount = 1;
+
+    return network;
+}
+
+/** Destroys a loopback network.
+    @param network network to destroy
+    @remarks The network's memory is only released once every host attached to it has been destroyed too.
+*/
+void
+enet_loopback_network_destroy (ENetLoopbackNetwork * network)
+{
+    size_t port;
+
+    if (ENET_ATOMIC_DECREMENT (& network -> referenceCount) != 0)
+      return;
+
+    for (port = 0; port < sizeof (network -> endpoints) / sizeof (network -> endpoints [0]); ++ port)
+    {
+        ENetLoopbackEndpoint * endpoint = network -> endpoints [port];
+        ENetLoopbackDatagram * datagram;
+
+        if (endpoint == NULL)
+          continue;
+
+        while ((datagram = (ENetLoopbackDatagram *) enet_atomic_queue_pop (& endpoint -> inbox)) != NULL)
+          enet_pool_free (datagram);
+
+        enet_free (endpoint);
+    }
+
+    enet_free (network);
+}
+
+/** Changes the conditions simulated by a loopback network, affecting datagrams sent afterwards.
+    @param network network to change
+    @param conditions new conditions
+    @remarks May be called while hosts on other threads send, which always see either the old or the new conditions.
+*/
+void
+enet_loopback_network_set_conditions (ENetLoopbackNetwork * network, const ENetLoopbackConditions * conditions)
+{
+    long version;
+
+    /* a sequence lock: senders retry if the version changed or was odd while they read */
+    while (! ENET_ATOMIC_COMPARE_EXCHANGE (& network -> conditionsWriter, (void *) NULL, (void *) conditions))
+      ENET_LOOPBACK_SLEEP (0);
+
+    version = network -> conditionsVersion;
+    ENET_ATOMIC_STORE (& network -> conditionsVersion, version + 1);
+
+    ENET_ATOMIC_STORE (& network -> conditions.latency, conditions -> latency);
+    ENET_ATOMIC_STORE (& network -> conditions.jitter, conditions -> jitter);
+    ENET_ATOMIC_STORE (& network -> conditions.loss, conditions -> loss);
+    ENET_ATOMIC_STORE (& network -> conditions.reorder, conditions -> reorder);
+
+    ENET_ATOMIC_STORE (& network -> conditionsVersion, version + 2);
+    ENET_ATOMIC_STORE (& network -> conditionsWriter, (void *) NULL);
+}
+
+static void
+enet_loopback_get_conditions (ENetLoopbackNetwork * network, ENetLoopbackConditions * conditions)
+{
+    long version;
+
+    do
+    {
+        version = ENET_ATOMIC_LOAD (& network -> conditionsVersion);
+
+        conditions -> latency = ENET_ATOMIC_LOAD (& network -> conditions.latency);
+        conditions -> jitter = ENET_ATOMIC_LOAD (& network -> conditions.jitter);
+        conditions -> loss = ENET_ATOMIC_LOAD (& network -> conditions.loss);
+        conditions -> reorder = ENET_ATOMIC_LOAD (& network -> conditions.reorder);
+    } while ((version & 1) || ENET_ATOMIC_LOAD (& network -> conditionsVersion) != version);
+}
+
+static enet_uint32
+enet_loopback_random (ENetLoopbackEndpoint * endpoint)
+{
+    enet_uint32 n = (endpoint -> randomSeed += 0x6D2B79F5U);
+    n = (n ^ (n >> 15)) * (n | 1U);
+    n ^= n + (n ^ (n >> 7)) * (n | 61U);
+    return n ^ (n >> 14);
+}
+
+static void
+enet_loopback_collect (ENetLoopbackEndpoint * endpoint)
+{
+    ENetLoopbackDatagram * datagram;
+
+    while ((datagram = (ENetLoopbackDatagram *) enet_atomic_queue_pop (& endpoint -> inbox)) != NULL)
+    {
+        datagram -> next = NULL;
+
+        if (endpoint -> pending == NULL)
+          endpoint -> pending = endpoint -> pendingTail = datagram;
+        else
+        if (ENET_TIME_GREATER_EQUAL (datagram -> deliveryTime, endpoint -> pendingTail -> deliveryTime))
+        {
+            endpoint -> pendingTail -> next = datagram;
+            endpoint -> pendingTail = datagram;
+        }
+        else
+        if (ENET_TIME_LESS (datagram -> deliveryTime, endpoint -> pending -> deliveryTime))
+        {
+            datagram -> next = endpoint -> pending;
+            endpoint -> pending = datagram;
+        }
+        else
+        {
+            ENetLoopbackDatagram * previous = endpoint -> pending;
+
+            while (ENET_TIME_GREATER_EQUAL (datagram -> deliveryTime, previous -> next -> deliveryTime))
+              previous = previous -> next;
+
+            datagram -> next = previous -> next;
+            previous -> next = datagram;
+        }
+    }
+}
+
+static int ENET_CALLBACK
+enet_loopback_send (void * context, const ENetAddress * address, const ENetBuffer * buffers, size_t bufferCount)
+{
+    ENetLoopbackEndpoint * endpoint = (ENetLoopbackEndpoint *) context,
+                         * destination;
+    ENetLoopbackConditions conditions;
+    ENetLoopbackDatagram * datagram;
+    enet_uint32 delay;
+    size_t length = 0, bufferIndex;
+    enet_uint8 * data;
+
+    for (bufferIndex = 0; bufferIndex < bufferCount; ++ bufferIndex)
+      length += buffers [bufferIndex].dataLength;
+
+    /* endpoints outlive their hosts, so a destination found here stays valid even if its host is destroyed meanwhile */
+    destination = (ENetLoopbackEndpoint *) ENET_ATOMIC_LOAD (& endpoint -> network -> endpoints [address -> port]);
+    if (destination == NULL || ENET_ATOMIC_LOAD (& destination -> host) == NULL)
+      return (int) length;
+
+    enet_loopback_get_conditions (endpoint -> network, & conditions);
+
+    if (conditions.loss > 0 && enet_loopback_random (endpoint) % ENET_LOOPBACK_PROBABILITY_SCALE < conditions.loss)
+      return (int) length;
+
+    delay = conditions.latency;
+    if (conditions.jitter > 0)
+      delay += enet_loopback_random (endpoint) % (conditions.jitter + 1);
+    if (conditions.reorder > 0 && enet_loopback_random (endpoint) % ENET_LOOPBACK_PROBABILITY_SCALE < conditions.reorder)
+      delay += conditions.latency + conditions.jitter + 1;
+
+    datagram = (ENetLoopbackDatagram *) enet_pool_malloc (sizeof (ENetLoopbackDatagram) + length);
+    if (datagram == NULL)
+      return -1;
+
+    datagram -> deliveryTime = enet_time_get () + delay;
+    datagram -> source = endpoint -> address;
+    datagram -> dataLength = length;
+
+    data = (enet_uint8 *) (datagram + 1);
+    for (bufferIndex = 0; bufferIndex < bufferCount; ++ bufferIndex)
+    {
+        memcpy (data, buffers [bufferIndex].data, buffers [bufferIndex].dataLength);
+        data += buffers [bufferIndex].dataLength;
+    }
+
+    enet_atomic_queue_push (& destination -> inbox, datagram);
+
+    return (int) length;
+}
+
+static int ENET_CALLBACK
+enet_loopback_receive (void * context, ENetAddress * address, ENetBuffer * buffers, size_t bufferCount)
+{
+    ENetLoopbackEndpoint * endpoint = (ENetLoopbackEndpoint *) context;
+    ENetLoopbackDatagram * datagram;
+    const enet_uint8 * data;
+    size_t remaining, bufferIndex;
+
+    enet_loopback_collect (endpoint);
+
+    datagram = endpoint -> pending;
+    if (datagram == NULL || ENET_TIME_LESS (enet_time_get (), datagram -> deliveryTime))
+      return 0;
+
+    endpoint -> pending = datagram -> next;
+
+    * address = datagram -> source;
+
+    data = (const enet_uint8 *) (datagram + 1);
+    remaining = datagram -> dataLength;
+    for (bufferIndex = 0; bufferIndex < bufferCount && remaining > 0; ++ bufferIndex)
+    {
+        size_t length = ENET_MIN (remaining, buffers [bufferIndex].dataLength);
+
+        memcpy (buffers [bufferIndex].data, data, length);
+        data += length;
+        remaining -= length;
+    }
+
+    remaining = datagram -> dataLength - remaining;
+
+    enet_pool_free (datagram);
+
+    return (int) remaining;
+}
+
+static int ENET_CALLBACK
+enet_loopback_wait (void * context, enet_uint32 * condition, enet_uint32 timeout)
+{
+    ENetLoopbackEndpoint * endpoint = (ENetLoopbackEndpoint *) context;
+    enet_uint32 deadline = enet_time_get () + timeout;
+
+    if (! (* condition & ENET_SOCKET_WAIT_RECEIVE))
+    {
+        * condition = ENET_SOCKET_WAIT_SEND;
+        return 0;
+    }
+
+    for (;;)
+    {
+        enet_uint32 now;
+
+        enet_loopback_collect (endpoint);
+
+        now = enet_time_get ();
+
+        if (endpoint -> pending != NULL && ENET_TIME_GREATER_EQUAL (now, endpoint -> pending -> deliveryTime))
+        {
+            * condition = ENET_SOCKET_WAIT_RECEIVE;
+            return 0;
+        }
+
+        if (ENET_TIME_GREATER_EQUAL (now, deadline))
+          break;
+
+        ENET_LOOPBACK_SLEEP (1);
+    }
+
+    * condition = ENET_SOCKET_WAIT_NONE;
+    return 0;
+}
+
+static void
+enet_loopback_drain (ENetLoopbackEndpoint * endpoint)
+{
+    ENetLoopbackDatagram * datagram;
+
+    enet_loopback_collect (endpoint);
+
+    while (endpoint -> pending != NULL)
+    {
+        datagram = endpoint -> pending;
+        endpoint -> pending = datagram -> next;
+
+        enet_pool_free (datagram);
+    }
+
+    endpoint -> pendingTail = NULL;
+}
+
+static void ENET_CALLBACK
+enet_loopback_destroy (void * context)
+{
+    ENetLoopbackEndpoint * endpoint = (ENetLoopbackEndpoint *) context;
+
+    /* drain before detaching, since the next host to claim the endpoint becomes the inbox's consumer */
+    enet_loopback_drain (endpoint);
+
+    ENET_ATOMIC_STORE (& endpoint -> host, (ENetHost *) NULL);
+
+    enet_loopback_network_destroy (endpoint -> network);
+}
+
+/* claims the endpoint of a port for a host, creating it if the port was never used */
+static ENetLoopbackEndpoint *
+enet_loopback_claim (ENetLoopbackNetwork * network, ENetHost * host, enet_uint16 port, ENetLoopbackEndpoint ** spare)
+{
+    ENetLoopbackEndpoint * endpoint = (ENetLoopbackEndpoint *) ENET_ATOMIC_LOAD (& network -> endpoints [port]);
+
+    if (endpoint == NULL)
+    {
+        if (! ENET_ATOMIC_COMPARE_EXCHANGE (& network -> endpoints [port], (ENetLoopbackEndpoint *) NULL, * spare))
+          return NULL;
+
+        endpoint = * spare;
+        * spare = NULL;
+
+        return endpoint;
+    }
+
+    if (! ENET_ATOMIC_COMPARE_EXCHANGE (& endpoint -> host, (ENetHost *) NULL, host))
+      return NULL;
+
+    /* drop whatever was sent to the previous host after it detached */
+    enet_loopback_drain (endpoint);
+
+    return endpoint;
+}
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Attaches a host to a loopback network in place of its UDP socket.
+    @param host host to attach, preferably just created with enet_host_create()
+    @param network network to attach to
+    @param port port to receive on, or 0 to pick an unused one
+    @returns 0 on success, < 0 if the port is taken or memory ran out
+    @remarks On success host -> address holds the address other hosts on the network may connect to.
+*/
+int
+enet_host_loopback (ENetHost * host, ENetLoopbackNetwork * network, enet_uint16 port)
+{
+    ENetLoopbackEndpoint * endpoint = NULL,
+                         * spare;
+    ENetTransport transport;
+
+    spare = (ENetLoopbackEndpoint *) enet_malloc (sizeof (ENetLoopbackEndpoint));
+    if (spare == NULL)
+      return -1;
+
+    memset (spare, 0, sizeof (ENetLoopbackEndpoint));
+
+    /* senders may find the endpoint as soon as it is registered */
+    spare -> network = network;
+    spare -> host = host;
+    enet_atomic_queue_clear (& spare -> inbox);
+
+    if (port == 0)
+    {
+        enet_uint32 attempts;
+
+        for (attempts = 0; attempts < 0xFFFF; ++ attempts)
+        {
+            port = (enet_uint16) ((enet_uint32) ENET_ATOMIC_INCREMENT (& network -> nextPort) % 0xFFFF + 1);
+
+            endpoint = enet_loopback_claim (network, host, port, & spare);
+            if (endpoint != NULL)
+              break;
+        }
+    }
+    else
+      endpoint = enet_loopback_claim (network, host, port, & spare);
+
+    enet_free (spare);
+
+    if (endpoint == NULL)
+      return -1;
+
+    endpoint -> address.host = ENET_HOST_TO_NET_32 (0x7F000001);
+    endpoint -> address.port = port;
+    endpoint -> randomSeed = network -> seed ^ ((enet_uint32) port * 0x9E3779B9U);
+
+    ENET_ATOMIC_INCREMENT (& network -> referenceCount);
+
+    transport.context = endpoint;
+    transport.send = enet_loopback_send;
+    transport.receive = enet_loopback_receive;
+    transport.wait = enet_loopback_wait;
+    transport.destroy = enet_loopback_destroy;
+    enet_host_transport (host, & transport);
+
+    host -> address = endpoint -> address;
+
+    return 0;
+}
+
+/** @} */
+
+/** @} */
@@ -0,0 +1,491 @@
+/**
+ @file lz4.c
+ @brief A fast LZ77 packet compressor using the LZ4 block format, with optional dictionary priming
+*/
+#define ENET_BUILDING_LIB 1
+#include <stdlib.h>
+#include <string.h>
+#include "enet/utility.h"
+#include "enet/enet.h"
+
+/* The range coder in compress.c gives the best ratios on small packets but
+   spends a lot of time per byte.  This codec trades ratio for speed: a greedy
+   single-probe hash match finder emitting LZ4 block sequences.  Packets are
+   too small for LZ77 to find much redundancy on their own, so a dictionary of
+   typical packet content can be placed in front of every packet, making it
+   reachable by matches on both sides of the connection. */
+
+enum
+{
+    ENET_LZ4_HASH_LOG        = 12,
+    ENET_LZ4_HASH_SIZE       = 1 << ENET_LZ4_HASH_LOG,
+    ENET_LZ4_MINIMUM_MATCH   = 4,
+    ENET_LZ4_LAST_LITERALS   = 5,
+    ENET_LZ4_MATCH_LIMIT     = 12,
+    ENET_LZ4_MAXIMUM_OFFSET  = 0xFFFF,
+    ENET_LZ4_SKIP_TRIGGER    = 6,
+
+    ENET_LZ4_TRAIN_SHINGLE   = 8,
+    ENET_LZ4_TRAIN_SEGMENT   = 32,
+    ENET_LZ4_TRAIN_HASH_LOG  = 16,
+    /* on average every shingle of a segment must recur at least twice */
+    ENET_LZ4_TRAIN_MINIMUM_SCORE = 2 * (ENET_LZ4_TRAIN_SEGMENT - ENET_LZ4_TRAIN_SHINGLE + 1)
+};
+
+typedef struct _ENetLZ4
+{
+    size_t      dictionaryLength;
+    enet_uint16 table [ENET_LZ4_HASH_SIZE];
+    enet_uint16 primedTable [ENET_LZ4_HASH_SIZE];
+    /* dictionary followed by the packet currently being compressed or decompressed */
+    enet_uint8  window [ENET_LZ4_MAXIMUM_DICTIONARY + ENET_PROTOCOL_MAXIMUM_MTU];
+} ENetLZ4;
+
+#define ENET_LZ4_READ_32(data) \
+    ((enet_uint32) (data) [0] | ((enet_uint32) (data) [1] << 8) | ((enet_uint32) (data) [2] << 16) | ((enet_uint32) (data) [3] << 24))
+
+#define ENET_LZ4_HASH(value) \
+    ((enet_uint32) ((value) * 2654435761U) >> (32 - ENET_LZ4_HASH_LOG))
+
+/** Creates an LZ4 compressor context.
+    @param dictionary data to prime the compressor with, or NULL; both sides of a connection must use the same dictionary
+    @param dictionaryLength length of dictionary; only the last ENET_LZ4_MAXIMUM_DICTIONARY bytes are used
+    @returns the context on success, NULL on failure
+*/
+void *
+enet_lz4_create (const void * dictionary, size_t dictionaryLength)
+{
+    ENetLZ4 * lz4 = (ENetLZ4 *) enet_malloc (sizeof (ENetLZ4));
+    if (lz4 == NULL)
+      return NULL;
+
+    memset (lz4 -> table, 0, sizeof (lz4 -> table));
+
+    if (dictionary == NULL)
+      dictionaryLength = 0;
+    else
+    if (dictionaryLength > ENET_LZ4_MAXIMUM_DICTIONARY)
+    {
+        dictionary = (const enet_uint8 *) dictionary + dictionaryLength - ENET_LZ4_MAXIMUM_DICTIONARY;
+        dictionaryLength = ENET_LZ4_MAXIMUM_DICTIONARY;
+    }
+
+    lz4 -> dictionaryLength = dictionaryLength;
+
+    if (dictionaryLength > 0)
+    {
+        size_t position;
+
+        memcpy (lz4 -> window, dictionary, dictionaryLength);
+
+        for (position = 0; position + ENET_LZ4_MINIMUM_MATCH <= dictionaryLength; ++ position)
+          lz4 -> table [ENET_LZ4_HASH (ENET_LZ4_READ_32 (& lz4 -> window [position]))] = (enet_uint16) position;
+
+        memcpy (lz4 -> primedTable, lz4 -> table, sizeof (lz4 -> table));
+    }
+
+    return lz4;
+}
+
+void
+enet_lz4_destroy (void * context)
+{
+    ENetLZ4 * lz4 = (ENetLZ4 *) context;
+    if (lz4 == NULL)
+      return;
+
+    enet_free (lz4);
+}
+
+#define ENET_LZ4_WRITE_LENGTH(length) \
+{ \
+    size_t remaining = (length); \
+    while (remaining >= 255) \
+    { \
+        * outData ++ = 255; \
+        remaining -= 255; \
+    } \
+    * outData ++ = (enet_uint8) remaining; \
+}
+
+static enet_uint8 *
+enet_lz4_write_sequence (enet_uint8 * outData, enet_uint8 * outEnd, const enet_uint8 * literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    enet_uint8 * token;
+
+    if ((size_t) (outEnd - outData) < 1 + literalLength + literalLength / 255 + 1 + (matchLength > 0 ? 2 + matchLength / 255 + 1 : 0))
+      return NULL;
+
+    token = outData ++;
+
+    if (literalLength >= 15)
+    {
+        * token = 15 << 4;
+        ENET_LZ4_WRITE_LENGTH (literalLength - 15);
+    }
+    else
+      * token = (enet_uint8) (literalLength << 4);
+
+    memcpy (outData, literals, literalLength);
+    outData += literalLength;
+
+    if (matchLength == 0)
+      return outData;
+
+    * outData ++ = (enet_uint8) (offset & 0xFF);
+    * outData ++ = (enet_uint8) (offset >> 8);
+
+    matchLength -= ENET_LZ4_MINIMUM_MATCH;
+    if (matchLength >= 15)
+    {
+        * token |= 15;
+        ENET_LZ4_WRITE_LENGTH (matchLength - 15);
+    }
+    else
+      * token |= (enet_uint8) matchLength;
+
+    return outData;
+}
+
+size_t
+enet_lz4_compress (void * context, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetLZ4 * lz4 = (ENetLZ4 *) context;
+    enet_uint8 * outStart = outData,
+               * outEnd = & outData [outLimit],
+               * inStart, * inData;
+    const enet_uint8 * lowLimit, * anchor, * inEnd, * matchLimit, * inputLimit;
+    size_t skip = 1 << ENET_LZ4_SKIP_TRIGGER;
+
+    if (lz4 == NULL || inLimit <= 0 || inLimit > ENET_PROTOCOL_MAXIMUM_MTU)
+      return 0;
+
+    inStart = & lz4 -> window [lz4 -> dictionaryLength];
+    inData = inStart;
+
+    while (inBufferCount -- > 0 && inData < & inStart [inLimit])
+    {
+        size_t length = ENET_MIN (inBuffers -> dataLength, (size_t) (& inStart [inLimit] - inData));
+
+        memcpy (inData, inBuffers -> data, length);
+        inData += length;
+        ++ inBuffers;
+    }
+
+    inEnd = inData;
+    anchor = inData = inStart;
+
+    if (lz4 -> dictionaryLength > 0)
+    {
+        memcpy (lz4 -> table, lz4 -> primedTable, sizeof (lz4 -> table));
+        lowLimit = lz4 -> window;
+    }
+    else
+      lowLimit = inStart;
+
+    if (inEnd - inStart >= ENET_LZ4_MATCH_LIMIT + 1)
+    {
+        matchLimit = inEnd - ENET_LZ4_LAST_LITERALS;
+        inputLimit = inEnd - ENET_LZ4_MATCH_LIMIT;
+
+        while (inData < inputLimit)
+        {
+            enet_uint32 sequence = ENET_LZ4_READ_32 (inData),
+                        hash = ENET_LZ4_HASH (sequence);
+            const enet_uint8 * match = & lz4 -> window [lz4 -> table [hash]];
+            size_t matchLength;
+
+            lz4 -> table [hash] = (enet_uint16) (inData - lz4 -> window);
+
+            if (match < lowLimit || match >= inData ||
+                inData - match > ENET_LZ4_MAXIMUM_OFFSET ||
+                ENET_LZ4_READ_32 (match) != sequence)
+            {
+                inData += skip ++ >> ENET_LZ4_SKIP_TRIGGER;
+                continue;
+            }
+
+            while (inData > anchor && match > lowLimit && inData [-1] == match [-1])
+            {
+                -- inData;
+                -- match;
+            }
+
+            matchLength = ENET_LZ4_MINIMUM_MATCH;
+            while (& inData [matchLength] < matchLimit && inData [matchLength] == match [matchLength])
+              ++ matchLength;
+
+            outData = enet_lz4_write_sequence (outData, outEnd, anchor, (size_t) (inData - anchor), (size_t) (inData - match), matchLength);
+            if (outData == NULL)
+              return 0;
+
+            inData += matchLength;
+            anchor = inData;
+            skip = 1 << ENET_LZ4_SKIP_TRIGGER;
+
+            if (inData < inputLimit)
+              lz4 -> table [ENET_LZ4_HASH (ENET_LZ4_READ_32 (inData - 2))] = (enet_uint16) (inData - 2 - lz4 -> window);
+        }
+    }
+
+    outData = enet_lz4_write_sequence (outData, outEnd, anchor, (size_t) (inEnd - anchor), 0, 0);
+    if (outData == NULL)
+      return 0;
+
+    return (size_t) (outData - outStart);
+}
+
+#define ENET_LZ4_READ_LENGTH(length) \
+{ \
+    enet_uint8 value; \
+    do \
+    { \
+        if (inData >= inEnd) \
+          return 0; \
+        value = * inData ++; \
+        length += value; \
+    } while (value == 255); \
+}
+
+size_t
+enet_lz4_decompress (void * context, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetLZ4 * lz4 = (ENetLZ4 *) context;
+    const enet_uint8 * inEnd = & inData [inLimit];
+    enet_uint8 * outStart, * outEnd, * output, * lowLimit;
+
+    if (lz4 == NULL)
+      return 0;
+
+    if (lz4 -> dictionaryLength > 0)
+    {
+        /* decode behind the dictionary so that matches may reach back into it */
+        lowLimit = lz4 -> window;
+        outStart = & lz4 -> window [lz4 -> dictionaryLength];
+        outEnd = & outStart [ENET_MIN (outLimit, (size_t) ENET_PROTOCOL_MAXIMUM_MTU)];
+    }
+    else
+    {
+        lowLimit = outStart = outData;
+        outEnd = & outData [outLimit];
+    }
+
+    output = outStart;
+
+    while (inData < inEnd)
+    {
+        enet_uint8 token = * inData ++;
+        size_t literalLength = token >> 4,
+               matchLength = token & 15,
+               offset;
+        const enet_uint8 * match;
+
+        if (literalLength == 15)
+          ENET_LZ4_READ_LENGTH (literalLength);
+
+        if ((size_t) (inEnd - inData) < literalLength || (size_t) (outEnd - output) < literalLength)
+          return 0;
+
+        memcpy (output, inData, literalLength);
+        inData += literalLength;
+        output += literalLength;
+
+        if (inData >= inEnd)
+          break;
+
+        if (inEnd - inData < 2)
+          return 0;
+
+        offset = inData [0] | (inData [1] << 8);
+        inData += 2;
+
+        if (matchLength == 15)
+          ENET_LZ4_READ_LENGTH (matchLength);
+        matchLength += ENET_LZ4_MINIMUM_MATCH;
+
+        if (offset == 0 || offset > (size_t) (output - lowLimit) || (size_t) (outEnd - output) < matchLength)
+          return 0;
+
+        match = output - offset;
+        if (offset >= matchLength)
+        {
+            memcpy (output, match, matchLength);
+            output += matchLength;
+        }
+        else
+        {
+            while (matchLength -- > 0)
+              * output ++ = * match ++;
+        }
+    }
+
+    if (lz4 -> dictionaryLength > 0)
+      memcpy (outData, outStart, output - outStart);
+
+    return (size_t) (output - outStart);
+}
+
+typedef struct _ENetLZ4Segment
+{
+    enet_uint32 score;
+    enet_uint32 sample;
+    enet_uint32 offset;
+} ENetLZ4Segment;
+
+static int
+enet_lz4_compare_segments (const void * a, const void * b)
+{
+    enet_uint32 scoreA = ((const ENetLZ4Segment *) a) -> score,
+                scoreB = ((const ENetLZ4Segment *) b) -> score;
+
+    return scoreA < scoreB ? 1 : (scoreA > scoreB ? -1 : 0);
+}
+
+#define ENET_LZ4_SHINGLE_HASH(data) \
+    ((enet_uint32) ((ENET_LZ4_READ_32 (data) * 2654435761U) ^ (ENET_LZ4_READ_32 ((data) + 4) * 2246822519U)) >> (32 - ENET_LZ4_TRAIN_HASH_LOG))
+
+static enet_uint32
+enet_lz4_score_segment (const enet_uint32 * counts, const enet_uint8 * data)
+{
+    enet_uint32 score = 0;
+    size_t position;
+
+    for (position = 0; position + ENET_LZ4_TRAIN_SHINGLE <= ENET_LZ4_TRAIN_SEGMENT; ++ position)
+    {
+        enet_uint32 count = counts [ENET_LZ4_SHINGLE_HASH (& data [position])];
+
+        /* a shingle seen only once is noise, not shared structure */
+        if (count > 1)
+          score += count;
+    }
+
+    return score;
+}
+
+/** Builds a compression dictionary from a set of sample packets.
+
+    Every 8-byte substring of the samples is counted, then the 32-byte
+    segments whose substrings recur most often across the samples are
+    copied into the dictionary, most valuable last so that they sit closest
+    to the packet data.  The substrings of a chosen segment stop counting
+    toward other segments so that the dictionary does not fill up with
+    copies of the same content.
+
+    @param samples sample packets, typically recorded from real traffic
+    @param sampleCount number of samples
+    @param dictionary destination for the dictionary
+    @param dictionaryLimit capacity of dictionary
+    @returns the length of the dictionary written, 0 on failure
+*/
+size_t
+enet_lz4_train_dictionary (const ENetBuffer * samples, size_t sampleCount, enet_uint8 * dictionary, size_t dictionaryLimit)
+{
+    enet_uint32 * counts;
+    ENetLZ4Segment * segments;
+    size_t segmentCount = 0, sample, segment, dictionaryLength = 0;
+
+    if (dictionaryLimit > ENET_LZ4_MAXIMUM_DICTIONARY)
+      dictionaryLimit = ENET_LZ4_MAXIMUM_DICTIONARY;
+
+    for (sample = 0; sample < sampleCount; ++ sample)
+      if (samples [sample].dataLength >= ENET_LZ4_TRAIN_SEGMENT)
+        segmentCount += (samples [sample].dataLength - ENET_LZ4_TRAIN_SEGMENT) / (ENET_LZ4_TRAIN_SEGMENT / 2) + 1;
+
+    if (segmentCount == 0 || dictionaryLimit < ENET_LZ4_TRAIN_SEGMENT)
+      return 0;
+
+    counts = (enet_uint32 *) enet_malloc (sizeof (enet_uint32) << ENET_LZ4_TRAIN_HASH_LOG);
+    if (counts == NULL)
+      return 0;
+
+    segments = (ENetLZ4Segment *) enet_malloc (segmentCount * sizeof (ENetLZ4Segment));
+    if (segments == NULL)
+    {
+        enet_free (counts);
+
+        return 0;
+    }
+
+    memset (counts, 0, sizeof (enet_uint32) << ENET_LZ4_TRAIN_HASH_LOG);
+
+    for (sample = 0; sample < sampleCount; ++ sample)
+    {
+        const enet_uint8 * data = (const enet_uint8 *) samples [sample].data;
+        size_t position;
+
+        for (position = 0; position + ENET_LZ4_TRAIN_SHINGLE <= samples [sample].dataLength; ++ position)
+          ++ counts [ENET_LZ4_SHINGLE_HASH (& data [position])];
+    }
+
+    segmentCount = 0;
+    for (sample = 0; sample < sampleCount; ++ sample)
+    {
+        const enet_uint8 * data = (const enet_uint8 *) samples [sample].data;
+        size_t offset;
+
+        for (offset = 0; offset + ENET_LZ4_TRAIN_SEGMENT <= samples [sample].dataLength; offset += ENET_LZ4_TRAIN_SEGMENT / 2)
+        {
+            segments [segmentCount].score = enet_lz4_score_segment (counts, & data [offset]);
+            segments [segmentCount].sample = (enet_uint32) sample;
+            segments [segmentCount].offset = (enet_uint32) offset;
+            ++ segmentCount;
+        }
+    }
+
+    qsort (segments, segmentCount, sizeof (ENetLZ4Segment), enet_lz4_compare_segments);
+
+    for (segment = 0;
+         segment < segmentCount && dictionaryLength + ENET_LZ4_TRAIN_SEGMENT <= dictionaryLimit && segments [segment].score >= ENET_LZ4_TRAIN_MINIMUM_SCORE;
+         ++ segment)
+    {
+        const enet_uint8 * data = (const enet_uint8 *) samples [segments [segment].sample].data + segments [segment].offset;
+        size_t position;
+
+        /* scores only ever drop as segments are taken, so a stale score is an upper bound */
+        if (enet_lz4_score_segment (counts, data) < segments [segment].score / 2)
+          continue;
+
+        for (position = 0; position + ENET_LZ4_TRAIN_SHINGLE <= ENET_LZ4_TRAIN_SEGMENT; ++ position)
+          counts [ENET_LZ4_SHINGLE_HASH (& data [position])] = 0;
+
+        dictionaryLength += ENET_LZ4_TRAIN_SEGMENT;
+        memcpy (& dictionary [dictionaryLimit - dictionaryLength], data, ENET_LZ4_TRAIN_SEGMENT);
+    }
+
+    if (dictionaryLength < dictionaryLimit)
+      memmove (dictionary, & dictionary [dictionaryLimit - dictionaryLength], dictionaryLength);
+
+    enet_free (segments);
+    enet_free (counts);
+
+    return dictionaryLength;
+}
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Sets the packet compressor the host should use to the LZ4 block compressor.
+    @param host host to enable the compressor for
+    @param dictionary data to prime the compressor with, or NULL; see enet_lz4_train_dictionary()
+    @param dictionaryLength length of dictionary
+    @returns 0 on success, < 0 on failure
+    @remarks The peers of the host must use the same compressor and dictionary, since the
+    protocol only flags a packet as compressed and does not identify the codec.
+*/
+int
+enet_host_compress_with_lz4 (ENetHost * host, const void * dictionary, size_t dictionaryLength)
+{
+    ENetCompressor compressor;
+    memset (& compressor, 0, sizeof (compressor));
+    compressor.context = enet_lz4_create (dictionary, dictionaryLength);
+    if (compressor.context == NULL)
+      return -1;
+    compressor.compress = enet_lz4_compress;
+    compressor.decompress = enet_lz4_decompress;
+    compressor.destroy = enet_lz4_destroy;
+    enet_host_compress (host, & compressor);
+    return 0;
+}
+
+/** @} */
@@ -2,6 +2,7 @@
  @file  packet.c
  @brief ENet packet management functions
 */
+#include <stddef.h>
 #include <string.h>
 #define ENET_BUILDING_LIB 1
 #include "enet/enet.h"
@@ -10,6 +11,19 @@
     @{ 
 */
 
+static void
+enet_packet_clear_fragment_layouts (ENetPacket * packet)
+{
+    while (packet -> fragmentLayouts != NULL)
+    {
+       ENetFragmentLayout * layout = packet -> fragmentLayouts;
+
+       packet -> fragmentLayouts = layout -> next;
+
+       enet_pool_free (layout);
+    }
+}
+
 /** Creates a packet that may be sent to a peer.
     @param dataContents initial contents of the packet's data; the packet's data will remain uninitialized if dataContents is NULL.
     @param dataLength   size of the data allocated for this packet
@@ -19,7 +33,7 @@
 ENetPacket *
 enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
 {
-    ENetPacket * packet = (ENetPacket *) enet_malloc (sizeof (ENetPacket));
+    ENetPacket * packet = (ENetPacket *) enet_pool_malloc (sizeof (ENetPacket));
     if (packet == NULL)
       return NULL;
 
@@ -30,10 +44,10 @@ enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
       packet -> data = NULL;
     else
     {
-       packet -> data = (enet_uint8 *) enet_malloc (dataLength);
+       packet -> data = (enet_uint8 *) enet_pool_malloc (dataLength);
        if (packet -> data == NULL)
        {
-          enet_free (packet);
+          enet_pool_free (packet);
           return NULL;
        }
 
@@ -46,6 +60,7 @@ enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
     packet -> dataLength = dataLength;
     packet -> freeCallback = NULL;
     packet -> userData = NULL;
+    packet -> fragmentLayouts = NULL;
 
     return packet;
 }
@@ -61,10 +76,11 @@ enet_packet_destroy (ENetPacket * packet)
 
     if (packet -> freeCallback != NULL)
       (* packet -> freeCallback) (packet);
+    enet_packet_clear_fragment_layouts (packet);
     if (! (packet -> flags & ENET_PACKET_FLAG_NO_ALLOCATE) &&
         packet -> data != NULL)
-      enet_free (packet -> data);
-    enet_free (packet);
+      enet_pool_free (packet -> data);
+    enet_pool_free (packet);
 }
 
 /** Attempts to resize the data in the packet to length specified in the 
@@ -77,6 +93,10 @@ int
 enet_packet_resize (ENetPacket * packet, size_t dataLength)
 {
     enet_uint8 * newData;
+
+    /* the fragments of a packet that is no longer queued are laid out again */
+    if (packet -> referenceCount == 0)
+      enet_packet_clear_fragment_layouts (packet);
    
     if (dataLength <= packet -> dataLength || (packet -> flags & ENET_PACKET_FLAG_NO_ALLOCATE))
     {
@@ -85,12 +105,12 @@ enet_packet_resize (ENetPacket * packet, size_t dataLength)
        return 0;
     }
 
-    newData = (enet_uint8 *) enet_malloc (dataLength);
+    newData = (enet_uint8 *) enet_pool_malloc (dataLength);
     if (newData == NULL)
       return -1;
 
     memcpy (newData, packet -> data, packet -> dataLength);
-    enet_free (packet -> data);
+    enet_pool_free (packet -> data);
     
     packet -> data = newData;
     packet -> dataLength = dataLength;
@@ -98,6 +118,61 @@ enet_packet_resize (ENetPacket * packet, size_t dataLength)
     return 0;
 }
 
+/** Gives the fragment headers of a packet split into fragments of a given length.
+    @param packet packet to fragment
+    @param fragmentLength payload size of each fragment, as given by enet_peer_fragment_length()
+    @returns the layout on success, NULL on failure
+    @remarks The layout is computed the first time it is asked for and kept with the packet
+    until it is destroyed or resized, so sending the packet to many peers with the same MTU only lays it
+    out once.  Only the size and offset fields of the headers are filled in, already in network
+    byte-order; the command number and sequence numbers depend on the channel state of each
+    peer.
+*/
+const ENetFragmentLayout *
+enet_packet_fragment_layout (ENetPacket * packet, size_t fragmentLength)
+{
+    ENetFragmentLayout * layout;
+    enet_uint32 fragmentCount = (packet -> dataLength + fragmentLength - 1) / fragmentLength,
+           fragmentNumber,
+           fragmentOffset;
+
+    for (layout = packet -> fragmentLayouts; layout != NULL; layout = layout -> next)
+    {
+       if (layout -> fragmentLength == fragmentLength)
+         return layout;
+    }
+
+    layout = (ENetFragmentLayout *) enet_pool_malloc (offsetof (ENetFragmentLayout, fragments) + fragmentCount * sizeof (ENetProtocolSendFragment));
+    if (layout == NULL)
+      return NULL;
+
+    layout -> fragmentLength = fragmentLength;
+    layout -> fragmentCount = fragmentCount;
+
+    for (fragmentNumber = 0,
+           fragmentOffset = 0;
+         fragmentOffset < packet -> dataLength;
+         ++ fragmentNumber,
+           fragmentOffset += fragmentLength)
+    {
+       ENetProtocolSendFragment * fragment = & layout -> fragments [fragmentNumber];
+
+       if (packet -> dataLength - fragmentOffset < fragmentLength)
+         fragmentLength = packet -> dataLength - fragmentOffset;
+
+       fragment -> dataLength = ENET_HOST_TO_NET_16 (fragmentLength);
+       fragment -> fragmentCount = ENET_HOST_TO_NET_32 (fragmentCount);
+       fragment -> fragmentNumber = ENET_HOST_TO_NET_32 (fragmentNumber);
+       fragment -> totalLength = ENET_HOST_TO_NET_32 (packet -> dataLength);
+       fragment -> fragmentOffset = ENET_HOST_TO_NET_32 (fragmentOffset);
+    }
+
+    layout -> next = packet -> fragmentLayouts;
+    packet -> fragmentLayouts = layout;
+
+    return layout;
+}
+
 static int initializedCRC32 = 0;
 static enet_uint32 crcTable [256];
 
@@ -89,105 +89,129 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
     return 0;
 }
 
-/** Queues a packet to be sent.
+/** Gives the largest fragment payload that fits into a single datagram to the peer. */
+size_t
+enet_peer_fragment_length (ENetPeer * peer)
+{
+   size_t fragmentLength = peer -> mtu - sizeof (ENetProtocolHeader) - sizeof (ENetProtocolSendFragment);
+   if (peer -> host -> checksum != NULL)
+     fragmentLength -= sizeof(enet_uint32);
+
+   return fragmentLength;
+}
+
+/** Queues a packet that exceeds the peer's MTU as a series of fragments.
     @param peer destination for the packet
     @param channelID channel on which to send
     @param packet packet to send
+    @param fragmentLength payload size of each fragment
     @retval 0 on success
     @retval < 0 on failure
+    @remarks The fragment headers come from the packet's shared layout, so queueing the
+    packet to another peer only costs the commands and their sequence numbers.
 */
 int
-enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
+enet_peer_send_fragments (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet, size_t fragmentLength)
 {
    ENetChannel * channel = & peer -> channels [channelID];
-   ENetProtocol command;
-   size_t fragmentLength;
-
-   if (peer -> state != ENET_PEER_STATE_CONNECTED ||
-       channelID >= peer -> channelCount ||
-       packet -> dataLength > ENET_PROTOCOL_MAXIMUM_PACKET_SIZE)
+   enet_uint32 fragmentCount = (packet -> dataLength + fragmentLength - 1) / fragmentLength,
+          fragmentNumber,
+          fragmentOffset;
+   enet_uint8 commandNumber;
+   enet_uint16 startSequenceNumber; 
+   ENetList fragmentList;
+   ENetOutgoingCommand * fragment;
+   const ENetFragmentLayout * layout;
+
+   if (fragmentCount > ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
      return -1;
 
-   fragmentLength = peer -> mtu - sizeof (ENetProtocolHeader) - sizeof (ENetProtocolSendFragment);
-   if (peer -> host -> checksum != NULL)
-     fragmentLength -= sizeof(enet_uint32);
+   layout = enet_packet_fragment_layout (packet, fragmentLength);
+   if (layout == NULL)
+     return -1;
 
-   if (packet -> dataLength > fragmentLength)
+   if ((packet -> flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)) == ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT &&
+       channel -> outgoingUnreliableSequenceNumber < 0xFFFF)
    {
-      enet_uint32 fragmentCount = (packet -> dataLength + fragmentLength - 1) / fragmentLength,
-             fragmentNumber,
-             fragmentOffset;
-      enet_uint8 commandNumber;
-      enet_uint16 startSequenceNumber; 
-      ENetList fragments;
-      ENetOutgoingCommand * fragment;
-
-      if (fragmentCount > ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
-        return -1;
-
-      if ((packet -> flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)) == ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT &&
-          channel -> outgoingUnreliableSequenceNumber < 0xFFFF)
-      {
-         commandNumber = ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT;
-         startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingUnreliableSequenceNumber + 1);
-      }
-      else
-      {
-         commandNumber = ENET_PROTOCOL_COMMAND_SEND_FRAGMENT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
-         startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingReliableSequenceNumber + 1);
-      }
-        
-      enet_list_clear (& fragments);
+      commandNumber = ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT;
+      startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingUnreliableSequenceNumber + 1);
+   }
+   else
+   {
+      commandNumber = ENET_PROTOCOL_COMMAND_SEND_FRAGMENT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+      startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingReliableSequenceNumber + 1);
+   }
+     
+   enet_list_clear (& fragmentList);
+
+   for (fragmentNumber = 0,
+          fragmentOffset = 0;
+        fragmentOffset < packet -> dataLength;
+        ++ fragmentNumber,
+          fragmentOffset += fragmentLength)
+   {
+      if (packet -> dataLength - fragmentOffset < fragmentLength)
+        fragmentLength = packet -> dataLength - fragmentOffset;
 
-      for (fragmentNumber = 0,
-             fragmentOffset = 0;
-           fragmentOffset < packet -> dataLength;
-           ++ fragmentNumber,
-             fragmentOffset += fragmentLength)
+      fragment = (ENetOutgoingCommand *) enet_pool_malloc (sizeof (ENetOutgoingCommand));
+      if (fragment == NULL)
       {
-         if (packet -> dataLength - fragmentOffset < fragmentLength)
-           fragmentLength = packet -> dataLength - fragmentOffset;
-
-         fragment = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
-         if (fragment == NULL)
+         while (! enet_list_empty (& fragmentList))
          {
-            while (! enet_list_empty (& fragments))
-            {
-               fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragments));
-               
-               enet_free (fragment);
-            }
+            fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragmentList));
             
-            return -1;
+            enet_pool_free (fragment);
          }
          
-         fragment -> fragmentOffset = fragmentOffset;
-         fragment -> fragmentLength = fragmentLength;
-         fragment -> packet = packet;
-         fragment -> command.header.command = commandNumber;
-         fragment -> command.header.channelID = channelID;
-         fragment -> command.sendFragment.startSequenceNumber = startSequenceNumber;
-         fragment -> command.sendFragment.dataLength = ENET_HOST_TO_NET_16 (fragmentLength);
-         fragment -> command.sendFragment.fragmentCount = ENET_HOST_TO_NET_32 (fragmentCount);
-         fragment -> command.sendFragment.fragmentNumber = ENET_HOST_TO_NET_32 (fragmentNumber);
-         fragment -> command.sendFragment.totalLength = ENET_HOST_TO_NET_32 (packet -> dataLength);
-         fragment -> command.sendFragment.fragmentOffset = ENET_NET_TO_HOST_32 (fragmentOffset);
-        
-         enet_list_insert (enet_list_end (& fragments), fragment);
+         return -1;
       }
+      
+      fragment -> fragmentOffset = fragmentOffset;
+      fragment -> fragmentLength = fragmentLength;
+      fragment -> packet = packet;
+      fragment -> fragmentHeader = & layout -> fragments [fragmentNumber];
+      fragment -> command.header.command = commandNumber;
+      fragment -> command.header.channelID = channelID;
+      fragment -> command.sendFragment.startSequenceNumber = startSequenceNumber;
+     
+      enet_list_insert (enet_list_end (& fragmentList), fragment);
+   }
 
-      packet -> referenceCount += fragmentNumber;
+   packet -> referenceCount += fragmentNumber;
 
-      while (! enet_list_empty (& fragments))
-      {
-         fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragments));
- 
-         enet_peer_setup_outgoing_command (peer, fragment);
-      }
+   while (! enet_list_empty (& fragmentList))
+   {
+      fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragmentList));
 
-      return 0;
+      enet_peer_setup_outgoing_command (peer, fragment);
    }
 
+   return 0;
+}
+
+/** Queues a packet to be sent.
+    @param peer destination for the packet
+    @param channelID channel on which to send
+    @param packet packet to send
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
+{
+   ENetChannel * channel = & peer -> channels [channelID];
+   ENetProtocol command;
+   size_t fragmentLength;
+
+   if (peer -> state != ENET_PEER_STATE_CONNECTED ||
+       channelID >= peer -> channelCount ||
+       packet -> dataLength > ENET_PROTOCOL_MAXIMUM_PACKET_SIZE)
+     return -1;
+
+   fragmentLength = enet_peer_fragment_length (peer);
+   if (packet -> dataLength > fragmentLength)
+     return enet_peer_send_fragments (peer, channelID, packet, fragmentLength);
+
    command.header.channelID = channelID;
 
    if ((packet -> flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNSEQUENCED)) == ENET_PACKET_FLAG_UNSEQUENCED)
@@ -236,10 +260,7 @@ enet_peer_receive (ENetPeer * peer, enet_uint8 * channelID)
 
    -- packet -> referenceCount;
 
-   if (incomingCommand -> fragments != NULL)
-     enet_free (incomingCommand -> fragments);
-
-   enet_free (incomingCommand);
+   enet_pool_free (incomingCommand);
 
    return packet;
 }
@@ -261,7 +282,7 @@ enet_peer_reset_outgoing_commands (ENetList * queue)
             enet_packet_destroy (outgoingCommand -> packet);
        }
 
-       enet_free (outgoingCommand);
+       enet_pool_free (outgoingCommand);
     }
 }
 
@@ -286,10 +307,7 @@ enet_peer_remove_incoming_commands (ENetList * queue, ENetListIterator startComm
             enet_packet_destroy (incomingCommand -> packet);
        }
 
-       if (incomingCommand -> fragments != NULL)
-         enet_free (incomingCommand -> fragments);
-
-       enet_free (incomingCommand);
+       enet_pool_free (incomingCommand);
     }
 }
 
@@ -311,8 +329,17 @@ enet_peer_reset_queues (ENetPeer * peer)
        peer -> needsDispatch = 0;
     }
 
+    if (peer -> needsSend)
+    {
+       enet_list_remove (& peer -> sendList);
+
+       peer -> needsSend = 0;
+    }
+
+    enet_host_unschedule_peer (peer -> host, peer);
+
     while (! enet_list_empty (& peer -> acknowledgements))
-      enet_free (enet_list_remove (enet_list_begin (& peer -> acknowledgements)));
+      enet_pool_free (enet_list_remove (enet_list_begin (& peer -> acknowledgements)));
 
     enet_peer_reset_outgoing_commands (& peer -> sentReliableCommands);
     enet_peer_reset_outgoing_commands (& peer -> sentUnreliableCommands);
@@ -410,6 +437,7 @@ enet_peer_reset (ENetPeer * peer)
     peer -> roundTripTimeVariance = 0;
     peer -> mtu = peer -> host -> mtu;
     peer -> reliableDataInTransit = 0;
+    peer -> packetsRetransmitted = 0;
     peer -> outgoingReliableSequenceNumber = 0;
     peer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
     peer -> incomingUnsequencedGroup = 0;
@@ -417,10 +445,163 @@ enet_peer_reset (ENetPeer * peer)
     peer -> eventData = 0;
 
     memset (peer -> unsequencedWindow, 0, sizeof (peer -> unsequencedWindow));
+    memset (peer -> roundTripTimeHistogram, 0, sizeof (peer -> roundTripTimeHistogram));
+    memset (peer -> sendLatencyHistogram, 0, sizeof (peer -> sendLatencyHistogram));
     
     enet_peer_reset_queues (peer);
 }
 
+static size_t
+enet_peer_histogram_bucket (enet_uint32 value)
+{
+    size_t bucket = 0;
+
+    while (value != 0 && bucket < ENET_PEER_HISTOGRAM_BUCKETS - 1)
+    {
+        value >>= 1;
+        ++ bucket;
+    }
+
+    return bucket;
+}
+
+void
+enet_peer_sample_round_trip_time (ENetPeer * peer, enet_uint32 roundTripTime)
+{
+    size_t bucket = enet_peer_histogram_bucket (roundTripTime);
+
+    ++ peer -> roundTripTimeHistogram [bucket];
+    ++ peer -> host -> roundTripTimeHistogram [bucket];
+}
+
+void
+enet_peer_sample_send_latency (ENetPeer * peer, enet_uint32 latency)
+{
+    size_t bucket = enet_peer_histogram_bucket (latency);
+
+    ++ peer -> sendLatencyHistogram [bucket];
+    ++ peer -> host -> sendLatencyHistogram [bucket];
+}
+
+static size_t
+enet_peer_count_fragmented_packets (ENetList * queue, size_t * fragmentBytes)
+{
+    ENetListIterator currentCommand;
+    size_t count = 0;
+
+    for (currentCommand = enet_list_begin (queue);
+         currentCommand != enet_list_end (queue);
+         currentCommand = enet_list_next (currentCommand))
+    {
+       ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) currentCommand;
+
+       if (incomingCommand -> fragmentsRemaining == 0)
+         continue;
+
+       ++ count;
+       if (fragmentBytes != NULL && incomingCommand -> packet != NULL)
+         * fragmentBytes += incomingCommand -> packet -> dataLength;
+    }
+
+    return count;
+}
+
+/** Fills in a snapshot of a peer's round trip time, loss, throttle, windowing and queue state.
+    @param peer peer to query
+    @param stats receives the snapshot
+    @remarks queue lengths are counted by walking the queues, so the cost grows with their length.
+*/
+void
+enet_peer_get_stats (ENetPeer * peer, ENetPeerStats * stats)
+{
+    ENetChannel * channel;
+
+    stats -> roundTripTime = peer -> roundTripTime;
+    stats -> roundTripTimeVariance = peer -> roundTripTimeVariance;
+    stats -> lowestRoundTripTime = peer -> lowestRoundTripTime;
+    stats -> lastRoundTripTime = peer -> lastRoundTripTime;
+    stats -> packetLoss = peer -> packetLoss;
+    stats -> packetLossVariance = peer -> packetLossVariance;
+    stats -> packetThrottle = peer -> packetThrottle;
+    stats -> packetThrottleLimit = peer -> packetThrottleLimit;
+    stats -> packetsSent = peer -> packetsSent;
+    stats -> packetsLost = peer -> packetsLost;
+    stats -> packetsRetransmitted = peer -> packetsRetransmitted;
+    stats -> reliableDataInTransit = peer -> reliableDataInTransit;
+    stats -> windowSize = peer -> windowSize;
+    stats -> mtu = peer -> mtu;
+    stats -> incomingBandwidth = peer -> incomingBandwidth;
+    stats -> outgoingBandwidth = peer -> outgoingBandwidth;
+    stats -> incomingDataTotal = peer -> incomingDataTotal;
+    stats -> outgoingDataTotal = peer -> outgoingDataTotal;
+
+    stats -> acknowledgements = enet_list_size (& peer -> acknowledgements);
+    stats -> outgoingReliableCommands = enet_list_size (& peer -> outgoingReliableCommands);
+    stats -> outgoingUnreliableCommands = enet_list_size (& peer -> outgoingUnreliableCommands);
+    stats -> sentReliableCommands = enet_list_size (& peer -> sentReliableCommands);
+    stats -> dispatchedCommands = enet_list_size (& peer -> dispatchedCommands);
+    stats -> incomingReliableCommands = 0;
+    stats -> incomingUnreliableCommands = 0;
+    stats -> incomingFragmentedPackets = 0;
+
+    if (peer -> channels != NULL)
+    {
+        for (channel = peer -> channels;
+             channel < & peer -> channels [peer -> channelCount];
+             ++ channel)
+        {
+            stats -> incomingReliableCommands += enet_list_size (& channel -> incomingReliableCommands);
+            stats -> incomingUnreliableCommands += enet_list_size (& channel -> incomingUnreliableCommands);
+            stats -> incomingFragmentedPackets += enet_peer_count_fragmented_packets (& channel -> incomingReliableCommands, NULL) +
+                                                  enet_peer_count_fragmented_packets (& channel -> incomingUnreliableCommands, NULL);
+        }
+    }
+
+    memcpy (stats -> roundTripTimeHistogram, peer -> roundTripTimeHistogram, sizeof (stats -> roundTripTimeHistogram));
+    memcpy (stats -> sendLatencyHistogram, peer -> sendLatencyHistogram, sizeof (stats -> sendLatencyHistogram));
+}
+
+/** Fills in a snapshot of the sequencing and reassembly state of one of a peer's channels.
+    @param peer peer to query
+    @param channelID channel to query
+    @param stats receives the snapshot
+    @retval 0 on success
+    @retval < 0 if the channel does not exist
+*/
+int
+enet_peer_get_channel_stats (ENetPeer * peer, size_t channelID, ENetChannelStats * stats)
+{
+    ENetChannel * channel;
+
+    if (peer -> channels == NULL || channelID >= peer -> channelCount)
+      return -1;
+
+    channel = & peer -> channels [channelID];
+
+    stats -> outgoingReliableSequenceNumber = channel -> outgoingReliableSequenceNumber;
+    stats -> outgoingUnreliableSequenceNumber = channel -> outgoingUnreliableSequenceNumber;
+    stats -> incomingReliableSequenceNumber = channel -> incomingReliableSequenceNumber;
+    stats -> incomingUnreliableSequenceNumber = channel -> incomingUnreliableSequenceNumber;
+    stats -> usedReliableWindows = channel -> usedReliableWindows;
+    stats -> incomingReliableCommands = enet_list_size (& channel -> incomingReliableCommands);
+    stats -> incomingUnreliableCommands = enet_list_size (& channel -> incomingUnreliableCommands);
+    stats -> incomingFragmentBytes = 0;
+    stats -> incomingFragmentedPackets = enet_peer_count_fragmented_packets (& channel -> incomingReliableCommands, & stats -> incomingFragmentBytes) +
+                                         enet_peer_count_fragmented_packets (& channel -> incomingUnreliableCommands, & stats -> incomingFragmentBytes);
+
+    return 0;
+}
+
+/** Clears a peer's round trip time and send latency histograms and its retransmission count. */
+void
+enet_peer_reset_stats (ENetPeer * peer)
+{
+    peer -> packetsRetransmitted = 0;
+
+    memset (peer -> roundTripTimeHistogram, 0, sizeof (peer -> roundTripTimeHistogram));
+    memset (peer -> sendLatencyHistogram, 0, sizeof (peer -> sendLatencyHistogram));
+}
+
 /** Sends a ping request to a peer.
     @param peer destination for the ping request
     @remarks ping requests factor into the mean round trip time as designated by the 
@@ -455,6 +636,8 @@ void
 enet_peer_ping_interval (ENetPeer * peer, enet_uint32 pingInterval)
 {
     peer -> pingInterval = pingInterval ? pingInterval : ENET_PEER_PING_INTERVAL;
+
+    enet_peer_mark_outgoing (peer);
 }
 
 /** Sets the timeout parameters for a peer.
@@ -596,7 +779,7 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
           return NULL;
     }
 
-    acknowledgement = (ENetAcknowledgement *) enet_malloc (sizeof (ENetAcknowledgement));
+    acknowledgement = (ENetAcknowledgement *) enet_pool_malloc (sizeof (ENetAcknowledgement));
     if (acknowledgement == NULL)
       return NULL;
 
@@ -606,10 +789,24 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
     acknowledgement -> command = * command;
     
     enet_list_insert (enet_list_end (& peer -> acknowledgements), acknowledgement);
+
+    enet_peer_mark_outgoing (peer);
     
     return acknowledgement;
 }
 
+/** Queues a peer to be visited by the next pass of the send loop, if it is not already queued. */
+void
+enet_peer_mark_outgoing (ENetPeer * peer)
+{
+    if (peer -> needsSend)
+      return;
+
+    enet_list_insert (enet_list_end (& peer -> host -> sendQueue), & peer -> sendList);
+
+    peer -> needsSend = 1;
+}
+
 void
 enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
 {
@@ -654,6 +851,7 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
     outgoingCommand -> sentTime = 0;
     outgoingCommand -> roundTripTimeout = 0;
     outgoingCommand -> roundTripTimeoutLimit = 0;
+    outgoingCommand -> queueTime = peer -> host -> serviceTime;
     outgoingCommand -> command.header.reliableSequenceNumber = ENET_HOST_TO_NET_16 (outgoingCommand -> reliableSequenceNumber);
 
     switch (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK)
@@ -674,18 +872,21 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
       enet_list_insert (enet_list_end (& peer -> outgoingReliableCommands), outgoingCommand);
     else
       enet_list_insert (enet_list_end (& peer -> outgoingUnreliableCommands), outgoingCommand);
+
+    enet_peer_mark_outgoing (peer);
 }
 
 ENetOutgoingCommand *
 enet_peer_queue_outgoing_command (ENetPeer * peer, const ENetProtocol * command, ENetPacket * packet, enet_uint32 offset, enet_uint16 length)
 {
-    ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
+    ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) enet_pool_malloc (sizeof (ENetOutgoingCommand));
     if (outgoingCommand == NULL)
       return NULL;
 
     outgoingCommand -> command = * command;
     outgoingCommand -> fragmentOffset = offset;
     outgoingCommand -> fragmentLength = length;
+    outgoingCommand -> fragmentHeader = NULL;
     outgoingCommand -> packet = packet;
     if (packet != NULL)
       ++ packet -> referenceCount;
@@ -926,7 +1127,11 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
        goto freePacket;
     }
 
-    incomingCommand = (ENetIncomingCommand *) enet_malloc (sizeof (ENetIncomingCommand));
+    if (fragmentCount > ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
+      goto notifyError;
+
+    /* the fragment bitmap lives directly behind the command so reassembly costs one pooled block */
+    incomingCommand = (ENetIncomingCommand *) enet_pool_malloc (sizeof (ENetIncomingCommand) + (fragmentCount + 31) / 32 * sizeof (enet_uint32));
     if (incomingCommand == NULL)
       goto notifyError;
 
@@ -940,14 +1145,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     
     if (fragmentCount > 0)
     { 
-       if (fragmentCount <= ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
-         incomingCommand -> fragments = (enet_uint32 *) enet_malloc ((fragmentCount + 31) / 32 * sizeof (enet_uint32));
-       if (incomingCommand -> fragments == NULL)
-       {
-          enet_free (incomingCommand);
-
-          goto notifyError;
-       }
+       incomingCommand -> fragments = (enet_uint32 *) (incomingCommand + 1);
        memset (incomingCommand -> fragments, 0, (fragmentCount + 31) / 32 * sizeof (enet_uint32));
     }
 
@@ -0,0 +1,258 @@
+/**
+ @file pool.c
+ @brief ENet size-classed memory pool
+*/
+#define ENET_BUILDING_LIB 1
+#include <string.h>
+#include "enet/enet.h"
+
+/** @defgroup pool ENet memory pool
+    @ingroup private
+
+    Packets, packet data, acknowledgements and incoming/outgoing commands are
+    allocated and freed at a very high rate under load.  Rather than going to
+    enet_malloc() for each of them, blocks are rounded up to a power-of-two
+    size class and recycled through per-class freelists.  Every block carries
+    a small header recording its size class so enet_pool_free() does not need
+    to be told the size.  Freelists are kept per thread so that hosts serviced
+    on different threads never contend on them; a block freed on a thread other
+    than the one that allocated it simply migrates to the freeing thread's list.
+
+    Live blocks can't be counted per thread, since the thread freeing a block
+    is often not the one that allocated it.  Each thread instead keeps a signed
+    count of its allocations minus its frees in a record that outlives it, and
+    the live block count is the sum of all the records.
+    @{
+*/
+
+/** Header of a block. A cached block's size class is the one of its freelist,
+    so the header only needs one of the fields at a time, and stays small
+    enough for an ENetOutgoingCommand to fit the 128 byte size class.
+*/
+typedef union _ENetPoolBlock
+{
+   union _ENetPoolBlock * next;   /**< next cached block, while in a freelist */
+   size_t sizeClass;              /**< size class, while in use */
+   double alignment;              /**< keeps blocks aligned for any ENet structure */
+} ENetPoolBlock;
+
+typedef struct _ENetPoolClass
+{
+   ENetPoolBlock * freeList;
+   size_t          cachedBlocks;
+} ENetPoolClass;
+
+typedef struct _ENetPoolThread
+{
+   struct _ENetPoolThread * next;
+   long liveBlocks;      /**< blocks allocated minus blocks freed by the thread, negative if it freed other threads' blocks */
+} ENetPoolThread;
+
+static ENET_THREAD_LOCAL ENetPoolClass poolClasses [ENET_POOL_SIZE_CLASSES];
+static ENET_THREAD_LOCAL ENetPoolStats poolStats;
+static ENET_THREAD_LOCAL ENetPoolThread * poolThread;
+
+/** Records of every thread that used the pool, never freed */
+static ENetPoolThread * poolThreads;
+
+static ENetPoolThread *
+enet_pool_thread (void)
+{
+    ENetPoolThread * thread = poolThread;
+
+    if (thread != NULL)
+      return thread;
+
+    thread = (ENetPoolThread *) enet_malloc (sizeof (ENetPoolThread));
+    if (thread == NULL)
+      return NULL;
+
+    thread -> liveBlocks = 0;
+
+    do
+      thread -> next = ENET_ATOMIC_LOAD (& poolThreads);
+    while (! ENET_ATOMIC_COMPARE_EXCHANGE (& poolThreads, thread -> next, thread));
+
+    poolThread = thread;
+    return thread;
+}
+
+/** Adds to the calling thread's live block count. Only the thread writes its
+    record, but enet_pool_get_stats() reads it from any thread.
+*/
+static void
+enet_pool_count_live (long change)
+{
+    ENetPoolThread * thread = enet_pool_thread ();
+
+    /* Without a record, after enet_malloc() failed, the block goes uncounted. */
+    if (thread != NULL)
+      ENET_ATOMIC_STORE (& thread -> liveBlocks, thread -> liveBlocks + change);
+}
+
+static size_t
+enet_pool_size_class (size_t size)
+{
+    size_t sizeClass = 0,
+           classSize = ENET_POOL_MINIMUM_BLOCK_SIZE;
+
+    size += sizeof (ENetPoolBlock);
+
+    while (classSize < size)
+    {
+        if (++ sizeClass >= ENET_POOL_SIZE_CLASSES)
+          return ENET_POOL_SIZE_CLASSES;
+
+        classSize <<= 1;
+    }
+
+    return sizeClass;
+}
+
+#define ENET_POOL_CLASS_SIZE(sizeClass) ((size_t) ENET_POOL_MINIMUM_BLOCK_SIZE << (sizeClass))
+
+void *
+enet_pool_default_malloc (size_t size)
+{
+    size_t sizeClass = enet_pool_size_class (size);
+    ENetPoolBlock * block;
+
+    if (sizeClass >= ENET_POOL_SIZE_CLASSES)
+    {
+        block = (ENetPoolBlock *) enet_malloc (sizeof (ENetPoolBlock) + size);
+        if (block == NULL)
+          return NULL;
+
+        ++ poolStats.oversized;
+    }
+    else
+    {
+        ENetPoolClass * poolClass = & poolClasses [sizeClass];
+
+        block = poolClass -> freeList;
+        if (block != NULL)
+        {
+            poolClass -> freeList = block -> next;
+            -- poolClass -> cachedBlocks;
+
+            -- poolStats.cachedBlocks;
+            poolStats.cachedBytes -= ENET_POOL_CLASS_SIZE (sizeClass);
+            ++ poolStats.hits;
+        }
+        else
+        {
+            block = (ENetPoolBlock *) enet_malloc (ENET_POOL_CLASS_SIZE (sizeClass));
+            if (block == NULL)
+              return NULL;
+
+            ++ poolStats.misses;
+        }
+    }
+
+    block -> sizeClass = sizeClass;
+
+    ++ poolStats.allocations;
+    enet_pool_count_live (1);
+
+    return block + 1;
+}
+
+void
+enet_pool_default_free (void * memory)
+{
+    ENetPoolBlock * block;
+    ENetPoolClass * poolClass;
+    size_t sizeClass;
+
+    if (memory == NULL)
+      return;
+
+    block = (ENetPoolBlock *) memory - 1;
+    sizeClass = block -> sizeClass;
+
+    ++ poolStats.frees;
+    enet_pool_count_live (-1);
+
+    if (sizeClass >= ENET_POOL_SIZE_CLASSES)
+    {
+        enet_free (block);
+        return;
+    }
+
+    poolClass = & poolClasses [sizeClass];
+    if ((poolClass -> cachedBlocks + 1) * ENET_POOL_CLASS_SIZE (sizeClass) > ENET_POOL_MAXIMUM_CACHED_BYTES)
+    {
+        enet_free (block);
+        return;
+    }
+
+    block -> next = poolClass -> freeList;
+    poolClass -> freeList = block;
+    ++ poolClass -> cachedBlocks;
+
+    ++ poolStats.cachedBlocks;
+    poolStats.cachedBytes += ENET_POOL_CLASS_SIZE (sizeClass);
+}
+
+/** Releases every block cached in the calling thread's freelists back to enet_free().
+    @remarks Threads that service hosts should call this before exiting, since
+    their cached blocks are otherwise unreachable.
+*/
+void
+enet_pool_trim (void)
+{
+    size_t sizeClass;
+
+    for (sizeClass = 0; sizeClass < ENET_POOL_SIZE_CLASSES; ++ sizeClass)
+    {
+        ENetPoolClass * poolClass = & poolClasses [sizeClass];
+
+        while (poolClass -> freeList != NULL)
+        {
+            ENetPoolBlock * block = poolClass -> freeList;
+
+            poolClass -> freeList = block -> next;
+
+            enet_free (block);
+        }
+
+        poolClass -> cachedBlocks = 0;
+    }
+
+    poolStats.cachedBlocks = 0;
+    poolStats.cachedBytes = 0;
+}
+
+/** Retrieves the allocation statistics of the calling thread's pool.
+    @param stats structure to fill
+    @remarks Only the built-in pool keeps statistics; if a pool_malloc callback
+    was supplied to enet_initialize_with_callbacks() the counters stay at zero.
+    The live block count is the only one which covers every thread.
+*/
+void
+enet_pool_get_stats (ENetPoolStats * stats)
+{
+    ENetPoolThread * thread;
+    long liveBlocks = 0;
+
+    * stats = poolStats;
+
+    for (thread = ENET_ATOMIC_LOAD (& poolThreads); thread != NULL; thread = thread -> next)
+      liveBlocks += ENET_ATOMIC_LOAD (& thread -> liveBlocks);
+
+    /* Counts of different threads are read at slightly different times. */
+    stats -> liveBlocks = liveBlocks > 0 ? (size_t) liveBlocks : 0;
+}
+
+/** Resets the cumulative counters of the calling thread's pool statistics. */
+void
+enet_pool_reset_stats (void)
+{
+    poolStats.allocations = 0;
+    poolStats.frees = 0;
+    poolStats.hits = 0;
+    poolStats.misses = 0;
+    poolStats.oversized = 0;
+}
+
+/** @} */
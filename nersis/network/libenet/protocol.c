@@ -23,7 +23,9 @@ static size_t commandSizes [ENET_PROTOCOL_COMMAND_COUNT] =
     sizeof (ENetProtocolSendUnsequenced),
     sizeof (ENetProtocolBandwidthLimit),
     sizeof (ENetProtocolThrottleConfigure),
-    sizeof (ENetProtocolSendFragment)
+    sizeof (ENetProtocolSendFragment),
+    sizeof (ENetProtocolConnectChallenge),
+    sizeof (ENetProtocolConnectCookie)
 };
 
 size_t
@@ -92,6 +94,16 @@ enet_protocol_dispatch_incoming_commands (ENetHost * host, ENetEvent * event)
            if (enet_list_empty (& peer -> dispatchedCommands))
              continue;
 
+           {
+              ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) enet_list_front (& peer -> dispatchedCommands);
+
+              if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_FRAGMENT &&
+                  incomingCommand -> fragmentCount == 0)
+                event -> data = ENET_NET_TO_HOST_32 (incomingCommand -> command.sendFragment.totalLength);
+              else
+                event -> data = 0;
+           }
+
            event -> packet = enet_peer_receive (peer, & event -> channelID);
            if (event -> packet == NULL)
              continue;
@@ -181,10 +193,26 @@ enet_protocol_remove_sent_unreliable_commands (ENetPeer * peer)
            }
         }
 
-        enet_free (outgoingCommand);
+        enet_pool_free (outgoingCommand);
     }
 }
 
+/** Copies the header of a fragment command from its packet's fragment layout */
+static void
+enet_protocol_fill_fragment (ENetProtocol * command, const ENetOutgoingCommand * outgoingCommand)
+{
+    const ENetProtocolSendFragment * fragment = outgoingCommand -> fragmentHeader;
+
+    if (fragment == NULL)
+      return;
+
+    command -> sendFragment.dataLength = fragment -> dataLength;
+    command -> sendFragment.fragmentCount = fragment -> fragmentCount;
+    command -> sendFragment.fragmentNumber = fragment -> fragmentNumber;
+    command -> sendFragment.totalLength = fragment -> totalLength;
+    command -> sendFragment.fragmentOffset = fragment -> fragmentOffset;
+}
+
 static ENetProtocolCommand
 enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliableSequenceNumber, enet_uint8 channelID)
 {
@@ -259,10 +287,14 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
        }
     }
 
-    enet_free (outgoingCommand);
+    enet_pool_free (outgoingCommand);
 
     if (enet_list_empty (& peer -> sentReliableCommands))
-      return commandNumber;
+    {
+       enet_host_schedule_peer (peer -> host, peer, peer -> lastReceiveTime + peer -> pingInterval);
+
+       return commandNumber;
+    }
     
     outgoingCommand = (ENetOutgoingCommand *) enet_list_front (& peer -> sentReliableCommands);
     
@@ -537,6 +569,7 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
            totalLength;
     ENetChannel * channel;
     enet_uint16 startWindow, currentWindow;
+    int streamed;
     ENetListIterator currentCommand;
     ENetIncomingCommand * startCommand = NULL;
 
@@ -552,7 +585,13 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
       return -1;
 
     channel = & peer -> channels [command -> header.channelID];
-    startSequenceNumber = ENET_NET_TO_HOST_16 (command -> sendFragment.startSequenceNumber);
+    streamed = host -> streamedChannels [command -> header.channelID / 32] & (1u << (command -> header.channelID % 32));
+
+    /* a streamed fragment is delivered on its own reliable sequence number rather than its message's */
+    if (streamed)
+      startSequenceNumber = command -> header.reliableSequenceNumber;
+    else
+      startSequenceNumber = ENET_NET_TO_HOST_16 (command -> sendFragment.startSequenceNumber);
     startWindow = startSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
     currentWindow = channel -> incomingReliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
 
@@ -573,6 +612,19 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
         fragmentOffset >= totalLength ||
         fragmentLength > totalLength - fragmentOffset)
       return -1;
+
+    if (streamed)
+    {
+       ENetPacket * packet = enet_packet_create ((const enet_uint8 *) command + sizeof (ENetProtocolSendFragment),
+                                                 fragmentLength,
+                                                 ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_STREAM_CHUNK |
+                                                   (fragmentNumber == fragmentCount - 1 ? ENET_PACKET_FLAG_STREAM_END : 0));
+       if (packet == NULL ||
+           enet_peer_queue_incoming_command (peer, command, packet, 0) == NULL)
+         return -1;
+
+       return 0;
+    }
  
     for (currentCommand = enet_list_previous (enet_list_end (& channel -> incomingReliableCommands));
          currentCommand != enet_list_end (& channel -> incomingReliableCommands);
@@ -867,6 +919,8 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
 
     enet_peer_throttle (peer, roundTripTime);
 
+    enet_peer_sample_round_trip_time (peer, roundTripTime);
+
     peer -> roundTripTimeVariance -= peer -> roundTripTimeVariance / 4;
 
     if (roundTripTime >= peer -> roundTripTime)
@@ -930,6 +984,61 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
     return 0;
 }
 
+static int
+enet_protocol_handle_connect_challenge (ENetHost * host, ENetPeer * peer, const ENetProtocol * command)
+{
+    ENetOutgoingCommand * outgoingCommand = NULL;
+    ENetListIterator currentCommand;
+    ENetList * lists [2];
+    int listIndex;
+
+    if (peer -> state != ENET_PEER_STATE_CONNECTING ||
+        command -> connectChallenge.connectID != peer -> connectID)
+      return 0;
+
+    /* the connect is either awaiting retransmission or still queued */
+    lists [0] = & peer -> sentReliableCommands;
+    lists [1] = & peer -> outgoingReliableCommands;
+
+    for (listIndex = 0; listIndex < 2 && outgoingCommand == NULL; ++ listIndex)
+    {
+       for (currentCommand = enet_list_begin (lists [listIndex]);
+            currentCommand != enet_list_end (lists [listIndex]);
+            currentCommand = enet_list_next (currentCommand))
+       {
+          ENetOutgoingCommand * candidate = (ENetOutgoingCommand *) currentCommand;
+
+          switch (candidate -> command.header.command & ENET_PROTOCOL_COMMAND_MASK)
+          {
+          case ENET_PROTOCOL_COMMAND_CONNECT:
+          case ENET_PROTOCOL_COMMAND_CONNECT_COOKIE:
+             outgoingCommand = candidate;
+             break;
+
+          default:
+             continue;
+          }
+
+          break;
+       }
+    }
+
+    if (outgoingCommand == NULL)
+      return 0;
+
+    outgoingCommand -> command.header.command = ENET_PROTOCOL_COMMAND_CONNECT_COOKIE | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+    memcpy (outgoingCommand -> command.connectCookie.cookie, command -> connectChallenge.cookie, ENET_PROTOCOL_COOKIE_SIZE);
+
+    /* answer right away rather than at the connect's next timeout */
+    enet_list_insert (enet_list_begin (& peer -> outgoingReliableCommands), enet_list_remove (& outgoingCommand -> outgoingCommandList));
+
+    peer -> lastReceiveTime = host -> serviceTime;
+
+    enet_peer_mark_outgoing (peer);
+
+    return 0;
+}
+
 static int
 enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
 {
@@ -1018,7 +1127,12 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
       headerSize += sizeof (enet_uint32);
 
     if (peerID == ENET_PROTOCOL_MAXIMUM_PEER_ID)
-      peer = NULL;
+    {
+       if (! enet_host_admit (host))
+         return 0;
+
+       peer = NULL;
+    }
     else
     if (peerID >= host -> peerCount)
       return 0;
@@ -1099,7 +1213,7 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
 
        currentData += commandSize;
 
-       if (peer == NULL && commandNumber != ENET_PROTOCOL_COMMAND_CONNECT)
+       if (peer == NULL && commandNumber != ENET_PROTOCOL_COMMAND_CONNECT && commandNumber != ENET_PROTOCOL_COMMAND_CONNECT_COOKIE)
          break;
          
        command -> header.reliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> header.reliableSequenceNumber);
@@ -1112,7 +1226,8 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
           break;
 
        case ENET_PROTOCOL_COMMAND_CONNECT:
-          if (peer != NULL)
+       case ENET_PROTOCOL_COMMAND_CONNECT_COOKIE:
+          if (peer != NULL || ! enet_host_check_cookie (host, command))
             goto commandError;
           peer = enet_protocol_handle_connect (host, header, command);
           if (peer == NULL)
@@ -1124,6 +1239,11 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
             goto commandError;
           break;
 
+       case ENET_PROTOCOL_COMMAND_CONNECT_CHALLENGE:
+          if (enet_protocol_handle_connect_challenge (host, peer, command))
+            goto commandError;
+          break;
+
        case ENET_PROTOCOL_COMMAND_DISCONNECT:
           if (enet_protocol_handle_disconnect (host, peer, command))
             goto commandError;
@@ -1221,10 +1341,16 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
        buffer.data = host -> packetData [0];
        buffer.dataLength = sizeof (host -> packetData [0]);
 
-       receivedLength = enet_socket_receive (host -> socket,
-                                             & host -> receivedAddress,
-                                             & buffer,
-                                             1);
+       if (host -> transport.receive != NULL)
+         receivedLength = (* host -> transport.receive) (host -> transport.context,
+                                                          & host -> receivedAddress,
+                                                          & buffer,
+                                                          1);
+       else
+         receivedLength = enet_socket_receive (host -> socket,
+                                               & host -> receivedAddress,
+                                               & buffer,
+                                               1);
 
        if (receivedLength < 0)
          return -1;
@@ -1315,7 +1441,7 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
          enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
 
        enet_list_remove (& acknowledgement -> acknowledgementList);
-       enet_free (acknowledgement);
+       enet_pool_free (acknowledgement);
 
        ++ command;
        ++ buffer;
@@ -1372,7 +1498,7 @@ enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * pee
                   enet_packet_destroy (outgoingCommand -> packet);
          
                 enet_list_remove (& outgoingCommand -> outgoingCommandList);
-                enet_free (outgoingCommand);
+                enet_pool_free (outgoingCommand);
 
                 if (currentCommand == enet_list_end (& peer -> outgoingUnreliableCommands))
                   break;
@@ -1395,6 +1521,9 @@ enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * pee
        host -> packetSize += buffer -> dataLength;
 
        * command = outgoingCommand -> command;
+       enet_protocol_fill_fragment (command, outgoingCommand);
+
+       enet_peer_sample_send_latency (peer, ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> queueTime));
        
        enet_list_remove (& outgoingCommand -> outgoingCommandList);
 
@@ -1410,7 +1539,7 @@ enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * pee
           enet_list_insert (enet_list_end (& peer -> sentUnreliableCommands), outgoingCommand);
        }
        else
-         enet_free (outgoingCommand);
+         enet_pool_free (outgoingCommand);
 
        ++ command;
        ++ buffer;
@@ -1462,6 +1591,7 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
          peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
           
        ++ peer -> packetsLost;
+       ++ peer -> packetsRetransmitted;
 
        outgoingCommand -> roundTripTimeout *= 2;
 
@@ -1555,6 +1685,9 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
           ++ channel -> reliableWindows [reliableWindow];
        }
 
+       if (outgoingCommand -> sendAttempts < 1)
+         enet_peer_sample_send_latency (peer, ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> queueTime));
+
        ++ outgoingCommand -> sendAttempts;
  
        if (outgoingCommand -> roundTripTimeout == 0)
@@ -1578,6 +1711,7 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
        host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_SENT_TIME;
 
        * command = outgoingCommand -> command;
+       enet_protocol_fill_fragment (command, outgoingCommand);
 
        if (outgoingCommand -> packet != NULL)
        {
@@ -1603,6 +1737,54 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
     return canPing;
 }
 
+static void
+enet_protocol_begin_outgoing_round (ENetHost * host)
+{
+    ENetListIterator currentNode;
+
+    if (enet_list_empty (& host -> sendQueue))
+      return;
+
+    currentNode = enet_list_end (& host -> visitQueue);
+
+    enet_list_move (currentNode, enet_list_begin (& host -> sendQueue), enet_list_back (& host -> sendQueue));
+}
+
+static ENetPeer *
+enet_protocol_next_outgoing_peer (ENetHost * host)
+{
+    ENetPeer * peer;
+
+    if (enet_list_empty (& host -> visitQueue))
+      return NULL;
+
+    peer = enet_list_entry (enet_list_remove (enet_list_begin (& host -> visitQueue)), ENetPeer, sendList);
+    peer -> needsSend = 0;
+
+    return peer;
+}
+
+static void
+enet_protocol_finish_outgoing_peer (ENetHost * host, ENetPeer * peer)
+{
+    if (peer -> state == ENET_PEER_STATE_DISCONNECTED ||
+        peer -> state == ENET_PEER_STATE_ZOMBIE)
+    {
+        enet_host_unschedule_peer (host, peer);
+        return;
+    }
+
+    if (! enet_list_empty (& peer -> acknowledgements) ||
+        ! enet_list_empty (& peer -> outgoingReliableCommands) ||
+        ! enet_list_empty (& peer -> outgoingUnreliableCommands))
+      enet_peer_mark_outgoing (peer);
+
+    if (! enet_list_empty (& peer -> sentReliableCommands))
+      enet_host_schedule_peer (host, peer, peer -> nextTimeout);
+    else
+      enet_host_schedule_peer (host, peer, peer -> lastReceiveTime + peer -> pingInterval);
+}
+
 static int
 enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
 {
@@ -1611,14 +1793,18 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
     ENetPeer * currentPeer;
     int sentLength;
     size_t shouldCompress = 0;
+
+    enet_host_expire_timers (host, host -> serviceTime);
  
     host -> continueSending = 1;
 
     while (host -> continueSending)
     for (host -> continueSending = 0,
-           currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+           enet_protocol_begin_outgoing_round (host),
+           currentPeer = enet_protocol_next_outgoing_peer (host);
+         currentPeer != NULL;
+         enet_protocol_finish_outgoing_peer (host, currentPeer),
+           currentPeer = enet_protocol_next_outgoing_peer (host))
     {
         if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED ||
             currentPeer -> state == ENET_PEER_STATE_ZOMBIE)
@@ -1638,7 +1824,10 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
             enet_protocol_check_timeouts (host, currentPeer, event) == 1)
         {
             if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
-              return 1;
+            {
+                enet_protocol_finish_outgoing_peer (host, currentPeer);
+                return 1;
+            }
             else
               continue;
         }
@@ -1738,12 +1927,18 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
 
         currentPeer -> lastSendTime = host -> serviceTime;
 
-        sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
+        if (host -> transport.send != NULL)
+          sentLength = (* host -> transport.send) (host -> transport.context, & currentPeer -> address, host -> buffers, host -> bufferCount);
+        else
+          sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
 
         enet_protocol_remove_sent_unreliable_commands (currentPeer);
 
         if (sentLength < 0)
-          return -1;
+        {
+            enet_protocol_finish_outgoing_peer (host, currentPeer);
+            return -1;
+        }
 
         host -> totalSentData += sentLength;
         host -> totalSentPackets ++;
@@ -1803,7 +1998,7 @@ enet_host_check_events (ENetHost * host, ENetEvent * event)
 int
 enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
 {
-    enet_uint32 waitCondition;
+    enet_uint32 waitCondition, waitTime, deadline;
 
     if (event != NULL)
     {
@@ -1912,14 +2107,47 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
             return 0;
 
           waitCondition = ENET_SOCKET_WAIT_RECEIVE | ENET_SOCKET_WAIT_INTERRUPT;
+          waitTime = ENET_TIME_DIFFERENCE (timeout, host -> serviceTime);
+
+          if (enet_host_next_timer (host, & deadline))
+          {
+             if (! ENET_TIME_GREATER (deadline, host -> serviceTime))
+               waitTime = 0;
+             else
+             if (ENET_TIME_DIFFERENCE (deadline, host -> serviceTime) < waitTime)
+               waitTime = ENET_TIME_DIFFERENCE (deadline, host -> serviceTime);
+          }
+
+          if (host -> connectedPeers > 0)
+          {
+             deadline = host -> bandwidthThrottleEpoch + ENET_HOST_BANDWIDTH_THROTTLE_INTERVAL;
+
+             if (! ENET_TIME_GREATER (deadline, host -> serviceTime))
+               waitTime = 0;
+             else
+             if (ENET_TIME_DIFFERENCE (deadline, host -> serviceTime) < waitTime)
+               waitTime = ENET_TIME_DIFFERENCE (deadline, host -> serviceTime);
+          }
 
-          if (enet_socket_wait (host -> socket, & waitCondition, ENET_TIME_DIFFERENCE (timeout, host -> serviceTime)) != 0)
+          if (waitTime == 0)
+          {
+             waitCondition = ENET_SOCKET_WAIT_NONE;
+             break;
+          }
+
+          if (host -> transport.wait != NULL)
+          {
+             if ((* host -> transport.wait) (host -> transport.context, & waitCondition, waitTime) != 0)
+               return -1;
+          }
+          else
+          if (enet_socket_wait (host -> socket, & waitCondition, waitTime) != 0)
             return -1;
        }
        while (waitCondition & ENET_SOCKET_WAIT_INTERRUPT);
 
        host -> serviceTime = enet_time_get ();
-    } while (waitCondition & ENET_SOCKET_WAIT_RECEIVE);
+    } while ((waitCondition & ENET_SOCKET_WAIT_RECEIVE) || ENET_TIME_LESS (host -> serviceTime, timeout));
 
     return 0; 
 }
@@ -0,0 +1,424 @@
+/**
+ @file  shard.c
+ @brief ENet sharded multi-threaded host
+*/
+#define ENET_BUILDING_LIB 1
+#include <string.h>
+#include "enet/enet.h"
+
+/** @defgroup shard ENet sharded host functions
+
+    Each shard is an ordinary ENetHost serviced by its own thread.  The
+    shards' sockets are bound to the same address with SO_REUSEPORT, so
+    the kernel hashes every client's datagrams to one socket and a
+    connection never moves between shards.  Nothing inside a shard is
+    shared: the only cross-thread traffic is the event queue drained by the
+    consumer and each shard's command queue, both lock-free.
+    @{
+*/
+
+typedef enum _ENetShardCommandType
+{
+   ENET_SHARD_COMMAND_SEND       = 0,
+   ENET_SHARD_COMMAND_DISCONNECT = 1,
+   ENET_SHARD_COMMAND_BROADCAST  = 2
+} ENetShardCommandType;
+
+typedef struct _ENetShardCommand
+{
+   ENetAtomicQueueNode  queueNode;
+   ENetShardCommandType type;
+   ENetPeer *           peer;
+   enet_uint32          connectID;
+   enet_uint8           channelID;
+   enet_uint32          data;
+   ENetPacket *         packet;
+} ENetShardCommand;
+
+static int
+enet_shard_bind (ENetHost * host, const ENetAddress * address, int reusePort)
+{
+    ENetSocket socket = enet_socket_create (ENET_SOCKET_TYPE_DATAGRAM);
+    if (socket == ENET_SOCKET_NULL)
+      return -1;
+
+    if ((reusePort && enet_socket_set_option (socket, ENET_SOCKOPT_REUSEPORT, 1) < 0) ||
+        enet_socket_bind (socket, address) < 0)
+    {
+        enet_socket_destroy (socket);
+
+        return -1;
+    }
+
+    enet_socket_set_option (socket, ENET_SOCKOPT_NONBLOCK, 1);
+    enet_socket_set_option (socket, ENET_SOCKOPT_BROADCAST, 1);
+    enet_socket_set_option (socket, ENET_SOCKOPT_RCVBUF, ENET_HOST_RECEIVE_BUFFER_SIZE);
+    enet_socket_set_option (socket, ENET_SOCKOPT_SNDBUF, ENET_HOST_SEND_BUFFER_SIZE);
+
+    if (host -> socket != ENET_SOCKET_NULL)
+      enet_socket_destroy (host -> socket);
+    host -> socket = socket;
+
+    if (enet_socket_get_address (socket, & host -> address) < 0)
+      host -> address = * address;
+
+    return 0;
+}
+
+static void
+enet_shard_push_event (ENetShard * shard, const ENetEvent * event)
+{
+    ENetShardEvent * shardEvent;
+    enet_uint32 connectID = shard -> connectIDs [event -> peer -> incomingPeerID];
+
+    if (event -> type == ENET_EVENT_TYPE_CONNECT)
+      shard -> connectIDs [event -> peer -> incomingPeerID] = connectID = event -> peer -> connectID;
+    else
+    if (event -> type == ENET_EVENT_TYPE_DISCONNECT)
+      shard -> connectIDs [event -> peer -> incomingPeerID] = 0;
+
+    shardEvent = (ENetShardEvent *) enet_pool_malloc (sizeof (ENetShardEvent));
+    if (shardEvent == NULL)
+    {
+        if (event -> packet != NULL)
+          enet_packet_destroy (event -> packet);
+
+        return;
+    }
+
+    shardEvent -> type = event -> type;
+    shardEvent -> shard = shard -> index;
+    shardEvent -> peer = event -> peer;
+    shardEvent -> connectID = connectID;
+    shardEvent -> channelID = event -> channelID;
+    shardEvent -> data = event -> data;
+    shardEvent -> packet = event -> packet;
+
+    enet_atomic_queue_push (& shard -> shardedHost -> events, shardEvent);
+}
+
+static void
+enet_shard_dispatch_commands (ENetShard * shard)
+{
+    ENetShardCommand * command;
+
+    while ((command = (ENetShardCommand *) enet_atomic_queue_pop (& shard -> commands)) != NULL)
+    {
+        ENetPeer * peer = command -> peer;
+        int live = peer != NULL &&
+                   shard -> connectIDs [peer -> incomingPeerID] == command -> connectID &&
+                   peer -> state == ENET_PEER_STATE_CONNECTED;
+
+        switch (command -> type)
+        {
+        case ENET_SHARD_COMMAND_SEND:
+            if (! live || enet_peer_send (peer, command -> channelID, command -> packet) < 0)
+            {
+                if (command -> packet -> referenceCount == 0)
+                  enet_packet_destroy (command -> packet);
+            }
+            break;
+
+        case ENET_SHARD_COMMAND_DISCONNECT:
+            if (live)
+              enet_peer_disconnect (peer, command -> data);
+            break;
+
+        case ENET_SHARD_COMMAND_BROADCAST:
+            enet_host_broadcast (shard -> host, command -> channelID, command -> packet);
+            break;
+        }
+
+        enet_pool_free (command);
+    }
+}
+
+static void ENET_CALLBACK
+enet_shard_run (void * data)
+{
+    ENetShard * shard = (ENetShard *) data;
+    ENetShardedHost * shardedHost = shard -> shardedHost;
+    ENetEvent event;
+
+    while (ENET_ATOMIC_LOAD (& shardedHost -> running))
+    {
+        int result;
+
+        enet_shard_dispatch_commands (shard);
+
+        result = enet_host_service (shard -> host, & event, shardedHost -> serviceTimeout);
+        while (result > 0)
+        {
+            enet_shard_push_event (shard, & event);
+
+            result = enet_host_check_events (shard -> host, & event);
+        }
+    }
+
+    enet_shard_dispatch_commands (shard);
+    enet_host_flush (shard -> host);
+
+    /* this thread's cached pool blocks would otherwise be unreachable */
+    enet_pool_trim ();
+}
+
+/** Creates a sharded host and starts servicing it.
+    @param address the address at which other peers may connect to this host; unlike enet_host_create(), may not be NULL
+    @param shardCount number of shards, each serviced on its own thread
+    @param peerCount the maximum number of peers of each shard
+    @param channelLimit the maximum number of channels allowed; if 0, then this is equivalent to ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT
+    @param incomingBandwidth downstream bandwidth of each shard in bytes/second; if 0, ENet will assume unlimited bandwidth.
+    @param outgoingBandwidth upstream bandwidth of each shard in bytes/second; if 0, ENet will assume unlimited bandwidth.
+    @returns the sharded host on success and NULL on failure
+    @remarks More than one shard requires SO_REUSEPORT, so on systems without it only a single shard can be created.
+*/
+ENetShardedHost *
+enet_sharded_host_create (const ENetAddress * address, size_t shardCount, size_t peerCount, size_t channelLimit,
+                          enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth)
+{
+    ENetShardedHost * shardedHost;
+    ENetAddress boundAddress = * address;
+    size_t shardIndex;
+
+    if (shardCount <= 0)
+      return NULL;
+
+    shardedHost = (ENetShardedHost *) enet_malloc (sizeof (ENetShardedHost));
+    if (shardedHost == NULL)
+      return NULL;
+
+    memset (shardedHost, 0, sizeof (ENetShardedHost));
+
+    shardedHost -> shards = (ENetShard *) enet_malloc (shardCount * sizeof (ENetShard));
+    if (shardedHost -> shards == NULL)
+    {
+        enet_free (shardedHost);
+
+        return NULL;
+    }
+
+    memset (shardedHost -> shards, 0, shardCount * sizeof (ENetShard));
+
+    shardedHost -> shardCount = shardCount;
+    shardedHost -> running = 1;
+    shardedHost -> serviceTimeout = 1;
+    enet_atomic_queue_clear (& shardedHost -> events);
+
+    for (shardIndex = 0; shardIndex < shardCount; ++ shardIndex)
+    {
+        ENetShard * shard = & shardedHost -> shards [shardIndex];
+
+        shard -> shardedHost = shardedHost;
+        shard -> index = shardIndex;
+        enet_atomic_queue_clear (& shard -> commands);
+
+        shard -> host = enet_host_create (NULL, peerCount, channelLimit, incomingBandwidth, outgoingBandwidth);
+        shard -> connectIDs = (enet_uint32 *) enet_malloc (peerCount * sizeof (enet_uint32));
+        if (shard -> host == NULL || shard -> connectIDs == NULL ||
+            enet_shard_bind (shard -> host, & boundAddress, shardCount > 1) < 0)
+        {
+            enet_sharded_host_destroy (shardedHost);
+
+            return NULL;
+        }
+
+        memset (shard -> connectIDs, 0, peerCount * sizeof (enet_uint32));
+
+        /* an ephemeral port is picked by the first shard and shared by the rest */
+        boundAddress.port = shard -> host -> address.port;
+    }
+
+    for (shardIndex = 0; shardIndex < shardCount; ++ shardIndex)
+    {
+        ENetShard * shard = & shardedHost -> shards [shardIndex];
+
+        if (enet_thread_create (& shard -> thread, enet_shard_run, shard) < 0)
+        {
+            enet_sharded_host_destroy (shardedHost);
+
+            return NULL;
+        }
+
+        shard -> threadStarted = 1;
+    }
+
+    return shardedHost;
+}
+
+/** Stops the shards' threads and destroys the sharded host.
+    @param shardedHost sharded host to destroy
+    @remarks Undelivered events and queued commands are discarded.
+*/
+void
+enet_sharded_host_destroy (ENetShardedHost * shardedHost)
+{
+    ENetShardEvent * event;
+    size_t shardIndex;
+
+    if (shardedHost == NULL)
+      return;
+
+    ENET_ATOMIC_STORE (& shardedHost -> running, 0);
+
+    for (shardIndex = 0; shardIndex < shardedHost -> shardCount; ++ shardIndex)
+    {
+        ENetShard * shard = & shardedHost -> shards [shardIndex];
+        ENetShardCommand * command;
+
+        if (shard -> threadStarted)
+          enet_thread_join (shard -> thread);
+
+        while ((command = (ENetShardCommand *) enet_atomic_queue_pop (& shard -> commands)) != NULL)
+        {
+            if (command -> packet != NULL && command -> packet -> referenceCount == 0)
+              enet_packet_destroy (command -> packet);
+
+            enet_pool_free (command);
+        }
+
+        enet_host_destroy (shard -> host);
+        enet_free (shard -> connectIDs);
+    }
+
+    while ((event = (ENetShardEvent *) enet_atomic_queue_pop (& shardedHost -> events)) != NULL)
+    {
+        if (event -> packet != NULL)
+          enet_packet_destroy (event -> packet);
+
+        enet_pool_free (event);
+    }
+
+    enet_free (shardedHost -> shards);
+    enet_free (shardedHost);
+}
+
+/** Takes the next event delivered by any of the shards.
+    @param shardedHost sharded host to poll
+    @param event an event structure where the event details will be placed
+    @retval > 0 if an event was received
+    @retval 0 if no event is pending
+    @remarks Must only be called from one thread at a time.
+*/
+int
+enet_sharded_host_receive (ENetShardedHost * shardedHost, ENetShardEvent * event)
+{
+    ENetShardEvent * shardEvent = (ENetShardEvent *) enet_atomic_queue_pop (& shardedHost -> events);
+    if (shardEvent == NULL)
+      return 0;
+
+    * event = * shardEvent;
+    event -> queueNode.next = NULL;
+
+    enet_pool_free (shardEvent);
+
+    return 1;
+}
+
+static ENetShard *
+enet_sharded_host_find_shard (ENetShardedHost * shardedHost, ENetPeer * peer)
+{
+    size_t shardIndex;
+
+    for (shardIndex = 0; shardIndex < shardedHost -> shardCount; ++ shardIndex)
+      if (shardedHost -> shards [shardIndex].host == peer -> host)
+        return & shardedHost -> shards [shardIndex];
+
+    return NULL;
+}
+
+static int
+enet_sharded_host_queue_command (ENetShard * shard, ENetShardCommandType type, ENetPeer * peer, enet_uint32 connectID,
+                                 enet_uint8 channelID, enet_uint32 data, ENetPacket * packet)
+{
+    ENetShardCommand * command = (ENetShardCommand *) enet_pool_malloc (sizeof (ENetShardCommand));
+    if (command == NULL)
+      return -1;
+
+    command -> type = type;
+    command -> peer = peer;
+    command -> connectID = connectID;
+    command -> channelID = channelID;
+    command -> data = data;
+    command -> packet = packet;
+
+    enet_atomic_queue_push (& shard -> commands, command);
+
+    return 0;
+}
+
+/** Queues a packet to be sent to a peer of one of the shards.
+    @param shardedHost sharded host the peer belongs to
+    @param peer peer from an ENetShardEvent
+    @param connectID connectID from the same event; the packet is dropped if the peer has since reconnected
+    @param channelID channel on which to send
+    @param packet packet to send; ownership passes to the shard, so it must not be used afterwards
+    @retval 0 on success
+    @retval < 0 on failure, in which case the packet is left to the caller
+    @remarks May be called from any thread.
+*/
+int
+enet_sharded_host_send (ENetShardedHost * shardedHost, ENetPeer * peer, enet_uint32 connectID, enet_uint8 channelID, ENetPacket * packet)
+{
+    ENetShard * shard = enet_sharded_host_find_shard (shardedHost, peer);
+    if (shard == NULL)
+      return -1;
+
+    return enet_sharded_host_queue_command (shard, ENET_SHARD_COMMAND_SEND, peer, connectID, channelID, 0, packet);
+}
+
+/** Queues a disconnection request for a peer of one of the shards.
+    @param shardedHost sharded host the peer belongs to
+    @param peer peer from an ENetShardEvent
+    @param connectID connectID from the same event
+    @param data data describing the disconnection
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_sharded_host_disconnect (ENetShardedHost * shardedHost, ENetPeer * peer, enet_uint32 connectID, enet_uint32 data)
+{
+    ENetShard * shard = enet_sharded_host_find_shard (shardedHost, peer);
+    if (shard == NULL)
+      return -1;
+
+    return enet_sharded_host_queue_command (shard, ENET_SHARD_COMMAND_DISCONNECT, peer, connectID, 0, data, NULL);
+}
+
+/** Queues a packet to be sent to all peers of all shards.
+    @param shardedHost sharded host to broadcast on
+    @param channelID channel on which to broadcast
+    @param packet packet to broadcast; it is copied for every shard but the first, since packets may not be shared between threads
+    @retval 0 on success
+    @retval < 0 on failure, in which case the packet was not queued to every shard; the
+    packet itself is queued last, so it is left to the caller, while its copies already
+    queued to other shards are still sent
+*/
+int
+enet_sharded_host_broadcast (ENetShardedHost * shardedHost, enet_uint8 channelID, ENetPacket * packet)
+{
+    size_t shardIndex;
+
+    for (shardIndex = shardedHost -> shardCount; shardIndex > 0; -- shardIndex)
+    {
+        ENetPacket * shardPacket = packet;
+
+        if (shardIndex > 1)
+        {
+            shardPacket = enet_packet_create (packet -> data, packet -> dataLength, packet -> flags & ~ENET_PACKET_FLAG_NO_ALLOCATE);
+            if (shardPacket == NULL)
+              return -1;
+        }
+
+        if (enet_sharded_host_queue_command (& shardedHost -> shards [shardIndex - 1], ENET_SHARD_COMMAND_BROADCAST, NULL, 0, channelID, 0, shardPacket) < 0)
+        {
+            if (shardPacket != packet)
+              enet_packet_destroy (shardPacket);
+
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/** @} */
@@ -0,0 +1,362 @@
+/**
+ @file  snapshot.c
+ @brief ENet delta-compressed state snapshots
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/utility.h"
+#include "enet/enet.h"
+
+/** @defgroup snapshot ENet snapshot functions
+
+    A snapshot is a table of entities, each made of the same number of
+    32-bit fixed-point fields, supplied as one column array per field.
+    The sending side keeps a ring of the snapshots it has sent and encodes
+    each new one as a field-level delta against the newest snapshot the
+    receiver has acknowledged.  Since every delta is self-contained relative
+    to an acknowledged baseline, snapshots can travel unreliably: a lost
+    snapshot is simply superseded by the next one.
+
+    Packet layout:
+
+        enet_uint32 sequence                  (network byte order)
+        enet_uint8  baseline distance         (0 when not delta encoded)
+        varint      entity count
+        repeated until the end of the packet:
+          varint    number of unchanged entities skipped
+          bytes     bitmask of changed fields, (fieldCount + 7) / 8 bytes
+          varint    zigzag encoded difference for each changed field
+
+    Entities not present in the baseline are encoded against zero.
+    @{
+*/
+
+static ENetSnapshotFrame *
+enet_snapshot_find_frame (ENetSnapshotHistory * history, enet_uint32 sequence)
+{
+    ENetSnapshotFrame * frame = & history -> frames [sequence % ENET_SNAPSHOT_HISTORY];
+
+    if (frame -> fields == NULL || frame -> sequence != sequence)
+      return NULL;
+
+    return frame;
+}
+
+/** Creates a snapshot history, used on either end of a snapshot stream.
+    @param fieldCount number of fields of each entity, at most ENET_SNAPSHOT_MAXIMUM_FIELDS
+    @param entityCapacity maximum number of entities of a snapshot
+    @returns the history on success, NULL on failure
+    @remarks A history either sends or receives, never both.  A server keeps one
+    sending history for each peer it sends snapshots to.
+*/
+ENetSnapshotHistory *
+enet_snapshot_history_create (size_t fieldCount, size_t entityCapacity)
+{
+    ENetSnapshotHistory * history;
+    size_t encodedLength, decodedLength;
+
+    if (fieldCount <= 0 || fieldCount > ENET_SNAPSHOT_MAXIMUM_FIELDS || entityCapacity <= 0)
+      return NULL;
+
+    history = (ENetSnapshotHistory *) enet_malloc (sizeof (ENetSnapshotHistory));
+    if (history == NULL)
+      return NULL;
+
+    memset (history, 0, sizeof (ENetSnapshotHistory));
+
+    /* the scratch buffer holds an encoded packet when sending and a decoded frame when
+       receiving, so it is sized for whichever is larger: sequence, baseline distance and
+       entity count, then per entity a skip count, the changed field mask and the fields */
+    encodedLength = sizeof (enet_uint32) + 1 + 5 + entityCapacity * (5 + (fieldCount + 7) / 8 + 5 * fieldCount);
+    decodedLength = fieldCount * entityCapacity * sizeof (enet_uint32);
+
+    history -> scratch = (enet_uint8 *) enet_malloc (ENET_MAX (encodedLength, decodedLength));
+    if (history -> scratch == NULL)
+    {
+        enet_free (history);
+        return NULL;
+    }
+
+    history -> fieldCount = fieldCount;
+    history -> entityCapacity = entityCapacity;
+    history -> nextSequence = 1;
+
+    return history;
+}
+
+/** Destroys a snapshot history.
+    @param history history to destroy
+*/
+void
+enet_snapshot_history_destroy (ENetSnapshotHistory * history)
+{
+    size_t frameIndex;
+
+    if (history == NULL)
+      return;
+
+    for (frameIndex = 0; frameIndex < ENET_SNAPSHOT_HISTORY; ++ frameIndex)
+      enet_free (history -> frames [frameIndex].fields);
+
+    enet_free (history -> scratch);
+    enet_free (history);
+}
+
+static ENetSnapshotFrame *
+enet_snapshot_claim_frame (ENetSnapshotHistory * history, enet_uint32 sequence)
+{
+    ENetSnapshotFrame * frame = & history -> frames [sequence % ENET_SNAPSHOT_HISTORY];
+
+    if (frame -> fields == NULL)
+    {
+        frame -> fields = (enet_uint32 *) enet_malloc (history -> fieldCount * history -> entityCapacity * sizeof (enet_uint32));
+        if (frame -> fields == NULL)
+          return NULL;
+    }
+
+    frame -> sequence = sequence;
+    frame -> entityCount = 0;
+
+    return frame;
+}
+
+#define ENET_SNAPSHOT_WRITE_VARINT(value) \
+{ \
+    enet_uint32 remaining = (value); \
+    while (remaining >= 0x80) \
+    { \
+        * output ++ = (enet_uint8) (remaining | 0x80); \
+        remaining >>= 7; \
+    } \
+    * output ++ = (enet_uint8) remaining; \
+}
+
+#define ENET_SNAPSHOT_READ_VARINT(value) \
+{ \
+    enet_uint32 shift = 0; \
+    (value) = 0; \
+    for (;;) \
+    { \
+        if (input >= inputEnd || shift > 28) \
+          return -1; \
+        (value) |= (enet_uint32) (* input & 0x7F) << shift; \
+        if (! (* input ++ & 0x80)) \
+          break; \
+        shift += 7; \
+    } \
+}
+
+/** Records a snapshot and encodes it against the newest acknowledged one.
+    @param history sending history
+    @param columns fieldCount arrays of entityCount values each; signed fixed-point values are passed as their two's complement bits
+    @param entityCount number of entities, at most the history's entity capacity
+    @param flags packet flags for the created packet, usually 0 for an unreliable, sequenced send
+    @returns a packet ready to be sent with enet_peer_send(), NULL on failure
+*/
+ENetPacket *
+enet_snapshot_encode (ENetSnapshotHistory * history, const enet_uint32 * const * columns, size_t entityCount, enet_uint32 flags)
+{
+    ENetSnapshotFrame * baseline = NULL, * frame;
+    size_t fieldIndex, entityIndex, baselineCount = 0, maskLength = (history -> fieldCount + 7) / 8, skipped = 0;
+    enet_uint8 * output;
+    enet_uint32 sequence;
+
+    if (entityCount > history -> entityCapacity)
+      return NULL;
+
+    sequence = history -> nextSequence;
+
+    if (history -> acknowledgedSequence != 0 &&
+        sequence - history -> acknowledgedSequence < ENET_SNAPSHOT_HISTORY)
+    {
+        baseline = enet_snapshot_find_frame (history, history -> acknowledgedSequence);
+        if (baseline != NULL)
+          baselineCount = baseline -> entityCount;
+    }
+
+    frame = enet_snapshot_claim_frame (history, sequence);
+    if (frame == NULL)
+      return NULL;
+
+    frame -> entityCount = entityCount;
+    for (fieldIndex = 0; fieldIndex < history -> fieldCount; ++ fieldIndex)
+      memcpy (& frame -> fields [fieldIndex * history -> entityCapacity], columns [fieldIndex], entityCount * sizeof (enet_uint32));
+
+    output = history -> scratch;
+    * (enet_uint32 *) output = ENET_HOST_TO_NET_32 (sequence);
+    output += sizeof (enet_uint32);
+    * output ++ = baseline != NULL ? (enet_uint8) (sequence - baseline -> sequence) : 0;
+    ENET_SNAPSHOT_WRITE_VARINT ((enet_uint32) entityCount);
+
+    for (entityIndex = 0; entityIndex < entityCount; ++ entityIndex)
+    {
+        enet_uint32 changedFields = 0;
+
+        for (fieldIndex = 0; fieldIndex < history -> fieldCount; ++ fieldIndex)
+        {
+            enet_uint32 base = entityIndex < baselineCount ? baseline -> fields [fieldIndex * history -> entityCapacity + entityIndex] : 0;
+
+            if (columns [fieldIndex] [entityIndex] != base)
+              changedFields |= 1u << fieldIndex;
+        }
+
+        if (changedFields == 0)
+        {
+            ++ skipped;
+            continue;
+        }
+
+        ENET_SNAPSHOT_WRITE_VARINT ((enet_uint32) skipped);
+        skipped = 0;
+
+        for (fieldIndex = 0; fieldIndex < maskLength; ++ fieldIndex)
+          * output ++ = (enet_uint8) (changedFields >> (fieldIndex * 8));
+
+        for (fieldIndex = 0; fieldIndex < history -> fieldCount; ++ fieldIndex)
+        {
+            enet_uint32 base, difference;
+
+            if (! (changedFields & (1u << fieldIndex)))
+              continue;
+
+            base = entityIndex < baselineCount ? baseline -> fields [fieldIndex * history -> entityCapacity + entityIndex] : 0;
+            difference = columns [fieldIndex] [entityIndex] - base;
+
+            ENET_SNAPSHOT_WRITE_VARINT ((difference << 1) ^ (enet_uint32) -(difference >> 31));
+        }
+    }
+
+    ++ history -> nextSequence;
+
+    return enet_packet_create (history -> scratch, output - history -> scratch, flags);
+}
+
+/** Marks a sent snapshot as received by the other end, making it the baseline of later snapshots.
+    @param history sending history
+    @param sequence sequence number acknowledged by the receiver
+    @returns 0 if the baseline advanced, < 0 if the acknowledgement was stale or unknown
+*/
+int
+enet_snapshot_acknowledge (ENetSnapshotHistory * history, enet_uint32 sequence)
+{
+    if (sequence >= history -> nextSequence ||
+        (history -> acknowledgedSequence != 0 && sequence <= history -> acknowledgedSequence) ||
+        enet_snapshot_find_frame (history, sequence) == NULL)
+      return -1;
+
+    history -> acknowledgedSequence = sequence;
+
+    return 0;
+}
+
+/** Decodes a received snapshot.
+    @param history receiving history
+    @param data packet data produced by enet_snapshot_encode()
+    @param dataLength length of data
+    @param columns fieldCount arrays of at least entityCapacity values each, receiving the reconstructed snapshot
+    @param entityCount receives the number of entities in the snapshot
+    @param sequence receives the snapshot's sequence number, which should be sent back and passed to enet_snapshot_acknowledge() on the sending side
+    @returns 0 on success, < 0 if the snapshot is malformed, older than the last one decoded, or its baseline is no longer known
+*/
+int
+enet_snapshot_decode (ENetSnapshotHistory * history, const enet_uint8 * data, size_t dataLength,
+                      enet_uint32 * const * columns, size_t * entityCount, enet_uint32 * sequence)
+{
+    const enet_uint8 * input = data, * inputEnd = & data [dataLength];
+    ENetSnapshotFrame * baseline = NULL, * frame;
+    size_t fieldIndex, entityIndex, baselineCount = 0, maskLength = (history -> fieldCount + 7) / 8;
+    enet_uint32 frameSequence, baselineDistance, frameEntityCount;
+
+    if (dataLength < ENET_SNAPSHOT_HEADER_SIZE)
+      return -1;
+
+    frameSequence = ENET_NET_TO_HOST_32 (* (const enet_uint32 *) input);
+    input += sizeof (enet_uint32);
+    baselineDistance = * input ++;
+    ENET_SNAPSHOT_READ_VARINT (frameEntityCount);
+
+    if (frameSequence == 0 || frameEntityCount > history -> entityCapacity ||
+        (history -> acknowledgedSequence != 0 && frameSequence <= history -> acknowledgedSequence))
+      return -1;
+
+    if (baselineDistance != 0)
+    {
+        baseline = enet_snapshot_find_frame (history, frameSequence - baselineDistance);
+        if (baseline == NULL || baselineDistance >= ENET_SNAPSHOT_HISTORY)
+          return -1;
+
+        baselineCount = baseline -> entityCount;
+    }
+
+    /* decode into the scratch frame first so a malformed packet cannot clobber the baseline it refers to */
+
+#define ENET_SNAPSHOT_BASE(fieldIndex, entityIndex) \
+    ((entityIndex) < baselineCount ? baseline -> fields [(fieldIndex) * history -> entityCapacity + (entityIndex)] : 0)
+#define ENET_SNAPSHOT_DECODED(fieldIndex, entityIndex) \
+    (((enet_uint32 *) history -> scratch) [(fieldIndex) * history -> entityCapacity + (entityIndex)])
+
+    entityIndex = 0;
+    while (input < inputEnd)
+    {
+        enet_uint32 skipped, changedFields = 0;
+
+        ENET_SNAPSHOT_READ_VARINT (skipped);
+        if (skipped >= frameEntityCount - entityIndex || (size_t) (inputEnd - input) < maskLength)
+          return -1;
+
+        for (; skipped > 0; -- skipped, ++ entityIndex)
+          for (fieldIndex = 0; fieldIndex < history -> fieldCount; ++ fieldIndex)
+            ENET_SNAPSHOT_DECODED (fieldIndex, entityIndex) = ENET_SNAPSHOT_BASE (fieldIndex, entityIndex);
+
+        for (fieldIndex = 0; fieldIndex < maskLength; ++ fieldIndex)
+          changedFields |= (enet_uint32) * input ++ << (fieldIndex * 8);
+
+        for (fieldIndex = 0; fieldIndex < history -> fieldCount; ++ fieldIndex)
+        {
+            enet_uint32 difference = 0;
+
+            if (changedFields & (1u << fieldIndex))
+            {
+                ENET_SNAPSHOT_READ_VARINT (difference);
+                difference = (difference >> 1) ^ (enet_uint32) -(difference & 1);
+            }
+
+            ENET_SNAPSHOT_DECODED (fieldIndex, entityIndex) = ENET_SNAPSHOT_BASE (fieldIndex, entityIndex) + difference;
+        }
+
+        ++ entityIndex;
+    }
+
+    for (; entityIndex < frameEntityCount; ++ entityIndex)
+      for (fieldIndex = 0; fieldIndex < history -> fieldCount; ++ fieldIndex)
+        ENET_SNAPSHOT_DECODED (fieldIndex, entityIndex) = ENET_SNAPSHOT_BASE (fieldIndex, entityIndex);
+
+#undef ENET_SNAPSHOT_BASE
+#undef ENET_SNAPSHOT_DECODED
+
+    frame = enet_snapshot_claim_frame (history, frameSequence);
+    if (frame == NULL)
+      return -1;
+
+    frame -> entityCount = frameEntityCount;
+    for (fieldIndex = 0; fieldIndex < history -> fieldCount; ++ fieldIndex)
+    {
+        const enet_uint32 * decoded = & ((const enet_uint32 *) history -> scratch) [fieldIndex * history -> entityCapacity];
+
+        memcpy (& frame -> fields [fieldIndex * history -> entityCapacity], decoded, frameEntityCount * sizeof (enet_uint32));
+        if (columns != NULL)
+          memcpy (columns [fieldIndex], decoded, frameEntityCount * sizeof (enet_uint32));
+    }
+
+    /* on the receiving side the newest decoded snapshot takes the place of the acknowledged one */
+    history -> acknowledgedSequence = frameSequence;
+
+    if (entityCount != NULL)
+      * entityCount = frameEntityCount;
+    if (sequence != NULL)
+      * sequence = frameSequence;
+
+    return 0;
+}
+
+/** @} */
@@ -0,0 +1,203 @@
+/**
+ @file  timer.c
+ @brief ENet host timer wheel
+*/
+#define ENET_BUILDING_LIB 1
+#include "enet/time.h"
+#include "enet/enet.h"
+
+/** @defgroup timer ENet host timer wheel
+
+    Every peer that is waiting on a retransmission timeout or a ping has
+    exactly one deadline, kept in a hierarchical timer wheel of
+    ENET_HOST_TIMER_WHEEL_LEVELS levels at one millisecond resolution.  A
+    deadline is filed at the lowest level whose current block it shares
+    with the wheel's time, so inserting and removing are constant time and
+    each service call only touches the slots it has moved past.  Deadlines
+    beyond the top level wait in an overflow list.
+
+    Deadlines are allowed to be stale: when a peer's deadline moves later,
+    the old entry simply fires early and the send loop files the new one.
+    @{
+*/
+
+#define ENET_TIMER_SHIFT(level) ((level) * ENET_HOST_TIMER_WHEEL_BITS)
+#define ENET_TIMER_SLOT(time, level) (((time) >> ENET_TIMER_SHIFT (level)) & (ENET_HOST_TIMER_WHEEL_SLOTS - 1))
+#define ENET_TIMER_BLOCK(time, level) ((time) >> ENET_TIMER_SHIFT ((level) + 1))
+
+static void
+enet_timer_insert (ENetHost * host, ENetPeer * peer)
+{
+    ENetList * slot = & host -> timerOverflow;
+    int level;
+
+    for (level = 0; level < ENET_HOST_TIMER_WHEEL_LEVELS; ++ level)
+    {
+        if (ENET_TIMER_BLOCK (peer -> timerDeadline, level) == ENET_TIMER_BLOCK (host -> timerTime, level))
+        {
+            slot = & host -> timerWheel [level][ENET_TIMER_SLOT (peer -> timerDeadline, level)];
+            break;
+        }
+    }
+
+    enet_list_insert (enet_list_end (slot), & peer -> timerList);
+}
+
+static void
+enet_timer_cascade (ENetHost * host, ENetList * slot)
+{
+    ENetList pending;
+
+    if (enet_list_empty (slot))
+      return;
+
+    enet_list_clear (& pending);
+    enet_list_move (enet_list_end (& pending), enet_list_begin (slot), enet_list_back (slot));
+
+    while (! enet_list_empty (& pending))
+      enet_timer_insert (host, enet_list_entry (enet_list_remove (enet_list_begin (& pending)), ENetPeer, timerList));
+}
+
+static void
+enet_timer_fire (ENetHost * host, ENetList * slot)
+{
+    while (! enet_list_empty (slot))
+    {
+        ENetPeer * peer = enet_list_entry (enet_list_remove (enet_list_begin (slot)), ENetPeer, timerList);
+
+        peer -> timerScheduled = 0;
+        -- host -> timerCount;
+
+        enet_peer_mark_outgoing (peer);
+    }
+}
+
+static void
+enet_timer_fire_all (ENetHost * host)
+{
+    int level, slot;
+
+    for (level = 0; level < ENET_HOST_TIMER_WHEEL_LEVELS; ++ level)
+      for (slot = 0; slot < ENET_HOST_TIMER_WHEEL_SLOTS; ++ slot)
+        enet_timer_fire (host, & host -> timerWheel [level][slot]);
+
+    enet_timer_fire (host, & host -> timerOverflow);
+}
+
+/** Schedules a peer to be visited by the send loop no earlier than a deadline.
+    @param host host the peer belongs to
+    @param peer peer to schedule; replaces any deadline it already had
+    @param deadline service time at which the peer must be visited
+*/
+void
+enet_host_schedule_peer (ENetHost * host, ENetPeer * peer, enet_uint32 deadline)
+{
+    if (peer -> timerScheduled)
+    {
+        if (peer -> timerDeadline == deadline)
+          return;
+
+        enet_list_remove (& peer -> timerList);
+    }
+    else
+    {
+        peer -> timerScheduled = 1;
+        ++ host -> timerCount;
+    }
+
+    if (! ENET_TIME_GREATER (deadline, host -> timerTime))
+      deadline = host -> timerTime + 1;
+
+    peer -> timerDeadline = deadline;
+
+    enet_timer_insert (host, peer);
+}
+
+/** Removes a peer's deadline from the timer wheel, if it has one. */
+void
+enet_host_unschedule_peer (ENetHost * host, ENetPeer * peer)
+{
+    if (! peer -> timerScheduled)
+      return;
+
+    enet_list_remove (& peer -> timerList);
+
+    peer -> timerScheduled = 0;
+    -- host -> timerCount;
+}
+
+/** Advances the timer wheel to the given time, queueing every peer whose deadline passed for sending.
+    @param host host whose timers to expire
+    @param currentTime time to advance the wheel to
+*/
+void
+enet_host_expire_timers (ENetHost * host, enet_uint32 currentTime)
+{
+    if (host -> timerCount == 0)
+    {
+        host -> timerTime = currentTime;
+        return;
+    }
+
+    if (ENET_TIME_LESS (currentTime, host -> timerTime) ||
+        ENET_TIME_DIFFERENCE (currentTime, host -> timerTime) >> ENET_TIMER_SHIFT (ENET_HOST_TIMER_WHEEL_LEVELS))
+    {
+        enet_timer_fire_all (host);
+
+        host -> timerTime = currentTime;
+        return;
+    }
+
+    while (host -> timerTime != currentTime && host -> timerCount > 0)
+    {
+        enet_uint32 time = ++ host -> timerTime;
+        int level = 1;
+
+        while (level <= ENET_HOST_TIMER_WHEEL_LEVELS && ENET_TIMER_SLOT (time, level - 1) == 0)
+          ++ level;
+
+        while (-- level > 0)
+        {
+            if (level == ENET_HOST_TIMER_WHEEL_LEVELS)
+              enet_timer_cascade (host, & host -> timerOverflow);
+            else
+              enet_timer_cascade (host, & host -> timerWheel [level][ENET_TIMER_SLOT (time, level)]);
+        }
+
+        enet_timer_fire (host, & host -> timerWheel [0][ENET_TIMER_SLOT (time, 0)]);
+    }
+
+    host -> timerTime = currentTime;
+}
+
+/** Finds the earliest time at which the timer wheel needs attention.
+    @param host host to query
+    @param deadline receives the earliest deadline, or the time at which the wheel must next cascade
+    @returns 1 if any peer is scheduled, 0 otherwise
+*/
+int
+enet_host_next_timer (ENetHost * host, enet_uint32 * deadline)
+{
+    int level, slot;
+
+    if (host -> timerCount == 0)
+      return 0;
+
+    for (level = 0; level < ENET_HOST_TIMER_WHEEL_LEVELS; ++ level)
+    {
+        for (slot = ENET_TIMER_SLOT (host -> timerTime, level) + 1; slot < ENET_HOST_TIMER_WHEEL_SLOTS; ++ slot)
+        {
+            if (enet_list_empty (& host -> timerWheel [level][slot]))
+              continue;
+
+            * deadline = (ENET_TIMER_BLOCK (host -> timerTime, level) << ENET_TIMER_SHIFT (level + 1)) +
+                           ((enet_uint32) slot << ENET_TIMER_SHIFT (level));
+            return 1;
+        }
+    }
+
+    * deadline = (ENET_TIMER_BLOCK (host -> timerTime, ENET_HOST_TIMER_WHEEL_LEVELS - 1) + 1) << ENET_TIMER_SHIFT (ENET_HOST_TIMER_WHEEL_LEVELS);
+    return 1;
+}
+
+/** @} */
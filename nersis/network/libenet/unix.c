@@ -251,6 +251,12 @@ enet_socket_set_option (ENetSocket socket, ENetSocketOption option, int value)
             result = setsockopt (socket, SOL_SOCKET, SO_REUSEADDR, (char *) & value, sizeof (int));
             break;
 
+#ifdef SO_REUSEPORT
+        case ENET_SOCKOPT_REUSEPORT:
+            result = setsockopt (socket, SOL_SOCKET, SO_REUSEPORT, (char *) & value, sizeof (int));
+            break;
+#endif
+
         case ENET_SOCKOPT_RCVBUF:
             result = setsockopt (socket, SOL_SOCKET, SO_RCVBUF, (char *) & value, sizeof (int));
             break;
@@ -544,5 +550,49 @@ enet_socket_wait (ENetSocket socket, enet_uint32 * condition, enet_uint32 timeou
 #endif
 }
 
+typedef struct _ENetThreadStart
+{
+    ENetThreadCallback callback;
+    void * data;
+} ENetThreadStart;
+
+static void *
+enet_thread_start (void * data)
+{
+    ENetThreadStart start = * (ENetThreadStart *) data;
+
+    enet_free (data);
+
+    (* start.callback) (start.data);
+
+    return NULL;
+}
+
+int
+enet_thread_create (ENetThread * thread, ENetThreadCallback callback, void * data)
+{
+    ENetThreadStart * start = (ENetThreadStart *) enet_malloc (sizeof (ENetThreadStart));
+    if (start == NULL)
+      return -1;
+
+    start -> callback = callback;
+    start -> data = data;
+
+    if (pthread_create (thread, NULL, enet_thread_start, start) != 0)
+    {
+        enet_free (start);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+enet_thread_join (ENetThread thread)
+{
+    pthread_join (thread, NULL);
+}
+
 #endif
 
@@ -406,5 +406,51 @@ enet_socket_wait (ENetSocket socket, enet_uint32 * condition, enet_uint32 timeou
     return 0;
 } 
 
+typedef struct _ENetThreadStart
+{
+    ENetThreadCallback callback;
+    void * data;
+} ENetThreadStart;
+
+static DWORD WINAPI
+enet_thread_start (LPVOID data)
+{
+    ENetThreadStart start = * (ENetThreadStart *) data;
+
+    enet_free (data);
+
+    (* start.callback) (start.data);
+
+    return 0;
+}
+
+int
+enet_thread_create (ENetThread * thread, ENetThreadCallback callback, void * data)
+{
+    ENetThreadStart * start = (ENetThreadStart *) enet_malloc (sizeof (ENetThreadStart));
+    if (start == NULL)
+      return -1;
+
+    start -> callback = callback;
+    start -> data = data;
+
+    * thread = CreateThread (NULL, 0, enet_thread_start, start, 0, NULL);
+    if (* thread == NULL)
+    {
+        enet_free (start);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+enet_thread_join (ENetThread thread)
+{
+    WaitForSingleObject (thread, INFINITE);
+    CloseHandle (thread);
+}
+
 #endif
 